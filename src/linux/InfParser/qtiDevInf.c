@@ -9,13 +9,57 @@ DESCRIPTION:
 ==========================================================================*/
 
 #include "qtiDevInf.h"
+#include "qtiDevInfBin.h"
 #include "../version.h"
 
 #define DRIVER_DESC "QTISubsystemUSB"
 
 int debug_g=0;//For global logging
 
-static int processData(fileInfo_t *pFileInfo, struct file *filp, bool flag);
+/**
+ * @brief   Local structure identifying the file content was read from
+ */
+typedef struct _infFileId {
+    dev_t           mDev;
+    unsigned long   mIno;
+    loff_t          mSize;
+    s64             mMtimeSec;
+    long            mMtimeNsec;
+} infFileId_t;
+
+/**
+ * @brief   Local structure holding the whole INF file, read in one go
+ */
+typedef struct _infBuffer {
+    char        *mpData;    /**< file content, NUL terminated */
+    size_t      mSize;      /**< bytes in mpData */
+    size_t      mOffset;    /**< next byte to parse */
+    infFileId_t mId;        /**< file as it was when read */
+} infBuffer_t;
+
+#ifndef QTIDEV_INF_USER
+/**
+ * @brief   Local structure for a parsed INF file shared by the drivers
+ */
+typedef struct _infDb {
+    struct list_head    mNode;      /**< on gInfDbList */
+    struct kref         mRefCount;  /**< one per QTIDevInfGet */
+    char                *mpPath;    /**< file the data was read from */
+    infFileId_t         mId;        /**< file as it was when parsed */
+    bool                mbStale;    /**< file changed, not handed out */
+    fileInfo_t          *mpFileInfo;
+} infDb_t;
+
+static LIST_HEAD(gInfDbList);
+static DEFINE_MUTEX(gInfDbLock);
+
+/* Device the precompiled tables are requested for, NULL if unavailable */
+static struct device *gpInfDevice;
+
+static fileInfo_t *loadInf(char *pFilePath, infFileId_t *pId);
+#endif
+
+static int processData(fileInfo_t **ppFileInfo, infBuffer_t *pBuf);
 
 /**
  * @brief   Local structure to store the available manufacturer list
@@ -25,6 +69,21 @@ typedef struct _manufacturerInfo {
     struct _manufacturerInfo *next;
 } manufacturerInfo_t;
 
+#ifndef QTIDEV_INF_USER
+static unsigned int infHash(unsigned int vid, unsigned int pid,
+        unsigned int iface, unsigned int bits)
+{
+    return jhash_3words(vid, pid, iface, 0) & ((1U << bits) - 1);
+}
+
+static bool infMatch(devInfo_t *devInfo, unsigned int vid,
+        unsigned int pid, unsigned int iface)
+{
+    return (devInfo->mVid_pid_iface[0] == vid) &&
+        (devInfo->mVid_pid_iface[1] == pid) &&
+        (devInfo->mVid_pid_iface[2] == iface);
+}
+
 /**
  * @brief To extract the device info from the stored data
  *
@@ -39,7 +98,7 @@ typedef struct _manufacturerInfo {
 void* QTIDevInfGetDevInfo(struct usb_interface *pIface, fileInfo_t *pFileInfo)
 {
     devInfo_t   *devInfo;
-    unsigned int idx = 0;
+    int         idx = 0;
     unsigned int ifaceNum;
     struct usb_device   *dev;
 
@@ -56,36 +115,54 @@ void* QTIDevInfGetDevInfo(struct usb_interface *pIface, fileInfo_t *pFileInfo)
             pIface->cur_altsetting->desc.bInterfaceNumber);
 
     ifaceNum = pIface->cur_altsetting->desc.bInterfaceNumber;
+    if (pFileInfo->mpHashHead)
+    {
+        /* Walk the bucket of VID/PID/interface */
+        idx = pFileInfo->mpHashHead[infHash(dev->descriptor.idVendor,
+                dev->descriptor.idProduct, ifaceNum, pFileInfo->mHashBits)];
+        while (idx != -1)
+        {
+            devInfo = pFileInfo->mDevInfo + idx;
+            if (infMatch(devInfo, dev->descriptor.idVendor,
+                        dev->descriptor.idProduct, ifaceNum))
+            {
+                return devInfo;
+            }
+            idx = pFileInfo->mpHashNext[idx];
+        }
+        return NULL;
+    }
+
     /* Traverse in the stored ctx and extract the matched dev info */
-    for (idx = 0; idx <= pFileInfo->mNumResp; idx++, devInfo++)
+    for (idx = 0; idx < pFileInfo->mNumResp; idx++, devInfo++)
     {
-        if ((devInfo->mVid_pid_iface[1] == dev->descriptor.idProduct) &&
-             devInfo->mVid_pid_iface[2] == ifaceNum)
+        if (infMatch(devInfo, dev->descriptor.idVendor,
+                    dev->descriptor.idProduct, ifaceNum))
         {
             break;
         }
     }
 
-    return (idx <= pFileInfo->mNumResp) ? devInfo : NULL;
+    return (idx < pFileInfo->mNumResp) ? devInfo : NULL;
 }
 EXPORT_SYMBOL(QTIDevInfGetDevInfo);
 
 /**
  * @brief To verify whether the INF/config file is modified
  *
- * Returns the file status
+ * Only looks at the cached state, the file itself is checked when a
+ * reload is requested through the Reload module parameter.
  *
  * @param   pFileInfo    global Ctx, contains INF info
  * @param   pFilePath    INF/Config file path
  *
- * @returns true    - If no change in config file
- *          false   - Config file got modified
- *          negative error - If file got corrupted/removed
+ * @returns false   - If no change in config file
+ *          true    - Config file got modified or 'pFilePath' changed
+ *          negative error - If the data is invalid
  */
 int QTIDevInfCheckFileStatus(fileInfo_t *pFileInfo, char *pFilePath)
 {
-    struct file *filp = NULL;
-
+    infDb_t *db;
     int ret = false;
 
     if (!pFileInfo || !pFilePath)
@@ -95,48 +172,139 @@ int QTIDevInfCheckFileStatus(fileInfo_t *pFileInfo, char *pFilePath)
         return -ENXIO;
     }
 
-    filp = filp_open(pFilePath, O_RDONLY, 0444);
-    if (IS_ERR(filp))
+    mutex_lock(&gInfDbLock);
+    list_for_each_entry(db, &gInfDbList, mNode)
     {
-        QC_LOG_ERR("Error in opening file, will be using the stored data\n");
-        /* Even if we get error, we can reuse the existing data
-         * This situation occurs if the "config file gets deleted"
-         */
-        return -ENXIO;
+        if (db->mpFileInfo == pFileInfo)
+        {
+            ret = db->mbStale || strcmp(db->mpPath, pFilePath);
+            break;
+        }
     }
-
-    filp_close(filp, NULL);
+    mutex_unlock(&gInfDbLock);
     return ret;
 }
 EXPORT_SYMBOL(QTIDevInfCheckFileStatus);
 
-static int MyReadLine(struct file *filp, char *data, int len, loff_t *offset)
+static void getFileId(struct file *filp, infFileId_t *pId)
 {
-    char val;
-    int i = 0;
+    struct inode *inode = file_inode(filp);
+#if (LINUX_VERSION_CODE >= KERNEL_VERSION(6,7,0))
+    struct timespec64 mtime = inode_get_mtime(inode);
+#else
+    typeof(inode->i_mtime) mtime = inode->i_mtime;
+#endif
+
+    pId->mDev = inode->i_sb->s_dev;
+    pId->mIno = inode->i_ino;
+    pId->mSize = i_size_read(inode);
+    pId->mMtimeSec = mtime.tv_sec;
+    pId->mMtimeNsec = mtime.tv_nsec;
+}
+
+static bool sameFileId(infFileId_t *pA, infFileId_t *pB)
+{
+    return pA->mDev == pB->mDev && pA->mIno == pB->mIno &&
+        pA->mSize == pB->mSize && pA->mMtimeSec == pB->mMtimeSec &&
+        pA->mMtimeNsec == pB->mMtimeNsec;
+}
+
+/* Read the whole file into a vmalloc buffer; the caller frees mpData */
+static int readInfFile(char *pFilePath, infBuffer_t *pBuf)
+{
+    struct file *filp;
+    loff_t size;
+    loff_t pos = 0;
+    ssize_t ret;
+    int status = 0;
+
+    if (!pFilePath || !pBuf)
+        return -EINVAL;
+
+    #if (LINUX_VERSION_CODE < KERNEL_VERSION(4,13,16))
+        mm_segment_t oldfs;
+        oldfs = get_fs();
+        set_fs(get_ds());
+    #endif
 
-    if (!filp || !data || len <= 0)
+    filp = filp_open(pFilePath, O_RDONLY, 0444);
+    if (IS_ERR(filp))
+    {
+        QC_LOG_ERR("Error in opening file : %d\n", (int)IS_ERR(filp));
+        #if (LINUX_VERSION_CODE < KERNEL_VERSION(4,13,16))
+            set_fs(oldfs);
+        #endif
         return -EINVAL;
+    }
 
-    while (i < len)
+    getFileId(filp, &pBuf->mId);
+    size = pBuf->mId.mSize;
+    if (size <= 0 || size > QTIDEV_INF_MAX_FILE_SIZE)
+    {
+        QC_LOG_ERR("Invalid INF file size %lld\n", (long long)size);
+        status = -EINVAL;
+        goto close;
+    }
+
+    pBuf->mpData = vmalloc(size + 1);
+    if (!pBuf->mpData)
+    {
+        status = -ENOMEM;
+        goto close;
+    }
+
+    pBuf->mSize = 0;
+    pBuf->mOffset = 0;
+    while (pBuf->mSize < size)
     {
 #if (LINUX_VERSION_CODE > KERNEL_VERSION(4,13,16))
-        if (kernel_read(filp, &val, 1, offset) <= 0)
+        ret = kernel_read(filp, pBuf->mpData + pBuf->mSize, size - pBuf->mSize, &pos);
 #else
-        if (kernel_read(filp, *offset, &val, 1) <= 0)
+        ret = kernel_read(filp, pos, pBuf->mpData + pBuf->mSize, size - pBuf->mSize);
+        pos += (ret > 0) ? ret : 0;
 #endif
+        if (ret <= 0)
         {
-            return -ENXIO;
+            break;
         }
-#if (LINUX_VERSION_CODE < KERNEL_VERSION(4,13,16))
-	(*offset)++; //Increase offset by i
+        pBuf->mSize += ret;
+    }
+    pBuf->mpData[pBuf->mSize] = '\0';
+
+close:
+    filp_close(filp, NULL);
+    #if (LINUX_VERSION_CODE < KERNEL_VERSION(4,13,16))
+        set_fs(oldfs);
+    #endif
+    return status;
+}
 #endif
-        data[i++] = val;
+
+static int MyReadLine(infBuffer_t *pBuf, char *data, int len)
+{
+    int i = 0;
+
+    if (!pBuf || !data || len <= 0)
+        return -EINVAL;
+
+    if (pBuf->mOffset >= pBuf->mSize)
+    {
+        return -ENXIO;
+    }
+
+    while (i < len && pBuf->mOffset < pBuf->mSize)
+    {
+        data[i++] = pBuf->mpData[pBuf->mOffset++];
         if (data[i - 1] == '\n')
         {
             break;
         }
     }
+    /* Last line without a newline */
+    if (data[i - 1] != '\n' && pBuf->mOffset >= pBuf->mSize && i < len)
+    {
+        data[i++] = '\n';
+    }
 
     data[i] = '\0';
     return i;
@@ -168,13 +336,13 @@ void extractDevName(char *name, char *src, int len)
     return;
 }
 
-static int _MyReadLine(struct file *filp, char *data, int size, loff_t *offset)
+static int _MyReadLine(infBuffer_t *pBuf, char *data, int size)
 {
     int  last = 0;
     char *line = data;
     int len = 0;
 
-    while ((len = MyReadLine(filp, line+last, size - last, offset)) > 0)
+    while ((len = MyReadLine(pBuf, line+last, size - last)) > 0)
     {
         len = (int)strlen(line) - 1;
         /* Remove empty lines */
@@ -334,7 +502,7 @@ static void updateDeviceInfo(fileInfo_t *pFileInfo, char *key, char *value)
         return;
     }
 
-    if (pFileInfo->mNumResp > pFileInfo->mLength)
+    if (pFileInfo->mNumResp >= pFileInfo->mLength)
     {
         return;
     }
@@ -391,10 +559,14 @@ static void updateDevStringInfo(fileInfo_t *pFileInfo, char *key, char *value)
 
     info = pFileInfo->mDevInfo;
 
-    while (info && strncmp(info->mpKey, key, QTIDEV_INF_MAX_KEY_SIZE) &&
-            (idx++ <= pFileInfo->mNumResp) && (info++));
+    while ((idx < pFileInfo->mNumResp) &&
+            strncmp(info->mpKey, key, QTIDEV_INF_MAX_KEY_SIZE))
+    {
+        idx++;
+        info++;
+    }
 
-    if (!info)
+    if (idx == pFileInfo->mNumResp)
     {
         return;
     }
@@ -410,13 +582,38 @@ static void updateDevStringInfo(fileInfo_t *pFileInfo, char *key, char *value)
     return;
 }
 
-static int processData(fileInfo_t *pFileInfo, struct file *filp, bool flag)
+/* Make room for one more device entry, doubling the table */
+static int growDeviceInfo(fileInfo_t **ppFileInfo)
+{
+    fileInfo_t *pFileInfo = *ppFileInfo;
+    fileInfo_t *newInfo;
+    unsigned int length;
+
+    if (pFileInfo->mNumResp < pFileInfo->mLength)
+    {
+        return 0;
+    }
+
+    length = pFileInfo->mLength * 2;
+    newInfo = krealloc(pFileInfo, sizeof(fileInfo_t) + length * sizeof(devInfo_t), GFP_KERNEL);
+    if (!newInfo)
+    {
+        QC_LOG_ERR("error in allocating memory\n");
+        return -ENOMEM;
+    }
+    memset(newInfo->mDevInfo + newInfo->mLength, 0,
+            (length - newInfo->mLength) * sizeof(devInfo_t));
+    newInfo->mLength = length;
+    *ppFileInfo = newInfo;
+    return 0;
+}
+
+static int processData(fileInfo_t **ppFileInfo, infBuffer_t *pBuf)
 {
     char line[QTIDEV_INF_MAX_LINE_SIZE + 1] = "";
 
     char section[QTIDEV_INF_MAX_KEY_SIZE] = "";
 
-    loff_t offset = 0;  /* For seeking */
     ssize_t ret;
     char *start;
     char *end;
@@ -424,23 +621,21 @@ static int processData(fileInfo_t *pFileInfo, struct file *filp, bool flag)
     char *value;
     sectionInfo_t sectionInfo = QTIDEV_INF_UNKNOWN;
     bool Filevalid = false;
-    unsigned int count = 0;
+    int status = 0;
 
 
     manufacturerInfo_t *mfgInfo = NULL;
     manufacturerInfo_t *tmp;
 
-    /* flag = 0 : To get device count
-     * flag = 1 : To update the device info
-     */
-    if (!filp || !filp->f_inode || (flag && !pFileInfo))
+    /* Device entries are counted and stored in the same pass */
+    if (!pBuf || !ppFileInfo || !*ppFileInfo)
     {
         QC_LOG_ERR("Invalid data\n");
         return -1;
     }
 
-    while ((ret = _MyReadLine(filp,
-                    line, QTIDEV_INF_MAX_LINE_SIZE, &offset)) >= 0) {
+    while ((status == 0) &&
+            ((ret = _MyReadLine(pBuf, line, QTIDEV_INF_MAX_LINE_SIZE)) >= 0)) {
         start = line;
 
         start = lskip(rstrip(start));
@@ -450,11 +645,6 @@ static int processData(fileInfo_t *pFileInfo, struct file *filp, bool flag)
             continue;
         } else if (*start == QTIDEV_INF_START_SECTION[0]) {
             /* [Section] line */
-
-            if ((flag == false) && (sectionInfo == QTIDEV_INF_DEVICE_INFO))
-            {
-                break;
-            }
             sectionInfo = QTIDEV_INF_UNKNOWN;
             end = find_chars_or_comment(start + 1, QTIDEV_INF_END_SECTION);
             if (*end == QTIDEV_INF_END_SECTION[0]) {
@@ -462,7 +652,8 @@ static int processData(fileInfo_t *pFileInfo, struct file *filp, bool flag)
                 strncpy0(section, start + 1, sizeof(section));
             } else {
                 QC_LOG_ERR("Invalid Section\n");
-                return -1;
+                status = -1;
+                break;
             }
             if (!strncasecmp(section, QTIDEV_INF_MANUFACTURER_STR, strlen(QTIDEV_INF_MANUFACTURER_STR)))
             {
@@ -514,33 +705,21 @@ static int processData(fileInfo_t *pFileInfo, struct file *filp, bool flag)
             switch (sectionInfo)
             {
                 case QTIDEV_INF_VERSION:
-                    if (flag == true)
-                    {
-                        updateVersion(pFileInfo, name, value);
-                    }
+                    updateVersion(*ppFileInfo, name, value);
                     break;
                 case QTIDEV_INF_MANUFACTURER:
                     updateManufacturer(&mfgInfo, value, strlen(value));
                     break;
                 case QTIDEV_INF_DEVICE_INFO:
-                    if (flag == true)
-                    {
-                        if (pFileInfo->mLength <= pFileInfo->mNumResp)
-                        {
-                            /* No need to process further */
-                            continue;
-                        }
-                        updateDeviceInfo(pFileInfo, name, value);
-                    } else
+                    if (growDeviceInfo(ppFileInfo) < 0)
                     {
-                        count++;
+                        status = -ENOMEM;
+                        break;
                     }
+                    updateDeviceInfo(*ppFileInfo, name, value);
                     break;
                 case QTIDEV_INF_STRING:
-                    if (flag == true)
-                    {
-                        updateDevStringInfo(pFileInfo, name, value);
-                    }
+                    updateDevStringInfo(*ppFileInfo, name, value);
                     break;
                 default :
                     break;
@@ -548,113 +727,516 @@ static int processData(fileInfo_t *pFileInfo, struct file *filp, bool flag)
         }
     }
 
-    return count;
+    /* manufacturer whose models section never showed up */
+    while (mfgInfo) {
+        tmp = mfgInfo;
+        mfgInfo = mfgInfo->next;
+        kfree(tmp);
+    }
+
+    return (status < 0) ? status : (int)(*ppFileInfo)->mNumResp;
+}
+
+#ifndef QTIDEV_INF_USER
+/*
+ * Shrink the table to the devices found and append the VID/PID/interface
+ * index, so the whole result is still freed with one kfree
+ */
+static fileInfo_t *buildIndex(fileInfo_t *pFileInfo)
+{
+    fileInfo_t *newInfo;
+    unsigned int num = pFileInfo->mNumResp;
+    unsigned int bits;
+    size_t size;
+    int idx;
+    int bucket;
+
+    bits = max_t(unsigned int, QTIDEV_INF_MIN_HASH_BITS,
+            order_base_2(num * 2));
+    size = sizeof(fileInfo_t) + num * sizeof(devInfo_t);
+    newInfo = krealloc(pFileInfo,
+            size + ((1U << bits) + num) * sizeof(int), GFP_KERNEL);
+    if (!newInfo)
+    {
+        QC_LOG_ERR("error in allocating memory\n");
+        kfree(pFileInfo);
+        return NULL;
+    }
+
+    newInfo->mLength = num;
+    newInfo->mHashBits = bits;
+    newInfo->mpHashHead = (int *)((char *)newInfo + size);
+    newInfo->mpHashNext = newInfo->mpHashHead + (1U << bits);
+    memset(newInfo->mpHashHead, 0xFF, (1U << bits) * sizeof(int));
+
+    /* Added last to first, so the first entry of the file wins */
+    for (idx = num - 1; idx >= 0; idx--)
+    {
+        bucket = infHash(newInfo->mDevInfo[idx].mVid_pid_iface[0],
+                newInfo->mDevInfo[idx].mVid_pid_iface[1],
+                newInfo->mDevInfo[idx].mVid_pid_iface[2], bits);
+        newInfo->mpHashNext[idx] = newInfo->mpHashHead[bucket];
+        newInfo->mpHashHead[bucket] = idx;
+    }
+    return newInfo;
 }
 
 /**
- * @brief To extract the device info and store in ctx
+ * @brief To read and parse the INF/config file in one pass
  *
- * extracts the device info from file 'pFilePath', and stores in pFileInfo
+ * Reads 'pFilePath' into memory with a single read and extracts the
+ * device info while counting it. The parse time is logged.
  *
  * @param   pFilePath    INF/Config file path
- * @param   pFileInfo    global Ctx, contains INF info
  *
- * @returns 0 on Success
- *          negative error - If file got corrupted/removed/invalid
+ * @returns device info to be freed with kfree on Success
+ *          NULL - If file got corrupted/removed/invalid
  */
-int QTIDevInfParse(void *pFilePath, fileInfo_t *pFileInfo)
+fileInfo_t *QTIDevInfLoad(char *pFilePath)
 {
-    /* To parse the .inf file and store the info in global context */
-    struct file *filp = NULL;
-    if (!pFilePath || !pFileInfo)
+    return loadInf(pFilePath, NULL);
+}
+
+EXPORT_SYMBOL(QTIDevInfLoad);
+
+/* Firmware name of the table compiled from 'pFilePath' */
+static int binFirmwareName(char *pFilePath, char *pName, size_t size)
+{
+    const char *base = strrchr(pFilePath, '/');
+    const char *ext;
+    int len;
+
+    base = base ? base + 1 : pFilePath;
+    ext = strrchr(base, '.');
+    len = ext ? (int)(ext - base) : (int)strlen(base);
+    if (len == 0)
     {
-        QC_LOG_ERR("Invalid INF file\n");
         return -EINVAL;
     }
-    #if (LINUX_VERSION_CODE < KERNEL_VERSION(4,13,16))
-        mm_segment_t oldfs;
-        oldfs = get_fs();
-        set_fs(get_ds());
-    #endif
+    if (snprintf(pName, size, "%s/%.*s.bin", QTIDEV_INFBIN_FW_DIR, len, base) >= size)
+    {
+        return -ENAMETOOLONG;
+    }
+    return 0;
+}
 
+/* Turn a checked table into device info, NULL if it is malformed */
+static fileInfo_t *parseBin(const u8 *pData, size_t size)
+{
+    const qtiDevInfBinHeader_t *hdr = (const qtiDevInfBinHeader_t *)pData;
+    const qtiDevInfBinEntry_t *entry;
+    const char *strings;
+    fileInfo_t *pFileInfo;
+    devInfo_t *devInfo;
+    u32 count;
+    u32 strSize;
+    u32 offset;
+    size_t len;
+    u32 idx;
+
+    if (size < sizeof(*hdr) ||
+        le32_to_cpu(hdr->mMagic) != QTIDEV_INFBIN_MAGIC ||
+        le16_to_cpu(hdr->mVersion) != QTIDEV_INFBIN_VERSION ||
+        le16_to_cpu(hdr->mClass) > QTIDEV_INF_CLASS_UNKNOWN)
+    {
+        return NULL;
+    }
+    count = le32_to_cpu(hdr->mCount);
+    strSize = le32_to_cpu(hdr->mStringSize);
+    if (count > QTIDEV_INFBIN_MAX_COUNT ||
+        size != sizeof(*hdr) + (size_t)count * sizeof(*entry) + strSize)
+    {
+        return NULL;
+    }
+    entry = (const qtiDevInfBinEntry_t *)(hdr + 1);
+    strings = (const char *)(entry + count);
+
+    pFileInfo = kzalloc(sizeof(fileInfo_t) + count * sizeof(devInfo_t), GFP_KERNEL);
+    if (!pFileInfo)
+    {
+        return NULL;
+    }
+    pFileInfo->mClass = le16_to_cpu(hdr->mClass);
+    pFileInfo->mLength = count;
+
+    devInfo = pFileInfo->mDevInfo;
+    for (idx = 0; idx < count; idx++, entry++, devInfo++)
+    {
+        offset = le32_to_cpu(entry->mKeyOffset);
+        if (entry->mDevType > QTIDEV_INF_TYPE_UNKNOWN || offset >= strSize)
+        {
+            kfree(pFileInfo);
+            return NULL;
+        }
+        len = strnlen(strings + offset, strSize - offset);
+        if (len == strSize - offset)
+        {
+            kfree(pFileInfo);
+            return NULL;
+        }
+        len = min_t(size_t, len, QTIDEV_INF_MAX_KEY_SIZE - 1);
+        memcpy(devInfo->mpKey, strings + offset, len);
+        devInfo->mpKey[len] = '\0';
+        devInfo->mDevType = entry->mDevType;
+        devInfo->mVid_pid_iface[0] = le16_to_cpu(entry->mVid);
+        devInfo->mVid_pid_iface[1] = le16_to_cpu(entry->mPid);
+        devInfo->mVid_pid_iface[2] = entry->mIface;
+    }
+    pFileInfo->mNumResp = count;
+    return pFileInfo;
+}
+
+/*
+ * Load the precompiled table of 'pFilePath' through the firmware loader.
+ * NULL when there is none, it is malformed, or the INF file no longer has
+ * the size and checksum it was compiled from; the caller then parses the
+ * INF file, which is left read into 'pBuf' if it exists.
+ */
+static fileInfo_t *loadInfBin(char *pFilePath, infBuffer_t *pBuf, infFileId_t *pId)
+{
+#if (LINUX_VERSION_CODE >= KERNEL_VERSION(3,14,0))
+    const struct firmware *fw;
+    const qtiDevInfBinHeader_t *hdr;
+    fileInfo_t *pFileInfo;
+    infFileId_t id = { 0 };
+    struct file *filp;
+    char name[64];
+    ktime_t start;
+
+    if (!gpInfDevice || binFirmwareName(pFilePath, name, sizeof(name)) < 0)
+    {
+        return NULL;
+    }
+
+    if (request_firmware_direct(&fw, name, gpInfDevice))
+    {
+        QC_LOG_GLOBAL("%s: no table, parsing %s\n", name, pFilePath);
+        return NULL;
+    }
+
+    /* Only a missing INF file skips the check, not one that fails to read */
+    start = ktime_get();
     filp = filp_open(pFilePath, O_RDONLY, 0444);
-    if (IS_ERR(filp))
+    if (!IS_ERR(filp))
     {
-        QC_LOG_ERR("Error in opening file : %d\n", (int)IS_ERR(filp));
-        #if (LINUX_VERSION_CODE < KERNEL_VERSION(4,13,16))
-            set_fs(oldfs);
-        #endif
-        return -EINVAL;
+        filp_close(filp, NULL);
+        if (readInfFile(pFilePath, pBuf) < 0)
+        {
+            release_firmware(fw);
+            return NULL;
+        }
+        id = pBuf->mId;
+    }
+
+    hdr = (const qtiDevInfBinHeader_t *)fw->data;
+    if (fw->size >= sizeof(*hdr) && pBuf->mpData &&
+        (pBuf->mSize != le32_to_cpu(hdr->mSourceSize) ||
+         qtiDevInfBinCrc(pBuf->mpData, pBuf->mSize) != le32_to_cpu(hdr->mSourceCrc)))
+    {
+        QC_LOG_INFO("%s: %s changed since it was compiled, parsing it\n",
+                name, pFilePath);
+        release_firmware(fw);
+        return NULL;
+    }
+
+    pFileInfo = parseBin(fw->data, fw->size);
+    release_firmware(fw);
+    if (!pFileInfo)
+    {
+        QC_LOG_ERR("%s: invalid table, parsing %s\n", name, pFilePath);
+        return NULL;
+    }
+
+    pFileInfo = buildIndex(pFileInfo);
+    if (!pFileInfo)
+    {
+        return NULL;
     }
 
-    if (processData(pFileInfo, filp, true) < 0)
+    QC_LOG_INFO("%s: %u devices from %s in %lld us\n", pFilePath,
+            pFileInfo->mNumResp, name,
+            (long long)ktime_to_us(ktime_sub(ktime_get(), start)));
+    if (pId)
+    {
+        *pId = id;
+    }
+    return pFileInfo;
+#else
+    return NULL;
+#endif
+}
+
+static fileInfo_t *loadInf(char *pFilePath, infFileId_t *pId)
+{
+    infBuffer_t buf = { 0 };
+    fileInfo_t *pFileInfo;
+    ktime_t start;
+    int ret;
+
+    if (!pFilePath)
+    {
+        QC_LOG_ERR("Invalid INF file\n");
+        return NULL;
+    }
+
+    /* The precompiled table if there is one, the INF file otherwise */
+    pFileInfo = loadInfBin(pFilePath, &buf, pId);
+    if (pFileInfo)
+    {
+        vfree(buf.mpData);
+        return pFileInfo;
+    }
+
+    start = ktime_get();
+    if (!buf.mpData && readInfFile(pFilePath, &buf) < 0)
+    {
+        vfree(buf.mpData);
+        return NULL;
+    }
+
+    pFileInfo = kzalloc(sizeof(fileInfo_t) +
+            QTIDEV_INF_INIT_ENTRIES * sizeof(devInfo_t), GFP_KERNEL);
+    if (!pFileInfo)
+    {
+        vfree(buf.mpData);
+        return NULL;
+    }
+    pFileInfo->mLength = QTIDEV_INF_INIT_ENTRIES;
+
+    ret = processData(&pFileInfo, &buf);
+    vfree(buf.mpData);
+    if (ret < 0)
     {
         QC_LOG_ERR("failed to retrieve the device ID\n");
+        kfree(pFileInfo);
+        return NULL;
     }
 
-    filp_close(filp, NULL);
-    #if (LINUX_VERSION_CODE < KERNEL_VERSION(4,13,16))
-        set_fs(oldfs);
-    #endif
-    return 0;
+    pFileInfo = buildIndex(pFileInfo);
+    if (!pFileInfo)
+    {
+        return NULL;
+    }
+
+    QC_LOG_INFO("%s: %u devices, %zu bytes in %lld us\n", pFilePath,
+            pFileInfo->mNumResp, buf.mSize,
+            (long long)ktime_to_us(ktime_sub(ktime_get(), start)));
+    if (pId)
+    {
+        *pId = buf.mId;
+    }
+    return pFileInfo;
 }
 
-EXPORT_SYMBOL(QTIDevInfParse);
+/**
+ * @brief To get the shared device info of an INF/config file
+ *
+ * The first caller for 'pFilePath' reads and parses the file, later
+ * callers share the same data until the last QTIDevInfPut. Lookups with
+ * QTIDevInfGetDevInfo use a hash index on VID/PID/interface.
+ *
+ * @param   pFilePath    INF/Config file path
+ *
+ * @returns device info on Success
+ *          NULL - If file got corrupted/removed/invalid
+ */
+fileInfo_t *QTIDevInfGet(char *pFilePath)
+{
+    infDb_t *db;
+    fileInfo_t *pFileInfo = NULL;
+
+    if (!pFilePath)
+    {
+        QC_LOG_ERR("Invalid INF file\n");
+        return NULL;
+    }
 
-#if 0
-static int getInfEntryCount(struct file *filp)
+    mutex_lock(&gInfDbLock);
+    list_for_each_entry(db, &gInfDbList, mNode)
+    {
+        if (!db->mbStale && !strcmp(db->mpPath, pFilePath))
+        {
+            kref_get(&db->mRefCount);
+            pFileInfo = db->mpFileInfo;
+            goto unlock;
+        }
+    }
+
+    db = kzalloc(sizeof(infDb_t), GFP_KERNEL);
+    if (!db)
+    {
+        goto unlock;
+    }
+    db->mpPath = kstrdup(pFilePath, GFP_KERNEL);
+    db->mpFileInfo = loadInf(pFilePath, &db->mId);
+    if (!db->mpPath || !db->mpFileInfo)
+    {
+        kfree(db->mpFileInfo);
+        kfree(db->mpPath);
+        kfree(db);
+        goto unlock;
+    }
+    kref_init(&db->mRefCount);
+    list_add(&db->mNode, &gInfDbList);
+    pFileInfo = db->mpFileInfo;
+
+unlock:
+    mutex_unlock(&gInfDbLock);
+    return pFileInfo;
+}
+
+EXPORT_SYMBOL(QTIDevInfGet);
+
+/* Runs within gInfDbLock */
+static void infDbRelease(struct kref *ref)
 {
-    char    line[QTIDEV_INF_MAX_LINE_SIZE + 1] = "";
-    char    *section = NULL;
+    infDb_t *db = container_of(ref, infDb_t, mRefCount);
 
-    loff_t  offset = 0;  /* For seeking */
-    char    *start;
-    char    *end;
-    unsigned int    count = 0;
-    sectionInfo_t   sectionInfo = QTIDEV_INF_UNKNOWN;
+    list_del(&db->mNode);
+    kfree(db->mpFileInfo);
+    kfree(db->mpPath);
+    kfree(db);
+}
 
+/**
+ * @brief To drop a reference taken with QTIDevInfGet
+ *
+ * @param   pFileInfo    device info returned by QTIDevInfGet, may be NULL
+ */
+void QTIDevInfPut(fileInfo_t *pFileInfo)
+{
+    infDb_t *db;
 
-    while (_MyReadLine(filp, line, QTIDEV_INF_MAX_LINE_SIZE, &offset) >= 0) {
-        start = line;
-        start = lskip(rstrip(start));
+    if (!pFileInfo)
+    {
+        return;
+    }
 
-        if (strchr(QTIDEV_INF_START_COMMENT_PREFIXES, *start)) {
-            /* Start-of-line comment */
+    mutex_lock(&gInfDbLock);
+    list_for_each_entry(db, &gInfDbList, mNode)
+    {
+        if (db->mpFileInfo == pFileInfo)
+        {
+            kref_put(&db->mRefCount, infDbRelease);
+            break;
+        }
+    }
+    mutex_unlock(&gInfDbLock);
+}
+
+EXPORT_SYMBOL(QTIDevInfPut);
+
+/**
+ * @brief To check the cached INF/config files against the filesystem
+ *
+ * A cached file whose inode, size or modification time changed is
+ * marked stale: QTIDevInfCheckFileStatus reports it as modified and the
+ * next QTIDevInfGet parses it again. Files that cannot be opened keep
+ * their cached data.
+ *
+ * @returns number of files marked stale
+ */
+int QTIDevInfReload(void)
+{
+    infDb_t *db;
+    infFileId_t id;
+    struct file *filp;
+    int count = 0;
+
+    mutex_lock(&gInfDbLock);
+    list_for_each_entry(db, &gInfDbList, mNode)
+    {
+        if (db->mbStale)
+        {
             continue;
-        } else if (*start == QTIDEV_INF_START_SECTION[0]) {
-            /* [Section] line */
-            if (sectionInfo == QTIDEV_INF_STRING)
-            {
-                break;
-            }
-            end = find_chars_or_comment(start + 1, QTIDEV_INF_END_SECTION);
-            if (*end == QTIDEV_INF_END_SECTION[0]) {
-                *end = '\0';
-                section = start + 1;
-            } else {
-                QC_LOG_ERR("Invalid Section\n");
-                return -1;
-            }
-            if (!strncasecmp(section, INF_STRING, strlen(INF_STRING)))
-            {
-                sectionInfo = QTIDEV_INF_STRING;
-            }
-        } else if (sectionInfo == QTIDEV_INF_STRING) {
+        }
+
+        filp = filp_open(db->mpPath, O_RDONLY, 0444);
+        if (IS_ERR(filp))
+        {
+            QC_LOG_ERR("%s: cannot open, keeping the stored data\n", db->mpPath);
+            continue;
+        }
+        getFileId(filp, &id);
+        filp_close(filp, NULL);
+
+        if (!sameFileId(&id, &db->mId))
+        {
+            QC_LOG_INFO("%s: changed, reloaded on next probe\n", db->mpPath);
+            db->mbStale = true;
             count++;
         }
     }
+    mutex_unlock(&gInfDbLock);
     return count;
 }
+
+EXPORT_SYMBOL(QTIDevInfReload);
+
+static int reloadSet(const char *val, const struct kernel_param *kp)
+{
+    bool reload;
+    int ret;
+
+#if (LINUX_VERSION_CODE >= KERNEL_VERSION(4,6,0))
+    ret = kstrtobool(val, &reload);
 #else
-static int getInfEntryCount(struct file *filp)
+    ret = strtobool(val, &reload);
+#endif
+    if (ret)
+    {
+        return ret;
+    }
+    if (reload)
+    {
+        QTIDevInfReload();
+    }
+    return 0;
+}
+
+static const struct kernel_param_ops reloadOps = {
+    .set = reloadSet,
+};
+
+/**
+ * @brief To extract the device info and store in ctx
+ *
+ * extracts the device info from file 'pFilePath', and stores in pFileInfo
+ *
+ * @param   pFilePath    INF/Config file path
+ * @param   pFileInfo    global Ctx, contains INF info
+ *
+ * @returns 0 on Success
+ *          negative error - If file got corrupted/removed/invalid
+ */
+int QTIDevInfParse(void *pFilePath, fileInfo_t *pFileInfo)
 {
-    unsigned int count = 0;
+    fileInfo_t *pLoaded;
+    unsigned int count;
 
-    count = processData(NULL, filp, false);
-    return count;
+    if (!pFilePath || !pFileInfo)
+    {
+        QC_LOG_ERR("Invalid INF file\n");
+        return -EINVAL;
+    }
+
+    pLoaded = QTIDevInfLoad(pFilePath);
+    if (!pLoaded)
+    {
+        return -EINVAL;
+    }
+
+    /* pFileInfo->mLength entries fit, as sized by QTIDevInfEntrySize */
+    count = min(pLoaded->mNumResp, pFileInfo->mLength);
+    pFileInfo->mClass = pLoaded->mClass;
+    pFileInfo->mNumResp = count;
+    pFileInfo->mpHashHead = NULL;   /* looked up linearly */
+    memcpy(pFileInfo->mDevInfo, pLoaded->mDevInfo, count * sizeof(devInfo_t));
+    kfree(pLoaded);
+    return 0;
 }
 
-#endif
+EXPORT_SYMBOL(QTIDevInfParse);
 
 /**
  * @brief To get number of entries present in INF/config file
@@ -669,44 +1251,64 @@ static int getInfEntryCount(struct file *filp)
  */
 int QTIDevInfEntrySize(void *pFilePath)
 {
-    /* To parse the .inf file and store the info in global context */
-    struct file *filp = NULL;
-    int ret;
-    
+    fileInfo_t *pLoaded;
+    int count;
+
     if (!pFilePath)
     {
         QC_LOG_ERR("Invalid INF file\n");
         return -EINVAL;
     }
-    #if (LINUX_VERSION_CODE < KERNEL_VERSION(4,13,16))
-        mm_segment_t oldfs;
-        oldfs = get_fs();
-        set_fs(get_ds());
-    #endif
 
-    filp = filp_open(pFilePath, O_RDONLY, 0444);
-    if (IS_ERR(filp))
+    pLoaded = QTIDevInfLoad(pFilePath);
+    if (!pLoaded)
     {
-        QC_LOG_ERR("Error in opening file : %d\n", (int)IS_ERR(filp));
-        #if (LINUX_VERSION_CODE < KERNEL_VERSION(4,13,16))
-            set_fs(oldfs);
-        #endif
         return -EINVAL;
     }
+    count = pLoaded->mNumResp;
+    kfree(pLoaded);
+    return count;
+}
+
+EXPORT_SYMBOL(QTIDevInfEntrySize);
 
-    if ((ret = getInfEntryCount(filp)) < 0)
+/**
+ * @brief To pick the CPU to queue the work of a device on
+ *
+ * @param   node    NUMA node of the device, NUMA_NO_NODE for any
+ *
+ * @returns CPU number for queue_work_on()
+ *          WORK_CPU_UNBOUND - for the local CPU
+ */
+int QTIDevInfWorkCpu(int node)
+{
+    int cpu;
+#if (LINUX_VERSION_CODE < KERNEL_VERSION(5,9,0))
+    static int lastCpu = -1;
+#endif
+
+    if ((node == NUMA_NO_NODE) || (node == numa_node_id()))
     {
-        QC_LOG_ERR("failed to retrieve the device ID\n");
+        return WORK_CPU_UNBOUND;
     }
-
-    filp_close(filp, NULL);
-    #if (LINUX_VERSION_CODE < KERNEL_VERSION(4,13,16))
-        set_fs(oldfs);
-    #endif
-    return ret;
+#if (LINUX_VERSION_CODE >= KERNEL_VERSION(5,9,0))
+    cpu = cpumask_any_and_distribute(cpumask_of_node(node), cpu_online_mask);
+#else
+    /* Racy round robin as in cpumask_any_and_distribute(), any CPU will do */
+    cpu = cpumask_next_and(READ_ONCE(lastCpu), cpumask_of_node(node), cpu_online_mask);
+    if (cpu >= nr_cpu_ids)
+    {
+        cpu = cpumask_next_and(-1, cpumask_of_node(node), cpu_online_mask);
+    }
+    if (cpu < nr_cpu_ids)
+    {
+        WRITE_ONCE(lastCpu, cpu);
+    }
+#endif
+    return (cpu < nr_cpu_ids) ? cpu : WORK_CPU_UNBOUND;
 }
 
-EXPORT_SYMBOL(QTIDevInfEntrySize);
+EXPORT_SYMBOL(QTIDevInfWorkCpu);
 
 /*===========================================================================
 METHOD:
@@ -721,6 +1323,12 @@ Negative errno for error
 ===========================================================================*/
 static int QdssUSBModInit(void)
 {
+    gpInfDevice = root_device_register("qtiDevInf");
+    if (IS_ERR(gpInfDevice))
+    {
+        QC_LOG_ERR("no device for precompiled tables: %ld\n", PTR_ERR(gpInfDevice));
+        gpInfDevice = NULL;
+    }
 
     // This will be shown whenever driver is loaded
     QC_LOG_INFO( "%s: %s\n", DRIVER_DESC, DRIVER_VERSION );
@@ -740,6 +1348,22 @@ void
 ===========================================================================*/
 static void __exit QdssUSBModExit(void)
 {
+    infDb_t *db;
+    infDb_t *next;
+
+    /* Users hold a module reference, so nothing is left but leaks */
+    list_for_each_entry_safe(db, next, &gInfDbList, mNode)
+    {
+        QC_LOG_ERR("%s still referenced\n", db->mpPath);
+        list_del(&db->mNode);
+        kfree(db->mpFileInfo);
+        kfree(db->mpPath);
+        kfree(db);
+    }
+    if (gpInfDevice)
+    {
+        root_device_unregister(gpInfDevice);
+    }
     QC_LOG_INFO( "Unload %s: %s\n", DRIVER_DESC, DRIVER_VERSION );
     return;
 }
@@ -749,6 +1373,10 @@ module_exit(QdssUSBModExit);
 
 module_param( debug_g, int, S_IRUGO | S_IWUSR );
 
+module_param_cb( Reload, &reloadOps, NULL, S_IWUSR );
+MODULE_PARM_DESC(Reload, "Write 1 to pick up changed INF files on the next probe");
+
 MODULE_VERSION( DRIVER_VERSION );
 MODULE_DESCRIPTION( DRIVER_DESC );
 MODULE_LICENSE("Dual BSD/GPL");
+#endif
@@ -10,6 +10,7 @@ DESCRIPTION:
 #ifndef QTIDEVINF_H
 #define QTIDEVINF_H
 
+#ifndef QTIDEV_INF_USER
 #include <linux/kernel.h>
 #include <linux/slab.h>
 #include <linux/module.h>
@@ -18,6 +19,19 @@ DESCRIPTION:
 #include <linux/ctype.h>
 #include <linux/uaccess.h>
 #include <linux/version.h>
+#include <linux/fs.h>
+#include <linux/vmalloc.h>
+#include <linux/ktime.h>
+#include <linux/jhash.h>
+#include <linux/log2.h>
+#include <linux/kref.h>
+#include <linux/mutex.h>
+#include <linux/firmware.h>
+#include <linux/device.h>
+#include <linux/cpumask.h>
+#include <linux/topology.h>
+#include <linux/workqueue.h>
+#endif
 
 #define QTIDEV_INF_DEFAULT_VENDOR    "QTI"  /**< Default Vendor */
 
@@ -28,6 +42,9 @@ DESCRIPTION:
 
 #define QTIDEV_INF_MAX_KEY_SIZE      64      /**< Maximum key size       */
 #define QTIDEV_INF_MAX_LINE_SIZE (512)      /**< Maximum INF Line size  */
+#define QTIDEV_INF_MAX_FILE_SIZE (4 << 20)  /**< Maximum INF file size  */
+#define QTIDEV_INF_INIT_ENTRIES  64         /**< Device table, grows x2 */
+#define QTIDEV_INF_MIN_HASH_BITS 4          /**< Smallest lookup index  */
 
 #define QTIDEV_INF_DICT_OPERATOR ":="        /**< Possible dict operators    */
 #define QTIDEV_INF_START_SECTION "["         /**< Possible start operators   */
@@ -95,6 +112,9 @@ typedef struct _fileInfo {
     deviceClass         mClass;     /**< INF/Config file class  */
     unsigned int        mLength;    /**< Number of devices can occupy */
     unsigned int        mNumResp;   /**< Number of devices present */
+    unsigned int        mHashBits;  /**< log2 of the index buckets, 0 if no index */
+    int                 *mpHashHead;/**< first entry of each bucket, -1 if empty */
+    int                 *mpHashNext;/**< next entry of the same bucket */
     struct _devInfo     mDevInfo[0];
 }fileInfo_t;
 
@@ -119,12 +139,60 @@ void* QTIDevInfGetDevInfo(struct usb_interface *pIface, fileInfo_t *pFileInfo);
  * @param   pFileInfo    global Ctx, contains INF info
  * @param   pFilePath    INF/Config file path
  *
- * @returns true    - If no change in config file
- *          false   - Config file got modified
- *          negative error - If file got corrupted/removed
+ * Only looks at the cached state, the file itself is checked by
+ * QTIDevInfReload.
+ *
+ * @returns false   - If no change in config file
+ *          true    - Config file got modified or 'pFilePath' changed
+ *          negative error - If the data is invalid
  */
 int QTIDevInfCheckFileStatus(fileInfo_t *pFileInfo, char *pFilePath);
 
+/**
+ * @brief To read and parse the INF/config file in one pass
+ *
+ * Reads 'pFilePath' into memory with a single read and extracts the
+ * device info while counting it. The parse time is logged.
+ *
+ * @param   pFilePath    INF/Config file path
+ *
+ * @returns device info to be freed with kfree on Success
+ *          NULL - If file got corrupted/removed/invalid
+ */
+fileInfo_t *QTIDevInfLoad(char *pFilePath);
+
+/**
+ * @brief To get the shared device info of an INF/config file
+ *
+ * The first caller for 'pFilePath' reads and parses the file, later
+ * callers share the same data until the last QTIDevInfPut. Lookups with
+ * QTIDevInfGetDevInfo use a hash index on VID/PID/interface.
+ *
+ * @param   pFilePath    INF/Config file path
+ *
+ * @returns device info on Success
+ *          NULL - If file got corrupted/removed/invalid
+ */
+fileInfo_t *QTIDevInfGet(char *pFilePath);
+
+/**
+ * @brief To drop a reference taken with QTIDevInfGet
+ *
+ * @param   pFileInfo    device info returned by QTIDevInfGet, may be NULL
+ */
+void QTIDevInfPut(fileInfo_t *pFileInfo);
+
+/**
+ * @brief To check the cached INF/config files against the filesystem
+ *
+ * Files whose inode, size or modification time changed are parsed again
+ * by the next QTIDevInfGet. Also run by writing 1 to the Reload
+ * parameter of qtiDevInf.
+ *
+ * @returns number of changed files
+ */
+int QTIDevInfReload(void);
+
 /**
  * @brief To get number of entries present in INF/config file
  *
@@ -138,6 +206,20 @@ int QTIDevInfCheckFileStatus(fileInfo_t *pFileInfo, char *pFilePath);
  */
 int QTIDevInfEntrySize(void *pFilePath);
 
+/**
+ * @brief To pick the CPU to queue the work of a device on
+ *
+ * Work of a device on another NUMA node runs on a CPU of that node,
+ * successive calls hand out the online CPUs of the node in turn so that
+ * the devices of a node share its CPUs.
+ *
+ * @param   node    NUMA node of the device, NUMA_NO_NODE for any
+ *
+ * @returns CPU number for queue_work_on()
+ *          WORK_CPU_UNBOUND - for the local CPU
+ */
+int QTIDevInfWorkCpu(int node);
+
 /**
  * @brief To extract the device info and store in ctx
  *
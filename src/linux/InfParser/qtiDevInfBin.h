@@ -0,0 +1,61 @@
+/*===========================================================================
+FILE:
+   qtiDevInfBin.h
+DESCRIPTION:
+   Precompiled device table, shared by qtiDevInf and qtiDevInfCompile
+
+   Copyright (c) Qualcomm Technologies, Inc. and/or its subsidiaries.
+   SPDX-License-Identifier: BSD-3-Clause
+==========================================================================*/
+#ifndef QTIDEVINFBIN_H
+#define QTIDEVINFBIN_H
+
+#include <linux/types.h>
+#ifndef QTIDEV_INF_USER
+#include <linux/crc32.h>
+#endif
+
+/*
+ * Layout, all fields little endian:
+ *
+ *   qtiDevInfBinHeader_t
+ *   mCount x qtiDevInfBinEntry_t, sorted by VID, PID and interface, at
+ *            most one entry for each of them (the first one of the INF)
+ *   mStringSize bytes of NUL terminated device names
+ *
+ * The table is found through the firmware loader as
+ * QTIDEV_INFBIN_FW_DIR "/<INF name without .inf>.bin". It is only used
+ * while the INF file is missing or still has mSourceSize bytes with a
+ * checksum of mSourceCrc.
+ */
+#define QTIDEV_INFBIN_MAGIC      0x42464E49  /**< "INFB" */
+#define QTIDEV_INFBIN_VERSION    2           /**< 2: mSourceCrc added */
+#define QTIDEV_INFBIN_FW_DIR     "qtiDevInf"
+#define QTIDEV_INFBIN_MAX_COUNT  0x10000     /**< one per VID/PID/interface */
+
+typedef struct _qtiDevInfBinHeader {
+    __le32      mMagic;
+    __le16      mVersion;
+    __le16      mClass;         /**< deviceClass of the INF */
+    __le32      mCount;         /**< entries following the header */
+    __le32      mStringSize;    /**< bytes following the entries */
+    __le32      mSourceSize;    /**< size of the INF file compiled */
+    __le32      mSourceCrc;     /**< qtiDevInfBinCrc of the INF file */
+} qtiDevInfBinHeader_t;
+
+typedef struct _qtiDevInfBinEntry {
+    __le16      mVid;
+    __le16      mPid;
+    __u8        mIface;
+    __u8        mDevType;       /**< QTIdevtype */
+    __le16      mReserved;
+    __le32      mKeyOffset;     /**< device name, from the string table */
+} qtiDevInfBinEntry_t;
+
+/* Checksum of the INF file a table is compiled from, the CRC-32 of zlib */
+static inline __u32 qtiDevInfBinCrc(const void *pData, size_t size)
+{
+    return crc32_le(~0U, pData, size) ^ ~0U;
+}
+
+#endif
@@ -0,0 +1,253 @@
+/*===========================================================================
+FILE:
+   qtiDevInfCompile.c
+DESCRIPTION:
+   Host tool compiling an INF file into the precompiled device table
+   loaded by qtiDevInf, see qtiDevInfBin.h
+
+   Copyright (c) Qualcomm Technologies, Inc. and/or its subsidiaries.
+   SPDX-License-Identifier: BSD-3-Clause
+==========================================================================*/
+
+/*
+ * Usage: qtiDevInfCompile <file.inf> <file.bin>
+ *
+ * The INF file goes through the parser of qtiDevInf.c itself, built here
+ * with QTIDEV_INF_USER, so the table holds what the driver would read
+ * from the text file.
+ */
+#define _GNU_SOURCE
+#define QTIDEV_INF_USER
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <errno.h>
+#include <endian.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+/* Userspace stand-ins for what the parser uses from the kernel */
+#define KERN_INFO                   ""
+#define KERN_ERR                    ""
+#define printk(format, args...)     fprintf(stderr, format, ##args)
+#define GFP_KERNEL                  0
+#define kzalloc(size, flags)        calloc(1, size)
+#define krealloc(ptr, size, flags)  realloc(ptr, size)
+#define kfree(ptr)                  free(ptr)
+#define simple_strtoul              strtoul
+#define EXPORT_SYMBOL(sym)
+
+typedef int64_t s64;
+struct usb_interface;
+
+/* Bitwise CRC-32 (reflected 0xEDB88320), the kernel's crc32_le */
+static uint32_t crc32_le(uint32_t crc, const void *pData, size_t size)
+{
+    const unsigned char *p = pData;
+    int bit;
+
+    while (size--)
+    {
+        crc ^= *p++;
+        for (bit = 0; bit < 8; bit++)
+            crc = (crc >> 1) ^ (0xEDB88320 & -(crc & 1));
+    }
+    return crc;
+}
+
+#include "qtiDevInf.c"
+
+typedef struct _compileEntry {
+    unsigned int    mVid;
+    unsigned int    mPid;
+    unsigned int    mIface;
+    unsigned int    mIndex;     /* position in the INF, first one wins */
+} compileEntry_t;
+
+static int compareEntry(const void *pA, const void *pB)
+{
+    const compileEntry_t *a = pA;
+    const compileEntry_t *b = pB;
+
+    if (a->mVid != b->mVid)
+        return a->mVid < b->mVid ? -1 : 1;
+    if (a->mPid != b->mPid)
+        return a->mPid < b->mPid ? -1 : 1;
+    if (a->mIface != b->mIface)
+        return a->mIface < b->mIface ? -1 : 1;
+    return a->mIndex < b->mIndex ? -1 : (a->mIndex > b->mIndex);
+}
+
+static int readFile(const char *pPath, infBuffer_t *pBuf)
+{
+    struct stat st;
+    FILE *fp;
+
+    fp = fopen(pPath, "rb");
+    if (!fp || fstat(fileno(fp), &st) < 0)
+    {
+        fprintf(stderr, "%s: %s\n", pPath, strerror(errno));
+        if (fp)
+            fclose(fp);
+        return -1;
+    }
+    if (st.st_size <= 0 || st.st_size > QTIDEV_INF_MAX_FILE_SIZE)
+    {
+        fprintf(stderr, "%s: invalid size %lld\n", pPath, (long long)st.st_size);
+        fclose(fp);
+        return -1;
+    }
+
+    pBuf->mpData = malloc(st.st_size + 1);
+    if (!pBuf->mpData)
+    {
+        fclose(fp);
+        return -1;
+    }
+    pBuf->mSize = fread(pBuf->mpData, 1, st.st_size, fp);
+    pBuf->mpData[pBuf->mSize] = '\0';
+    pBuf->mOffset = 0;
+    fclose(fp);
+    return pBuf->mSize == (size_t)st.st_size ? 0 : -1;
+}
+
+static int writeTable(const char *pPath, fileInfo_t *pFileInfo,
+        compileEntry_t *pEntries, unsigned int count, const infBuffer_t *pSource)
+{
+    qtiDevInfBinHeader_t hdr;
+    qtiDevInfBinEntry_t entry;
+    devInfo_t *devInfo;
+    uint32_t strSize = 0;
+    unsigned int idx;
+    FILE *fp;
+    int ret = 0;
+
+    for (idx = 0; idx < count; idx++)
+        strSize += strlen(pFileInfo->mDevInfo[pEntries[idx].mIndex].mpKey) + 1;
+
+    fp = fopen(pPath, "wb");
+    if (!fp)
+    {
+        fprintf(stderr, "%s: %s\n", pPath, strerror(errno));
+        return -1;
+    }
+
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.mMagic = htole32(QTIDEV_INFBIN_MAGIC);
+    hdr.mVersion = htole16(QTIDEV_INFBIN_VERSION);
+    hdr.mClass = htole16(pFileInfo->mClass);
+    hdr.mCount = htole32(count);
+    hdr.mStringSize = htole32(strSize);
+    hdr.mSourceSize = htole32(pSource->mSize);
+    hdr.mSourceCrc = htole32(qtiDevInfBinCrc(pSource->mpData, pSource->mSize));
+    if (fwrite(&hdr, sizeof(hdr), 1, fp) != 1)
+        ret = -1;
+
+    strSize = 0;
+    for (idx = 0; idx < count && !ret; idx++)
+    {
+        devInfo = &pFileInfo->mDevInfo[pEntries[idx].mIndex];
+        memset(&entry, 0, sizeof(entry));
+        entry.mVid = htole16(pEntries[idx].mVid);
+        entry.mPid = htole16(pEntries[idx].mPid);
+        entry.mIface = pEntries[idx].mIface;
+        entry.mDevType = devInfo->mDevType;
+        entry.mKeyOffset = htole32(strSize);
+        strSize += strlen(devInfo->mpKey) + 1;
+        if (fwrite(&entry, sizeof(entry), 1, fp) != 1)
+            ret = -1;
+    }
+
+    for (idx = 0; idx < count && !ret; idx++)
+    {
+        devInfo = &pFileInfo->mDevInfo[pEntries[idx].mIndex];
+        if (fwrite(devInfo->mpKey, strlen(devInfo->mpKey) + 1, 1, fp) != 1)
+            ret = -1;
+    }
+
+    if (fclose(fp) != 0 || ret)
+    {
+        fprintf(stderr, "%s: write failed\n", pPath);
+        remove(pPath);
+        return -1;
+    }
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    infBuffer_t buf = { 0 };
+    fileInfo_t *pFileInfo;
+    compileEntry_t *pEntries;
+    devInfo_t *devInfo;
+    unsigned int count = 0;
+    unsigned int idx;
+
+    if (argc != 3)
+    {
+        fprintf(stderr, "usage: %s <file.inf> <file.bin>\n", argv[0]);
+        return 2;
+    }
+
+    if (readFile(argv[1], &buf) < 0)
+        return 1;
+
+    pFileInfo = kzalloc(sizeof(fileInfo_t) +
+            QTIDEV_INF_INIT_ENTRIES * sizeof(devInfo_t), GFP_KERNEL);
+    if (!pFileInfo)
+        return 1;
+    pFileInfo->mLength = QTIDEV_INF_INIT_ENTRIES;
+    if (processData(&pFileInfo, &buf) < 0)
+    {
+        fprintf(stderr, "%s: failed to retrieve the device ID\n", argv[1]);
+        return 1;
+    }
+
+    pEntries = calloc(pFileInfo->mNumResp + 1, sizeof(*pEntries));
+    if (!pEntries)
+        return 1;
+    for (idx = 0; idx < pFileInfo->mNumResp; idx++)
+    {
+        devInfo = &pFileInfo->mDevInfo[idx];
+        if (devInfo->mVid_pid_iface[0] < 0 || devInfo->mVid_pid_iface[0] > 0xFFFF ||
+            devInfo->mVid_pid_iface[1] < 0 || devInfo->mVid_pid_iface[1] > 0xFFFF ||
+            devInfo->mVid_pid_iface[2] < 0 || devInfo->mVid_pid_iface[2] > 0xFF)
+        {
+            fprintf(stderr, "%s: %s: VID/PID/interface out of range\n",
+                    argv[1], devInfo->mpKey);
+            return 1;
+        }
+        pEntries[idx].mVid = devInfo->mVid_pid_iface[0];
+        pEntries[idx].mPid = devInfo->mVid_pid_iface[1];
+        pEntries[idx].mIface = devInfo->mVid_pid_iface[2];
+        pEntries[idx].mIndex = idx;
+    }
+
+    /* Sorted, keeping only the first entry of each VID/PID/interface */
+    qsort(pEntries, pFileInfo->mNumResp, sizeof(*pEntries), compareEntry);
+    for (idx = 0; idx < pFileInfo->mNumResp; idx++)
+    {
+        if (count && pEntries[idx].mVid == pEntries[count - 1].mVid &&
+            pEntries[idx].mPid == pEntries[count - 1].mPid &&
+            pEntries[idx].mIface == pEntries[count - 1].mIface)
+        {
+            continue;
+        }
+        pEntries[count++] = pEntries[idx];
+    }
+
+    if (writeTable(argv[2], pFileInfo, pEntries, count, &buf) < 0)
+        return 1;
+
+    printf("%s: %u devices (%u in the INF) -> %s\n", argv[1], count,
+            pFileInfo->mNumResp, argv[2]);
+    free(pEntries);
+    free(pFileInfo);
+    free(buf.mpData);
+    return 0;
+}
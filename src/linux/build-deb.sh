@@ -10,6 +10,7 @@ set -euo pipefail
 #
 # - Packs the entire qcom-usb-kernel-drivers/src/linux folder into the package
 # - All files are installed under /opt/qcom/QUD
+# - INF device tables are precompiled into /lib/firmware/qtiDevInf
 # - Executes qcom_drivers.sh install during package installation
 # - Executes qcom_drivers.sh uninstall during package removal
 # - Version is read from version.h (DRIVER_VERSION)
@@ -124,7 +125,24 @@ shopt -u dotglob nullglob
 find "$BUILDROOT$INSTALL_PREFIX" \( \
      -name '*.o' -o -name '*.ko' -o -name '*.mod' -o -name '*.mod.c' \
      -o -name '*.cmd' -o -name 'Module.symvers' -o -name 'modules.order' \
-     -o -name '.tmp_versions' \) -exec rm -rf {} + 2>/dev/null || true
+     -o -name '.tmp_versions' -o -name 'qtiDevInfCompile' \) -exec rm -rf {} + 2>/dev/null || true
+
+# Precompile the INF files into the device tables qtiDevInf loads through the
+# firmware loader. Without them, or once an INF file is edited, the drivers
+# parse the INF files as before.
+FW_TABLE_DIR="$BUILDROOT/lib/firmware/qtiDevInf"
+HOSTCC="${HOSTCC:-cc}"
+if command -v "$HOSTCC" >/dev/null 2>&1; then
+  echo "Compiling INF device tables -> $FW_TABLE_DIR"
+  "$HOSTCC" -O2 -o "$WORKDIR/qtiDevInfCompile" "$SRC_DIR/InfParser/qtiDevInfCompile.c"
+  mkdir -p "$FW_TABLE_DIR"
+  for inf in qcom_usbnet/qtiwwan.inf qcom_usb/qtiser.inf qcom_usb/qdbusb.inf qcom_serial/qtimdm.inf; do
+    "$WORKDIR/qtiDevInfCompile" "$SRC_DIR/$inf" "$FW_TABLE_DIR/$(basename "$inf" .inf).bin"
+  done
+  chmod 0644 "$FW_TABLE_DIR"/*.bin
+else
+  echo "NOTE: $HOSTCC not found, packaging without precompiled INF tables."
+fi
 
 # Sanity check: qcom_drivers.sh must end up in the payload
 if [ ! -f "$BUILDROOT$INSTALL_PREFIX/qcom_drivers.sh" ]; then
@@ -583,6 +583,13 @@ if [ ! -f $DEST_QCOM_USBINF_PARSER_PATH/qtiDevInf.h ]; then
    exit 1
 fi
 
+$QCOM_LN_RM_MK_DIR/cp ./InfParser/qtiDevInfBin.h $DEST_QCOM_USBINF_PARSER_PATH/
+if [ ! -f $DEST_QCOM_USBINF_PARSER_PATH/qtiDevInfBin.h ]; then
+   echo -e "${RED}Error: Failed to copy 'InfParser/qtiDevInfBin.h' to installation path"${RESET}
+   $QCOM_LN_RM_MK_DIR/rm -rf $DEST_QCOM_USBINF_PARSER_PATH
+   exit 1
+fi
+
 $QCOM_LN_RM_MK_DIR/cp ./InfParser/qtiDevInf.c $DEST_QCOM_USBINF_PARSER_PATH/
 if [ ! -f $DEST_QCOM_USBINF_PARSER_PATH/qtiDevInf.c ]; then
    echo -e "${RED}Error: Failed to copy 'InfParser/qtiDevInf.c' to installation path"${RESET}
@@ -674,6 +681,48 @@ if [ ! -f $DEST_QCOM_USB_PATH/qcom_event.h ]; then
    exit 1
 fi
 
+$QCOM_LN_RM_MK_DIR/cp ./$QCOM_USB_DIR/qcom_ring.c $DEST_QCOM_USB_PATH/
+if [ ! -f $DEST_QCOM_USB_PATH/qcom_ring.c ]; then
+   echo -e "${RED}Error: Failed to copy '$QCOM_USB_DIR/qcom_ring.c' to installation path"${RESET}
+   $QCOM_LN_RM_MK_DIR/rm -rf $DEST_QCOM_USB_PATH
+   exit 1
+fi
+
+$QCOM_LN_RM_MK_DIR/cp ./$QCOM_USB_DIR/qcom_ring.h $DEST_QCOM_USB_PATH/
+if [ ! -f $DEST_QCOM_USB_PATH/qcom_ring.h ]; then
+   echo -e "${RED}Error: Failed to copy '$QCOM_USB_DIR/qcom_ring.h' to installation path"${RESET}
+   $QCOM_LN_RM_MK_DIR/rm -rf $DEST_QCOM_USB_PATH
+   exit 1
+fi
+
+$QCOM_LN_RM_MK_DIR/cp ./$QCOM_USB_DIR/qcom_hdlc.c $DEST_QCOM_USB_PATH/
+if [ ! -f $DEST_QCOM_USB_PATH/qcom_hdlc.c ]; then
+   echo -e "${RED}Error: Failed to copy '$QCOM_USB_DIR/qcom_hdlc.c' to installation path"${RESET}
+   $QCOM_LN_RM_MK_DIR/rm -rf $DEST_QCOM_USB_PATH
+   exit 1
+fi
+
+$QCOM_LN_RM_MK_DIR/cp ./$QCOM_USB_DIR/qcom_hdlc.h $DEST_QCOM_USB_PATH/
+if [ ! -f $DEST_QCOM_USB_PATH/qcom_hdlc.h ]; then
+   echo -e "${RED}Error: Failed to copy '$QCOM_USB_DIR/qcom_hdlc.h' to installation path"${RESET}
+   $QCOM_LN_RM_MK_DIR/rm -rf $DEST_QCOM_USB_PATH
+   exit 1
+fi
+
+$QCOM_LN_RM_MK_DIR/cp ./$QCOM_USB_DIR/qcom_bench.c $DEST_QCOM_USB_PATH/
+if [ ! -f $DEST_QCOM_USB_PATH/qcom_bench.c ]; then
+   echo -e "${RED}Error: Failed to copy '$QCOM_USB_DIR/qcom_bench.c' to installation path"${RESET}
+   $QCOM_LN_RM_MK_DIR/rm -rf $DEST_QCOM_USB_PATH
+   exit 1
+fi
+
+$QCOM_LN_RM_MK_DIR/cp ./$QCOM_USB_DIR/qcom_bench.h $DEST_QCOM_USB_PATH/
+if [ ! -f $DEST_QCOM_USB_PATH/qcom_bench.h ]; then
+   echo -e "${RED}Error: Failed to copy '$QCOM_USB_DIR/qcom_bench.h' to installation path"${RESET}
+   $QCOM_LN_RM_MK_DIR/rm -rf $DEST_QCOM_USB_PATH
+   exit 1
+fi
+
 # All modules makefile
 $QCOM_LN_RM_MK_DIR/cp ./Makefile $DEST_QUD_PATH/
 if [ ! -f $DEST_QUD_PATH/Makefile ]; then
@@ -732,6 +781,20 @@ if [ ! -f $DEST_QCOM_USBNET_PATH/qmi.h ]; then
    exit 1
 fi
 
+$QCOM_LN_RM_MK_DIR/cp -rf ./$QCOM_USBNET_DIR/qmicapture.c $DEST_QCOM_USBNET_PATH
+if [ ! -f $DEST_QCOM_USBNET_PATH/qmicapture.c ]; then
+   echo -e ${RED}"Error: Failed to copy qmicapture.c to installation path"${RESET}
+   $QCOM_LN_RM_MK_DIR/rm -rf $DEST_QCOM_USBNET_PATH
+   exit 1
+fi
+
+$QCOM_LN_RM_MK_DIR/cp -rf ./$QCOM_USBNET_DIR/qmicapture.h $DEST_QCOM_USBNET_PATH
+if [ ! -f $DEST_QCOM_USBNET_PATH/qmicapture.h ]; then
+   echo -e ${RED}"Error: Failed to copy qmicapture.h to installation path"${RESET}
+   $QCOM_LN_RM_MK_DIR/rm -rf $DEST_QCOM_USBNET_PATH
+   exit 1
+fi
+
 $QCOM_LN_RM_MK_DIR/cp -rf ./$QCOM_USBNET_DIR/qmap.c $DEST_QCOM_USBNET_PATH
 if [ ! -f $DEST_QCOM_USBNET_PATH/qmap.c ]; then
    echo -e ${RED}"Error: Failed to copy qmap.c to installation path"${RESET}
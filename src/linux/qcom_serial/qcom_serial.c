@@ -15,6 +15,7 @@ DESCRIPTION:
 #include <linux/usb/serial.h>
 #include <linux/version.h>
 #include <linux/slab.h>
+#include <linux/mutex.h>
 #if (LINUX_VERSION_CODE >= KERNEL_VERSION( 3,2,0 ))
 #include <linux/module.h>
 #endif
@@ -23,6 +24,13 @@ DESCRIPTION:
 #include "../version.h"
 // Debug flag
 static ulong debug;
+#ifdef GOBI_URB_ENGINE
+// Bulk-in and bulk-out URBs per port
+static int ReadUrbs = GOBI_READ_URBS;
+static int WriteUrbs = GOBI_WRITE_URBS;
+#endif
+// Place buffers and receive work on the node of the host controller
+static bool NumaAware = true;
 
 #define CONFIG_USB_CODE
 #ifdef CONFIG_USB_CODE
@@ -32,6 +40,10 @@ fileInfo_t  *gQTIModemFileInfo = NULL;
 static char *gQTIModemInfFilePath = NULL;
 #endif
 
+// Serializes parallel probes on gQTIModemFileInfo and the hooks
+//    installed in the usb_serial_driver
+static DEFINE_MUTEX(gProbeLock);
+
 static const struct usb_device_id GobiConfigVIDPIDTable[] =
 {
    {
@@ -84,6 +96,14 @@ static struct usb_serial_driver gGobiDevice =
    .attach              = GobiAttach,
    .disconnect          = GobiDisconnect,
    .release             = GobiRelease,
+#ifdef GOBI_URB_ENGINE
+   .throttle            = GobiThrottle,
+   .unthrottle          = GobiUnthrottle,
+   .write_room          = GobiWriteRoom,
+   .chars_in_buffer     = GobiCharsInBuffer,
+   .suspend             = GobiSerialSuspend,
+   .resume              = GobiSerialResume,
+#endif
 #if (LINUX_VERSION_CODE < KERNEL_VERSION( 2,6,25 ))
    .num_interrupt_in    = NUM_DONT_CARE,
    .num_bulk_in         = 1,
@@ -233,39 +253,20 @@ void GobiSetDtrRts(gobi_device_context *context, __u16 DtrRts)
 #ifdef CONFIG_USB_CODE
 static int UpdateDeviceInfo(fileInfo_t **pFileInfo, char *pFilePath)
 {
-    int ret;
-
     if (!pFilePath || !pFileInfo)
     {
         DBG("Invalid data\n");
         return -EINVAL;
     }
 
-    ret = QTIDevInfEntrySize(pFilePath);
-    if (ret < 0)
-    {
-        DBG("Failed to get the devices info\n");
-        return ret;
-    }
-
-    *pFileInfo =
-        kzalloc(sizeof(fileInfo_t) + ret * sizeof(devInfo_t), GFP_KERNEL);
-    if (!pFileInfo)
-    {
-        DBG("error in allocating memory\n");
-        return -ENOMEM;
-    }
-
-    (*pFileInfo)->mLength = ret;
-
-    if (QTIDevInfParse(pFilePath, *pFileInfo) < 0)
+    /* Parsed once per file and shared by every driver using it */
+    *pFileInfo = QTIDevInfGet(pFilePath);
+    if (!*pFileInfo)
     {
         DBG("Error in parsing INF file\n");
-        kfree(*pFileInfo);
-        *pFileInfo = NULL;
         return -ENXIO;
     }
-    printk("Number of devices %d ; %d\n", (*pFileInfo)->mNumResp, ret);
+    printk("Number of devices %d\n", (*pFileInfo)->mNumResp);
     return 0;
 }
 #endif
@@ -301,6 +302,7 @@ static int GobiProbe(
    char *path;
    int retval;
 
+   mutex_lock( &gProbeLock );
    path = (gQTIModemInfFilePath != NULL) ? gQTIModemInfFilePath : QTI_MODEM_INF_PATH;
    retval = QTIDevInfCheckFileStatus(gQTIModemFileInfo, path);
 
@@ -312,21 +314,24 @@ static int GobiProbe(
        printk("Update required\n");
        if (gQTIModemFileInfo)
        {
-           kfree(gQTIModemFileInfo);
+           QTIDevInfPut(gQTIModemFileInfo);
            gQTIModemFileInfo = NULL;
        }
        if (UpdateDeviceInfo(&gQTIModemFileInfo, path) < 0)
        {
            DBG("Error in parsing INF file\n");
+           mutex_unlock( &gProbeLock );
            return -ENXIO;
        }
    } else
    {
        printk("Unable to get the status of VID/PID Info\n");
+       mutex_unlock( &gProbeLock );
        return -EIO;
    }
 
    devInfo = QTIDevInfGetDevInfo(pSerial->interface, gQTIModemFileInfo);
+   mutex_unlock( &gProbeLock );
    if (!devInfo)
    {
        printk("USB corresponds to other Iface, (Supports only: %s)\n", path);
@@ -371,6 +376,7 @@ static int GobiProbe(
       DBG( "Could not set interface, error %d\n", nRetval );
    }
    // Check for recursion
+   mutex_lock( &gProbeLock );
    if (pSerial->type->close != GobiClose)
    {
       // Store usb_serial_generic_close in gpClose
@@ -384,6 +390,7 @@ static int GobiProbe(
       gpWrite = pSerial->type->write;
       pSerial->type->write = GobiWrite;
    }
+   mutex_unlock( &gProbeLock );
 
    if (nRetval == 0)
    {
@@ -437,8 +444,13 @@ static int GobiProbe(
    if ((nRetval == 0) && (context == NULL))
    {
       gobi_device_context *myContext;
+      int node = NUMA_NO_NODE;
 
-      context = kzalloc( sizeof(gobi_device_context), GFP_KERNEL );
+      if ((NumaAware == true) && (num_online_nodes() > 1))
+      {
+         node = dev_to_node( pSerial->dev->bus->controller );
+      }
+      context = kzalloc_node( sizeof(gobi_device_context), GFP_KERNEL, node );
       if (context != NULL)
       {
          DBG ("GobiProbe: Created context 0x%p\n", context);
@@ -453,6 +465,7 @@ static int GobiProbe(
          myContext->IntErrCnt = 0;
          myContext->OpenRefCount = 0;
          myContext->DebugMask = debug = 0;
+         myContext->NumaNode = node;
          spin_lock_init(&myContext->AccessLock);
          memset(myContext->PortName, 0, GOBI_PORT_NAME_LEN);
          usb_set_serial_data(pSerial, context);
@@ -482,6 +495,19 @@ int GobiAttach(struct usb_serial *serial)
 
    DBG ("-->GobiAttach\n");
    context = (gobi_device_context *)usb_get_serial_data(serial);
+#ifdef GOBI_URB_ENGINE
+   if (GobiAllocRead(context) != 0)
+   {
+      DBG( "<--GobiAttach: Error allocating read urbs\n" );
+      return -ENOMEM;
+   }
+   if (GobiAllocWrite(context) != 0)
+   {
+      DBG( "<--GobiAttach: Error allocating write urbs\n" );
+      GobiFreeRead(context);
+      return -ENOMEM;
+   }
+#endif
    if (context->bInterruptPresent == 0)
    {
       DBG( "<--GobiAttach: no action\n" );
@@ -492,6 +518,10 @@ int GobiAttach(struct usb_serial *serial)
    if (context->pIntUrb == NULL)
    {
       DBG( "<--GobiAttach: Error allocating int urb\n" );
+#ifdef GOBI_URB_ENGINE
+      GobiFreeRead(context);
+      GobiFreeWrite(context);
+#endif
       return -ENOMEM;
    }
 
@@ -520,6 +550,10 @@ void GobiDisconnect(struct usb_serial *serial)
    if (context != NULL)
    {
       context->bDevRemoved = 1;
+#ifdef GOBI_URB_ENGINE
+      GobiStopRead(context, 1);
+      GobiStopWrite(context, 1);
+#endif
       if (context->pIntUrb != NULL)
       {
          usb_kill_urb(context->pIntUrb);
@@ -565,6 +599,12 @@ void GobiRelease(struct usb_serial *serial)
       {
          GOBI_DBG(context, ("<%s> Interrupt URB cleared\n",  GobiPort(context, NULL)));
       }
+#ifdef GOBI_URB_ENGINE
+      GobiStopRead(context, 1);
+      GobiStopWrite(context, 1);
+      GobiFreeRead(context);
+      GobiFreeWrite(context);
+#endif
       kfree(context);
       context = NULL;
       usb_set_serial_data(serial, NULL);
@@ -820,6 +860,13 @@ int GobiOpen(
       context->OpenRefCount--;
       spin_unlock_irqrestore(&context->AccessLock, flags);
    }
+#ifdef GOBI_URB_ENGINE
+   else
+   {
+      GobiStartRead(context);
+      GobiStartWrite(context);
+   }
+#endif
 
    GobiDBG(context, "<-- ST %d RefCnt %d\n", genericOpenStatus, context->OpenRefCount);
    return genericOpenStatus;
@@ -873,6 +920,10 @@ void GobiClose( struct usb_serial_port * pPort )
 
    context = (gobi_device_context *)usb_get_serial_data(pPort->serial);
    context->bDevClosed = 1;
+#ifdef GOBI_URB_ENGINE
+   GobiStopRead(context, 1);
+   GobiStopWrite(context, 1);
+#endif
    if (context->pIntUrb != NULL)
    {
       GOBI_DBG(NULL, ("<%s> cancel interrupt URB 0x%p\n", GobiPort(NULL, pPort), context->pIntUrb));
@@ -962,9 +1013,852 @@ int GobiWrite
    }
    ***/
    PrintHex(context, buf, count, "SEND");
+#ifdef GOBI_URB_ENGINE
+   if ((context != NULL) && (((gobi_device_context *)context)->WriteUrbCount != 0))
+   {
+      return GobiQueueWrite((gobi_device_context *)context, buf, count);
+   }
+#endif
    return gpWrite(tty, pPort, buf, count);
 }  // GobiWrite
 
+#ifdef GOBI_URB_ENGINE
+
+/*===========================================================================
+METHOD:
+   GobiAllocRead
+
+DESCRIPTION:
+   Allocate the bulk-in URBs of the port and take the read side over from
+   usb_serial_generic, which only runs two URBs of wMaxPacketSize and drops
+   what the tty cannot take
+
+PARAMETERS:
+   context [ I ] - private context for the serial device
+
+RETURN VALUE:
+   int - negative error code on failure
+         zero on success
+===========================================================================*/
+static int GobiAllocRead( gobi_device_context *context )
+{
+   struct usb_serial_port *pPort = context->MySerial->port[0];
+   struct urb *pURB;
+   void *pBuf;
+   int i;
+
+   spin_lock_init(&context->ReadLock);
+   INIT_DELAYED_WORK(&context->ReadWork, GobiReadWork);
+   context->ReadUrbCount = 0;
+   if ((pPort == NULL) || (pPort->bulk_in_size == 0))
+   {
+      return 0;
+   }
+
+   for (i = 0; i < clamp(ReadUrbs, 1, GOBI_READ_URBS_MAX); i++)
+   {
+      pURB = usb_alloc_urb( 0, GFP_KERNEL );
+      pBuf = kmalloc_node( GOBI_READ_BUF_SIZE, GFP_KERNEL, context->NumaNode );
+      if ((pURB == NULL) || (pBuf == NULL))
+      {
+         usb_free_urb(pURB);
+         kfree(pBuf);
+         GobiFreeRead(context);
+         return -ENOMEM;
+      }
+      usb_fill_bulk_urb( pURB,
+                         context->MySerial->dev,
+                         usb_rcvbulkpipe( context->MySerial->dev,
+                                          pPort->bulk_in_endpointAddress ),
+                         pBuf,
+                         GOBI_READ_BUF_SIZE,
+                         GobiReadCallback,
+                         context );
+      context->ReadUrb[i] = pURB;
+      context->ReadUrbCount++;
+   }
+
+   // usb_serial_generic open, close and resume leave the read URBs
+   // of a port without bulk_in_size alone
+   pPort->bulk_in_size = 0;
+   DBG( "%d read urbs of %d bytes\n", context->ReadUrbCount, GOBI_READ_BUF_SIZE );
+   return 0;
+}  // GobiAllocRead
+
+/*===========================================================================
+METHOD:
+   GobiFreeRead
+
+DESCRIPTION:
+   Free the bulk-in URBs, they must not be in flight
+
+PARAMETERS:
+   context [ I ] - private context for the serial device
+
+RETURN VALUE:
+   none
+===========================================================================*/
+static void GobiFreeRead( gobi_device_context *context )
+{
+   int i;
+
+   for (i = 0; i < context->ReadUrbCount; i++)
+   {
+      kfree(context->ReadUrb[i]->transfer_buffer);
+      usb_free_urb(context->ReadUrb[i]);
+      context->ReadUrb[i] = NULL;
+   }
+   context->ReadUrbCount = 0;
+}  // GobiFreeRead
+
+/*===========================================================================
+METHOD:
+   GobiSubmitRead
+
+DESCRIPTION:
+   Submit an idle bulk-in URB, runs within ReadLock
+
+PARAMETERS:
+   context [ I ] - private context for the serial device
+   index   [ I ] - URB to submit
+
+RETURN VALUE:
+   none
+===========================================================================*/
+static void GobiSubmitRead( gobi_device_context *context, int index )
+{
+   int nResult;
+
+   if ((context->bReadRunning == 0) || (context->bDevRemoved != 0))
+   {
+      return;
+   }
+   context->ReadActive |= (1UL << index);
+   nResult = usb_submit_urb( context->ReadUrb[index], GFP_ATOMIC );
+   if (nResult != 0)
+   {
+      // Stays idle until the next open or resume
+      context->ReadActive &= ~(1UL << index);
+      DBG( "failed submitting read urb %d, error %d\n", index, nResult );
+   }
+}  // GobiSubmitRead
+
+/*===========================================================================
+METHOD:
+   GobiPushRead
+
+DESCRIPTION:
+   Move completed URBs into the tty flip buffer in the order they were
+   received and resubmit each one once all of it is delivered, runs
+   within ReadLock. Nothing moves while the tty is throttled, and a full
+   flip buffer is retried later, so no data is dropped.
+
+PARAMETERS:
+   context [ I ] - private context for the serial device
+
+RETURN VALUE:
+   none
+===========================================================================*/
+static void GobiPushRead( gobi_device_context *context )
+{
+   struct usb_serial_port *pPort = context->MySerial->port[0];
+   struct urb *pURB;
+   int index, count, done;
+   int bPushed = 0;
+
+   while ((context->ReadCount != 0) && (context->bReadThrottled == 0))
+   {
+      index = context->ReadQueue[context->ReadHead];
+      pURB = context->ReadUrb[index];
+      count = (pURB->status == 0) ? (pURB->actual_length - context->ReadOffset) : 0;
+      if (count > 0)
+      {
+         done = tty_insert_flip_string( &pPort->port,
+                                        (unsigned char *)pURB->transfer_buffer + context->ReadOffset,
+                                        count );
+         if (done > 0)
+         {
+            PrintHex(context, (unsigned char *)pURB->transfer_buffer + context->ReadOffset, done, "RECV");
+            context->ReadOffset += done;
+            bPushed = 1;
+         }
+         if (done < count)
+         {
+            queue_delayed_work_on(QTIDevInfWorkCpu(context->NumaNode), system_wq, &context->ReadWork,
+                                  msecs_to_jiffies(GOBI_READ_RETRY_MS));
+            break;
+         }
+      }
+
+      context->ReadHead = (context->ReadHead + 1) % GOBI_READ_URBS_MAX;
+      context->ReadCount--;
+      context->ReadOffset = 0;
+      GobiSubmitRead(context, index);
+   }
+
+   if (bPushed != 0)
+   {
+      tty_flip_buffer_push(&pPort->port);
+   }
+}  // GobiPushRead
+
+/*===========================================================================
+METHOD:
+   GobiReadWork
+
+DESCRIPTION:
+   Retry delivery after the flip buffer was full
+
+PARAMETERS:
+   work    [ I ] - ReadWork of the device context
+
+RETURN VALUE:
+   none
+===========================================================================*/
+static void GobiReadWork( struct work_struct *work )
+{
+   gobi_device_context *context = container_of(to_delayed_work(work),
+                                               gobi_device_context, ReadWork);
+   unsigned long flags;
+
+   spin_lock_irqsave(&context->ReadLock, flags);
+   if (context->bReadRunning != 0)
+   {
+      GobiPushRead(context);
+   }
+   spin_unlock_irqrestore(&context->ReadLock, flags);
+}  // GobiReadWork
+
+/*===========================================================================
+METHOD:
+   GobiReadCallback
+
+DESCRIPTION:
+   Queue a completed bulk-in URB for delivery. URBs of one endpoint
+   complete in submission order, so the queue keeps the stream in order.
+
+PARAMETERS:
+   pURB    [ I ] - URB
+
+RETURN VALUE:
+   none
+===========================================================================*/
+static void GobiReadCallback( struct urb * pURB )
+{
+   gobi_device_context *context = (gobi_device_context *)pURB->context;
+   unsigned long flags;
+   int index;
+
+   for (index = 0; index < context->ReadUrbCount; index++)
+   {
+      if (context->ReadUrb[index] == pURB)
+      {
+         break;
+      }
+   }
+
+   spin_lock_irqsave(&context->ReadLock, flags);
+   context->ReadActive &= ~(1UL << index);
+   switch (pURB->status)
+   {
+      case -ENOENT:
+      case -ECONNRESET:
+      case -ESHUTDOWN:
+      case -EPIPE:
+         // Killed, or the pipe is gone; the URB stays idle
+         DBG( "read urb %d stopped, status %d\n", index, pURB->status );
+         break;
+
+      default:
+         // Other errors deliver nothing and resubmit in turn
+         if (pURB->status != 0)
+         {
+            DBG( "read urb %d status %d\n", index, pURB->status );
+         }
+         context->ReadQueue[(context->ReadHead + context->ReadCount) % GOBI_READ_URBS_MAX] = index;
+         context->ReadCount++;
+         GobiPushRead(context);
+         break;
+   }
+   spin_unlock_irqrestore(&context->ReadLock, flags);
+}  // GobiReadCallback
+
+/*===========================================================================
+METHOD:
+   GobiStartRead
+
+DESCRIPTION:
+   Submit every idle bulk-in URB, on open and resume
+
+PARAMETERS:
+   context [ I ] - private context for the serial device
+
+RETURN VALUE:
+   none
+===========================================================================*/
+static void GobiStartRead( gobi_device_context *context )
+{
+   unsigned long flags;
+   int i, queued;
+
+   spin_lock_irqsave(&context->ReadLock, flags);
+   context->bReadRunning = 1;
+   for (i = 0; i < context->ReadUrbCount; i++)
+   {
+      // Completed URBs still waiting for the tty resubmit after delivery
+      for (queued = 0; queued < context->ReadCount; queued++)
+      {
+         if (context->ReadQueue[(context->ReadHead + queued) % GOBI_READ_URBS_MAX] == i)
+         {
+            break;
+         }
+      }
+      if ((queued == context->ReadCount) && !(context->ReadActive & (1UL << i)))
+      {
+         GobiSubmitRead(context, i);
+      }
+   }
+   GobiPushRead(context);
+   spin_unlock_irqrestore(&context->ReadLock, flags);
+}  // GobiStartRead
+
+/*===========================================================================
+METHOD:
+   GobiStopRead
+
+DESCRIPTION:
+   Kill the bulk-in URBs, on close, suspend and disconnect
+
+PARAMETERS:
+   context [ I ] - private context for the serial device
+   bFlush  [ I ] - also drop received data not delivered yet
+
+RETURN VALUE:
+   none
+===========================================================================*/
+static void GobiStopRead( gobi_device_context *context, int bFlush )
+{
+   unsigned long flags;
+   int i;
+
+   spin_lock_irqsave(&context->ReadLock, flags);
+   context->bReadRunning = 0;
+   spin_unlock_irqrestore(&context->ReadLock, flags);
+
+   for (i = 0; i < context->ReadUrbCount; i++)
+   {
+      usb_kill_urb(context->ReadUrb[i]);
+   }
+   cancel_delayed_work_sync(&context->ReadWork);
+
+   if (bFlush != 0)
+   {
+      spin_lock_irqsave(&context->ReadLock, flags);
+      context->ReadHead = context->ReadCount = context->ReadOffset = 0;
+      context->bReadThrottled = 0;
+      spin_unlock_irqrestore(&context->ReadLock, flags);
+   }
+}  // GobiStopRead
+
+/*===========================================================================
+METHOD:
+   GobiAllocWrite
+
+DESCRIPTION:
+   Allocate the bulk-out URBs of the port. usb_serial_generic sends one
+   wMaxPacketSize URB at a time out of a small FIFO, so every write()
+   waits for a round trip.
+
+PARAMETERS:
+   context [ I ] - private context for the serial device
+
+RETURN VALUE:
+   int - negative error code on failure
+         zero on success
+===========================================================================*/
+static int GobiAllocWrite( gobi_device_context *context )
+{
+   struct usb_serial_port *pPort = context->MySerial->port[0];
+   struct urb *pURB;
+   void *pBuf;
+   int i;
+
+   spin_lock_init(&context->WriteLock);
+   context->WriteUrbCount = 0;
+   context->WriteFill = -1;
+   context->WriteFillLen = 0;
+   if ((pPort == NULL) || (pPort->bulk_out_size == 0))
+   {
+      return 0;
+   }
+
+   for (i = 0; i < clamp(WriteUrbs, 1, GOBI_WRITE_URBS_MAX); i++)
+   {
+      pURB = usb_alloc_urb( 0, GFP_KERNEL );
+      pBuf = kmalloc_node( GOBI_WRITE_BUF_SIZE, GFP_KERNEL, context->NumaNode );
+      if ((pURB == NULL) || (pBuf == NULL))
+      {
+         usb_free_urb(pURB);
+         kfree(pBuf);
+         GobiFreeWrite(context);
+         return -ENOMEM;
+      }
+      usb_fill_bulk_urb( pURB,
+                         context->MySerial->dev,
+                         usb_sndbulkpipe( context->MySerial->dev,
+                                          pPort->bulk_out_endpointAddress ),
+                         pBuf,
+                         GOBI_WRITE_BUF_SIZE,
+                         GobiWriteCallback,
+                         context );
+      context->WriteUrb[i] = pURB;
+      context->WriteUrbCount++;
+   }
+   context->WriteFill = 0;
+   DBG( "%d write urbs of %d bytes\n", context->WriteUrbCount, GOBI_WRITE_BUF_SIZE );
+   return 0;
+}  // GobiAllocWrite
+
+/*===========================================================================
+METHOD:
+   GobiFreeWrite
+
+DESCRIPTION:
+   Free the bulk-out URBs, they must not be in flight
+
+PARAMETERS:
+   context [ I ] - private context for the serial device
+
+RETURN VALUE:
+   none
+===========================================================================*/
+static void GobiFreeWrite( gobi_device_context *context )
+{
+   int i;
+
+   for (i = 0; i < context->WriteUrbCount; i++)
+   {
+      kfree(context->WriteUrb[i]->transfer_buffer);
+      usb_free_urb(context->WriteUrb[i]);
+      context->WriteUrb[i] = NULL;
+   }
+   context->WriteUrbCount = 0;
+   context->WriteFill = -1;
+   context->WriteFillLen = 0;
+}  // GobiFreeWrite
+
+/*===========================================================================
+METHOD:
+   GobiNextWriteFill
+
+DESCRIPTION:
+   Pick an idle bulk-out URB to collect the next writes, runs within
+   WriteLock
+
+PARAMETERS:
+   context [ I ] - private context for the serial device
+
+RETURN VALUE:
+   none
+===========================================================================*/
+static void GobiNextWriteFill( gobi_device_context *context )
+{
+   int i;
+
+   context->WriteFill = -1;
+   context->WriteFillLen = 0;
+   for (i = 0; i < context->WriteUrbCount; i++)
+   {
+      if (!(context->WriteActive & (1UL << i)))
+      {
+         context->WriteFill = i;
+         break;
+      }
+   }
+}  // GobiNextWriteFill
+
+/*===========================================================================
+METHOD:
+   GobiSubmitWrite
+
+DESCRIPTION:
+   Send the data collected in the fill URB, runs within WriteLock.
+   URB_ZERO_PACKET ends a transfer of whole max size packets with a
+   zero length packet, so the device sees where it stops.
+
+PARAMETERS:
+   context [ I ] - private context for the serial device
+
+RETURN VALUE:
+   none
+===========================================================================*/
+static void GobiSubmitWrite( gobi_device_context *context )
+{
+   int index = context->WriteFill;
+   struct urb *pURB = context->WriteUrb[index];
+   int nResult;
+
+   pURB->transfer_buffer_length = context->WriteFillLen;
+   pURB->transfer_flags |= URB_ZERO_PACKET;
+   context->WriteActive |= (1UL << index);
+   nResult = usb_submit_urb( pURB, GFP_ATOMIC );
+   if (nResult != 0)
+   {
+      // The data is lost, as with a failed transfer
+      context->WriteActive &= ~(1UL << index);
+      DBG( "failed submitting write urb %d, error %d\n", index, nResult );
+   }
+   GobiNextWriteFill(context);
+}  // GobiSubmitWrite
+
+/*===========================================================================
+METHOD:
+   GobiQueueWrite
+
+DESCRIPTION:
+   Copy write data into the fill URB. A full URB is sent at once; a
+   partial one is sent right away when nothing is in flight, otherwise
+   it keeps collecting until the next completion.
+
+PARAMETERS:
+   context [ I ] - private context for the serial device
+   buf     [ I ] - buffer containing the USB bulk OUT data
+   count   [ I ] - number of bytes of the USB bulk OUT data
+
+RETURN VALUE:
+   int - number of bytes accepted, less than count when all URBs are busy
+===========================================================================*/
+static int GobiQueueWrite
+(
+   gobi_device_context *context,
+   const unsigned char *buf,
+   int                 count
+)
+{
+   unsigned long flags;
+   int done = 0;
+   int size;
+
+   spin_lock_irqsave(&context->WriteLock, flags);
+   if (context->bWriteRunning == 0)
+   {
+      spin_unlock_irqrestore(&context->WriteLock, flags);
+      return -EIO;
+   }
+   while ((done < count) && (context->WriteFill >= 0))
+   {
+      size = min(count - done, GOBI_WRITE_BUF_SIZE - context->WriteFillLen);
+      memcpy( (unsigned char *)context->WriteUrb[context->WriteFill]->transfer_buffer
+              + context->WriteFillLen, buf + done, size );
+      context->WriteFillLen += size;
+      done += size;
+      if (context->WriteFillLen == GOBI_WRITE_BUF_SIZE)
+      {
+         GobiSubmitWrite(context);
+      }
+   }
+   if ((context->WriteFill >= 0) && (context->WriteFillLen != 0) && (context->WriteActive == 0))
+   {
+      GobiSubmitWrite(context);
+   }
+   spin_unlock_irqrestore(&context->WriteLock, flags);
+   return done;
+}  // GobiQueueWrite
+
+/*===========================================================================
+METHOD:
+   GobiWriteCallback
+
+DESCRIPTION:
+   Send what was collected while the URB was in flight and wake writers
+
+PARAMETERS:
+   pURB    [ I ] - URB
+
+RETURN VALUE:
+   none
+===========================================================================*/
+static void GobiWriteCallback( struct urb * pURB )
+{
+   gobi_device_context *context = (gobi_device_context *)pURB->context;
+   unsigned long flags;
+   int index;
+
+   for (index = 0; index < context->WriteUrbCount; index++)
+   {
+      if (context->WriteUrb[index] == pURB)
+      {
+         break;
+      }
+   }
+   if (pURB->status != 0)
+   {
+      DBG( "write urb %d status %d\n", index, pURB->status );
+   }
+
+   spin_lock_irqsave(&context->WriteLock, flags);
+   context->WriteActive &= ~(1UL << index);
+   if (context->WriteFill < 0)
+   {
+      GobiNextWriteFill(context);
+   }
+   else if ((context->WriteFillLen != 0) && (context->bWriteRunning != 0))
+   {
+      GobiSubmitWrite(context);
+   }
+   spin_unlock_irqrestore(&context->WriteLock, flags);
+
+   usb_serial_port_softint(context->MySerial->port[0]);
+}  // GobiWriteCallback
+
+/*===========================================================================
+METHOD:
+   GobiStartWrite
+
+DESCRIPTION:
+   Accept writes, on open and resume; data kept over a suspend is sent
+
+PARAMETERS:
+   context [ I ] - private context for the serial device
+
+RETURN VALUE:
+   none
+===========================================================================*/
+static void GobiStartWrite( gobi_device_context *context )
+{
+   unsigned long flags;
+
+   spin_lock_irqsave(&context->WriteLock, flags);
+   context->bWriteRunning = 1;
+   if ((context->WriteFill >= 0) && (context->WriteFillLen != 0) && (context->WriteActive == 0))
+   {
+      GobiSubmitWrite(context);
+   }
+   spin_unlock_irqrestore(&context->WriteLock, flags);
+}  // GobiStartWrite
+
+/*===========================================================================
+METHOD:
+   GobiStopWrite
+
+DESCRIPTION:
+   Kill the bulk-out URBs, on close, suspend and disconnect
+
+PARAMETERS:
+   context [ I ] - private context for the serial device
+   bFlush  [ I ] - also drop data not sent yet
+
+RETURN VALUE:
+   none
+===========================================================================*/
+static void GobiStopWrite( gobi_device_context *context, int bFlush )
+{
+   unsigned long flags;
+   int i;
+
+   spin_lock_irqsave(&context->WriteLock, flags);
+   context->bWriteRunning = 0;
+   spin_unlock_irqrestore(&context->WriteLock, flags);
+
+   for (i = 0; i < context->WriteUrbCount; i++)
+   {
+      usb_kill_urb(context->WriteUrb[i]);
+   }
+
+   spin_lock_irqsave(&context->WriteLock, flags);
+   if ((bFlush != 0) || (context->WriteFill < 0))
+   {
+      GobiNextWriteFill(context);
+   }
+   spin_unlock_irqrestore(&context->WriteLock, flags);
+}  // GobiStopWrite
+
+/*===========================================================================
+METHOD:
+   GobiWriteRoom
+
+DESCRIPTION:
+   Bytes a write would accept now
+
+PARAMETERS:
+   tty     [ I ] - TTY structure associated with the serial device
+
+RETURN VALUE:
+   free space of the fill URB and the idle URBs behind it
+===========================================================================*/
+static GOBI_TTY_COUNT GobiWriteRoom( struct tty_struct *tty )
+{
+   struct usb_serial_port *pPort = tty->driver_data;
+   gobi_device_context *context = usb_get_serial_data(pPort->serial);
+   unsigned long flags;
+   int room = 0;
+   int i;
+
+   if (context->WriteUrbCount == 0)
+   {
+      return usb_serial_generic_write_room(tty);
+   }
+   spin_lock_irqsave(&context->WriteLock, flags);
+   if (context->WriteFill >= 0)
+   {
+      for (i = 0; i < context->WriteUrbCount; i++)
+      {
+         if (!(context->WriteActive & (1UL << i)))
+         {
+            room += GOBI_WRITE_BUF_SIZE;
+         }
+      }
+      room -= context->WriteFillLen;
+   }
+   spin_unlock_irqrestore(&context->WriteLock, flags);
+   return room;
+}  // GobiWriteRoom
+
+/*===========================================================================
+METHOD:
+   GobiCharsInBuffer
+
+DESCRIPTION:
+   Bytes accepted but not sent yet, so close and tcdrain wait for them
+
+PARAMETERS:
+   tty     [ I ] - TTY structure associated with the serial device
+
+RETURN VALUE:
+   bytes in flight and in the fill URB
+===========================================================================*/
+static GOBI_TTY_COUNT GobiCharsInBuffer( struct tty_struct *tty )
+{
+   struct usb_serial_port *pPort = tty->driver_data;
+   gobi_device_context *context = usb_get_serial_data(pPort->serial);
+   unsigned long flags;
+   int chars;
+   int i;
+
+   if (context->WriteUrbCount == 0)
+   {
+      return usb_serial_generic_chars_in_buffer(tty);
+   }
+   spin_lock_irqsave(&context->WriteLock, flags);
+   chars = (context->WriteFill >= 0) ? context->WriteFillLen : 0;
+   for (i = 0; i < context->WriteUrbCount; i++)
+   {
+      if (context->WriteActive & (1UL << i))
+      {
+         chars += context->WriteUrb[i]->transfer_buffer_length;
+      }
+   }
+   spin_unlock_irqrestore(&context->WriteLock, flags);
+   return chars;
+}  // GobiCharsInBuffer
+
+/*===========================================================================
+METHOD:
+   GobiThrottle
+
+DESCRIPTION:
+   Hold completed URBs back instead of delivering and resubmitting them.
+   URBs already in flight complete into the queue.
+
+PARAMETERS:
+   tty     [ I ] - TTY structure associated with the serial device
+
+RETURN VALUE:
+   none
+===========================================================================*/
+static void GobiThrottle( struct tty_struct *tty )
+{
+   struct usb_serial_port *pPort = tty->driver_data;
+   gobi_device_context *context = usb_get_serial_data(pPort->serial);
+   unsigned long flags;
+
+   spin_lock_irqsave(&context->ReadLock, flags);
+   context->bReadThrottled = 1;
+   spin_unlock_irqrestore(&context->ReadLock, flags);
+}  // GobiThrottle
+
+/*===========================================================================
+METHOD:
+   GobiUnthrottle
+
+DESCRIPTION:
+   Deliver the held URBs and resubmit them
+
+PARAMETERS:
+   tty     [ I ] - TTY structure associated with the serial device
+
+RETURN VALUE:
+   none
+===========================================================================*/
+static void GobiUnthrottle( struct tty_struct *tty )
+{
+   struct usb_serial_port *pPort = tty->driver_data;
+   gobi_device_context *context = usb_get_serial_data(pPort->serial);
+   unsigned long flags;
+
+   spin_lock_irqsave(&context->ReadLock, flags);
+   context->bReadThrottled = 0;
+   GobiPushRead(context);
+   spin_unlock_irqrestore(&context->ReadLock, flags);
+}  // GobiUnthrottle
+
+/*===========================================================================
+METHOD:
+   GobiSerialSuspend
+
+DESCRIPTION:
+   Stop the bulk URBs, usb_serial_suspend stops the other port URBs.
+   Received data not delivered yet and writes not sent yet are kept.
+
+PARAMETERS:
+   serial  [ I ] - Serial structure
+   message [ I ] - Power management event
+
+RETURN VALUE:
+   int - zero
+===========================================================================*/
+static int GobiSerialSuspend( struct usb_serial *serial, pm_message_t message )
+{
+   gobi_device_context *context = usb_get_serial_data(serial);
+
+   if (context != NULL)
+   {
+      GobiStopRead(context, 0);
+      GobiStopWrite(context, 0);
+   }
+   return 0;
+}  // GobiSerialSuspend
+
+/*===========================================================================
+METHOD:
+   GobiSerialResume
+
+DESCRIPTION:
+   Resume the port through usb_serial_generic_resume and restart the
+   bulk URBs of an open port
+
+PARAMETERS:
+   serial  [ I ] - Serial structure
+
+RETURN VALUE:
+   int - negative errno from usb_serial_generic_resume, or zero
+===========================================================================*/
+static int GobiSerialResume( struct usb_serial *serial )
+{
+   gobi_device_context *context = usb_get_serial_data(serial);
+   int nResult;
+
+   nResult = usb_serial_generic_resume(serial);
+   if ((context != NULL) && (context->bDevClosed == 0) && (context->OpenRefCount > 0))
+   {
+      GobiStartRead(context);
+      GobiStartWrite(context);
+   }
+   return nResult;
+}  // GobiSerialResume
+
+#endif // GOBI_URB_ENGINE
+
 #if (LINUX_VERSION_CODE < KERNEL_VERSION( 2,6,25 ))
 
 /*===========================================================================
@@ -1191,7 +2085,7 @@ static int __init GobiInit( void )
 #ifdef CONFIG_USB_CODE
      if (gQTIModemFileInfo)
      {
-         kfree(gQTIModemFileInfo);
+         QTIDevInfPut(gQTIModemFileInfo);
          gQTIModemFileInfo = NULL;
      }
 #endif
@@ -1207,7 +2101,7 @@ static int __init GobiInit( void )
 #ifdef CONFIG_USB_CODE
      if (gQTIModemFileInfo)
      {
-         kfree(gQTIModemFileInfo);
+         QTIDevInfPut(gQTIModemFileInfo);
          gQTIModemFileInfo = NULL;
      }
 #endif
@@ -1257,6 +2151,15 @@ MODULE_LICENSE("Dual BSD/GPL");
 module_param( debug, ulong, S_IRUGO | S_IWUSR );
 MODULE_PARM_DESC( debug, "Debug enabled or not" );
 
+#ifdef GOBI_URB_ENGINE
+module_param( ReadUrbs, int, S_IRUGO | S_IWUSR );
+MODULE_PARM_DESC( ReadUrbs, "Bulk-in URBs per port, 1 - 16, read when a device is attached" );
+module_param( WriteUrbs, int, S_IRUGO | S_IWUSR );
+MODULE_PARM_DESC( WriteUrbs, "Bulk-out URBs per port, 1 - 16, read when a device is attached" );
+#endif
+module_param( NumaAware, bool, S_IRUGO | S_IWUSR );
+MODULE_PARM_DESC( NumaAware, "Allocate on the NUMA node of the USB host controller, read when a device is probed" );
+
 module_param(gQTIModemInfFilePath, charp, S_IRUGO | S_IWUSR );
 MODULE_PARM_DESC(gQTIModemInfFilePath, "Inf File location (Need complete path)");
 
@@ -27,6 +27,28 @@ DESCRIPTION:
 #define GOBI_SER_DTR       0x01
 #define GOBI_SER_RTS       0x02
 
+// Bulk URB engine: several URBs per port in each direction.
+// Reads are delivered in order and held instead of dropped while the
+// tty is throttled or full, small writes are merged while others are
+// in flight.
+#if (LINUX_VERSION_CODE >= KERNEL_VERSION( 3,9,0 ))
+#define GOBI_URB_ENGINE
+#endif
+#define GOBI_READ_URBS       4      // default of the ReadUrbs parameter
+#define GOBI_READ_URBS_MAX   16
+#define GOBI_READ_BUF_SIZE   8192
+#define GOBI_READ_RETRY_MS   10     // flip buffer full, retry delivery
+#define GOBI_WRITE_URBS      4      // default of the WriteUrbs parameter
+#define GOBI_WRITE_URBS_MAX  16
+#define GOBI_WRITE_BUF_SIZE  16384  // a multiple of every bulk max packet size
+
+// write_room and chars_in_buffer return unsigned int from 5.14
+#if (LINUX_VERSION_CODE >= KERNEL_VERSION( 5,14,0 ))
+#define GOBI_TTY_COUNT unsigned int
+#else
+#define GOBI_TTY_COUNT int
+#endif
+
 // Global pointer to usb_serial_generic_close function
 // This function is not exported, which is why we have to use a pointer
 // instead of just calling it.
@@ -82,6 +104,27 @@ typedef struct _gobi_device_context
    spinlock_t AccessLock;
    ulong      DebugMask;
    char       PortName[GOBI_PORT_NAME_LEN];
+   int        NumaNode;                         // node of the host controller, NUMA_NO_NODE for any
+#ifdef GOBI_URB_ENGINE
+   struct urb *ReadUrb[GOBI_READ_URBS_MAX];
+   int        ReadUrbCount;
+   spinlock_t ReadLock;
+   int        bReadRunning;
+   int        bReadThrottled;
+   ulong      ReadActive;                       // bit per URB in flight
+   int        ReadQueue[GOBI_READ_URBS_MAX];    // completed URBs, oldest first
+   int        ReadHead;
+   int        ReadCount;
+   int        ReadOffset;                       // bytes of the oldest already delivered
+   struct delayed_work ReadWork;
+   struct urb *WriteUrb[GOBI_WRITE_URBS_MAX];
+   int        WriteUrbCount;
+   spinlock_t WriteLock;
+   int        bWriteRunning;
+   ulong      WriteActive;                      // bit per URB in flight
+   int        WriteFill;                        // idle URB collecting data, -1 if none
+   int        WriteFillLen;
+#endif
 } gobi_device_context;
 
 /*=========================================================================*/
@@ -147,6 +190,28 @@ void IntCallback( struct urb * pIntUrb );
 int  ResubmitIntURB( struct urb * pIntUrb );
 #endif
 
+#ifdef GOBI_URB_ENGINE
+// Multi-URB bulk paths replacing usb_serial_generic's URBs
+static int  GobiAllocRead( gobi_device_context *context );
+static void GobiFreeRead( gobi_device_context *context );
+static void GobiReadWork( struct work_struct *work );
+static void GobiReadCallback( struct urb * pURB );
+static void GobiStartRead( gobi_device_context *context );
+static void GobiStopRead( gobi_device_context *context, int bFlush );
+static void GobiThrottle( struct tty_struct *tty );
+static void GobiUnthrottle( struct tty_struct *tty );
+static int  GobiAllocWrite( gobi_device_context *context );
+static void GobiFreeWrite( gobi_device_context *context );
+static void GobiWriteCallback( struct urb * pURB );
+static int  GobiQueueWrite( gobi_device_context *context, const unsigned char *buf, int count );
+static void GobiStartWrite( gobi_device_context *context );
+static void GobiStopWrite( gobi_device_context *context, int bFlush );
+static GOBI_TTY_COUNT GobiWriteRoom( struct tty_struct *tty );
+static GOBI_TTY_COUNT GobiCharsInBuffer( struct tty_struct *tty );
+static int  GobiSerialSuspend( struct usb_serial *serial, pm_message_t message );
+static int  GobiSerialResume( struct usb_serial *serial );
+#endif
+
 #if (LINUX_VERSION_CODE < KERNEL_VERSION( 2,6,25 ))
 // Read data from USB, push to TTY and user space
 static void GobiReadBulkCallback( struct urb * pURB );
@@ -93,6 +93,9 @@ typedef struct _fileInfo {
     deviceClass         mClass;     /**< INF/Config file class  */
     unsigned int        mLength;    /**< Number of devices can occupy */
     unsigned int        mNumResp;   /**< Number of devices present */
+    unsigned int        mHashBits;  /**< log2 of the index buckets, 0 if no index */
+    int                 *mpHashHead;/**< first entry of each bucket, -1 if empty */
+    int                 *mpHashNext;/**< next entry of the same bucket */
     struct _devInfo     mDevInfo[0];
 }fileInfo_t;
 
@@ -117,12 +120,60 @@ void* QTIDevInfGetDevInfo(struct usb_interface *pIface, fileInfo_t *pFileInfo);
  * @param   pFileInfo    global Ctx, contains INF info
  * @param   pFilePath    INF/Config file path
  *
- * @returns true    - If no change in config file
- *          false   - Config file got modified
- *          negative error - If file got corrupted/removed
+ * Only looks at the cached state, the file itself is checked by
+ * QTIDevInfReload.
+ *
+ * @returns false   - If no change in config file
+ *          true    - Config file got modified or 'pFilePath' changed
+ *          negative error - If the data is invalid
  */
 int QTIDevInfCheckFileStatus(fileInfo_t *pFileInfo, char *pFilePath);
 
+/**
+ * @brief To read and parse the INF/config file in one pass
+ *
+ * Reads 'pFilePath' into memory with a single read and extracts the
+ * device info while counting it. The parse time is logged.
+ *
+ * @param   pFilePath    INF/Config file path
+ *
+ * @returns device info to be freed with kfree on Success
+ *          NULL - If file got corrupted/removed/invalid
+ */
+fileInfo_t *QTIDevInfLoad(char *pFilePath);
+
+/**
+ * @brief To get the shared device info of an INF/config file
+ *
+ * The first caller for 'pFilePath' reads and parses the file, later
+ * callers share the same data until the last QTIDevInfPut. Lookups with
+ * QTIDevInfGetDevInfo use a hash index on VID/PID/interface.
+ *
+ * @param   pFilePath    INF/Config file path
+ *
+ * @returns device info on Success
+ *          NULL - If file got corrupted/removed/invalid
+ */
+fileInfo_t *QTIDevInfGet(char *pFilePath);
+
+/**
+ * @brief To drop a reference taken with QTIDevInfGet
+ *
+ * @param   pFileInfo    device info returned by QTIDevInfGet, may be NULL
+ */
+void QTIDevInfPut(fileInfo_t *pFileInfo);
+
+/**
+ * @brief To check the cached INF/config files against the filesystem
+ *
+ * Files whose inode, size or modification time changed are parsed again
+ * by the next QTIDevInfGet. Also run by writing 1 to the Reload
+ * parameter of qtiDevInf.
+ *
+ * @returns number of changed files
+ */
+int QTIDevInfReload(void);
+
 /**
  * @brief To get number of entries present in INF/config file
  *
@@ -0,0 +1,207 @@
+/*
+    Copyright (c) Qualcomm Technologies, Inc. and/or its subsidiaries.
+    SPDX-License-Identifier: BSD-3-Clause
+*/
+
+#include <linux/kernel.h>
+#include <linux/version.h>
+#include <linux/ktime.h>
+#include <linux/log2.h>
+#include <linux/math64.h>
+#include <linux/cpumask.h>
+#include <linux/kernel_stat.h>
+#include "qcom_bench.h"
+
+#if (LINUX_VERSION_CODE < KERNEL_VERSION(4,11,0))
+#define QTIDEV_CPUTIME_NS(t)  cputime_to_nsecs(t)
+#else
+#define QTIDEV_CPUTIME_NS(t)  (t)
+#endif
+
+/* CPU time of all CPUs, busy and its kernel part */
+static void BenchCpuTime(__u64 *pBusyNs, __u64 *pSysNs)
+{
+    __u64 busy = 0;
+    __u64 sys = 0;
+    __u64 *cpustat;
+    int cpu;
+
+    for_each_possible_cpu(cpu)
+    {
+        cpustat = kcpustat_cpu(cpu).cpustat;
+        sys += QTIDEV_CPUTIME_NS(cpustat[CPUTIME_SYSTEM]) +
+               QTIDEV_CPUTIME_NS(cpustat[CPUTIME_IRQ]) +
+               QTIDEV_CPUTIME_NS(cpustat[CPUTIME_SOFTIRQ]);
+        busy += QTIDEV_CPUTIME_NS(cpustat[CPUTIME_USER]) +
+                QTIDEV_CPUTIME_NS(cpustat[CPUTIME_NICE]);
+    }
+    *pBusyNs = busy + sys;
+    *pSysNs = sys;
+}
+
+void QTIDevBenchInit(sQTIDevBench *pBench)
+{
+    memset(pBench, 0, sizeof(sQTIDevBench));
+    spin_lock_init(&pBench->mLock);
+}
+
+void QTIDevBenchStart(sQTIDevBench *pBench)
+{
+    unsigned long flags;
+    __u64 busy;
+    __u64 sys;
+
+    BenchCpuTime(&busy, &sys);
+    spin_lock_irqsave(&pBench->mLock, flags);
+    memset(&pBench->mRx, 0, sizeof(sQTIDevBenchDir));
+    memset(&pBench->mTx, 0, sizeof(sQTIDevBenchDir));
+    pBench->mCpuBusyNs = busy;
+    pBench->mCpuSysNs = sys;
+    pBench->mCpus = num_online_cpus();
+    pBench->mStartNs = ktime_get_ns();
+    pBench->mStopNs = 0;
+    WRITE_ONCE(pBench->mbRunning, true);
+    spin_unlock_irqrestore(&pBench->mLock, flags);
+}
+
+void QTIDevBenchStop(sQTIDevBench *pBench)
+{
+    unsigned long flags;
+    __u64 busy;
+    __u64 sys;
+
+    BenchCpuTime(&busy, &sys);
+    spin_lock_irqsave(&pBench->mLock, flags);
+    if (pBench->mbRunning)
+    {
+        WRITE_ONCE(pBench->mbRunning, false);
+        pBench->mStopNs = ktime_get_ns();
+        pBench->mCpuBusyNs = busy - pBench->mCpuBusyNs;
+        pBench->mCpuSysNs = sys - pBench->mCpuSysNs;
+    }
+    spin_unlock_irqrestore(&pBench->mLock, flags);
+}
+
+// Completion of a URB stamped with QTIDevBenchStamp(), any context
+void QTIDevBenchUrb(sQTIDevBench *pBench, bool bRx, __u64 submitNs, unsigned int bytes, int status)
+{
+    sQTIDevBenchDir *pDir = bRx ? &pBench->mRx : &pBench->mTx;
+    unsigned long flags;
+    __u64 latency;
+    __u64 us;
+    int bucket;
+
+    if ((submitNs == 0) || !READ_ONCE(pBench->mbRunning))
+        return;
+
+    latency = ktime_get_ns() - submitNs;
+    us = div_u64(latency, NSEC_PER_USEC);
+    bucket = (us == 0) ? 0 : min_t(int, ilog2(us) + 1, QTIDEV_BENCH_BUCKETS - 1);
+
+    spin_lock_irqsave(&pBench->mLock, flags);
+    /* Stamped before the window started over */
+    if (pBench->mbRunning && (submitNs >= pBench->mStartNs))
+    {
+        pDir->mUrbs++;
+        pDir->mBytes += bytes;
+        if (status != 0)
+            pDir->mErrors++;
+        pDir->mHist[bucket]++;
+        if (latency > pDir->mMaxNs)
+            pDir->mMaxNs = latency;
+    }
+    spin_unlock_irqrestore(&pBench->mLock, flags);
+}
+
+/* Upper bound in us of the bucket holding the given per mille of the URBs */
+static __u64 BenchPercentile(const sQTIDevBenchDir *pDir, unsigned int perMille)
+{
+    __u64 want = div_u64(pDir->mUrbs * perMille + 999, 1000);
+    __u64 seen = 0;
+    int bucket;
+
+    for (bucket = 0; bucket < QTIDEV_BENCH_BUCKETS; bucket++)
+    {
+        seen += pDir->mHist[bucket];
+        if ((seen != 0) && (seen >= want))
+            return 1ULL << bucket;
+    }
+    return 1ULL << (QTIDEV_BENCH_BUCKETS - 1);
+}
+
+static int BenchShowDir(const char *name, const sQTIDevBenchDir *pDir, __u64 elapsedUs, char *buf)
+{
+    /* bytes per us are MB/s */
+    __u64 rate = div64_u64(pDir->mBytes * 100, max_t(__u64, elapsedUs, 1));
+    __u32 hundredths;
+    __u64 whole = div_u64_rem(rate, 100, &hundredths);
+
+    return sprintf(buf, "%s: %llu bytes %llu urbs %llu errors %llu.%02u MB/s "
+            "latency us p50 %llu p90 %llu p99 %llu p99.9 %llu max %llu\n",
+            name, pDir->mBytes, pDir->mUrbs, pDir->mErrors, whole, hundredths,
+            BenchPercentile(pDir, 500), BenchPercentile(pDir, 900),
+            BenchPercentile(pDir, 990), BenchPercentile(pDir, 999),
+            div_u64(pDir->mMaxNs, NSEC_PER_USEC));
+}
+
+/* The counters of sQTIDevBench without its lock */
+typedef struct sQTIDevBenchSnap
+{
+    bool                mbRunning;
+    __u64               mStartNs;
+    __u64               mStopNs;
+    __u64               mCpuBusyNs;
+    __u64               mCpuSysNs;
+    unsigned int        mCpus;
+    sQTIDevBenchDir     mRx;
+    sQTIDevBenchDir     mTx;
+} sQTIDevBenchSnap;
+
+ssize_t QTIDevBenchShow(sQTIDevBench *pBench, char *buf)
+{
+    sQTIDevBenchSnap snap;
+    unsigned long flags;
+    __u64 elapsedNs;
+    __u64 elapsedSec;
+    __u32 elapsedRemNs;
+    __u64 cpuNs;
+    __u64 busy;
+    __u64 sys;
+    int len;
+
+    BenchCpuTime(&busy, &sys);
+    spin_lock_irqsave(&pBench->mLock, flags);
+    snap.mbRunning = pBench->mbRunning;
+    snap.mStartNs = pBench->mStartNs;
+    snap.mStopNs = pBench->mStopNs;
+    snap.mCpuBusyNs = pBench->mCpuBusyNs;
+    snap.mCpuSysNs = pBench->mCpuSysNs;
+    snap.mCpus = pBench->mCpus;
+    snap.mRx = pBench->mRx;
+    snap.mTx = pBench->mTx;
+    spin_unlock_irqrestore(&pBench->mLock, flags);
+
+    if (snap.mStartNs == 0)
+        return sprintf(buf, "idle\n");
+
+    if (snap.mbRunning)
+    {
+        elapsedNs = ktime_get_ns() - snap.mStartNs;
+        snap.mCpuBusyNs = busy - snap.mCpuBusyNs;
+        snap.mCpuSysNs = sys - snap.mCpuSysNs;
+    }
+    else
+    {
+        elapsedNs = snap.mStopNs - snap.mStartNs;
+    }
+    cpuNs = max_t(__u64, elapsedNs * snap.mCpus, 1);
+
+    elapsedSec = div_u64_rem(elapsedNs, NSEC_PER_SEC, &elapsedRemNs);
+    len = sprintf(buf, "%s: %llu.%03u s\n", snap.mbRunning ? "running" : "stopped",
+            elapsedSec, (__u32)(elapsedRemNs / NSEC_PER_MSEC));
+    len += BenchShowDir("rx", &snap.mRx, div_u64(elapsedNs, NSEC_PER_USEC), buf + len);
+    len += BenchShowDir("tx", &snap.mTx, div_u64(elapsedNs, NSEC_PER_USEC), buf + len);
+    len += sprintf(buf + len, "cpu: %llu%% busy %llu%% kernel of %u CPUs\n",
+            div64_u64(snap.mCpuBusyNs * 100, cpuNs), div64_u64(snap.mCpuSysNs * 100, cpuNs), snap.mCpus);
+    return len;
+}
@@ -0,0 +1,61 @@
+/*
+    Copyright (c) Qualcomm Technologies, Inc. and/or its subsidiaries.
+    SPDX-License-Identifier: BSD-3-Clause
+*/
+
+#ifndef QTIBENCH_H
+#define QTIBENCH_H
+
+#include <linux/types.h>
+#include <linux/spinlock.h>
+
+/*
+ * Throughput benchmark
+ *
+ * Writing 1 to the Bench sysfs file of a node starts a measurement
+ * window, 0 ends it.  While it runs, the bulk URBs of read() and write()
+ * are timed from submission to completion, and reading Bench reports the
+ * bytes moved, MB/s, completion latency percentiles and the CPU time the
+ * whole system spent over the window.  Traffic comes from the usual
+ * read()/write() callers, e.g. dd against a sink/source or loopback
+ * gadget function.
+ */
+
+/* Latency histogram, bucket n counts completions under 2^n us */
+#define QTIDEV_BENCH_BUCKETS     24
+
+typedef struct sQTIDevBenchDir
+{
+    __u64               mBytes;
+    __u64               mUrbs;
+    __u64               mErrors;
+    __u64               mMaxNs;
+    __u32               mHist[QTIDEV_BENCH_BUCKETS];
+} sQTIDevBenchDir;
+
+typedef struct sQTIDevBench
+{
+    spinlock_t          mLock;
+    bool                mbRunning;
+    __u64               mStartNs;
+    __u64               mStopNs;
+    __u64               mCpuBusyNs;  /* system wide, at start then over the window */
+    __u64               mCpuSysNs;   /* kernel, irq and softirq part of mCpuBusyNs */
+    unsigned int        mCpus;
+    sQTIDevBenchDir     mRx;
+    sQTIDevBenchDir     mTx;
+} sQTIDevBench;
+
+void QTIDevBenchInit(sQTIDevBench *pBench);
+void QTIDevBenchStart(sQTIDevBench *pBench);
+void QTIDevBenchStop(sQTIDevBench *pBench);
+void QTIDevBenchUrb(sQTIDevBench *pBench, bool bRx, __u64 submitNs, unsigned int bytes, int status);
+ssize_t QTIDevBenchShow(sQTIDevBench *pBench, char *buf);
+
+/* Submission stamp of a URB, 0 when no window runs */
+static inline __u64 QTIDevBenchStamp(sQTIDevBench *pBench)
+{
+    return READ_ONCE(pBench->mbRunning) ? ktime_get_ns() : 0;
+}
+
+#endif
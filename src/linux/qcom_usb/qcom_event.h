@@ -24,9 +24,11 @@
 
 #ifdef QTI_USE_VM
 #define qti_kmalloc(size, flags) kvzalloc(size, flags)
+#define qti_kmalloc_node(size, flags, node) kvzalloc_node(size, flags, node)
 #define qti_kfree(mem_ptr) kvfree(mem_ptr)
 #else
 #define qti_kmalloc(size, flags) kzalloc(size, flags)
+#define qti_kmalloc_node(size, flags, node) kzalloc_node(size, flags, node)
 #define qti_kfree(mem_ptr) kfree(mem_ptr)
 #endif
 
@@ -0,0 +1,167 @@
+/*
+    Copyright (c) Qualcomm Technologies, Inc. and/or its subsidiaries.
+    SPDX-License-Identifier: BSD-3-Clause
+*/
+
+#include <linux/kernel.h>
+#include <linux/string.h>
+#include <linux/crc-ccitt.h>
+#include "qcom_hdlc.h"
+
+#define QTIDEV_HDLC_ONES        (~0UL / 0xFF)
+#define QTIDEV_HDLC_HIGHS       (QTIDEV_HDLC_ONES << 7)
+
+#define QTIDEV_HDLC_SPECIAL(c)  (((c) == QTIDEV_HDLC_FLAG) || ((c) == QTIDEV_HDLC_ESC))
+
+/* A byte of the word is c */
+static inline bool HdlcWordHasByte(unsigned long word, unsigned char c)
+{
+    unsigned long x = word ^ (QTIDEV_HDLC_ONES * c);
+
+    return ((x - QTIDEV_HDLC_ONES) & ~x & QTIDEV_HDLC_HIGHS) != 0;
+}
+
+/* Bytes before the first flag or escape, tested a word at a time */
+static size_t HdlcPlainSpan(const unsigned char *pData, size_t len)
+{
+    const unsigned long *pWord;
+    size_t i = 0;
+
+    while ((i < len) && !IS_ALIGNED((unsigned long)(pData + i), sizeof(unsigned long)))
+    {
+        if (QTIDEV_HDLC_SPECIAL(pData[i]))
+            return i;
+        i++;
+    }
+    pWord = (const unsigned long *)(pData + i);
+    while ((i + sizeof(unsigned long) <= len) &&
+           !HdlcWordHasByte(*pWord, QTIDEV_HDLC_FLAG) &&
+           !HdlcWordHasByte(*pWord, QTIDEV_HDLC_ESC))
+    {
+        pWord++;
+        i += sizeof(unsigned long);
+    }
+    while ((i < len) && !QTIDEV_HDLC_SPECIAL(pData[i]))
+        i++;
+    return i;
+}
+
+static void HdlcAppend(sQTIDevHdlc *pHdlc, const unsigned char *pData, size_t len)
+{
+    if (pHdlc->mbOverflow)
+        return;
+    if (pHdlc->mLength + len > QTIDEV_HDLC_PACKET_MAX)
+    {
+        pHdlc->mbOverflow = true;
+        return;
+    }
+    memcpy(pHdlc->mpPacket + pHdlc->mLength, pData, len);
+    pHdlc->mLength += len;
+}
+
+/* Flag seen, keep the frame if its CRC checks */
+static void HdlcEndFrame(sQTIDevHdlc *pHdlc)
+{
+    if (pHdlc->mbOverflow)
+    {
+        pHdlc->mOverflows++;
+    }
+    else if ((pHdlc->mLength > QTIDEV_HDLC_CRC_LEN) && !pHdlc->mbEscape &&
+             (crc_ccitt(0xFFFF, pHdlc->mpPacket, pHdlc->mLength) == QTIDEV_HDLC_CRC_GOOD))
+    {
+        pHdlc->mLength -= QTIDEV_HDLC_CRC_LEN;
+        pHdlc->mbFrame = true;
+        return;
+    }
+    else if (pHdlc->mLength != 0)
+    {
+        /* Back to back flags are no frame */
+        pHdlc->mCrcErrors++;
+    }
+    QTIDevHdlcReset(pHdlc);
+}
+
+/* Drop the frame in progress or the packet that was read */
+void QTIDevHdlcReset(sQTIDevHdlc *pHdlc)
+{
+    pHdlc->mLength = 0;
+    pHdlc->mbEscape = false;
+    pHdlc->mbOverflow = false;
+    pHdlc->mbFrame = false;
+}
+
+/* Bytes of pData used, stops after the first good frame (mbFrame) */
+size_t QTIDevHdlcDecode(sQTIDevHdlc *pHdlc, const unsigned char *pData, size_t len)
+{
+    size_t used = 0;
+    size_t run;
+    unsigned char c;
+
+    while ((used < len) && !pHdlc->mbFrame)
+    {
+        if (!pHdlc->mbEscape)
+        {
+            run = HdlcPlainSpan(pData + used, len - used);
+            if (run != 0)
+            {
+                HdlcAppend(pHdlc, pData + used, run);
+                used += run;
+                continue;
+            }
+        }
+        c = pData[used++];
+        if (c == QTIDEV_HDLC_FLAG)
+        {
+            HdlcEndFrame(pHdlc);
+        }
+        else if (pHdlc->mbEscape)
+        {
+            pHdlc->mbEscape = false;
+            c ^= QTIDEV_HDLC_ESC_MASK;
+            HdlcAppend(pHdlc, &c, 1);
+        }
+        else
+        {
+            pHdlc->mbEscape = true;
+        }
+    }
+    return used;
+}
+
+static size_t HdlcEscape(unsigned char *pDst, const unsigned char *pSrc, size_t len)
+{
+    size_t in = 0;
+    size_t out = 0;
+    size_t run;
+
+    while (in < len)
+    {
+        run = HdlcPlainSpan(pSrc + in, len - in);
+        memcpy(pDst + out, pSrc + in, run);
+        in += run;
+        out += run;
+        if (in < len)
+        {
+            pDst[out++] = QTIDEV_HDLC_ESC;
+            pDst[out++] = pSrc[in++] ^ QTIDEV_HDLC_ESC_MASK;
+        }
+    }
+    return out;
+}
+
+// Frames len bytes of pPacket into pFrame, returns the frame length.
+// pFrame holds QTIDEV_HDLC_ENCODED_MAX(len) bytes, and pPacket may be
+// its last len bytes: no byte is written before it has been read.
+size_t QTIDevHdlcEncode(unsigned char *pFrame, const unsigned char *pPacket, size_t len)
+{
+    unsigned char crc[QTIDEV_HDLC_CRC_LEN];
+    u16 fcs = ~crc_ccitt(0xFFFF, pPacket, len);
+    size_t out;
+
+    crc[0] = fcs & 0xFF;
+    crc[1] = fcs >> 8;
+    out = HdlcEscape(pFrame, pPacket, len);
+    out += HdlcEscape(pFrame + out, crc, QTIDEV_HDLC_CRC_LEN);
+    pFrame[out++] = QTIDEV_HDLC_FLAG;
+    return out;
+}
@@ -0,0 +1,53 @@
+/*
+    Copyright (c) Qualcomm Technologies, Inc. and/or its subsidiaries.
+    SPDX-License-Identifier: BSD-3-Clause
+*/
+
+#ifndef QTIHDLC_H
+#define QTIHDLC_H
+
+#include <linux/types.h>
+
+/*
+ * DIAG HDLC framing
+ *
+ * A DIAG packet goes over the bulk pipes as its bytes and a CRC-16/CCITT
+ * (init 0xFFFF, sent inverted, low byte first), with 0x7E and 0x7D
+ * escaped as 0x7D, byte ^ 0x20, and a 0x7E after the frame.  With
+ * IOCTL_QTIDEV_SET_DIAG_HDLC the DIAG node does this itself:
+ *
+ *   - each write() is one packet and goes out as one frame
+ *   - read() returns the packets of the frames with a good CRC, each
+ *     after a __u32 with its length; a length larger than the bytes that
+ *     follow means the read() buffer truncated the packet
+ */
+
+#define QTIDEV_HDLC_FLAG        0x7E
+#define QTIDEV_HDLC_ESC         0x7D
+#define QTIDEV_HDLC_ESC_MASK    0x20
+#define QTIDEV_HDLC_CRC_LEN     2
+#define QTIDEV_HDLC_CRC_GOOD    0xF0B8  /* CRC over a packet and its own CRC */
+
+/* Largest packet a frame is decoded into, longer frames are dropped */
+#define QTIDEV_HDLC_PACKET_MAX  (16 * 1024)
+
+/* Bytes a packet of len can take once framed, every byte escaped */
+#define QTIDEV_HDLC_ENCODED_MAX(len)  (2 * ((len) + QTIDEV_HDLC_CRC_LEN) + 1)
+
+typedef struct sQTIDevHdlc
+{
+    unsigned char       *mpPacket;  /* unescaped frame, NULL when framing is off */
+    size_t              mLength;    /* bytes in mpPacket */
+    bool                mbEscape;   /* the last byte was QTIDEV_HDLC_ESC */
+    bool                mbOverflow; /* frame longer than QTIDEV_HDLC_PACKET_MAX */
+    bool                mbFrame;    /* mpPacket holds a checked packet */
+    bool                mbBusy;     /* a read() is copying the packet out */
+    __u32               mCrcErrors;
+    __u32               mOverflows;
+} sQTIDevHdlc;
+
+void QTIDevHdlcReset(sQTIDevHdlc *pHdlc);
+size_t QTIDevHdlcDecode(sQTIDevHdlc *pHdlc, const unsigned char *pData, size_t len);
+size_t QTIDevHdlcEncode(unsigned char *pFrame, const unsigned char *pPacket, size_t len);
+
+#endif
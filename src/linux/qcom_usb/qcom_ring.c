@@ -0,0 +1,371 @@
+/*
+    Copyright (c) Qualcomm Technologies, Inc. and/or its subsidiaries.
+    SPDX-License-Identifier: BSD-3-Clause
+*/
+
+#include <linux/mm.h>
+#include <linux/log2.h>
+#include "qcom_ring.h"
+
+static void QTIDevRingFree(struct kref *pRefCount)
+{
+    sQTIDevRing *pRing = container_of(pRefCount, sQTIDevRing, mRefCount);
+    unsigned int idx;
+
+    for (idx = 0; idx < pRing->mUrbCount; idx++)
+    {
+        usb_free_urb(pRing->mUrbs[idx].mpUrb);
+    }
+    if (pRing->mpSlots != NULL)
+    {
+        for (idx = 0; idx < pRing->mSlotCount; idx++)
+        {
+            if (pRing->mpSlots[idx] != NULL)
+                free_pages((unsigned long)pRing->mpSlots[idx], pRing->mSlotOrder);
+        }
+        qti_kfree(pRing->mpSlots);
+    }
+    qti_kfree(pRing->mpSlotDone);
+    if (pRing->mpHeader != NULL)
+        free_page((unsigned long)pRing->mpHeader);
+    qti_kfree(pRing);
+}
+
+/* Reader position, caller holds mLock */
+static __u64 QTIDevRingTail(sQTIDevRing *pRing)
+{
+    __u64 tail = READ_ONCE(pRing->mpHeader->mTail);
+
+    /* Ignore a tail moving backwards or past the filled slots */
+    if (tail > pRing->mTail && tail <= pRing->mHead)
+        pRing->mTail = tail;
+    return pRing->mTail;
+}
+
+/* Move mHead past the completed slots, caller holds mLock */
+static bool QTIDevRingPublish(sQTIDevRing *pRing)
+{
+    __u64 head = pRing->mHead;
+
+    while (head != pRing->mNext && pRing->mpSlotDone[head & (pRing->mSlotCount - 1)])
+        head++;
+
+    if (head == pRing->mHead)
+        return false;
+
+    pRing->mHead = head;
+    /* Slot contents and descriptors before the new head */
+    smp_wmb();
+    WRITE_ONCE(pRing->mpHeader->mHead, head);
+    return true;
+}
+
+static void QTIDevRingCallback(struct urb *pUrb);
+
+/* Read into the next free slot, caller holds mLock */
+static int QTIDevRingSubmit(sQTIDevRing *pRing, sQTIDevRingUrb *pRingUrb)
+{
+    sQTIDevUSB *pDev = pRing->mpDev;
+    unsigned int idx;
+    int status;
+
+    if (pRing->mNext - QTIDevRingTail(pRing) >= pRing->mSlotCount)
+    {
+        /* Ring full, poll() submits again once the reader moved on */
+        if (!pRingUrb->mbParked)
+        {
+            pRingUrb->mbParked = true;
+            WRITE_ONCE(pRing->mpHeader->mFullCount, pRing->mpHeader->mFullCount + 1);
+            QC_LOG_DBG(pDev, "ring full, head %llu tail %llu\n", pRing->mHead, pRing->mTail);
+        }
+        return 0;
+    }
+
+    idx = pRing->mNext & (pRing->mSlotCount - 1);
+    pRing->mpSlotDone[idx] = false;
+    usb_fill_bulk_urb(pRingUrb->mpUrb,
+                      pDev->udev,
+                      usb_rcvbulkpipe(pDev->udev, pDev->mBulkInEndAddr),
+                      pRing->mpSlots[idx],
+                      pDev->mBulkInSize,
+                      QTIDevRingCallback,
+                      pRingUrb);
+
+    status = usb_submit_urb(pRingUrb->mpUrb, GFP_ATOMIC);
+    if (status != 0)
+    {
+        QC_LOG_ERR(pDev, "Error sending URB for slot %u (%d)\n", idx, status);
+        pRingUrb->mbParked = false;
+        return status;
+    }
+
+    pRingUrb->mSlot = pRing->mNext++;
+    pRingUrb->mbSubmitted = true;
+    pRingUrb->mbParked = false;
+    return 0;
+}
+
+static void QTIDevRingCallback(struct urb *pUrb)
+{
+    sQTIDevRingUrb *pRingUrb = pUrb->context;
+    sQTIDevRing *pRing = pRingUrb->mpRing;
+    sQTIDevUSB *pDev;
+    unsigned int idx;
+    unsigned long flags;
+    bool bWake;
+
+    spin_lock_irqsave(&pRing->mLock, flags);
+    pDev = pRing->mpDev;
+    pRingUrb->mbSubmitted = false;
+
+    idx = pRingUrb->mSlot & (pRing->mSlotCount - 1);
+    pRing->mpHeader->mDesc[idx].mLength = pUrb->actual_length;
+    pRing->mpHeader->mDesc[idx].mStatus = pUrb->status;
+    pRing->mpSlotDone[idx] = true;
+    bWake = QTIDevRingPublish(pRing);
+
+    if (pDev != NULL)
+    {
+        pDev->mStats.RxCount += pUrb->actual_length;
+        pDev->mStats.USBRxCnt += pUrb->actual_length;
+        QC_LOG_DBG(pDev, "slot %u got %d status %d\n", idx, pUrb->actual_length, pUrb->status);
+
+        /* Same policy as BlkCallback, errors other than overflow end the read */
+        if (pRing->mbRunning && (pUrb->status == 0 || pUrb->status == -EOVERFLOW))
+            QTIDevRingSubmit(pRing, pRingUrb);
+    }
+    spin_unlock_irqrestore(&pRing->mLock, flags);
+
+    if (bWake && pDev != NULL)
+        wake_up_interruptible(&pDev->mBulkMemList.mWaitQueue);
+}
+
+sQTIDevRing *QTIDevRingCreate(sQTIDevUSB *pDev, int slotCount)
+{
+    sQTIDevRing *pRing;
+    sQTIDevRingHeader *pHeader;
+    unsigned int idx;
+
+    switch (pDev->mDevInfo.mDevInfInfo.mDevType)
+    {
+        case QTIDEV_INF_TYPE_TRACE_IN:
+        case QTIDEV_INF_TYPE_DPL:
+        case QTIDEV_INF_TYPE_BULK_IN_OUT:
+            break;
+        default:
+            QC_LOG_ERR(pDev, "mmap not supported for type %d\n", pDev->mDevInfo.mDevInfInfo.mDevType);
+            return ERR_PTR(-EOPNOTSUPP);
+    }
+
+    slotCount = max(slotCount, (int)pDev->mBulkUrbCount * 2);
+    slotCount = clamp(slotCount, QTIDEV_RING_MIN_SLOTS, QTIDEV_RING_MAX_SLOTS);
+
+    pRing = qti_kmalloc_node(sizeof(sQTIDevRing), GFP_KERNEL, pDev->mNumaNode);
+    if (pRing == NULL)
+        return ERR_PTR(-ENOMEM);
+
+    kref_init(&pRing->mRefCount);
+    spin_lock_init(&pRing->mLock);
+    pRing->mpDev = pDev;
+    pRing->mSlotCount = rounddown_pow_of_two(slotCount);
+    pRing->mSlotOrder = get_order(pDev->mBulkInSize);
+    pRing->mUrbCount = pDev->mBulkUrbCount;
+
+    pRing->mpHeader = (sQTIDevRingHeader *)get_zeroed_page(GFP_KERNEL);
+    pRing->mpSlots = qti_kmalloc_node(pRing->mSlotCount * sizeof(void *), GFP_KERNEL, pDev->mNumaNode);
+    pRing->mpSlotDone = qti_kmalloc_node(pRing->mSlotCount * sizeof(bool), GFP_KERNEL, pDev->mNumaNode);
+    if (pRing->mpHeader == NULL || pRing->mpSlots == NULL || pRing->mpSlotDone == NULL)
+        goto nomem;
+
+    /* The URBs read straight into the slots, so they must be DMA capable,
+       and are kept on the node of the controller writing them */
+    for (idx = 0; idx < pRing->mSlotCount; idx++)
+    {
+        struct page *pPage = alloc_pages_node(pDev->mNumaNode, GFP_KERNEL | __GFP_ZERO | __GFP_NOWARN,
+                                              pRing->mSlotOrder);
+
+        pRing->mpSlots[idx] = pPage ? page_address(pPage) : NULL;
+        if (pRing->mpSlots[idx] == NULL)
+        {
+            QC_LOG_ERR(pDev, "Could not allocate slot %u of %u, order %u\n",
+                       idx, pRing->mSlotCount, pRing->mSlotOrder);
+            goto nomem;
+        }
+    }
+
+    for (idx = 0; idx < pRing->mUrbCount; idx++)
+    {
+        pRing->mUrbs[idx].mpRing = pRing;
+        pRing->mUrbs[idx].mpUrb = usb_alloc_urb(0, GFP_KERNEL);
+        if (pRing->mUrbs[idx].mpUrb == NULL)
+            goto nomem;
+    }
+
+    pHeader = pRing->mpHeader;
+    pHeader->mMagic = QTIDEV_RING_MAGIC;
+    pHeader->mVersion = QTIDEV_RING_VERSION;
+    pHeader->mSlotSize = PAGE_SIZE << pRing->mSlotOrder;
+    pHeader->mSlotCount = pRing->mSlotCount;
+    pHeader->mDataOffset = PAGE_SIZE;
+
+    QC_LOG_INFO(pDev, "ring of %u slots of %u bytes\n", pHeader->mSlotCount, pHeader->mSlotSize);
+    return pRing;
+
+nomem:
+    kref_put(&pRing->mRefCount, QTIDevRingFree);
+    return ERR_PTR(-ENOMEM);
+}
+
+int QTIDevRingStart(sQTIDevRing *pRing)
+{
+    unsigned long flags;
+    unsigned int idx;
+    int status = 0;
+
+    spin_lock_irqsave(&pRing->mLock, flags);
+    if (pRing->mpDev == NULL)
+    {
+        spin_unlock_irqrestore(&pRing->mLock, flags);
+        return -ENODEV;
+    }
+    pRing->mbRunning = true;
+    for (idx = 0; idx < pRing->mUrbCount; idx++)
+    {
+        if (pRing->mUrbs[idx].mbSubmitted)
+            continue;
+        status = QTIDevRingSubmit(pRing, &pRing->mUrbs[idx]);
+        if (status != 0)
+            break;
+    }
+    spin_unlock_irqrestore(&pRing->mLock, flags);
+
+    if (status != 0)
+    {
+        QTIDevRingStop(pRing);
+        status = (status == -ENOMEM) ? status : -EIO;
+    }
+    return status;
+}
+
+void QTIDevRingStop(sQTIDevRing *pRing)
+{
+    unsigned long flags;
+    unsigned int idx;
+
+    spin_lock_irqsave(&pRing->mLock, flags);
+    pRing->mbRunning = false;
+    for (idx = 0; idx < pRing->mUrbCount; idx++)
+    {
+        pRing->mUrbs[idx].mbParked = false;
+    }
+    spin_unlock_irqrestore(&pRing->mLock, flags);
+
+    /* Killed reads are handed to the reader as empty slots */
+    for (idx = 0; idx < pRing->mUrbCount; idx++)
+    {
+        usb_kill_urb(pRing->mUrbs[idx].mpUrb);
+    }
+}
+
+void QTIDevRingDetach(sQTIDevUSB *pDev)
+{
+    sQTIDevRing *pRing = xchg(&pDev->mpRing, NULL);
+    unsigned long flags;
+    unsigned int idx;
+
+    if (pRing == NULL)
+        return;
+
+    QTIDevRingStop(pRing);
+    spin_lock_irqsave(&pRing->mLock, flags);
+    pRing->mpDev = NULL;
+    spin_unlock_irqrestore(&pRing->mLock, flags);
+
+    for (idx = 0; idx < pRing->mUrbCount; idx++)
+    {
+        usb_free_urb(pRing->mUrbs[idx].mpUrb);
+        pRing->mUrbs[idx].mpUrb = NULL;
+    }
+
+    /* Pages stay until the last munmap */
+    kref_put(&pRing->mRefCount, QTIDevRingFree);
+}
+
+bool QTIDevRingPoll(sQTIDevRing *pRing)
+{
+    unsigned long flags;
+    unsigned int idx;
+    bool bReady;
+
+    spin_lock_irqsave(&pRing->mLock, flags);
+    if (pRing->mbRunning)
+    {
+        for (idx = 0; idx < pRing->mUrbCount; idx++)
+        {
+            if (pRing->mUrbs[idx].mbParked)
+                QTIDevRingSubmit(pRing, &pRing->mUrbs[idx]);
+        }
+    }
+    bReady = (QTIDevRingTail(pRing) != pRing->mHead);
+    spin_unlock_irqrestore(&pRing->mLock, flags);
+
+    return bReady;
+}
+
+static void QTIDevRingVmOpen(struct vm_area_struct *pVma)
+{
+    sQTIDevRing *pRing = pVma->vm_private_data;
+
+    kref_get(&pRing->mRefCount);
+}
+
+static void QTIDevRingVmClose(struct vm_area_struct *pVma)
+{
+    sQTIDevRing *pRing = pVma->vm_private_data;
+
+    kref_put(&pRing->mRefCount, QTIDevRingFree);
+}
+
+static const struct vm_operations_struct QTIDevRingVmOps =
+{
+    .open  = QTIDevRingVmOpen,
+    .close = QTIDevRingVmClose,
+};
+
+int QTIDevRingMmap(sQTIDevRing *pRing, struct vm_area_struct *pVma)
+{
+    unsigned long slotSize = PAGE_SIZE << pRing->mSlotOrder;
+    unsigned long size = pVma->vm_end - pVma->vm_start;
+    unsigned long addr = pVma->vm_start;
+    unsigned int slots = pRing->mSlotCount;
+    unsigned int idx;
+    int status;
+
+    /* Either the header page alone, to learn the geometry, or everything */
+    if (size == PAGE_SIZE)
+        slots = 0;
+
+    if (pVma->vm_pgoff != 0 || size != PAGE_SIZE + slots * slotSize)
+    {
+        QC_LOG_ERR(pRing->mpDev, "mapping must cover %lu bytes from offset 0\n",
+                   PAGE_SIZE + pRing->mSlotCount * slotSize);
+        return -EINVAL;
+    }
+
+    status = remap_pfn_range(pVma, addr, virt_to_phys(pRing->mpHeader) >> PAGE_SHIFT,
+                             PAGE_SIZE, pVma->vm_page_prot);
+    addr += PAGE_SIZE;
+    for (idx = 0; status == 0 && idx < slots; idx++)
+    {
+        status = remap_pfn_range(pVma, addr, virt_to_phys(pRing->mpSlots[idx]) >> PAGE_SHIFT,
+                                 slotSize, pVma->vm_page_prot);
+        addr += slotSize;
+    }
+    if (status != 0)
+        return status;
+
+    pVma->vm_ops = &QTIDevRingVmOps;
+    pVma->vm_private_data = pRing;
+    kref_get(&pRing->mRefCount);
+    return 0;
+}
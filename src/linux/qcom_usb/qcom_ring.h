@@ -0,0 +1,94 @@
+/*
+    Copyright (c) Qualcomm Technologies, Inc. and/or its subsidiaries.
+    SPDX-License-Identifier: BSD-3-Clause
+*/
+
+#ifndef QTIRING_H
+#define QTIRING_H
+
+#include "qcom_usb.h"
+
+/*
+ * Zero copy receive ring
+ *
+ * mmap() on a QDSS trace, DPL or DIAG node replaces the circular buffer
+ * with a ring of slots the bulk-in URBs read into directly.  The mapping
+ * is one header page (sQTIDevRingHeader followed by one sQTIDevRingDesc
+ * per slot) and then mSlotCount slots of mSlotSize bytes:
+ *
+ *   - the driver fills slot n % mSlotCount, sets mDesc[n % mSlotCount]
+ *     and then moves mHead past n
+ *   - the reader consumes the slots from mTail to mHead - 1 and stores
+ *     the new mTail; a slot is not reused before mTail has passed it
+ *   - poll() returns POLLIN while mHead != mTail, and is also what hands
+ *     released slots back to reads held back by a full ring
+ *
+ * read() returns -EBUSY while the ring is in use.  The ring goes away
+ * with the last close and munmap.
+ */
+
+#define QTIDEV_RING_MAGIC          0x5154524E  /* "QTRN" */
+#define QTIDEV_RING_VERSION        1
+
+/* Slot count, rounded down to a power of 2 */
+#define QTIDEV_RING_DEFAULT_SLOTS  32
+#define QTIDEV_RING_MIN_SLOTS      (BULK_URB_LIST * 2) /* and twice the URBs */
+#define QTIDEV_RING_MAX_SLOTS      256
+
+typedef struct sQTIDevRingDesc
+{
+    __u32               mLength;    /* bytes received into the slot */
+    __s32               mStatus;    /* 0, -EOVERFLOW or why the read ended */
+} sQTIDevRingDesc;
+
+typedef struct sQTIDevRingHeader
+{
+    __u32               mMagic;
+    __u32               mVersion;
+    __u32               mSlotSize;  /* distance between two slots */
+    __u32               mSlotCount;
+    __u32               mDataOffset;/* offset of slot 0 in the mapping */
+    __u32               mReserved;
+    __u64               mHead;      /* slots filled, written by the driver */
+    __u64               mTail;      /* slots consumed, written by the reader */
+    __u64               mFullCount; /* reads held back by a full ring */
+    sQTIDevRingDesc     mDesc[0];
+} sQTIDevRingHeader;
+
+struct sQTIDevRing;
+
+typedef struct sQTIDevRingUrb
+{
+    struct sQTIDevRing  *mpRing;
+    struct urb          *mpUrb;
+    __u64               mSlot;      /* slot the URB is reading into */
+    bool                mbSubmitted;
+    bool                mbParked;   /* waiting for the reader */
+} sQTIDevRingUrb;
+
+typedef struct sQTIDevRing
+{
+    struct kref         mRefCount;  /* held by the device and each mapping */
+    spinlock_t          mLock;
+    sQTIDevUSB          *mpDev;     /* NULL once detached */
+    sQTIDevRingHeader   *mpHeader;  /* shared page */
+    void                **mpSlots;  /* mSlotCount blocks of 2^mSlotOrder pages */
+    bool                *mpSlotDone;
+    unsigned int        mSlotOrder;
+    unsigned int        mSlotCount;
+    __u64               mHead;      /* last value stored in mpHeader->mHead */
+    __u64               mTail;      /* last valid mpHeader->mTail seen */
+    __u64               mNext;      /* next slot to hand to a URB */
+    bool                mbRunning;
+    unsigned int        mUrbCount;  /* mBulkUrbCount when the ring was made */
+    sQTIDevRingUrb      mUrbs[BULK_URB_LIST_MAX];
+} sQTIDevRing;
+
+sQTIDevRing *QTIDevRingCreate(sQTIDevUSB *pDev, int slotCount);
+void QTIDevRingDetach(sQTIDevUSB *pDev);
+int QTIDevRingStart(sQTIDevRing *pRing);
+void QTIDevRingStop(sQTIDevRing *pRing);
+bool QTIDevRingPoll(sQTIDevRing *pRing);
+int QTIDevRingMmap(sQTIDevRing *pRing, struct vm_area_struct *pVma);
+
+#endif
@@ -21,6 +21,8 @@
 #include <linux/aio.h>
 #include <linux/kthread.h>
 #include <linux/mmu_context.h>
+#include <linux/splice.h>
+#include <linux/pipe_fs_i.h>
 
 #include <linux/cdev.h>
 
@@ -39,6 +41,8 @@
 #endif
 
 #include "qcom_event.h"
+#include "qcom_hdlc.h"
+#include "qcom_bench.h"
 #include "qtiDevInf.h"
 
 #ifndef RHEL_RELEASE_CODE
@@ -55,7 +59,8 @@
 #define RHEL_RELEASE_VERSION(x,y) (((x) << 8) | (y))
 #endif
 
-#define BULK_URB_LIST            4
+#define BULK_URB_LIST            4      // default bulk-in URBs in flight per device
+#define BULK_URB_LIST_MAX        32
 #define QTIDEV_TX_TIMEOUT        2000   // in milliseconds
 #define QTIDEV_RX_TIMEOUT        2000  // in milliseconds
 #define QTIDEV_BULK_BUF_LEN      1024*1024*3 // 4000000//1024*1024*3
@@ -70,8 +75,13 @@
 #define QTIDEV_TX_SIZE           1024*128
 #endif
 
-#define QTIDEV_RX_NOTIFY_POOL_SZ 32
+#define QTIDEV_RX_SIZE_MIN       1024*4
+#define QTIDEV_RX_SIZE_MAX       1024*1024
+#define QTIDEV_RX_SIZE_ALIGN     1024   // SuperSpeed bulk max packet
+
+#define QTIDEV_RX_CHUNKS_PER_URB 2      // receive buffers per bulk-in URB, at least
 #define QTIDEV_TX_BUF_POOL_SZ    32
+#define QTIDEV_TX_BUF_PREALLOC   PAGE_SIZE  // per slot at init, grows for larger writes
 #define QTIDEV_DRIVER_NAME       "QCOM_QDSS_DPL_DIAG_Subsystem"
 #define QTIDEV_USB_CLASS_NAME    "qcom_usb"
 #define QTIDEV_PORT_CLASS_NAME   "qcom_ports"
@@ -79,8 +89,10 @@
 
 #define BULK_URB_INITIALIZED    (1 << 0)
 #define BULK_URB_SUBMITTED      (1 << 1)
+#define BULK_URB_PARKED         (1 << 2)  /* waiting for a free receive buffer */
 #define IS_URB_INITIALIZED(status)  (status & BULK_URB_INITIALIZED)
 #define IS_URB_SUBMITTED(status)    (status & BULK_URB_SUBMITTED)
+#define IS_URB_PARKED(status)       (status & BULK_URB_PARKED)
 
 #define DEFAULT_READ_URB_LENGTH 0x1000
 #define GOBI_SER_DTR       0x01
@@ -95,6 +107,36 @@
 #ifdef QCUSB_TEST_ONLY
 #define IOCTL_QTIDEV_SESSION_TOTAL    0x1005
 #endif
+#define IOCTL_QTIDEV_SET_RX_WATERMARK 0x1006  // bytes queued before a reader is woken, 0 for any
+#define IOCTL_QTIDEV_SET_RX_LATENCY   0x1007  // ms data may wait below the watermark, 0 for no limit
+#define IOCTL_QTIDEV_GET_RX_DROPPED   0x1008  // __u64 bytes a shared reader lost to the drop policy
+#define IOCTL_QTIDEV_SET_DPL_RECORDS  0x1009  // 1: DPL read() returns sQTIDevDplRecord framed records
+#define IOCTL_QTIDEV_SET_DIAG_HDLC    0x100A  // 1: DIAG read()/write() carry packets, the driver does the HDLC framing
+
+#define QTIDEV_RX_WATERMARK_MAX  (QTIDEV_BULK_BUF_LEN / 2)
+#define QTIDEV_RX_LATENCY_MAX    QTIDEV_RX_TIMEOUT
+
+/* DPL transfers are whole QMAP records: pad/cd, mux id, be16 length with padding */
+#define QTIDEV_QMAP_HDR_LEN      4
+#define QTIDEV_QMAP_PAD_MASK     0x3F
+
+#define QTIDEV_DPL_RECORD_TRUNCATED  0x0001  /* the read() buffer ended inside mLength */
+
+typedef struct sQTIDevDplRecord
+{
+    __u32               mLength;    /* payload bytes of the QMAP record, padding removed */
+    __u32               mCopied;    /* payload bytes that follow this header */
+    __u64               mTimestamp; /* ns, CLOCK_MONOTONIC at the bulk-in completion */
+    __u8                mMuxId;
+    __u8                mPadCD;     /* QMAP first byte as received */
+    __u16               mFlags;     /* QTIDEV_DPL_RECORD_xxx */
+    __u32               mReserved;
+} sQTIDevDplRecord;
+
+/* Opens of a bulk-in node beyond the first read the stream without consuming it */
+#define QTIDEV_RX_READERS_MAX    8
+#define QTIDEV_RX_POLICY_DROP    0   /* a full pool drops the oldest data of slow readers */
+#define QTIDEV_RX_POLICY_BLOCK   1   /* a full pool stops the bulk-in reads */
 
 #define QTIDEV_QTIOM_VID      0x05C6
 #ifdef QCUSB_TEST_ONLY
@@ -104,7 +146,6 @@
 #endif
 
 #define QDSS_DIAG_MERGE
-#define QDSS_INT_BULK_BUFFER
 
 typedef enum eRxType
 {
@@ -130,6 +171,9 @@ typedef struct qtidev_tx_buf
     void       *mpTxSem;   // signal
     void       *mpDev;     // device
     int        mIndex;     // for tracking
+    bool       mbAsync;    // write() returned before completion
+    __u64      mSubmitNs;  // benchmark stamp, 0 when not timed
+    struct list_head node; // on mTxFreeList while idle
 } sQTIDevTxBuf;
 
 typedef enum eTimerReadType
@@ -148,6 +192,12 @@ typedef enum eTimerReadStatus
 } eTimerReadStatus;
 
 struct sQTIDevUSB;
+#if (LINUX_VERSION_CODE >= KERNEL_VERSION(6,0,0))
+#define QTIDEV_ITER_IS_UBUF(i)  iter_is_ubuf(i)  /* one user buffer, nothing to dup_iter() */
+#else
+#define QTIDEV_ITER_IS_UBUF(i)  false
+#endif
+
 typedef struct qtidev_aio_data
 {
     bool    aio;
@@ -162,7 +212,6 @@ typedef struct qtidev_aio_data
     const void          *to_free;
     struct kiocb        *kiocb;
     struct iov_iter     data;
-    struct semaphore    readSem;
     struct mm_struct    *mm;
     struct work_struct  work;
     struct work_struct  cancellation_work;
@@ -172,68 +221,60 @@ typedef struct qtidev_aio_data
     unsigned long       mActualLen;
     void* (*complete)(struct kiocb *kiocb, void *userData);
     struct aio_data_ctx *mpNext;
+    struct list_head    mReadNode;  /* on mIoReadBuffListActive while queued */
+    __u64               mSubmitNs;  /* benchmark stamp of the write URB */
 } sIoData;
 
-typedef struct sIoReadList
+typedef struct sReadMemChunk
 {
-    struct kiocb        *kiocb;
-    struct list_head	node;
-} sIoReadList;
+    struct list_head    node;
+    unsigned char       *mpBuffer;          /* URB sized receive buffer */
+    unsigned int        mDataLen;           /* bytes received */
+    unsigned int        mOffset;            /* bytes already handed to readers */
+    bool                mbShared;           /* pages handed to a pipe by splice_read */
+    __u64               mSeq;               /* stream offset of the first byte */
+    __u64               mTimestamp;         /* ktime_get_ns() at completion */
+} sReadMemChunk;
+
+typedef struct sQTIDevReader
+{
+    struct list_head    node;               /* on sBulkMemList.mReaderList */
+    struct sQTIDevUSB   *mpDev;
+    __u64               mCursor;            /* stream offset of the next byte to read */
+    __u64               mDropped;           /* bytes skipped by the drop policy */
+    sReadMemChunk       *mpBusyChunk;       /* being copied, must not be dropped */
+    size_t              mRxWatermark;       /* bytes unread before this reader is woken */
+    unsigned int        mRxLatency;         /* ms data may wait below mRxWatermark */
+    wait_queue_head_t   mWaitQueue;         /* read() and poll() of this reader */
+} sQTIDevReader;
 
 typedef struct sBulkUrbList
 {
     void                *Context;
     int                 mIndex;
     struct urb          *mBulk_in_urb;      /* the urb to read data with */
-    unsigned char       *mBulk_in_buffer;   /* the buffer to receive data */
+    sReadMemChunk       *mpChunk;           /* the buffer to receive data, NULL while parked */
     __u8                mUrbStatus;         /* Status of urb            */
-    struct list_head	node;
+    __u64               mSubmitNs;          /* benchmark stamp, 0 when not timed */
 } sBulkUrbList;
 
-#define QTI_RX_EVT_CANCEL 1
-#define QTI_RX_EVT_FILL   2
-
-typedef struct sNotifyList
-{
-    /* Function to be run when data becomes available */
-    void                (*mpNotifyFunct)(struct sQTIDevUSB*, void *, int);
-    /* Data to provide as parameter to mpNotifyFunct */
-    void                *mpData;
-    sQtiEvent           mEvent;
-    /* User request size */
-    size_t              mUsrReqSize;
-    /* Index for tracking */
-    int                 mIndex;
-    /* status of being pricessed */
-    int                 mInProcess;
-    /* Next entry in linked list */
-    struct sNotifyList  *mpNext;
-} sNotifyList;
-
-typedef struct sReadMemList
-{
-    unsigned char       *mBulk_in_buffer;    /* the buffer to receive data */
-    int                  mDatalen;
-    struct sReadMemList *mpNext;
-} sReadMemList;
-
-#ifdef QDSS_INT_BULK_BUFFER
-typedef struct sReadMemListCircular
-{
-    unsigned char        *mBulk_in_buffer; /* the buffer to receive */
-    unsigned int         mStartIdx;
-    unsigned int         mEndIdx;
-    unsigned int         mBufflen;
-    bool                 mBufEmptyStatus;
-} sReadMemListCircular;
-
-#endif
-
 typedef struct sBulkMemList
 {
-    //sReadMemList        *mpList;
-    sReadMemListCircular mReadBuffCircular;
-    sNotifyList         *mpReadNotifyList;
+    sReadMemChunk       *mpChunkPool;       /* all receive buffers of the device */
+    unsigned int         mChunkCount;
+    struct list_head     mChunkList;        /* received chunks, oldest first */
+    struct list_head     mChunkFreeList;    /* buffers to replenish the URBs with */
+    struct list_head     mChunkSharedList;  /* consumed, pages still held by a pipe */
+    struct list_head     mChunkHeldList;    /* consumed, not yet read by a shared reader */
+    size_t               mChunkBytes;       /* unread bytes in mChunkList */
+    int                  mChunkNode;        /* NUMA node the buffers were allocated on */
+    __u64                mStreamBytes;      /* stream offset after the last queued byte */
+    bool                 mbOwnerOpen;       /* the first open consumes mChunkList */
+    struct list_head     mReaderList;       /* the other opens, sQTIDevReader */
+    int                  mReaderPolicy;     /* QTIDEV_RX_POLICY_xxx */
+    wait_queue_head_t    mRxWaitQueue;      /* blocked read()s, exclusive waiters */
+    unsigned int         mRxCancelSeq;      /* bumped to send the blocked read()s back */
+    unsigned int         mRxSmallWaiters;   /* blocked read()s asking for less than the watermark */
     /* Wait queue object for poll() */
     spinlock_t           mReadMemLock;       /* lock for I/O operations */
     wait_queue_head_t    mWaitQueue;
@@ -255,19 +296,16 @@ typedef struct sQTIDevUSB {
     struct urb *         mpIntURB;    /* Interrupt URB */
     void *               mpIntBuffer;  /* Buffer used by Interrupt URB */
 
-    sNotifyList         mRxNotifyPool[QTIDEV_RX_NOTIFY_POOL_SZ];
     sQTIDevTxBuf        mTxBufferPool[QTIDEV_TX_BUF_POOL_SZ];
-    sBulkUrbList        mBulkUrbList[BULK_URB_LIST];
-    struct list_head	mBulkUrbBuffList;	/* list head for URB buffer */
-    size_t		mBulkUrbBuffListSize;	/* active and valid URB buffer count */
+    struct list_head    mTxFreeList;    /* idle mTxBufferPool slots */
+    spinlock_t          mTxLock;        /* mTxFreeList and mTxInFlight */
+    unsigned int        mTxInFlight;    /* write()s returned before completion */
+    unsigned int        mTxDepth;       /* mTxInFlight limit, 0 for synchronous write() */
+    wait_queue_head_t   mTxWaitQueue;   /* a slot became idle */
+    sBulkUrbList        mBulkUrbList[BULK_URB_LIST_MAX];
     sBulkMemList        mBulkMemList;
-    sIoReadList		mIoReadList[BULK_URB_LIST];
-    struct list_head	mIoReadBuffList;    /* list head for IO Read LinkedList */
-
-    struct list_head	mIoReadBuffListActive;    /* list head for IO Read LinkedList */
+    struct list_head	mIoReadBuffListActive;    /* queued aio reads, sIoData */
     size_t		mIoReadBuffListActiveSize;/* Active Read IO requests at an instance */
-    struct list_head	mIoReadBuffListIdle;    /* list head for IO Read LinkedList */
-    size_t		mIoReadBuffListIdleSize;/* Active Read IO requests at an instance */
 
     spinlock_t		mSpinReadBuffLock;
      
@@ -277,6 +315,7 @@ typedef struct sQTIDevUSB {
     unsigned            mIntErrCnt;
 
     size_t              mBulkInSize;
+    unsigned int        mBulkUrbCount;  /* bulk-in URBs in use, up to BULK_URB_LIST_MAX */
     size_t              mBulkOutSize;
     size_t              mBulkInEndAddr;
     size_t              mBulkOutEndAddr;
@@ -288,6 +327,13 @@ typedef struct sQTIDevUSB {
     dev_t               mDevNum;        /* Device number */
     sDevinfInfo         mDevInfo;       /* Device info */
     unsigned int        mTimeout;       /* read timeout */
+    size_t              mRxWatermark;   /* of the consuming open, bytes queued before it is woken */
+    unsigned int        mRxLatency;     /* of the consuming open, ms data may wait below mRxWatermark */
+    unsigned long       mRxHeldSince;   /* jiffies the oldest queued data arrived */
+    struct delayed_work mRxLatencyWork; /* wakes readers once mRxLatency has passed */
+    bool                mbDplRecords;   /* read() returns framed DPL records */
+    sQTIDevHdlc         mHdlc;          /* DIAG HDLC framing, see qcom_hdlc.h */
+    sQTIDevBench        mBench;         /* throughput benchmark, see qcom_bench.h */
     __u8		        disconnected;
 #ifdef QCUSB_TEST_ONLY
     __u8                mLpcRead;
@@ -295,8 +341,10 @@ typedef struct sQTIDevUSB {
     spinlock_t          mTestLock;      /* lock for test IO */
 #endif
     struct workqueue_struct *mpWorkQ;   /* Work queue */
+    int                 mNumaNode;      /* node buffers and work go to, NUMA_NO_NODE for any */
     sQTIDevStats        mStats;
     struct kobject      *kobj_qdss; 
+    struct sQTIDevRing  *mpRing;        /* mmap receive ring, NULL when not mapped */
     int                 debug;
     char                pName[255]; 
     char                fqDevName[255]; /* Fully qualified Device node Name*/
@@ -4,6 +4,7 @@
 */
 
 #include "qcom_usb.h"
+#include "qcom_ring.h"
 #include "../version.h"
 #include <linux/poll.h>
 #include <linux/vmalloc.h>
@@ -22,10 +23,25 @@ static char *gModemInfFilePath = NULL;
 fileInfo_t  *gDiagFileInfo;
 static char *gDiagInfFilePath = NULL;
 
+/* Serializes probes reloading and reading the INF tables above */
+static DEFINE_MUTEX(gInfLock);
+
 int debug_g=0;//For global logging
 
 int UrbRxSize=QTIDEV_RX_SIZE;//global RxSize variable
+int UrbRxCount=BULK_URB_LIST;//bulk-in URBs in flight per device
+/* Per device type overrides of UrbRxCount/UrbRxSize, 0 keeps the global value */
+int UrbRxCountTrace=0;
+int UrbRxSizeTrace=0;
+int UrbRxCountDpl=0;
+int UrbRxSizeDpl=0;
+int UrbRxCountBulk=0;
+int UrbRxSizeBulk=0;
 int UrbTxSize=QTIDEV_TX_SIZE;//global TxSize variable
+int TxDepth=0;//write()s in flight per device, 0 to wait for each
+int RingSlots=QTIDEV_RING_DEFAULT_SLOTS;//slots of an mmap ring
+int RxReaders=0;//opens sharing a bulk-in stream with the first one
+int RxReaderPolicy=QTIDEV_RX_POLICY_DROP;//what a slow shared reader costs
 int skip_open_handles = 0;
 
 static struct usb_driver qtiDevDriver;
@@ -43,16 +59,26 @@ static int DevicesIdle, DevicesActive;
 
 static void InitializeTxBuffers(sQTIDevUSB *pDev);
 static void DeinitializeTxBuffers(sQTIDevUSB *pDev);
-static void UpSem(sQTIDevUSB *pDev, void *pData, int evt);
-static unsigned int ReadBufferFreeSpace(sQTIDevUSB *pDev);
+static void KillTxUrbs(sQTIDevUSB *pDev);
+static void ReleaseTxBuffer(sQTIDevUSB *pDev, sQTIDevTxBuf *pTxBuf);
 static int InitializeURB(sQTIDevUSB *pDev);
+static void RxLatencyWork(struct work_struct *pWork);
+static void QueueRxLatencyWork(sQTIDevUSB *pDev, unsigned long due);
+static void NotifyRxReaders(sQTIDevUSB *pDev);
+static sReadMemChunk *FindReaderChunk(sQTIDevUSB *pDev, sQTIDevReader *pReader);
+static int AllocBulkInUrbs(sQTIDevUSB *pDev);
 static void FinalizeURB(sQTIDevUSB *pDev);
 static bool ClearReadMemList(sQTIDevUSB *pDev);
 static void DeInitializeURB(sQTIDevUSB *pDev);
 static int SubmitAllReadUrb(sQTIDevUSB *pDev);
 static void StopRead(sQTIDevUSB *pDev);
-static bool PopFromQueueAndSubmit(sQTIDevUSB *pDev);
-static void AddToQueue(sQTIDevUSB *pDev, struct urb *pUrb);
+static void ResubmitParkedUrbs(sQTIDevUSB *pDev);
+static int InitializeReadChunks(sQTIDevUSB *pDev);
+static void FreeReadChunks(sQTIDevUSB *pDev);
+static void DetachReadChunks(sQTIDevUSB *pDev);
+static void StopBulkInUrbs(sQTIDevUSB *pDev);
+static void FreeBulkInBuffers(sQTIDevUSB *pDev);
+static const struct file_operations UserSpaceQdssReaderFops;
 static ssize_t ioData_dequeue(struct kiocb *kiocb, void *userData);
 static void *io_async_complete(struct kiocb *kiocb, void *userData);
 static ssize_t readFromRingbuff(struct qtidev_aio_data *pIoData);
@@ -71,9 +97,7 @@ void PrintHex(void *pBuffer, u16 bufSize);
 int ResubmitIntURB(struct urb *pIntUrb);
 void IntCallback(struct urb * pIntURB);
 void SetDtrRts(sQTIDevUSB *pDev, __u16 DtrRts);
-void RemoveNotification(sQTIDevUSB *pDev, void *evt);
 int PrepareTxUrbBuffer(sQTIDevUSB *pDev, size_t dataLen, void *pSem);
-void *io_sync_complete(struct kiocb *kiocb, void *userData);
 ssize_t ioData_enqueue(struct kiocb *kiocb);
 ssize_t UserspaceQTIDevWriteIter(struct kiocb *kiocb, struct iov_iter *iov);
 
@@ -130,6 +154,66 @@ static void QtiEnterSVEFlow(sQTIDevUSB *pDev)
 }
 #endif 
 
+static void GetBulkInConfig(sQTIDevUSB *pDev, unsigned int *pUrbCount, size_t *pUrbSize)
+{
+    int urbCount = UrbRxCount;
+    int urbSize = UrbRxSize;
+
+    /* Type specific values, the type comes from the INF the device matched */
+    switch (pDev->mDevInfo.mDevInfInfo.mDevType)
+    {
+        case QTIDEV_INF_TYPE_TRACE_IN:
+            urbCount = (UrbRxCountTrace > 0) ? UrbRxCountTrace : urbCount;
+            urbSize = (UrbRxSizeTrace > 0) ? UrbRxSizeTrace : urbSize;
+            break;
+        case QTIDEV_INF_TYPE_DPL:
+            urbCount = (UrbRxCountDpl > 0) ? UrbRxCountDpl : urbCount;
+            urbSize = (UrbRxSizeDpl > 0) ? UrbRxSizeDpl : urbSize;
+            break;
+        case QTIDEV_INF_TYPE_BULK_IN_OUT:
+            urbCount = (UrbRxCountBulk > 0) ? UrbRxCountBulk : urbCount;
+            urbSize = (UrbRxSizeBulk > 0) ? UrbRxSizeBulk : urbSize;
+            break;
+        default:
+            break;
+    }
+
+    *pUrbCount = clamp(urbCount, 1, BULK_URB_LIST_MAX);
+    *pUrbSize = ALIGN(clamp(urbSize, QTIDEV_RX_SIZE_MIN, QTIDEV_RX_SIZE_MAX), QTIDEV_RX_SIZE_ALIGN);
+}
+
+/* Node of the host controller the device hangs off, NUMA_NO_NODE on single node systems */
+static int QtiControllerNode(struct usb_device *udev)
+{
+    if (num_online_nodes() <= 1)
+        return NUMA_NO_NODE;
+    return dev_to_node(udev->bus->controller);
+}
+
+/* alloc_pages_exact() on a node, alloc_pages_exact_nid() is not exported */
+static void *QtiAllocPagesNode(int node, size_t size, gfp_t gfp)
+{
+    unsigned int order = get_order(size);
+    unsigned long addr;
+    unsigned long used;
+    unsigned long end;
+    struct page *page;
+
+    if (node == NUMA_NO_NODE)
+        return alloc_pages_exact(size, gfp);
+
+    page = alloc_pages_node(node, gfp & ~__GFP_COMP, order);
+    if (page == NULL)
+        return NULL;
+    /* Split so the buffer can be released with free_pages_exact() */
+    addr = (unsigned long)page_address(page);
+    split_page(page, order);
+    end = addr + (PAGE_SIZE << order);
+    for (used = addr + PAGE_ALIGN(size); used < end; used += PAGE_SIZE)
+        free_page(used);
+    return (void *)addr;
+}
+
 static int QtiInitializeDeviceContext(sQTIDevUSB *dev)
 {
     /* To maintain Ref count, can be avoided */
@@ -138,34 +222,39 @@ static int QtiInitializeDeviceContext(sQTIDevUSB *dev)
     spin_lock_init(&dev->mSpinReadBuffLock);
     spin_lock_init(&dev->mSpinErrLock);
     spin_lock_init(&dev->mBulkMemList.mReadMemLock);
+    INIT_LIST_HEAD(&dev->mBulkMemList.mReaderList);
+    init_waitqueue_head(&dev->mBulkMemList.mRxWaitQueue);
+    dev->mBulkMemList.mbOwnerOpen = false;
     init_usb_anchor(&dev->submitted);
+    /* Pooled contexts are placed by the probe that takes them */
+    dev->mNumaNode = NUMA_NO_NODE;
     /* Initialize TX buffer elements */
     InitializeTxBuffers(dev);
 
     dev->mpWorkQ = alloc_workqueue("qtiWQ", 0, 4);
+    INIT_DELAYED_WORK(&dev->mRxLatencyWork, RxLatencyWork);
     // dev->udev = usb_get_dev(interface_to_usbdev(interface));
     // dev->interface = interface;
-    dev->mBulkMemList.mpReadNotifyList = NULL;
     dev->debug=QC_LOG_LVL_INFO/10;
     dev->disconnected = 0;
+    dev->mpRing = NULL;
+    QTIDevBenchInit(&dev->mBench);
     
 #ifdef QCUSB_TEST_ONLY
     dev->mLpcRead = 0;
     spin_lock_init(&dev->mTestLock);
 #endif
-#ifdef QDSS_INT_BULK_BUFFER
-    dev->mBulkMemList.mReadBuffCircular.mBulk_in_buffer = vzalloc(QTIDEV_BULK_BUF_LEN+1024);
-    if (!dev->mBulkMemList.mReadBuffCircular.mBulk_in_buffer) {
-        QC_LOG_ERR(dev,"Failed to allocate vmalloc memory\n");
-        return -ENOMEM;
-    }
-    dev->mBulkMemList.mReadBuffCircular.mBufflen = QTIDEV_BULK_BUF_LEN;
-    dev->mBulkMemList.mReadBuffCircular.mStartIdx = 0;
-    dev->mBulkMemList.mReadBuffCircular.mEndIdx = 0;
-    dev->mBulkMemList.mReadBuffCircular.mBufEmptyStatus = true;
-#endif
-    dev->mBulkInSize = UrbRxSize; // QTIDEV_RX_SIZE;
-    QC_LOG_GLOBAL("URB Rx Size %zu\n", dev->mBulkInSize);
+    /* Global defaults until probe knows the device type */
+    dev->mDevInfo.mDevInfInfo.mDevType = QTIDEV_INF_TYPE_UNKNOWN;
+    GetBulkInConfig(dev, &dev->mBulkUrbCount, &dev->mBulkInSize);
+    QC_LOG_GLOBAL("URB Rx Size %zu x %u\n", dev->mBulkInSize, dev->mBulkUrbCount);
+    /* Receive buffers and bulk-in URBs come with the probe that takes the context */
+    INIT_LIST_HEAD(&dev->mBulkMemList.mChunkList);
+    INIT_LIST_HEAD(&dev->mBulkMemList.mChunkFreeList);
+    INIT_LIST_HEAD(&dev->mBulkMemList.mChunkSharedList);
+    INIT_LIST_HEAD(&dev->mBulkMemList.mChunkHeldList);
+    dev->mBulkMemList.mpChunkPool = NULL;
+    dev->mBulkMemList.mChunkCount = 0;
     return InitializeURB(dev);
 }
 
@@ -185,12 +274,10 @@ static void QtiResetDeviceContext(sQTIDevUSB *pDev)
     memset(&pDev->mStats, 0, sizeof(sQTIDevStats));
 
     pDev->mIoReadBuffListActiveSize = 0;
-    pDev->mIoReadBuffListIdleSize = BULK_URB_LIST;
-    ClearReadMemList(pDev); // pDev->mBulkUrbBuffListSize = 0;
+    ClearReadMemList(pDev);
 
-    for (i = 0; i < BULK_URB_LIST; i++)
+    for (i = 0; i < pDev->mBulkUrbCount; i++)
     {
-        pDev->mIoReadList[i].kiocb = NULL;
         pDev->mBulkUrbList[i].mUrbStatus = BULK_URB_INITIALIZED;
     }
 }
@@ -234,6 +321,7 @@ static sQTIDevUSB *QtiAcquireDevice(struct usb_device *udev_temp, struct usb_int
 {
     char fqDevName_temp[255];
     sQTIDevUSB *pDev = NULL;
+    sQTIDevUSB *pEntry;
     unsigned long flags;
     int success = 0;
 
@@ -243,12 +331,41 @@ static sQTIDevUSB *QtiAcquireDevice(struct usb_device *udev_temp, struct usb_int
         udev_temp->actconfig->desc.bConfigurationValue,
         interface->cur_altsetting->desc.bInterfaceNumber);  
 
+    /* Probes may run in parallel: the lists are only walked under the lock */
     spin_lock_irqsave(&DevListLock, flags);
-    if (list_empty(&DeviceListIdle) == true)
+    list_for_each_entry(pEntry, &DeviceListIdle, node)
+    {
+        if (strncmp(pEntry->fqDevName,fqDevName_temp,255) == 0)
+        {
+            pDev = pEntry;
+            break;
+        }
+    }
+    if (pDev == NULL)
+    {
+        /*Entry not found: Check if there is any empty list node (default entry) else Create new entry and add it to active list directly. We can't do blind move because entries are important if device comes back later (in case of multiple device)*/
+        list_for_each_entry(pEntry, &DeviceListIdle, node)
+        {
+            if (strncmp(pEntry->fqDevName,"",255) == 0)
+            {
+                pDev = pEntry;
+                break;
+            }
+        }
+    }
+    if (pDev != NULL)
+    {
+        list_move_tail(&pDev->node, &DeviceListActive);
+        --DevicesIdle;
+        ++DevicesActive;
+        success = 1;
+    }
+    spin_unlock_irqrestore(&DevListLock, flags);
+
+    if (pDev == NULL) /* Now create a new entry, outside of the lock as it sleeps */
     {
-        spin_unlock_irqrestore(&DevListLock, flags);
         pDev = qti_kmalloc(sizeof(sQTIDevUSB), GFP_KERNEL);
-	if (pDev != NULL)
+        if (pDev != NULL)
         {
             if (QtiInitializeDeviceContext(pDev))
             {
@@ -259,71 +376,14 @@ static sQTIDevUSB *QtiAcquireDevice(struct usb_device *udev_temp, struct usb_int
             }
             else
             {
+                spin_lock_irqsave(&DevListLock, flags);
                 list_add_tail(&pDev->node, &DeviceListActive);
                 ++DevicesActive;
+                spin_unlock_irqrestore(&DevListLock, flags);
                 success = 1;
             }
         }
     }
-    else
-    {
-        int found=0;
-        list_for_each_entry(pDev, &DeviceListIdle, node)
-        {
-            
-         
-            int res = strncmp(pDev->fqDevName,fqDevName_temp,255);
-            if(res == 0)
-            {
-                /* printk(KERN_INFO "FOUND THE ENTRY\n"); */
-                found=1;
-                list_move_tail(&pDev->node, &DeviceListActive);
-                --DevicesIdle;
-                ++DevicesActive;
-                success = 1;
-                break;
-            }
-        }
-        if(found == 0){/*Entry not found: Check if there is any empty list node (default entry) else Create new entry and add it to active list directly. We can't do blind move because entries are important if device comes back later (in case of multiple device)*/
-            int findNULL = 0;/* Flag to record if any NULL entry found*/ 
-            list_for_each_entry(pDev, &DeviceListIdle, node)
-            {
-                int res = strncmp(pDev->fqDevName,"",255);
-                if(res == 0)
-                {
-                    /* printk(KERN_INFO "FOUND A NULL ENTRY\n");*/
-                    findNULL = 1;
-                    list_move_tail(&pDev->node, &DeviceListActive);
-                    --DevicesIdle;
-                    ++DevicesActive;
-                    success = 1;
-                    break;
-                }
-            }
-            if(findNULL == 0) /* Now create a new entry*/
-            {
-                pDev = qti_kmalloc(sizeof(sQTIDevUSB), GFP_KERNEL);
-                if (pDev != NULL)
-                {
-                    /*printk(KERN_INFO "CREATED A NEW ENTRY\n");*/
-                    if (QtiInitializeDeviceContext(pDev))
-                    {
-                        QC_LOG_ERR(pDev,"Failed to initialize dev context\n");
-                        DeInitializeURB(pDev);
-                        qti_kfree(pDev);
-                        pDev = NULL;
-                    }
-                    else
-                    {
-                        list_add_tail(&pDev->node, &DeviceListActive);
-                        ++DevicesActive;
-                        success = 1;
-                    }
-                }
-            }
-        }
-        spin_unlock_irqrestore(&DevListLock, flags);
-    }
     if (success == 0)
     {
         QC_LOG_WARN(pDev,"QTI-ALERT: failure to acquire Device (idle-active %d-%d)\n", DevicesIdle, DevicesActive);
@@ -379,6 +439,7 @@ static void QtiFreeDevices(void)
                 list_del(&pDevOnRecord->node);
                 spin_unlock_irqrestore(&DevListLock, flags);
                 DeInitializeURB(pDevOnRecord);
+                cancel_delayed_work_sync(&pDevOnRecord->mRxLatencyWork);
                 destroy_workqueue(pDevOnRecord->mpWorkQ);
                 qti_kfree(pDevOnRecord);
                 --DevicesIdle;
@@ -399,6 +460,7 @@ static void QtiFreeDevices(void)
                 list_del(&pDevOnRecord->node);
                 spin_unlock_irqrestore(&DevListLock, flags);
                 DeInitializeURB(pDevOnRecord);
+                cancel_delayed_work_sync(&pDevOnRecord->mRxLatencyWork);
                 destroy_workqueue(pDevOnRecord->mpWorkQ);
                 qti_kfree(pDevOnRecord);
                 --DevicesActive;
@@ -414,29 +476,256 @@ static void QtiFreeDevices(void)
     return;
 }
 
-static unsigned int ReadBufferFreeSpace(sQTIDevUSB *pDev)
+static int InitializeReadChunks(sQTIDevUSB *pDev)
 {
-    unsigned int freeSpace = 0;
-    unsigned int buffLen = pDev->mBulkMemList.mReadBuffCircular.mBufflen;
-    unsigned int startIdx = pDev->mBulkMemList.mReadBuffCircular.mStartIdx;
-    unsigned int endIdx = pDev->mBulkMemList.mReadBuffCircular.mEndIdx;
+    unsigned int idx;
+    unsigned int count;
+
+    INIT_LIST_HEAD(&pDev->mBulkMemList.mChunkList);
+    INIT_LIST_HEAD(&pDev->mBulkMemList.mChunkFreeList);
+    INIT_LIST_HEAD(&pDev->mBulkMemList.mChunkSharedList);
+    INIT_LIST_HEAD(&pDev->mBulkMemList.mChunkHeldList);
+    pDev->mBulkMemList.mChunkBytes = 0;
+
+    /* Same memory budget as the former circular buffer, in URB sized pieces */
+    count = QTIDEV_BULK_BUF_LEN / pDev->mBulkInSize;
+    if (count < pDev->mBulkUrbCount * QTIDEV_RX_CHUNKS_PER_URB)
+        count = pDev->mBulkUrbCount * QTIDEV_RX_CHUNKS_PER_URB;
+
+    pDev->mBulkMemList.mpChunkPool = qti_kmalloc_node(count * sizeof(sReadMemChunk), GFP_KERNEL, pDev->mNumaNode);
+    if (!pDev->mBulkMemList.mpChunkPool)
+        return -ENOMEM;
+    pDev->mBulkMemList.mChunkCount = count;
+    pDev->mBulkMemList.mChunkNode = pDev->mNumaNode;
 
-    if (pDev->mBulkMemList.mReadBuffCircular.mBufEmptyStatus == true)
+    for (idx = 0; idx < count; idx++)
     {
-        freeSpace = QTIDEV_BULK_BUF_LEN;
+        sReadMemChunk *pChunk = &pDev->mBulkMemList.mpChunkPool[idx];
+
+        /* DMA-able and made of plain pages that splice_read can pin */
+        pChunk->mpBuffer = QtiAllocPagesNode(pDev->mNumaNode, pDev->mBulkInSize, GFP_KERNEL);
+        if (!pChunk->mpBuffer)
+        {
+            FreeReadChunks(pDev);
+            return -ENOMEM;
+        }
+        list_add_tail(&pChunk->node, &pDev->mBulkMemList.mChunkFreeList);
     }
-    else
+    QC_LOG_DBG(pDev,"%u receive buffers of %zu\n", count, pDev->mBulkInSize);
+    return 0;
+}
+
+static void FreeReadChunks(sQTIDevUSB *pDev)
+{
+    unsigned int idx;
+
+    if (!pDev->mBulkMemList.mpChunkPool)
+        return;
+
+    for (idx = 0; idx < pDev->mBulkMemList.mChunkCount; idx++)
+    {
+        /* Pages still in a pipe are freed by their last user */
+        if (pDev->mBulkMemList.mpChunkPool[idx].mpBuffer != NULL)
+            free_pages_exact(pDev->mBulkMemList.mpChunkPool[idx].mpBuffer, pDev->mBulkInSize);
+    }
+    qti_kfree(pDev->mBulkMemList.mpChunkPool);
+    pDev->mBulkMemList.mpChunkPool = NULL;
+    pDev->mBulkMemList.mChunkCount = 0;
+    INIT_LIST_HEAD(&pDev->mBulkMemList.mChunkList);
+    INIT_LIST_HEAD(&pDev->mBulkMemList.mChunkFreeList);
+    INIT_LIST_HEAD(&pDev->mBulkMemList.mChunkSharedList);
+    INIT_LIST_HEAD(&pDev->mBulkMemList.mChunkHeldList);
+    pDev->mBulkMemList.mChunkBytes = 0;
+}
+
+/* No pipe or socket holds a page of the buffer any more */
+static bool ReadChunkIdle(sQTIDevUSB *pDev, sReadMemChunk *pChunk)
+{
+    size_t offset;
+
+    for (offset = 0; offset < pDev->mBulkInSize; offset += PAGE_SIZE)
+    {
+        if (page_count(virt_to_page(pChunk->mpBuffer + offset)) != 1)
+            return false;
+    }
+    return true;
+}
+
+// FUNCTION SharedReaderDue runs within mReadMemLock
+//    Whether a shared reader gets its unread data now, by its own watermark
+//    and latency. Arms the latency work for data below the watermark.
+static bool SharedReaderDue(sQTIDevUSB *pDev, sQTIDevReader *pReader)
+{
+    __u64 unread = pDev->mBulkMemList.mStreamBytes - pReader->mCursor;
+    __u64 latencyNs = (__u64)pReader->mRxLatency * NSEC_PER_MSEC;
+    sReadMemChunk *pChunk;
+    __u64 waitedNs;
+
+    if (unread == 0)
+    {
+        return false;
+    }
+    /* The URBs ran out of buffers, held back data must go */
+    if ((unread >= pReader->mRxWatermark) || list_empty(&pDev->mBulkMemList.mChunkFreeList))
+    {
+        return true;
+    }
+    if (pReader->mRxLatency == 0)
+    {
+        return false;
+    }
+    pChunk = FindReaderChunk(pDev, pReader);
+    if (pChunk == NULL)
+    {
+        return false;
+    }
+    waitedNs = ktime_get_ns() - pChunk->mTimestamp;
+    if (waitedNs >= latencyNs)
+    {
+        return true;
+    }
+    QueueRxLatencyWork(pDev, jiffies + msecs_to_jiffies(div_u64(latencyNs - waitedNs, NSEC_PER_MSEC) + 1));
+    return false;
+}
+
+// FUNCTION WakeSharedReaders runs within mReadMemLock
+static void WakeSharedReaders(sQTIDevUSB *pDev)
+{
+    sQTIDevReader *pReader;
+
+    list_for_each_entry(pReader, &pDev->mBulkMemList.mReaderList, node)
+    {
+        if (SharedReaderDue(pDev, pReader))
+            wake_up_interruptible(&pReader->mWaitQueue);
+    }
+}
+
+// FUNCTION SharedReadersNeed runs within mReadMemLock
+static bool SharedReadersNeed(sQTIDevUSB *pDev, sReadMemChunk *pChunk)
+{
+    sQTIDevReader *pReader;
+
+    list_for_each_entry(pReader, &pDev->mBulkMemList.mReaderList, node)
+    {
+        if (pReader->mCursor < pChunk->mSeq + pChunk->mDataLen)
+            return true;
+    }
+    return false;
+}
+
+// FUNCTION ReturnReadChunk runs within mReadMemLock
+static void ReturnReadChunk(sQTIDevUSB *pDev, sReadMemChunk *pChunk)
+{
+    if (pChunk->mbShared && !ReadChunkIdle(pDev, pChunk))
+    {
+        /* A URB must not overwrite data a pipe still refers to */
+        list_add_tail(&pChunk->node, &pDev->mBulkMemList.mChunkSharedList);
+        return;
+    }
+    pChunk->mbShared = false;
+    list_add_tail(&pChunk->node, &pDev->mBulkMemList.mChunkFreeList);
+}
+
+// FUNCTION RecycleReadChunk runs within mReadMemLock
+//    A chunk the first open is done with
+static void RecycleReadChunk(sQTIDevUSB *pDev, sReadMemChunk *pChunk)
+{
+    if (SharedReadersNeed(pDev, pChunk))
+    {
+        /* Kept in stream order until the shared readers are past it */
+        list_add_tail(&pChunk->node, &pDev->mBulkMemList.mChunkHeldList);
+        WakeSharedReaders(pDev);
+        return;
+    }
+    ReturnReadChunk(pDev, pChunk);
+}
+
+// FUNCTION ReleaseHeldChunks runs within mReadMemLock
+static void ReleaseHeldChunks(sQTIDevUSB *pDev)
+{
+    sReadMemChunk *pChunk;
+    sReadMemChunk *pSafe;
+
+    list_for_each_entry_safe(pChunk, pSafe, &pDev->mBulkMemList.mChunkHeldList, node)
+    {
+        if (!SharedReadersNeed(pDev, pChunk))
+        {
+            list_del(&pChunk->node);
+            ReturnReadChunk(pDev, pChunk);
+        }
+    }
+}
+
+// FUNCTION DropHeldChunk runs within mReadMemLock
+//    Drop policy: the oldest data the slow readers did not get to goes to the
+//    URBs, and those readers continue after it
+static void DropHeldChunk(sQTIDevUSB *pDev)
+{
+    sReadMemChunk *pChunk;
+    sQTIDevReader *pReader;
+    __u64 end;
+
+    if (list_empty(&pDev->mBulkMemList.mChunkHeldList))
+        return;
+    pChunk = list_first_entry(&pDev->mBulkMemList.mChunkHeldList, sReadMemChunk, node);
+    list_for_each_entry(pReader, &pDev->mBulkMemList.mReaderList, node)
+    {
+        if (pReader->mpBusyChunk == pChunk)
+            return;
+    }
+
+    end = pChunk->mSeq + pChunk->mDataLen;
+    list_for_each_entry(pReader, &pDev->mBulkMemList.mReaderList, node)
     {
-        if (startIdx < endIdx)
+        if (pReader->mCursor < end)
         {
-            freeSpace = buffLen - (endIdx - startIdx);
+            pReader->mDropped += end - max(pReader->mCursor, pChunk->mSeq);
+            pReader->mCursor = end;
         }
-        else if (startIdx > endIdx)
+    }
+    QC_LOG_DBG(pDev,"dropped %u bytes at %llu for slow readers\n", pChunk->mDataLen, pChunk->mSeq);
+    list_del(&pChunk->node);
+    ReturnReadChunk(pDev, pChunk);
+}
+
+// FUNCTION ReclaimSharedChunks runs within mReadMemLock
+static void ReclaimSharedChunks(sQTIDevUSB *pDev)
+{
+    sReadMemChunk *pChunk;
+    sReadMemChunk *pSafe;
+
+    list_for_each_entry_safe(pChunk, pSafe, &pDev->mBulkMemList.mChunkSharedList, node)
+    {
+        if (ReadChunkIdle(pDev, pChunk))
         {
-            freeSpace = startIdx - endIdx;
+            pChunk->mbShared = false;
+            list_move_tail(&pChunk->node, &pDev->mBulkMemList.mChunkFreeList);
         }
     }
-    return freeSpace;
+}
+
+// FUNCTION AttachReadChunk runs within mReadMemLock
+static bool AttachReadChunk(sQTIDevUSB *pDev, sBulkUrbList *pUrbItem)
+{
+    sReadMemChunk *pChunk;
+
+    if (pUrbItem->mpChunk != NULL)
+        return true;
+    if (list_empty(&pDev->mBulkMemList.mChunkFreeList))
+        ReclaimSharedChunks(pDev);
+    if (list_empty(&pDev->mBulkMemList.mChunkFreeList) &&
+            (pDev->mBulkMemList.mReaderPolicy == QTIDEV_RX_POLICY_DROP))
+        DropHeldChunk(pDev);
+    if (list_empty(&pDev->mBulkMemList.mChunkFreeList))
+        return false;
+
+    pChunk = list_first_entry(&pDev->mBulkMemList.mChunkFreeList, sReadMemChunk, node);
+    list_del(&pChunk->node);
+    pChunk->mDataLen = 0;
+    pChunk->mOffset = 0;
+    pUrbItem->mpChunk = pChunk;
+    pUrbItem->mBulk_in_urb->transfer_buffer = pChunk->mpBuffer;
+    return true;
 }
 
 static void ClearAioData(struct kref *mRefCount)
@@ -459,6 +748,13 @@ static void QTIDevUSBDelete(struct kref *mRefCount)
     sQTIDevUSB *dev = container_of(mRefCount, sQTIDevUSB, mRefCount);
 
     QC_LOG_INFO(dev,"de-ref device\n");
+    /* Last close after an unplug: nothing reads the receive buffers any more */
+    if (dev->disconnected)
+    {
+        mutex_lock(&dev->mIoMutex);
+        FreeReadChunks(dev);
+        mutex_unlock(&dev->mIoMutex);
+    }
     /* prevent more I/O from starting */
     usb_put_intf(dev->interface);
     dev->interface = NULL;
@@ -676,6 +972,90 @@ void SetDtrRts(sQTIDevUSB *pDev, __u16 DtrRts)
    QC_LOG_INFO(pDev, "Set DTR/RTS 0x%x\n", DtrRts);
 } // SetDtrRts
 
+static bool SharedReadSupported(sQTIDevUSB *pDev)
+{
+    switch (pDev->mDevInfo.mDevInfInfo.mDevType)
+    {
+        case QTIDEV_INF_TYPE_TRACE_IN:
+        case QTIDEV_INF_TYPE_DPL:
+        case QTIDEV_INF_TYPE_BULK:
+        case QTIDEV_INF_TYPE_BULK_IN_OUT:
+            return true;
+        default:
+            return false;
+    }
+}
+
+// FUNCTION OpenSharedReader runs within mIoMutex
+//    Open of a node that is open already. Up to RxReaders opens follow the
+//    stream from now on without consuming it; once the first open is gone
+//    the next open consumes the queue in its place.
+static int OpenSharedReader(sQTIDevUSB *pDev, struct file *file)
+{
+    sQTIDevReader *pReader;
+    unsigned long flags;
+    unsigned int count = 0;
+    bool bOwnerOpen;
+
+    if ((RxReaders <= 0) || !SharedReadSupported(pDev))
+    {
+        return -EIO;
+    }
+    if (pDev->mpRing != NULL)
+    {
+        /* The ring has no queue to share */
+        return -EBUSY;
+    }
+
+    spin_lock_irqsave(&pDev->mBulkMemList.mReadMemLock, flags);
+    bOwnerOpen = pDev->mBulkMemList.mbOwnerOpen;
+    list_for_each_entry(pReader, &pDev->mBulkMemList.mReaderList, node)
+    {
+        count++;
+    }
+    if (!bOwnerOpen)
+    {
+        /* Read settings belong to the consuming open, not to the device */
+        pDev->mBulkMemList.mbOwnerOpen = true;
+        pDev->mRxWatermark = 0;
+        pDev->mRxLatency = 0;
+        pDev->mbDplRecords = false;
+    }
+    spin_unlock_irqrestore(&pDev->mBulkMemList.mReadMemLock, flags);
+
+    if (!bOwnerOpen)
+    {
+        QC_LOG_INFO(pDev,"takes over the stream from %u shared readers\n", count);
+        kref_get(&pDev->mRefCount);
+        file->private_data = pDev;
+        return 0;
+    }
+    if (count >= min(RxReaders, QTIDEV_RX_READERS_MAX))
+    {
+        return -EIO;
+    }
+
+    pReader = qti_kmalloc(sizeof(sQTIDevReader), GFP_KERNEL);
+    if (pReader == NULL)
+    {
+        return -ENOMEM;
+    }
+    memset(pReader, 0, sizeof(sQTIDevReader));
+    pReader->mpDev = pDev;
+    init_waitqueue_head(&pReader->mWaitQueue);
+
+    spin_lock_irqsave(&pDev->mBulkMemList.mReadMemLock, flags);
+    pReader->mCursor = pDev->mBulkMemList.mStreamBytes;
+    list_add_tail(&pReader->node, &pDev->mBulkMemList.mReaderList);
+    spin_unlock_irqrestore(&pDev->mBulkMemList.mReadMemLock, flags);
+
+    kref_get(&pDev->mRefCount);
+    file->private_data = pReader;
+    replace_fops(file, fops_get(&UserSpaceQdssReaderFops));
+    QC_LOG_INFO(pDev,"shared reader %u at %llu\n", count + 1, pReader->mCursor);
+    return 0;
+}
+
 static int UserspaceQTIDevOpen(struct inode *inode, struct file *file)
 {
     sQTIDevUSB *dev;
@@ -692,9 +1072,6 @@ static int UserspaceQTIDevOpen(struct inode *inode, struct file *file)
     QC_LOG_INFO(dev, "PID = %u, Pname = %s, tgid= %u\n",task_pid_nr(current),current->comm, task_tgid_nr(current));
     strscpy(dev->pName, current->comm, 255);
 
-    dev->mStats.RxCount = dev->mStats.TxCount = 0;
-    dev->mStats.USBRxCnt = dev->mStats.ToUsrCnt = 0;
-
     interface = dev->interface;
     if (!interface) {
         QC_LOG_ERR(dev,"%s - error, can't find device \n", __func__);
@@ -706,31 +1083,48 @@ static int UserspaceQTIDevOpen(struct inode *inode, struct file *file)
     if (retval)
         goto exit;
 
+    /* Serializes with a bulk-in re-size from sysfs */
+    mutex_lock(&dev->mIoMutex);
 #if (LINUX_VERSION_CODE <= KERNEL_VERSION(4,10,17))
     if (dev->mRefCount.refcount.counter > 1)
 #else
     if (dev->mRefCount.refcount.refs.counter > 1)
 #endif
     {
+        retval = OpenSharedReader(dev, file);
+        mutex_unlock(&dev->mIoMutex);
+        if (retval != 0)
+        {
 #if (LINUX_VERSION_CODE <= KERNEL_VERSION(4,10,17))
-        QC_LOG_ERR(dev,"device busy, open denied. RefCnt:%d\n",
-                dev->mRefCount.refcount.counter);
+            QC_LOG_ERR(dev,"device busy, open denied. RefCnt:%d\n",
+                    dev->mRefCount.refcount.counter);
 #else
-        QC_LOG_ERR(dev,"device busy, open denied. RefCnt:%d\n",
-                dev->mRefCount.refcount.refs.counter);
+            QC_LOG_ERR(dev,"device busy, open denied. RefCnt:%d\n",
+                    dev->mRefCount.refcount.refs.counter);
 #endif
-        retval = -EIO;
-        if (interface)
             usb_autopm_put_interface(interface);
+        }
         goto exit;
     }
 
     kref_init(&dev->mRefCount);
     /* increment our usage count for the device */
     kref_get(&dev->mRefCount);
+    dev->mBulkMemList.mbOwnerOpen = true;
+    mutex_unlock(&dev->mIoMutex);
+
+    dev->mStats.RxCount = dev->mStats.TxCount = 0;
+    dev->mStats.USBRxCnt = dev->mStats.ToUsrCnt = 0;
+    dev->mRxWatermark = 0;
+    dev->mRxLatency = 0;
+    dev->mbDplRecords = false;
 
     /* save our object in the file's private structure */
     file->private_data = dev;
+#ifdef FMODE_NOWAIT
+    /* read_iter honours IOCB_NOWAIT, so io_uring polls instead of handing reads to a worker */
+    file->f_mode |= FMODE_NOWAIT;
+#endif
 
     if ((dev->mDevInfo.mDevInfInfo.mDevType == QTIDEV_INF_TYPE_INT_IN) 
         && (dev->mpIntURB != NULL))
@@ -771,6 +1165,7 @@ static int UserspaceQTIDevOpen(struct inode *inode, struct file *file)
         if (retval != 0)
         {
             QC_LOG_ERR(dev," Error in reading\n");
+            dev->mBulkMemList.mbOwnerOpen = false;
             kref_put(&dev->mRefCount, QTIDevUSBDelete);
         }
     }
@@ -793,68 +1188,45 @@ exit:
     return retval;
 }
 
-static bool ClearNotifyList(sQTIDevUSB *pDev)
+// FUNCTION CancelRxWaiters runs within mReadMemLock
+//    The blocked read()s return 0
+static void CancelRxWaiters(sQTIDevUSB *pDev)
 {
-    sNotifyList *pThisNotifyList;
-
     QC_LOG_DBG(pDev,"");
-    while (pDev->mBulkMemList.mpReadNotifyList != NULL)
-    {
-        pThisNotifyList = pDev->mBulkMemList.mpReadNotifyList;
-        pDev->mBulkMemList.mpReadNotifyList = pThisNotifyList->mpNext;
-        if (pThisNotifyList->mpNotifyFunct && pThisNotifyList->mpData)
-            pThisNotifyList->mpNotifyFunct(pDev, pThisNotifyList->mpData, QTI_RX_EVT_CANCEL);
-        pThisNotifyList->mpData = NULL;
-        pThisNotifyList->mInProcess = 0;
-    }
-    return true;
+    pDev->mBulkMemList.mRxCancelSeq++;
+    wake_up_all(&pDev->mBulkMemList.mRxWaitQueue);
 }
 
 static bool ClearReadMemList(sQTIDevUSB *pDev)
 {
-    sBulkUrbList *pBulkUrbTraverse=NULL;
-
-    QC_LOG_DBG(pDev," mBulkUrbBuffListSize: %lu\n", pDev->mBulkUrbBuffListSize);
-    list_for_each_entry(pBulkUrbTraverse, &pDev->mBulkUrbBuffList, node) {
-        pBulkUrbTraverse->Context = NULL;
-        pBulkUrbTraverse->mIndex = -1;
-        pBulkUrbTraverse->mBulk_in_urb = NULL;
-        pBulkUrbTraverse->mBulk_in_buffer = NULL;
-        pBulkUrbTraverse->mUrbStatus = 0;
-    }
-    pDev->mBulkUrbBuffListSize = 0;
+    sReadMemChunk *pChunk;
 
-    if (pDev->mBulkMemList.mReadBuffCircular.mBulk_in_buffer) {
-        QC_LOG_INFO(pDev,"reset vmalloc memory\n");
-        memset(pDev->mBulkMemList.mReadBuffCircular.mBulk_in_buffer, 0, QTIDEV_BULK_BUF_LEN + 1024);
+    QC_LOG_DBG(pDev," unread bytes: %zu\n", pDev->mBulkMemList.mChunkBytes);
+    /* Received data goes back to the replenish pool, URB buffers stay attached */
+    while (!list_empty(&pDev->mBulkMemList.mChunkList))
+    {
+        pChunk = list_first_entry(&pDev->mBulkMemList.mChunkList, sReadMemChunk, node);
+        list_del(&pChunk->node);
+        RecycleReadChunk(pDev, pChunk);
     }
-    pDev->mBulkMemList.mReadBuffCircular.mStartIdx = 0;
-    pDev->mBulkMemList.mReadBuffCircular.mEndIdx = 0;
-    pDev->mBulkMemList.mReadBuffCircular.mBufEmptyStatus = true;
-    pDev->mBulkMemList.mReadBuffCircular.mBufflen = QTIDEV_BULK_BUF_LEN;
+    pDev->mBulkMemList.mChunkBytes = 0;
 
     return true;
 }
 
 static bool ClearAioList(sQTIDevUSB *pDev)
 {
-    sIoReadList *pIoReadTraverse;
-    sIoReadList *psafePtr;
     struct qtidev_aio_data *io_data;
+    struct qtidev_aio_data *psafePtr;
 
     QC_LOG_DBG(pDev,"");
     /*
      * list_for_each_entry_safe takes care of the deletion in the read_list
      * being done via ioData_dequeue.
      */
-    list_for_each_entry_safe(pIoReadTraverse, psafePtr, &pDev->mIoReadBuffListActive, node ) {
-	if (pIoReadTraverse && pIoReadTraverse->kiocb) {
-	    io_data = pIoReadTraverse->kiocb->private;
-	    QC_LOG_DBG(pDev,"%s io_data->read true and setting dequeue null \n",__func__);
-	    ioData_dequeue(io_data->kiocb, NULL);
-	}
-	else
-	    break;
+    list_for_each_entry_safe(io_data, psafePtr, &pDev->mIoReadBuffListActive, mReadNode ) {
+	QC_LOG_DBG(pDev,"%s io_data->read true and setting dequeue null \n",__func__);
+	ioData_dequeue(io_data->kiocb, NULL);
     }
     return true;
 }
@@ -862,7 +1234,9 @@ static bool ClearAioList(sQTIDevUSB *pDev)
 static int UserspaceQTIDevRelease(struct inode *inode, struct file *file)
 {
     sQTIDevUSB *pDev=NULL;
+    unsigned char *pPacket;
     unsigned long flags;
+    bool bShared;
 
     if ((file == NULL) || (pDev = file->private_data) == NULL)
     {
@@ -875,11 +1249,38 @@ static int UserspaceQTIDevRelease(struct inode *inode, struct file *file)
     if (pDev->interface)
         usb_autopm_put_interface(pDev->interface);
 
-    /* Stop async reading  */
-    StopRead(pDev);
+    mutex_lock(&pDev->mIoMutex);
+    spin_lock_irqsave(&pDev->mBulkMemList.mReadMemLock, flags);
+    pDev->mBulkMemList.mbOwnerOpen = false;
+    bShared = !list_empty(&pDev->mBulkMemList.mReaderList);
+    spin_unlock_irqrestore(&pDev->mBulkMemList.mReadMemLock, flags);
+
+    /* Stop async reading, unless shared readers still follow the stream */
+    if (!bShared)
+    {
+        StopRead(pDev);
+    }
+    QTIDevRingDetach(pDev);
+    cancel_delayed_work_sync(&pDev->mRxLatencyWork);
     spin_lock_irqsave(&pDev->mBulkMemList.mReadMemLock, flags);
     ClearReadMemList(pDev);
+    /* Shared readers left behind are not held back by this open's watermark */
+    pDev->mRxWatermark = 0;
+    pDev->mRxLatency = 0;
+    /* Rearm the latency work cancelled above for their own settings */
+    WakeSharedReaders(pDev);
+    pDev->mbDplRecords = false;
+    pPacket = pDev->mHdlc.mpPacket;
+    pDev->mHdlc.mpPacket = NULL;
+    QTIDevHdlcReset(&pDev->mHdlc);
     spin_unlock_irqrestore(&pDev->mBulkMemList.mReadMemLock, flags);
+    mutex_unlock(&pDev->mIoMutex);
+    if (pPacket != NULL)
+    {
+        QC_LOG_INFO(pDev,"DIAG HDLC: %u CRC errors, %u oversized frames\n",
+                pDev->mHdlc.mCrcErrors, pDev->mHdlc.mOverflows);
+        qti_kfree(pPacket);
+    }
     kref_put(&pDev->mRefCount, QTIDevUSBDelete);
     return 0;
 }
@@ -928,7 +1329,7 @@ static int UserspaceQTIDevFlush(struct file *pFile, fl_owner_t id)
         // StopRead(pDev,false);
         /* To clear read/notify list */
         spin_lock_irqsave(&pDev->mBulkMemList.mReadMemLock, flags);
-        ClearNotifyList(pDev);
+        CancelRxWaiters(pDev);
         ClearAioList(pDev);
         spin_unlock_irqrestore(&pDev->mBulkMemList.mReadMemLock, flags);
     }
@@ -981,8 +1382,7 @@ static bool MoveDataToDestination(sQTIDevUSB *pDev,
 
 #ifdef QCUSB_TEST_ONLY
     if (pDev->mDevInfo.mDevInfInfo.mDevType == QTIDEV_INF_TYPE_LPC) {
-        int bufLoc = (int)(from - (void *)pDev->mBulkMemList.mReadBuffCircular.mBulk_in_buffer);
-        LpcOutputBytes((unsigned char *)from, pDev->mStats.ToUsrCnt, bufLoc, "LPC-USER");
+        LpcOutputBytes((unsigned char *)from, pDev->mStats.ToUsrCnt, (int)pDev->mBulkMemList.mChunkBytes, "LPC-USER");
     }
 #endif
     if (bFailed == false)
@@ -1005,330 +1405,401 @@ static int CopyFromAioReadMemList(sQTIDevUSB *pDev,
     return CopyFromReadMemList(pDev, ppReadData, pDataSize, 0, QTI_RX_AIO);
 }
 
-static int CopyFromReadMemList(sQTIDevUSB *pDev,
+// Length of the QMAP record at the chunk offset, 0 if the rest is not one
+static unsigned int ParseDplRecord(sReadMemChunk *pChunk, sQTIDevDplRecord *pRecord)
+{
+    unsigned char *pQmap = pChunk->mpBuffer + pChunk->mOffset;
+    unsigned int left = pChunk->mDataLen - pChunk->mOffset;
+    unsigned int packetLen;
+    unsigned int padBytes;
+
+    if (left <= QTIDEV_QMAP_HDR_LEN)
+    {
+        return 0;
+    }
+    packetLen = (pQmap[2] << 8) | pQmap[3];
+    padBytes = pQmap[0] & QTIDEV_QMAP_PAD_MASK;
+    if ((packetLen > left - QTIDEV_QMAP_HDR_LEN) || (packetLen <= padBytes))
+    {
+        return 0;
+    }
+
+    memset(pRecord, 0, sizeof(sQTIDevDplRecord));
+    pRecord->mLength = packetLen - padBytes;
+    pRecord->mTimestamp = pChunk->mTimestamp;
+    pRecord->mMuxId = pQmap[1];
+    pRecord->mPadCD = pQmap[0];
+    return QTIDEV_QMAP_HDR_LEN + packetLen;
+}
+
+// FUNCTION CopyRecordsFromReadMemList runs within mReadMemLock
+//    DPL record mode: as many whole records as fit, each after its
+//    sQTIDevDplRecord. A record larger than the buffer is truncated.
+static int CopyRecordsFromReadMemList(sQTIDevUSB *pDev,
         void **ppReadData,
         size_t *pDataSize,
         unsigned long *iflags,
         eRxType eType)
 {
-    void *pBulkStartInBuffer;
-    unsigned int endIdx;
-    unsigned int startIdx;
-    unsigned int buffLen;
-    QC_LOG_DBG(pDev,"");
-
-    pBulkStartInBuffer = pDev->mBulkMemList.mReadBuffCircular.mBulk_in_buffer;
-    buffLen = pDev->mBulkMemList.mReadBuffCircular.mBufflen;
-    startIdx = pDev->mBulkMemList.mReadBuffCircular.mStartIdx;
-    endIdx = pDev->mBulkMemList.mReadBuffCircular.mEndIdx;
+    sReadMemChunk *pChunk;
+    sQTIDevDplRecord record;
+    unsigned int frameLen;
+    size_t copied = 0;
+    void *dest;
+    bool bFailed;
 
-    QC_LOG_DBG(pDev,"->T%d: data present strt:<%d>, end:<%d>, requested:<%d>\n", eType,
-            pDev->mBulkMemList.mReadBuffCircular.mStartIdx,
-            pDev->mBulkMemList.mReadBuffCircular.mEndIdx, (int)*pDataSize);
-    if ((startIdx < endIdx))
+    while ((copied + sizeof(sQTIDevDplRecord) <= *pDataSize) &&
+            !list_empty(&pDev->mBulkMemList.mChunkList))
     {
-        // non-empty case
-        if ((endIdx - startIdx) > *pDataSize)
+        pChunk = list_first_entry(&pDev->mBulkMemList.mChunkList, sReadMemChunk, node);
+        list_del(&pChunk->node);
+
+        frameLen = ParseDplRecord(pChunk, &record);
+        if (frameLen == 0)
         {
-            if (true == MoveDataToDestination(pDev, *ppReadData,
-                          pBulkStartInBuffer+startIdx, *pDataSize, iflags, eType))
-            {
-               QC_LOG_ERR(pDev,"T%d: Error copying read data to user (<---)\n", eType);
-               return -EFAULT;
-            }
-            pDev->mBulkMemList.mReadBuffCircular.mStartIdx += *pDataSize;
-            QC_LOG_DBG(pDev,"T%d: 1- data present strt:<%d>, end:<%d>, len:<%d>\n", eType,
-                    pDev->mBulkMemList.mReadBuffCircular.mStartIdx,
-                    pDev->mBulkMemList.mReadBuffCircular.mEndIdx, (int)*pDataSize);
-        } else
+            QC_LOG_ERR(pDev,"malformed DPL data, dropping %u bytes\n", pChunk->mDataLen - pChunk->mOffset);
+            pDev->mBulkMemList.mChunkBytes -= pChunk->mDataLen - pChunk->mOffset;
+            RecycleReadChunk(pDev, pChunk);
+            continue;
+        }
+        if ((copied != 0) && (copied + sizeof(sQTIDevDplRecord) + record.mLength > *pDataSize))
         {
-            // to provide fewer or all data
-            #ifdef QCUSB_TEST_ONLY
-            if (pDev->mDevInfo.mDevInfInfo.mDevType == QTIDEV_INF_TYPE_LPC)
-            {
-                if ((endIdx - startIdx) < *pDataSize)
-                {
-                   QC_LOG_ERR(pDev," (<--) T%d: Insufficient data strt:<%d>, end:<%d>, len:<%d>, need:<%lu>\n", eType,
-                       pDev->mBulkMemList.mReadBuffCircular.mStartIdx,
-                       pDev->mBulkMemList.mReadBuffCircular.mEndIdx,
-                       (int)*pDataSize, (*pDataSize - (endIdx - startIdx)));
-                   return false;
-                }
-            }
-            #endif
-            if (true == MoveDataToDestination(pDev, *ppReadData,
-                           pBulkStartInBuffer + startIdx, (endIdx - startIdx), iflags, eType))
-            {
-               QC_LOG_ERR(pDev,"T%d: Error copying read data to user\n", eType);
-               return -EFAULT;
-            }
-
-            *pDataSize = (endIdx - startIdx);  // adjus to smaller value
-            pDev->mBulkMemList.mReadBuffCircular.mStartIdx = endIdx;
-            QC_LOG_DBG(pDev,"T%d: 2- data present strt:<%d>, end:<%d>, len:<%d>\n", eType,
-                    pDev->mBulkMemList.mReadBuffCircular.mStartIdx,
-                    pDev->mBulkMemList.mReadBuffCircular.mEndIdx, (int)*pDataSize);
-	    if (pDev->mBulkMemList.mReadBuffCircular.mStartIdx == pDev->mBulkMemList.mReadBuffCircular.mEndIdx)
-		pDev->mBulkMemList.mReadBuffCircular.mBufEmptyStatus = true;
+            /* Whole for the next read */
+            list_add(&pChunk->node, &pDev->mBulkMemList.mChunkList);
+            break;
+        }
+        record.mCopied = min_t(size_t, record.mLength, *pDataSize - copied - sizeof(sQTIDevDplRecord));
+        if (record.mCopied < record.mLength)
+        {
+            record.mFlags |= QTIDEV_DPL_RECORD_TRUNCATED;
         }
-    } else if ((startIdx >= endIdx) && (pDev->mBulkMemList.mReadBuffCircular.mBufEmptyStatus == false))
-    {
-        // NOTE: checking mBufEmptyStatus == false for startIdx == endIdx to make sure it's buffer full
 
-        if ((buffLen - startIdx) >= *pDataSize)
+        // the copy may drop mReadMemLock, so take the record off the queue meanwhile
+        pDev->mBulkMemList.mChunkBytes -= frameLen;
+        dest = (eType == QTI_RX_ITER) ? *ppReadData : *ppReadData + copied;
+        bFailed = MoveDataToDestination(pDev, dest, &record, sizeof(sQTIDevDplRecord), iflags, eType);
+        if (!bFailed)
+        {
+            dest = (eType == QTI_RX_ITER) ? *ppReadData : *ppReadData + copied + sizeof(sQTIDevDplRecord);
+            bFailed = MoveDataToDestination(pDev, dest,
+                    pChunk->mpBuffer + pChunk->mOffset + QTIDEV_QMAP_HDR_LEN, record.mCopied, iflags, eType);
+        }
+        if (bFailed)
         {
-            if (true == MoveDataToDestination(pDev, *ppReadData,
-                           pBulkStartInBuffer + startIdx, *pDataSize, iflags, eType))
+            list_add(&pChunk->node, &pDev->mBulkMemList.mChunkList);
+            pDev->mBulkMemList.mChunkBytes += frameLen;
+            QC_LOG_ERR(pDev," (<--) T%d: Error copying DPL record to user\n", eType);
+            if (copied == 0)
             {
-               QC_LOG_ERR(pDev," (<--) T%d: Error copying read data to user\n", eType);
-               return -EFAULT;
+                return -EFAULT;
             }
+            break;
+        }
 
-            pDev->mBulkMemList.mReadBuffCircular.mStartIdx += *pDataSize;
-            pDev->mBulkMemList.mReadBuffCircular.mStartIdx %= buffLen;
-            QC_LOG_DBG(pDev,"T%d: 3- data present strt:<%d>, end:<%d>, len:<%d>\n", eType,
-                    pDev->mBulkMemList.mReadBuffCircular.mStartIdx,
-                    pDev->mBulkMemList.mReadBuffCircular.mEndIdx, (int)*pDataSize);
-        } else
+        pChunk->mOffset += frameLen;
+        copied += sizeof(sQTIDevDplRecord) + record.mCopied;
+        if (pChunk->mOffset < pChunk->mDataLen)
         {
-            int partialLen = 0;
-            unsigned int leg1=0, leg2=0, len3=0;
-            #ifdef QCUSB_TEST_ONLY
-            unsigned int storedSize;
-            #endif
+            list_add(&pChunk->node, &pDev->mBulkMemList.mChunkList);
+        }
+        else
+        {
+            RecycleReadChunk(pDev, pChunk);
+        }
+    }
+    *pDataSize = copied;
 
-            leg1 = buffLen - startIdx;
+    QC_LOG_DBG(pDev," (<--) T%d: records copied:<%d>, left:<%zu>\n", eType,
+            (int)copied, pDev->mBulkMemList.mChunkBytes);
 
-            #ifdef QCUSB_TEST_ONLY
+    WakeSharedReaders(pDev);
+    ResubmitParkedUrbs(pDev);
 
-            if (pDev->mDevInfo.mDevInfInfo.mDevType == QTIDEV_INF_TYPE_LPC)
-            {
-                storedSize = leg1 + endIdx;
-                if (*pDataSize > storedSize)
-                {
-                   QC_LOG_ERR(pDev," (<--) T%d: Insufficient data-wrap strt:<%d>, end:<%d>, len:<%d>/%d\n", eType,
-                       pDev->mBulkMemList.mReadBuffCircular.mStartIdx,
-                       pDev->mBulkMemList.mReadBuffCircular.mEndIdx,
-                       storedSize, (int)*pDataSize);
-                   return false;
-                }
-            }
-            #endif
+    return true;
+}
 
-            if (true == MoveDataToDestination(pDev, *ppReadData,
-                           pBulkStartInBuffer + startIdx, leg1, iflags, eType))
+// FUNCTION CopyHdlcFromReadMemList runs within mReadMemLock
+//    DIAG HDLC mode: the packets of as many frames as fit, each after its
+//    __u32 length. A packet larger than the buffer is truncated.
+static int CopyHdlcFromReadMemList(sQTIDevUSB *pDev,
+        void **ppReadData,
+        size_t *pDataSize,
+        unsigned long *iflags,
+        eRxType eType)
+{
+    sQTIDevHdlc *pHdlc = &pDev->mHdlc;
+    sReadMemChunk *pChunk;
+    size_t copied = 0;
+    size_t used;
+    __u32 packetLen;
+    size_t len;
+    void *dest;
+    bool bFailed;
+    int ret = true;
+
+    if (pHdlc->mbBusy)
+    {
+        /* Another read() of the node owns the packet being copied */
+        *pDataSize = 0;
+        return false;
+    }
+    // the copy may drop mReadMemLock, mbBusy keeps the packet meanwhile
+    pHdlc->mbBusy = true;
+    while (copied + sizeof(__u32) <= *pDataSize)
+    {
+        if (!pHdlc->mbFrame)
+        {
+            if (list_empty(&pDev->mBulkMemList.mChunkList))
             {
-               QC_LOG_ERR(pDev," (<--) T%d: Error copying read data to user - leg1 \n", eType);
-               return -EFAULT;
+                break;
             }
-
-            partialLen = leg1; // (buffLen - startIdx);
-            leg2 = *pDataSize - partialLen;
-
-            // now in leg2 data moving, mEndIdx could be updated by BlkCallback
-            // so need to re-sync endIdx
-            endIdx = pDev->mBulkMemList.mReadBuffCircular.mEndIdx;
-
-            if ( endIdx > leg2)
+            pChunk = list_first_entry(&pDev->mBulkMemList.mChunkList, sReadMemChunk, node);
+            used = QTIDevHdlcDecode(pHdlc, pChunk->mpBuffer + pChunk->mOffset,
+                    pChunk->mDataLen - pChunk->mOffset);
+            pChunk->mOffset += used;
+            pDev->mBulkMemList.mChunkBytes -= used;
+            if (pChunk->mOffset >= pChunk->mDataLen)
             {
-                bool res;
+                list_del(&pChunk->node);
+                RecycleReadChunk(pDev, pChunk);
+            }
+            continue;
+        }
 
-                if (eType == QTI_RX_ITER)
-                {
-                    res = MoveDataToDestination(pDev, *ppReadData,
-                              pBulkStartInBuffer, leg2, iflags, eType);
-                }
-                else
-                {
-                    res = MoveDataToDestination(pDev, *ppReadData + partialLen,
-                               pBulkStartInBuffer, leg2, iflags, eType);
-                }
-                if (res == true)
-                {
-                   QC_LOG_ERR(pDev," (<--) T%d: Error copying read data to user - leg2 \n", eType);
-                   return -EFAULT;
-                }
+        packetLen = pHdlc->mLength;
+        if ((copied != 0) && (copied + sizeof(__u32) + packetLen > *pDataSize))
+        {
+            /* Whole for the next read */
+            break;
+        }
+        len = min_t(size_t, packetLen, *pDataSize - copied - sizeof(__u32));
 
-                pDev->mBulkMemList.mReadBuffCircular.mStartIdx = *pDataSize - partialLen;
-            } else
+        dest = (eType == QTI_RX_ITER) ? *ppReadData : *ppReadData + copied;
+        bFailed = MoveDataToDestination(pDev, dest, &packetLen, sizeof(__u32), iflags, eType);
+        if (!bFailed)
+        {
+            dest = (eType == QTI_RX_ITER) ? *ppReadData : *ppReadData + copied + sizeof(__u32);
+            bFailed = MoveDataToDestination(pDev, dest, pHdlc->mpPacket, len, iflags, eType);
+        }
+        if (bFailed)
+        {
+            QC_LOG_ERR(pDev," (<--) T%d: Error copying DIAG packet to user\n", eType);
+            if (copied == 0)
             {
-                bool res;
-
-                // return fewer or all bytes  -- empty buffer
-                if (eType == QTI_RX_ITER)
-                {
-                    res = MoveDataToDestination(pDev, *ppReadData,
-                               pBulkStartInBuffer, endIdx, iflags, eType);
-                }
-                else
-                {
-                    res = MoveDataToDestination(pDev, *ppReadData + partialLen,
-                               pBulkStartInBuffer, endIdx, iflags, eType);
-                }
-                if (res == true)
-                {
-                   QC_LOG_ERR(pDev," (<--) T%d: Error copying read data to user - leg2a \n", eType);
-                   return -EFAULT;
-                }
-
-                len3 = endIdx; // actual length
-                *pDataSize = partialLen + endIdx;
-                pDev->mBulkMemList.mReadBuffCircular.mStartIdx = endIdx;
-
-                // need to inspec mEndIdx again
-                if (endIdx == pDev->mBulkMemList.mReadBuffCircular.mEndIdx)  // if mEndIdx remains same
-                {
-                    pDev->mBulkMemList.mReadBuffCircular.mBufEmptyStatus = true;
-                }
+                ret = -EFAULT;
             }
-            QC_LOG_DBG(pDev," (<--) T%d: 4- data present strt:<%d>, end:<%d/%d>, len:<%d>(%d, %d, %d)\n", eType,
-                    pDev->mBulkMemList.mReadBuffCircular.mStartIdx,
-                    endIdx, pDev->mBulkMemList.mReadBuffCircular.mEndIdx,
-                    (int)*pDataSize, leg1, leg2, len3);
+            break;
         }
+        copied += sizeof(__u32) + len;
+        QTIDevHdlcReset(pHdlc);
     }
-    else
-    {
-        QC_LOG_INFO(pDev," (<--) T%d: No data present strt:<%d>, end:<%d>, len:<%d> \n", eType,
-                pDev->mBulkMemList.mReadBuffCircular.mStartIdx,
-                pDev->mBulkMemList.mReadBuffCircular.mEndIdx, (int)*pDataSize);
-        return false;
-    }
+    pHdlc->mbBusy = false;
+    *pDataSize = copied;
 
-    /* To Pop out all the read queue */
-    while(PopFromQueueAndSubmit(pDev));
+    QC_LOG_DBG(pDev," (<--) T%d: packets copied:<%d>, left:<%zu>, crc errors:<%u>\n", eType,
+            (int)copied, pDev->mBulkMemList.mChunkBytes, pHdlc->mCrcErrors);
 
-    return true;
-}  // CopyFromReadMemList
+    WakeSharedReaders(pDev);
+    ResubmitParkedUrbs(pDev);
+
+    return ret;
+}
 
-static void InitializeRxNotifyPool(sQTIDevUSB *pDev)
+static int CopyFromReadMemList(sQTIDevUSB *pDev,
+        void **ppReadData,
+        size_t *pDataSize,
+        unsigned long *iflags,
+        eRxType eType)
 {
-    int i;
+    sReadMemChunk *pChunk;
+    size_t copied = 0;
+    size_t len;
+    void *dest;
     QC_LOG_DBG(pDev,"");
-    for (i = 0; i < QTIDEV_RX_NOTIFY_POOL_SZ; i++)
+
+    QC_LOG_DBG(pDev,"->T%d: data present:<%zu>, requested:<%d>\n", eType,
+            pDev->mBulkMemList.mChunkBytes, (int)*pDataSize);
+    if (pDev->mHdlc.mpPacket != NULL)
     {
-        qti_initialize_event(&(pDev->mRxNotifyPool[i].mEvent));
-        qti_register_event(&(pDev->mRxNotifyPool[i].mEvent), QTI_RX_EVT_CANCEL);
-        qti_register_event(&(pDev->mRxNotifyPool[i].mEvent), QTI_RX_EVT_FILL);
+        /* A decoded packet may be waiting with no bytes queued */
+        return CopyHdlcFromReadMemList(pDev, ppReadData, pDataSize, iflags, eType);
     }
-}
-static sNotifyList *AllocateRxNotifyItem(sQTIDevUSB *pDev)
-{
-    int i;
-    sNotifyList *item = NULL;
-    QC_LOG_DBG(pDev,"");
-    for (i = 0; i < QTIDEV_RX_NOTIFY_POOL_SZ; i++)
+    if (pDev->mBulkMemList.mChunkBytes == 0)
+    {
+        QC_LOG_INFO(pDev," (<--) T%d: No data present, len:<%d> \n", eType, (int)*pDataSize);
+        return false;
+    }
+
+    #ifdef QCUSB_TEST_ONLY
+    if (pDev->mDevInfo.mDevInfInfo.mDevType == QTIDEV_INF_TYPE_LPC)
     {
-        if (pDev->mRxNotifyPool[i].mpData == NULL)
+        if (pDev->mBulkMemList.mChunkBytes < *pDataSize)
         {
-           item = &(pDev->mRxNotifyPool[i]);
-           item->mIndex = i;
-           break;
+           QC_LOG_ERR(pDev," (<--) T%d: Insufficient data:<%zu>, len:<%d>\n", eType,
+               pDev->mBulkMemList.mChunkBytes, (int)*pDataSize);
+           return false;
         }
     }
-    return item;
-}  // AllocateRxNotifyItem
+    #endif
 
-static sQtiEvent *AddToNotifyList(sQTIDevUSB *pDev,
-        void (*pNotifyFunct)(struct sQTIDevUSB *, void *, int), size_t size)
-{
-    sNotifyList ** ppThisNotifyList;
-    QC_LOG_DBG(pDev,"");
-    // Go to last URBList entry
-    ppThisNotifyList = &pDev->mBulkMemList.mpReadNotifyList;
-    while (*ppThisNotifyList != NULL)
+    if (pDev->mbDplRecords)
     {
-        ppThisNotifyList = &(*ppThisNotifyList)->mpNext;
+        return CopyRecordsFromReadMemList(pDev, ppReadData, pDataSize, iflags, eType);
     }
 
-    *ppThisNotifyList = AllocateRxNotifyItem(pDev);
-    if (*ppThisNotifyList == NULL)
+    while ((copied < *pDataSize) && !list_empty(&pDev->mBulkMemList.mChunkList))
     {
-        QC_LOG_ERR(pDev,"Mem error\n" );
-        return NULL;
+        pChunk = list_first_entry(&pDev->mBulkMemList.mChunkList, sReadMemChunk, node);
+        len = min_t(size_t, pChunk->mDataLen - pChunk->mOffset, *pDataSize - copied);
+
+        // the copy may drop mReadMemLock, so take the chunk off the queue meanwhile
+        list_del(&pChunk->node);
+        pDev->mBulkMemList.mChunkBytes -= len;
+
+        dest = (eType == QTI_RX_ITER) ? *ppReadData : *ppReadData + copied;
+        if (true == MoveDataToDestination(pDev, dest,
+                       pChunk->mpBuffer + pChunk->mOffset, len, iflags, eType))
+        {
+            list_add(&pChunk->node, &pDev->mBulkMemList.mChunkList);
+            pDev->mBulkMemList.mChunkBytes += len;
+            QC_LOG_ERR(pDev," (<--) T%d: Error copying read data to user\n", eType);
+            if (copied == 0)
+            {
+                return -EFAULT;
+            }
+            break;
+        }
+
+        pChunk->mOffset += len;
+        copied += len;
+        if (pChunk->mOffset < pChunk->mDataLen)
+        {
+            list_add(&pChunk->node, &pDev->mBulkMemList.mChunkList);
+        }
+        else
+        {
+            /* Consumed, hand the buffer back for the next URB */
+            RecycleReadChunk(pDev, pChunk);
+        }
     }
+    *pDataSize = copied;
 
-    (*ppThisNotifyList)->mpNext = NULL;
-    (*ppThisNotifyList)->mpNotifyFunct = pNotifyFunct;
-    (*ppThisNotifyList)->mpData = &((*ppThisNotifyList)->mEvent);
-    (*ppThisNotifyList)->mUsrReqSize = size;
-    (*ppThisNotifyList)->mInProcess = 0;
+    QC_LOG_DBG(pDev," (<--) T%d: copied:<%d>, left:<%zu>\n", eType,
+            (int)copied, pDev->mBulkMemList.mChunkBytes);
 
-    QC_LOG_DBG(pDev,"added notify[%d]\n", (*ppThisNotifyList)->mIndex);
-    return (*ppThisNotifyList)->mpData;
-}
+    /* The chunk was off the queue during the copy */
+    WakeSharedReaders(pDev);
+    /* Restart the reads that waited for a buffer */
+    ResubmitParkedUrbs(pDev);
+
+    return true;
+}  // CopyFromReadMemList
 
-static void UpSem(sQTIDevUSB *pDev, void *pData, int evt)
+// FUNCTION RxDataReady runs within mReadMemLock
+//    Whether a reader asking for reqSize bytes (0 for any amount) gets the
+//    queued data now or waits for the watermark or the latency timer
+static bool RxDataReady(sQTIDevUSB *pDev, size_t reqSize)
 {
-    // QC_LOG_DBG(pDev,"qti_set_event - QTI_RX_EVT_FILL");  // TODO
-    QC_LOG_DBG(pDev,"");
-    qti_set_event((sQtiEvent *)pData, evt);
-    return;
+    size_t watermark = pDev->mRxWatermark;
+
+    if (pDev->mHdlc.mbFrame)
+    {
+        return true;
+    }
+    if (pDev->mBulkMemList.mChunkBytes == 0)
+    {
+        return false;
+    }
+    if ((reqSize != 0) && (reqSize < watermark))
+    {
+        watermark = reqSize;
+    }
+    if (pDev->mBulkMemList.mChunkBytes >= watermark)
+    {
+        return true;
+    }
+    /* The URBs ran out of buffers, or the data waited long enough */
+    if (list_empty(&pDev->mBulkMemList.mChunkFreeList))
+    {
+        return true;
+    }
+    return (pDev->mRxLatency != 0) &&
+        time_after_eq(jiffies, pDev->mRxHeldSince + msecs_to_jiffies(pDev->mRxLatency));
 }
 
-// FUNCTION RemoveNotification runs within spinlock
-void RemoveNotification(sQTIDevUSB *pDev, void *evt)
+// FUNCTION WakeRxWaiters runs within mReadMemLock
+//    One blocked read() per call while the data is ready for any reader,
+//    whatever the number waiting. Below the watermark only readers asking
+//    for less can take it, and those are woken together.
+static void WakeRxWaiters(sQTIDevUSB *pDev)
 {
-    sNotifyList **ppThisNotifyList;
-    sNotifyList *pDelNotifyListEntry;
-    QC_LOG_DBG(pDev,"");
-    ppThisNotifyList = &pDev->mBulkMemList.mpReadNotifyList;
-    pDelNotifyListEntry = NULL;
-    /* Find and delete matching entry */
-    while (*ppThisNotifyList != NULL)
+    if (RxDataReady(pDev, 0))
     {
-        if ((*ppThisNotifyList)->mpData == evt)
-        {
-            pDelNotifyListEntry = *ppThisNotifyList;
-            *ppThisNotifyList = (*ppThisNotifyList)->mpNext;
-            pDelNotifyListEntry->mpData = NULL;
-            pDelNotifyListEntry->mInProcess = 0;
-            break;
-        }
-        ppThisNotifyList = &(*ppThisNotifyList)->mpNext;
+        wake_up(&pDev->mBulkMemList.mRxWaitQueue);
+    }
+    else if ((pDev->mBulkMemList.mRxSmallWaiters != 0) && (pDev->mBulkMemList.mChunkBytes != 0))
+    {
+        wake_up_all(&pDev->mBulkMemList.mRxWaitQueue);
     }
-}  // RemoveNotification
+}  // WakeRxWaiters
 
-// FUNCTION NotifyUserRequest runs within spinlock
-static int NotifyUserRequest(sQTIDevUSB *pDev, void *evt)
+// FUNCTION WaitRxData runs within mReadMemLock
+//    Sleeps, the lock dropped, until a reader asking for reqSize bytes gets
+//    the queued data (1), QTIDEV_RX_TIMEOUT passed or the reads were
+//    cancelled (0), or a signal came (-EINTR)
+static int WaitRxData(sQTIDevUSB *pDev, size_t reqSize, unsigned long *iflags)
 {
-    sNotifyList *pNotifyItem;
-    unsigned int dataSize;
-    QC_LOG_DBG(pDev,"");
-    pNotifyItem = pDev->mBulkMemList.mpReadNotifyList;
-    if (pNotifyItem == NULL)
+    DEFINE_WAIT(wait);
+    long timeout = msecs_to_jiffies(QTIDEV_RX_TIMEOUT);
+    unsigned int cancelSeq = pDev->mBulkMemList.mRxCancelSeq;
+    bool bSmall = (reqSize != 0) && (reqSize < pDev->mRxWatermark);
+    bool bReady;
+    int ret;
+
+    if (bSmall)
     {
-        QC_LOG_DBG(pDev,"No client to notify\n");
-        return 0;
+        pDev->mBulkMemList.mRxSmallWaiters++;
     }
-    dataSize = pDev->mBulkMemList.mReadBuffCircular.mBufflen - ReadBufferFreeSpace(pDev);
-#ifdef QCUSB_TEST_ONLY
-    if (pDev->mDevInfo.mDevInfInfo.mDevType == QTIDEV_INF_TYPE_LPC)
+    for (;;)
     {
-        if (dataSize < pNotifyItem->mUsrReqSize)
+#ifdef QCUSB_TEST_ONLY
+        if (pDev->mDevInfo.mDevInfInfo.mDevType == QTIDEV_INF_TYPE_LPC)
         {
-             QC_LOG_ERR(pDev,"LPC: insufficient data: %u/%lu\n", dataSize, pNotifyItem->mUsrReqSize);
-            return 0;
+            bReady = (pDev->mBulkMemList.mChunkBytes >= reqSize);
         }
-    }
-    else
+        else
 #endif
-    {
-        if (dataSize == 0)
         {
-            QC_LOG_DBG(pDev,"No data\n");
-            return 0;
+            bReady = RxDataReady(pDev, reqSize);
+        }
+        if (bReady)
+        {
+            ret = 1;
+            break;
+        }
+        if ((cancelSeq != pDev->mBulkMemList.mRxCancelSeq) || pDev->disconnected || (timeout == 0))
+        {
+            ret = 0;
+            break;
+        }
+        if (signal_pending(current))
+        {
+            ret = -EINTR;
+            break;
         }
+        /* Queued while the lock is held, so no wake_up() in between is missed */
+        prepare_to_wait_exclusive(&pDev->mBulkMemList.mRxWaitQueue, &wait, TASK_INTERRUPTIBLE);
+        spin_unlock_irqrestore(&pDev->mBulkMemList.mReadMemLock, *iflags);
+        timeout = schedule_timeout(timeout);
+        spin_lock_irqsave(&pDev->mBulkMemList.mReadMemLock, *iflags);
     }
-    if (((evt == NULL) || (pNotifyItem->mpData == evt)) && (pNotifyItem->mInProcess == 0))
+    finish_wait(&pDev->mBulkMemList.mRxWaitQueue, &wait);
+    if (bSmall)
     {
-        QC_LOG_DBG(pDev,"item[%d] data %u/%lu\n", pNotifyItem->mIndex, dataSize, pNotifyItem->mUsrReqSize);
-        pNotifyItem->mInProcess = 1;
-        pNotifyItem->mpNotifyFunct(pDev, pNotifyItem->mpData, QTI_RX_EVT_FILL);  // set event
-        return 1;
+        pDev->mBulkMemList.mRxSmallWaiters--;
     }
-    return 0;
-}  // NotifyUserRequest
+    return ret;
+}  // WaitRxData
 
 static int ReadSyncBlk(sQTIDevUSB *pDev,
         void **ppReadData, size_t size, unsigned int flags)
@@ -1336,7 +1807,6 @@ static int ReadSyncBlk(sQTIDevUSB *pDev,
     int result;
     size_t dataSize;
     unsigned long iflags;
-    sQtiEvent *rxEvt = NULL;
     int retVal = 0;
     QC_LOG_DBG(pDev,"--> \n");
     if (!pDev || !ppReadData || !*ppReadData)
@@ -1352,62 +1822,26 @@ static int ReadSyncBlk(sQTIDevUSB *pDev,
 
     spin_lock_irqsave(&pDev->mBulkMemList.mReadMemLock, iflags);
     QC_LOG_DBG(pDev,"-->UserBuf 0x%px size %lu\n", *ppReadData, dataSize);
-    if ((rxEvt = AddToNotifyList( pDev, UpSem, size)) == NULL)
-    {
-        QC_LOG_ERR(pDev,"unable to register for notification\n" );
-        spin_unlock_irqrestore(&pDev->mBulkMemList.mReadMemLock, iflags);
-        return 0; // -EFAULT;
-    }
-    NotifyUserRequest(pDev, rxEvt);
-    spin_unlock_irqrestore(&pDev->mBulkMemList.mReadMemLock, iflags);
-
-    /* Wait for notification */
-    QC_LOG_DBG(pDev,"Now, Wait for notification\n");
-    result = qti_wait_event(rxEvt, QTIDEV_RX_TIMEOUT); // 2s timeout
-
-    spin_lock_irqsave(&pDev->mBulkMemList.mReadMemLock, iflags);
-    switch (result)
+    result = WaitRxData(pDev, size, &iflags);
+    if (result > 0)
     {
-        case QTI_RX_EVT_FILL:
-        {
-           qti_clear_event(rxEvt, result);
-           // QC_LOG_DBG(pDev,"QTI_RX_EVT_FILL: 0x%px size %lu -- evt%d\n", *ppReadData, dataSize, result);
-           if (CopyFromReadMemList(pDev, ppReadData, &dataSize, &iflags, QTI_RX_MEM) == false)
-           {
-               dataSize = 0;
-           }
-           retVal = (int)dataSize;
-           break;
-        }
-        case QTI_RX_EVT_CANCEL:
+        result = CopyFromReadMemList(pDev, ppReadData, &dataSize, &iflags, QTI_RX_MEM);
+        if (result < 0)
         {
-           qti_clear_event(rxEvt, result);
-        //    QC_LOG_EXCEPTION(pDev,"QTI_RX_EVT_CANCEL: 0x%px size %lu -- evt%d\n", *ppReadData, dataSize, result);
-           retVal = 0;
-           break;
+            retVal = result;
         }
-        default:
+        else
         {
-           dataSize = 0;
-           if (result > 0)
-           {
-              qti_clear_event(rxEvt, result);
-           }
-           else if (result == 0)
-           {
-            //    QC_LOG_EXCEPTION(pDev,"qti_wait_event: %d, RX timeout\n", result);
-               retVal = 0; // -ETIME;
-           }
-           else // if (result < 0)
-           {
-            //    QC_LOG_EXCEPTION(pDev,"qti_wait_event: %d, RX interrupted\n", result);
-               retVal = -EINTR;
-           }
-           break;
+            retVal = (result == false) ? 0 : (int)dataSize;
         }
     }
-    RemoveNotification(pDev, rxEvt);
-    NotifyUserRequest(pDev, NULL);
+    else
+    {
+        /* 0 on timeout or cancel, -EINTR */
+        retVal = result;
+    }
+    /* Whatever is left goes to the next reader, also one woken for nothing */
+    WakeRxWaiters(pDev);
     spin_unlock_irqrestore(&pDev->mBulkMemList.mReadMemLock, iflags);
 
     if (retVal < 0)
@@ -1447,8 +1881,23 @@ static ssize_t UserspaceQTIDevRead(struct file *file, char *buffer, size_t size,
         mutex_unlock(&dev->mIoMutex);
         return -ENODEV;
     }
+    if (dev->mpRing != NULL)
+    {
+        /* Data goes to the mapped ring */
+        mutex_unlock(&dev->mIoMutex);
+        return -EBUSY;
+    }
     mutex_unlock(&dev->mIoMutex);
 
+    if (dev->mbDplRecords && (size < sizeof(sQTIDevDplRecord)))
+    {
+        return -EINVAL;
+    }
+    if ((dev->mHdlc.mpPacket != NULL) && (size < sizeof(__u32)))
+    {
+        return -EINVAL;
+    }
+
     result = ReadSyncBlk(dev, &pReadData, size, file->f_flags);
 
     return result;
@@ -1494,7 +1943,14 @@ static void UserspaceQTIDevWrite_bulk_callback(struct urb *urb)
     }
 #endif
     dev->mStats.TxCount += urb->actual_length;
+    QTIDevBenchUrb(&dev->mBench, false, txBuf->mSubmitNs, urb->actual_length, urb->status);
 
+    if (txBuf->mbAsync)
+    {
+        /* Nobody waits, the error if any shows on the next write or fsync */
+        ReleaseTxBuffer(dev, txBuf);
+        return;
+    }
     urb->transfer_buffer = NULL;
     up((struct semaphore*)txBuf->mpTxSem);
     return;
@@ -1503,18 +1959,57 @@ static void UserspaceQTIDevWrite_bulk_callback(struct urb *urb)
 static void InitializeTxBuffers(sQTIDevUSB *pDev)
 {
     int i;
-    // get a free slot
+
+    INIT_LIST_HEAD(&pDev->mTxFreeList);
+    spin_lock_init(&pDev->mTxLock);
+    init_waitqueue_head(&pDev->mTxWaitQueue);
+    pDev->mTxInFlight = 0;
+    pDev->mTxDepth = 0;
     for (i = 0; i < QTIDEV_TX_BUF_POOL_SZ; i++)
     {
         pDev->mTxBufferPool[i].mpDev = pDev;
         pDev->mTxBufferPool[i].mIndex = i;
-        pDev->mTxBufferPool[i].mpTxBuf = NULL;
-        pDev->mTxBufferPool[i].mpTxUrb = NULL;
+        pDev->mTxBufferPool[i].mpTxSem = NULL;
+        pDev->mTxBufferPool[i].mbAsync = false;
         init_usb_anchor(&(pDev->mTxBufferPool[i].mTxAnchor));
+        /* Small writes such as DIAG commands need no allocation, failures retry on use */
+        pDev->mTxBufferPool[i].mpTxBuf = qti_kmalloc_node(QTIDEV_TX_BUF_PREALLOC, GFP_KERNEL, pDev->mNumaNode);
+        pDev->mTxBufferPool[i].mTxBufSize = pDev->mTxBufferPool[i].mpTxBuf ? QTIDEV_TX_BUF_PREALLOC : 0;
+        pDev->mTxBufferPool[i].mpTxUrb = usb_alloc_urb(0, GFP_KERNEL);
+        list_add_tail(&pDev->mTxBufferPool[i].node, &pDev->mTxFreeList);
     }
 
 }  // InitializeTxBuffers
 
+static bool TxSlotAvailable(sQTIDevUSB *pDev, bool bAsync)
+{
+    unsigned long flags;
+    bool bAvailable;
+
+    spin_lock_irqsave(&pDev->mTxLock, flags);
+    bAvailable = !list_empty(&pDev->mTxFreeList) &&
+        (!bAsync || (pDev->mTxInFlight < pDev->mTxDepth));
+    spin_unlock_irqrestore(&pDev->mTxLock, flags);
+    return bAvailable;
+}
+
+static void ReleaseTxBuffer(sQTIDevUSB *pDev, sQTIDevTxBuf *pTxBuf)
+{
+    unsigned long flags;
+
+    spin_lock_irqsave(&pDev->mTxLock, flags);
+    if (pTxBuf->mbAsync)
+    {
+        pDev->mTxInFlight--;
+        pTxBuf->mbAsync = false;
+    }
+    pTxBuf->mpTxSem = NULL;
+    /* Most recently used first, its buffer is the likeliest to be large enough */
+    list_add(&pTxBuf->node, &pDev->mTxFreeList);
+    spin_unlock_irqrestore(&pDev->mTxLock, flags);
+    wake_up(&pDev->mTxWaitQueue);
+}
+
 static void DeinitializeTxBuffers(sQTIDevUSB *pDev)
 {
     int i, time;
@@ -1531,29 +2026,48 @@ static void DeinitializeTxBuffers(sQTIDevUSB *pDev)
     }
 }  // DeinitializeTxBuffers
 
+// Cancel the TX URBs in flight at once, their callbacks free the slots
+static void KillTxUrbs(sQTIDevUSB *pDev)
+{
+    int i;
+
+    for (i = 0; i < QTIDEV_TX_BUF_POOL_SZ; i++)
+    {
+        usb_kill_anchored_urbs(&(pDev->mTxBufferPool[i].mTxAnchor));
+    }
+}  // KillTxUrbs
+
+// Takes an idle slot for a write() of dataLen, pSem NULL for one that
+// completes after write() returned. -EBUSY when none is available.
 int PrepareTxUrbBuffer(sQTIDevUSB *pDev, size_t dataLen, void *pSem)
 {
+    sQTIDevTxBuf *pTxBuf;
+    unsigned long flags;
     int i;
     QC_LOG_DBG(pDev,"of dataLen = %zu\n", dataLen);
     // get a free slot
-    for (i = 0; i < QTIDEV_TX_BUF_POOL_SZ; i++)
+    spin_lock_irqsave(&pDev->mTxLock, flags);
+    if (list_empty(&pDev->mTxFreeList) ||
+            ((pSem == NULL) && (pDev->mTxInFlight >= pDev->mTxDepth)))
     {
-        if (pDev->mTxBufferPool[i].mpTxSem == NULL)
-        {
-            pDev->mTxBufferPool[i].mpTxSem = pSem;
-            break;
-        }
+        spin_unlock_irqrestore(&pDev->mTxLock, flags);
+        QC_LOG_DBG(pDev,"TX slots busy, in flight %u\n", pDev->mTxInFlight);
+        return -EBUSY;
     }
-
-    if (i >= QTIDEV_TX_BUF_POOL_SZ)
+    pTxBuf = list_first_entry(&pDev->mTxFreeList, sQTIDevTxBuf, node);
+    list_del(&pTxBuf->node);
+    pTxBuf->mpTxSem = pSem;
+    if (pSem == NULL)
     {
-        QC_LOG_GLOBAL("TX buffer out of mem\n");
-        return -ENOMEM;
+        pTxBuf->mbAsync = true;
+        pDev->mTxInFlight++;
     }
+    spin_unlock_irqrestore(&pDev->mTxLock, flags);
+    i = pTxBuf->mIndex;
     // prepare TX buffer, re-allocate if necessary
     if (pDev->mTxBufferPool[i].mpTxBuf == NULL)
     {
-        pDev->mTxBufferPool[i].mpTxBuf = qti_kmalloc(dataLen, GFP_KERNEL);
+        pDev->mTxBufferPool[i].mpTxBuf = qti_kmalloc_node(dataLen, GFP_KERNEL, pDev->mNumaNode);
         if (pDev->mTxBufferPool[i].mpTxBuf != NULL)
         {
            pDev->mTxBufferPool[i].mTxBufSize = dataLen;
@@ -1561,7 +2075,7 @@ int PrepareTxUrbBuffer(sQTIDevUSB *pDev, size_t dataLen, void *pSem)
         else
         {
             pDev->mTxBufferPool[i].mTxBufSize = 0;
-            pDev->mTxBufferPool[i].mpTxSem = NULL;
+            ReleaseTxBuffer(pDev, pTxBuf);
             QC_LOG_ERR(pDev,"TX buffer mem failure-0[%d]\n", i);
             return -ENOMEM;
         }
@@ -1569,7 +2083,7 @@ int PrepareTxUrbBuffer(sQTIDevUSB *pDev, size_t dataLen, void *pSem)
     else if (pDev->mTxBufferPool[i].mTxBufSize < dataLen)
     {
         qti_kfree(pDev->mTxBufferPool[i].mpTxBuf);
-        pDev->mTxBufferPool[i].mpTxBuf = qti_kmalloc(dataLen, GFP_KERNEL);
+        pDev->mTxBufferPool[i].mpTxBuf = qti_kmalloc_node(dataLen, GFP_KERNEL, pDev->mNumaNode);
         if (pDev->mTxBufferPool[i].mpTxBuf != NULL)
         {
            pDev->mTxBufferPool[i].mTxBufSize = dataLen;
@@ -1577,7 +2091,7 @@ int PrepareTxUrbBuffer(sQTIDevUSB *pDev, size_t dataLen, void *pSem)
         else
         {
             pDev->mTxBufferPool[i].mTxBufSize = 0;
-            pDev->mTxBufferPool[i].mpTxSem = NULL;
+            ReleaseTxBuffer(pDev, pTxBuf);
             QC_LOG_ERR(pDev,"TX buffer mem failure-1[%d]\n", i);
             return -ENOMEM;
         }
@@ -1590,7 +2104,7 @@ int PrepareTxUrbBuffer(sQTIDevUSB *pDev, size_t dataLen, void *pSem)
         if (pDev->mTxBufferPool[i].mpTxUrb == NULL)
         {
             QC_LOG_ERR(pDev,"TX urb mem failure[%d]\n", i);
-            pDev->mTxBufferPool[i].mpTxSem = NULL;
+            ReleaseTxBuffer(pDev, pTxBuf);
             return -ENOMEM;
         }
     }
@@ -1611,6 +2125,9 @@ static ssize_t UserspaceQTIDevWrite(struct file *file, const char *user_buffer,
     int iterator = QTIDEV_RETRY;
     int txIdx = -1;
     u32 bytesSent; 
+    size_t txLen = dataLen;
+    bool bAsync;
+    bool bHdlc;
 
     pDev = file->private_data;
 
@@ -1637,23 +2154,52 @@ static ssize_t UserspaceQTIDevWrite(struct file *file, const char *user_buffer,
     spin_unlock_irq(&pDev->mSpinErrLock);
 
     sema_init(&writeSem, 0);
-    txIdx = PrepareTxUrbBuffer(pDev, dataLen, &writeSem);
+    /* With a depth set, write() returns once the URB is submitted */
+    bAsync = (pDev->mTxDepth != 0);
+    /* In HDLC mode the write() is one packet, framed in the TX buffer */
+    bHdlc = (pDev->mHdlc.mpPacket != NULL);
+    if (bHdlc)
+    {
+        txLen = QTIDEV_HDLC_ENCODED_MAX(dataLen);
+    }
+    while ((txIdx = PrepareTxUrbBuffer(pDev, txLen, bAsync ? NULL : &writeSem)) == -EBUSY)
+    {
+        if (file->f_flags & O_NONBLOCK)
+        {
+            return -EAGAIN;
+        }
+        if (wait_event_interruptible(pDev->mTxWaitQueue,
+                TxSlotAvailable(pDev, bAsync) || pDev->disconnected))
+        {
+            return -ERESTARTSYS;
+        }
+        if (pDev->disconnected)
+        {
+            return -ENODEV;
+        }
+    }
 
     // prepare TX buffer and TX URB, re-allocate if necessary
     if (txIdx < 0)
     {
+        retval = txIdx;
         goto error;
     }
     urb = pDev->mTxBufferPool[txIdx].mpTxUrb;
     buf = pDev->mTxBufferPool[txIdx].mpTxBuf;
     txAnchor = &(pDev->mTxBufferPool[txIdx].mTxAnchor);
 
-    if (copy_from_user(buf, user_buffer, dataLen))
+    if (copy_from_user(buf + txLen - dataLen, user_buffer, dataLen))
     {
         QC_LOG_ERR(pDev,"copy_from_user failure\n");
         retval = -EFAULT;
         goto error;
     }
+    if (bHdlc)
+    {
+        /* The packet sits at the end of the buffer, the frame fills it from the start */
+        txLen = QTIDevHdlcEncode(buf, buf + txLen - dataLen, dataLen);
+    }
 
     mutex_lock(&pDev->mIoMutex);
     if (pDev->disconnected)
@@ -1666,7 +2212,7 @@ static ssize_t UserspaceQTIDevWrite(struct file *file, const char *user_buffer,
 
     usb_fill_bulk_urb(urb, pDev->udev,
             usb_sndbulkpipe(pDev->udev, pDev->mBulkOutEndAddr),
-            buf, dataLen, UserspaceQTIDevWrite_bulk_callback, &(pDev->mTxBufferPool[txIdx]));
+            buf, txLen, UserspaceQTIDevWrite_bulk_callback, &(pDev->mTxBufferPool[txIdx]));
     urb->transfer_flags |= URB_ZERO_PACKET;
 #ifdef QCUSB_TEST_ONLY
     if (pDev->mDevInfo.mDevInfInfo.mDevType == QTIDEV_INF_TYPE_LPC)
@@ -1681,6 +2227,7 @@ static ssize_t UserspaceQTIDevWrite(struct file *file, const char *user_buffer,
          txIdx, urb, buf, user_buffer, dataLen, urb->transfer_flags);
     while(iterator--)
     {
+        pDev->mTxBufferPool[txIdx].mSubmitNs = QTIDevBenchStamp(&pDev->mBench);
         retval = usb_submit_urb(urb, GFP_KERNEL);
         if(retval == -EAGAIN || retval == -EWOULDBLOCK || retval == -ENODEV){
             msleep(QTIDEV_SLEEP_TIMER);
@@ -1696,6 +2243,12 @@ static ssize_t UserspaceQTIDevWrite(struct file *file, const char *user_buffer,
         goto error;
     }
     mutex_unlock(&pDev->mIoMutex);
+
+    if (bAsync)
+    {
+        /* The completion returns the slot */
+        return dataLen;
+    }
     
     mutex_lock(&pDev->mIoMutex);
     if (pDev->disconnected)
@@ -1719,29 +2272,65 @@ static ssize_t UserspaceQTIDevWrite(struct file *file, const char *user_buffer,
 
     down(&writeSem); // make it non-interruptible
 
-    pDev->mTxBufferPool[txIdx].mpTxSem = NULL;
+    ReleaseTxBuffer(pDev, &pDev->mTxBufferPool[txIdx]);
+    if (bHdlc)
+    {
+        /* A packet counts as written once its whole frame went out */
+        bytesSent = (bytesSent == txLen) ? dataLen : 0;
+    }
     return bytesSent;
 
 error:
     if (txIdx >= 0)
     {
-        pDev->mTxBufferPool[txIdx].mpTxSem = NULL;
+        ReleaseTxBuffer(pDev, &pDev->mTxBufferPool[txIdx]);
     }
     return retval;
 }
 
-static loff_t UserspaceQTIDevllseek(struct file *file, loff_t offset, int whence)
+/* Barrier for the write()s that returned before completion */
+static int UserspaceQTIDevFsync(struct file *pFile, loff_t start, loff_t end, int datasync)
 {
-    return file->f_pos;
-}
+    sQTIDevUSB *pDev = pFile->private_data;
+    unsigned long flags;
+    int res = 0;
 
-static int UserspaceQTIDevIOCTL(
-   struct inode *    pUnusedInode,
-   struct file *     pFilp,
-   unsigned int      cmd,
-   unsigned long     arg )
-{
-    int retval = 0;
+    if (pDev == NULL)
+    {
+        return -ENODEV;
+    }
+    if (wait_event_timeout(pDev->mTxWaitQueue, pDev->mTxInFlight == 0,
+            msecs_to_jiffies(QTIDEV_TX_TIMEOUT)) == 0)
+    {
+        /* Cancel what is stuck without waiting again, release tears down */
+        QC_LOG_WARN(pDev,"TX fsync timeout, %u in flight\n", pDev->mTxInFlight);
+        KillTxUrbs(pDev);
+        res = -ETIMEDOUT;
+    }
+
+    spin_lock_irqsave(&pDev->mSpinErrLock, flags);
+    /* after a timeout, the -ENOENT of the killed URBs is not reported */
+    if ((res == 0) && pDev->mLasterror)
+    {
+        res = (pDev->mLasterror == -EPIPE) ? -EPIPE : -EIO;
+    }
+    pDev->mLasterror = 0;
+    spin_unlock_irqrestore(&pDev->mSpinErrLock, flags);
+    return res;
+}
+
+static loff_t UserspaceQTIDevllseek(struct file *file, loff_t offset, int whence)
+{
+    return file->f_pos;
+}
+
+static int UserspaceQTIDevIOCTL(
+   struct inode *    pUnusedInode,
+   struct file *     pFilp,
+   unsigned int      cmd,
+   unsigned long     arg )
+{
+    int retval = 0;
     sQTIDevUSB *pDev=NULL;
     unsigned long userValue = 2;
 
@@ -1813,6 +2402,81 @@ static int UserspaceQTIDevIOCTL(
             break;
         }
 #endif
+        case IOCTL_QTIDEV_SET_DPL_RECORDS:
+        {
+            if (pDev->mDevInfo.mDevInfInfo.mDevType != QTIDEV_INF_TYPE_DPL)
+            {
+                QC_LOG_ERR(pDev,"DPL_RECORDS: not a DPL node\n");
+                return -EINVAL;
+            }
+            QC_LOG_INFO(pDev,"DPL record mode %lu\n", userValue);
+            pDev->mbDplRecords = (userValue != 0);
+            break;
+        }
+        case IOCTL_QTIDEV_SET_DIAG_HDLC:
+        {
+            unsigned char *pPacket = NULL;
+            unsigned long flags;
+
+            if ((pDev->mDevInfo.mDevInfInfo.mDevType != QTIDEV_INF_TYPE_BULK) &&
+                (pDev->mDevInfo.mDevInfInfo.mDevType != QTIDEV_INF_TYPE_BULK_IN_OUT))
+            {
+                QC_LOG_ERR(pDev,"DIAG_HDLC: not a DIAG node\n");
+                return -EINVAL;
+            }
+            if (userValue != 0)
+            {
+                pPacket = qti_kmalloc(QTIDEV_HDLC_PACKET_MAX, GFP_KERNEL);
+                if (pPacket == NULL)
+                {
+                    return -ENOMEM;
+                }
+            }
+            spin_lock_irqsave(&pDev->mBulkMemList.mReadMemLock, flags);
+            if (pDev->mHdlc.mbBusy)
+            {
+                spin_unlock_irqrestore(&pDev->mBulkMemList.mReadMemLock, flags);
+                qti_kfree(pPacket);
+                return -EBUSY;
+            }
+            /* Swap buffers, a frame in progress is dropped */
+            swap(pDev->mHdlc.mpPacket, pPacket);
+            QTIDevHdlcReset(&pDev->mHdlc);
+            pDev->mHdlc.mCrcErrors = pDev->mHdlc.mOverflows = 0;
+            spin_unlock_irqrestore(&pDev->mBulkMemList.mReadMemLock, flags);
+            qti_kfree(pPacket);
+            QC_LOG_INFO(pDev,"DIAG HDLC framing %lu\n", userValue);
+            break;
+        }
+        case IOCTL_QTIDEV_SET_RX_WATERMARK:
+        case IOCTL_QTIDEV_SET_RX_LATENCY:
+        {
+            unsigned long flags;
+
+            if (((cmd == IOCTL_QTIDEV_SET_RX_WATERMARK) && (userValue > QTIDEV_RX_WATERMARK_MAX)) ||
+                ((cmd == IOCTL_QTIDEV_SET_RX_LATENCY) && (userValue > QTIDEV_RX_LATENCY_MAX)))
+            {
+                QC_LOG_ERR(pDev,"Rx 0x%x: invalid value %lu\n", cmd, userValue);
+                return -EINVAL;
+            }
+            spin_lock_irqsave(&pDev->mBulkMemList.mReadMemLock, flags);
+            if (cmd == IOCTL_QTIDEV_SET_RX_WATERMARK)
+            {
+                pDev->mRxWatermark = userValue;
+            }
+            else
+            {
+                pDev->mRxLatency = userValue;
+            }
+            /* Data held back by the old setting may be due now */
+            if (RxDataReady(pDev, 0))
+            {
+                NotifyRxReaders(pDev);
+            }
+            spin_unlock_irqrestore(&pDev->mBulkMemList.mReadMemLock, flags);
+            QC_LOG_DBG(pDev,"Rx watermark %zu latency %u\n", pDev->mRxWatermark, pDev->mRxLatency);
+            break;
+        }
         default:
             retval = -EBADRQC;
             break;
@@ -1846,12 +2510,22 @@ static unsigned int UserspaceQTIDevPoll(
         return POLLERR;
     }
 
+    if (pDev->mpRing != NULL)
+    {
+        poll_wait(pFilp, &pDev->mBulkMemList.mWaitQueue, pPollTable);
+        if (QTIDevRingPoll(pDev->mpRing))
+        {
+            status |= POLLIN | POLLRDNORM;
+        }
+        return status;
+    }
+
     spin_lock_irqsave(&pDev->mBulkMemList.mReadMemLock, flags);
 
     poll_wait(pFilp, &pDev->mBulkMemList.mWaitQueue, pPollTable);
 
 
-    if(!pDev->mBulkMemList.mReadBuffCircular.mBufEmptyStatus)
+    if (RxDataReady(pDev, 0))
     {
         status |= POLLIN | POLLRDNORM;
     }
@@ -1862,18 +2536,6 @@ static unsigned int UserspaceQTIDevPoll(
     return (status | POLLOUT | POLLWRNORM);
 }
 
-void *io_sync_complete(struct kiocb *kiocb, void *userData)
-{
-    struct qtidev_aio_data *io_data;
-    io_data = kiocb->private;
-    QC_LOG_DBG(io_data->pDev," Inside %s\n", __func__);
-    readFromRingbuff(io_data);
-
-    up(&io_data->readSem);
-
-    return NULL;
-}
-
 static void aio_submit_read_worker(struct work_struct *work)
 {
     int ret = 0;
@@ -1947,31 +2609,16 @@ static void *io_async_complete(struct kiocb *kiocb, void *userData)
     currLen = iov_iter_count(&io_data->data);
 
     if (pDev) {
-        unsigned long startIdx;
-        unsigned long endIdx;
-        unsigned long buffLen;
-        unsigned long len;
-
         currLen = iov_iter_count(&io_data->data);
         if (!io_data->data.iov_offset)
             io_data->mDataLen = iov_iter_count(&io_data->data);
 
-        buffLen = pDev->mBulkMemList.mReadBuffCircular.mBufflen;
-        startIdx = pDev->mBulkMemList.mReadBuffCircular.mStartIdx;
-        endIdx = pDev->mBulkMemList.mReadBuffCircular.mEndIdx;
-        if (pDev->mBulkMemList.mReadBuffCircular.mBufEmptyStatus) {
-            QC_LOG_DBG(pDev,"mBufEmptyStatus true. return userData(<--)\n");
+        if (pDev->mBulkMemList.mChunkBytes == 0) {
+            QC_LOG_DBG(pDev,"no data queued. return userData(<--)\n");
             return userData;
         }
 
-        if (startIdx <= endIdx) {
-            len = endIdx - startIdx;
-            io_data->mActualLen = min(currLen, len);
-        }
-	else {
-            len = (buffLen - (startIdx - endIdx));
-            io_data->mActualLen = min(currLen, len);
-        }
+        io_data->mActualLen = min_t(unsigned long, currLen, pDev->mBulkMemList.mChunkBytes);
 
 #ifndef QCUSB_TEST_ONLY
          currLen = io_data->mActualLen;
@@ -2015,7 +2662,7 @@ static void *io_async_complete(struct kiocb *kiocb, void *userData)
 
     kref_get(&io_data->pDev->mRefCount);
     INIT_WORK(&io_data->submit_work, aio_submit_read_worker);
-    queue_work(io_data->pDev->mpWorkQ, &io_data->submit_work);
+    queue_work_on(QTIDevInfWorkCpu(io_data->pDev->mNumaNode), io_data->pDev->mpWorkQ, &io_data->submit_work);
     QC_LOG_DBG(pDev,"<--\n");
     return NULL;
 }
@@ -2023,8 +2670,6 @@ static void *io_async_complete(struct kiocb *kiocb, void *userData)
 static ssize_t ioData_dequeue(struct kiocb *kiocb, void *userData)
 {
     struct qtidev_aio_data *io_data;
-    sIoReadList *pIoReadTraverse=NULL;
-    sIoReadList *pIoReadsafe=NULL;
     struct sQTIDevUSB *pDev=NULL;
     bool found = false;
     unsigned long flags;
@@ -2057,23 +2702,15 @@ static ssize_t ioData_dequeue(struct kiocb *kiocb, void *userData)
 
     QC_LOG_DBG(pDev," Dequeue kiocb(%px) to mIoReadBuffList\n", kiocb);
     spin_lock_irqsave(&pDev->mSpinReadBuffLock, flags);
-    list_for_each_entry_safe(pIoReadTraverse, pIoReadsafe, &pDev->mIoReadBuffListActive, node) {
-        /* Comparing for address */
-        if (kiocb == pIoReadTraverse->kiocb) {
-	    found = true;
-	    pIoReadTraverse->kiocb = NULL;
-	    list_move_tail(&pIoReadTraverse->node, &pDev->mIoReadBuffListIdle);
-	    pDev->mIoReadBuffListActiveSize--;
-	    pDev->mIoReadBuffListIdleSize++;
-	    QC_LOG_DBG(pDev," Buffer matched, updated mIoReadBuffListActiveSize to %lu\n", pDev->mIoReadBuffListActiveSize);
-	    break;
-        }
+    /* The request carries its own node, no search */
+    if (!list_empty(&io_data->mReadNode)) {
+	found = true;
+	list_del_init(&io_data->mReadNode);
+	pDev->mIoReadBuffListActiveSize--;
+	QC_LOG_DBG(pDev," Buffer matched, updated mIoReadBuffListActiveSize to %lu\n", pDev->mIoReadBuffListActiveSize);
     }
     spin_unlock_irqrestore(&pDev->mSpinReadBuffLock, flags);
 
-    /*
-     * Check for circular Linkedlist entirely being parsed without a match.
-     */
     if (!found) {
         QC_LOG_ERR(pDev," Kiocb context did not match any readlist node. This should never happen!\n");
         io_data->complete(kiocb, NULL);
@@ -2093,25 +2730,16 @@ end:
 ssize_t ioData_enqueue(struct kiocb *kiocb)
 {
     struct qtidev_aio_data *io_data;
-    sIoReadList *pIoReadTraverse;
     unsigned long flags;
 
     io_data = kiocb->private;
     QC_LOG_INFO(io_data->pDev, "Enqueue kiocb(%px) to mIoReadBuffList\n", kiocb);
     spin_lock_irqsave(&io_data->pDev->mSpinReadBuffLock, flags);
-    list_for_each_entry(pIoReadTraverse, &io_data->pDev->mIoReadBuffListIdle, node) {
-	    pIoReadTraverse->kiocb = kiocb;
-	    list_move_tail(&pIoReadTraverse->node, &io_data->pDev->mIoReadBuffListActive);
-	    io_data->pDev->mIoReadBuffListActiveSize++;
-	    io_data->pDev->mIoReadBuffListIdleSize--;
-
-	    QC_LOG_DBG(io_data->pDev," Adding to queue [kiocb(%px)]. Updated mIoReadBuffListActiveSize = %lu\n", kiocb, io_data->pDev->mIoReadBuffListActiveSize);
-	    spin_unlock_irqrestore(&io_data->pDev->mSpinReadBuffLock, flags);
-	    return 0;
-    }
-    QC_LOG_ERR(io_data->pDev," Unable to enqueue new request.");
+    list_add_tail(&io_data->mReadNode, &io_data->pDev->mIoReadBuffListActive);
+    io_data->pDev->mIoReadBuffListActiveSize++;
+    QC_LOG_DBG(io_data->pDev," Adding to queue [kiocb(%px)]. Updated mIoReadBuffListActiveSize = %lu\n", kiocb, io_data->pDev->mIoReadBuffListActiveSize);
     spin_unlock_irqrestore(&io_data->pDev->mSpinReadBuffLock, flags);
-    return -ENOMEM;
+    return 0;
 }
 
 static void aio_cancel_worker(struct work_struct *work)
@@ -2158,7 +2786,7 @@ static int aio_cancel(struct kiocb *iocb)
 
     kref_get(&io_data->pDev->mRefCount);
     INIT_WORK(&io_data->cancellation_work, aio_cancel_worker);
-    queue_work(io_data->pDev->mpWorkQ, &io_data->cancellation_work);
+    queue_work_on(QTIDevInfWorkCpu(io_data->pDev->mNumaNode), io_data->pDev->mpWorkQ, &io_data->cancellation_work);
     value = -EINPROGRESS;
     QC_LOG_DBG(io_data->pDev,"<-- \n");
     return value;
@@ -2170,9 +2798,8 @@ static size_t cpyToTargetIter(sQTIDevUSB *pDev, void *to, void *from,
     size_t ret;
 
 #ifdef QCUSB_TEST_ONLY
-    QC_LOG_DBG(pDev,"cpyToTargetIter: %lu to user %d Buf<%d %d>\n", count, isIter,
-         pDev->mBulkMemList.mReadBuffCircular.mStartIdx,
-         pDev->mBulkMemList.mReadBuffCircular.mEndIdx);
+    QC_LOG_DBG(pDev,"cpyToTargetIter: %lu to user %d Buf<%zu>\n", count, isIter,
+         pDev->mBulkMemList.mChunkBytes);
 #endif
 
     if (count == 0)
@@ -2209,12 +2836,6 @@ static ssize_t readFromRingbuff(struct qtidev_aio_data *pIoData)
     ssize_t ret = 0;
     sQTIDevUSB *pDev;
     void *data;
-#ifdef QCUSB_TEST_ONLY
-    unsigned long startIdx;
-    unsigned long endIdx;
-    unsigned long buffLen;
-    unsigned long len;
-#endif
     unsigned long iflags;
 
     pDev = pIoData->pDev;
@@ -2222,39 +2843,17 @@ static ssize_t readFromRingbuff(struct qtidev_aio_data *pIoData)
     data = &pIoData->data;
     QC_LOG_DBG(pDev, "-->\n");
     spin_lock_irqsave(&pIoData->pDev->mBulkMemList.mReadMemLock, iflags);
-    if (pDev->mBulkMemList.mReadBuffCircular.mBufEmptyStatus)
-    {
-	unsigned long startIdx;
-	unsigned long endIdx;
-	unsigned long buffLen;
-	buffLen = pDev->mBulkMemList.mReadBuffCircular.mBufflen;
-	startIdx = pDev->mBulkMemList.mReadBuffCircular.mStartIdx;
-	endIdx = pDev->mBulkMemList.mReadBuffCircular.mEndIdx;
-        QC_LOG_ERR(pDev," (<--) Buffer empty. Returning. empty status: %d strt: %lu end:%lu bufflen:%lu \n",
-            pDev->mBulkMemList.mReadBuffCircular.mBufEmptyStatus, startIdx, endIdx, buffLen);
+    if ((pDev->mBulkMemList.mChunkBytes == 0) && !pDev->mHdlc.mbFrame)
+    {
+        QC_LOG_ERR(pDev," (<--) Buffer empty. Returning.\n");
         goto end;
     }
 
 #ifdef QCUSB_TEST_ONLY
     if (pDev->mDevInfo.mDevInfInfo.mDevType == QTIDEV_INF_TYPE_LPC)
     {
-        buffLen = pDev->mBulkMemList.mReadBuffCircular.mBufflen;
-        startIdx = pDev->mBulkMemList.mReadBuffCircular.mStartIdx;
-        endIdx = pDev->mBulkMemList.mReadBuffCircular.mEndIdx;
         QC_LOG_DBG(pDev, "--> LPC\n");
-        if (startIdx <= endIdx)
-        {
-        //  len = endIdx - startIdx + 1;
-            len = endIdx - startIdx;
-            len = min(dataSize, len);
-        } else
-        {
-        //  len = (buffLen - (startIdx - endIdx + 1));
-            len = (buffLen - (startIdx - endIdx));
-            len = min(dataSize, len);
-        }
-
-        if (len != dataSize)
+        if (pDev->mBulkMemList.mChunkBytes < dataSize)
         {
             goto end;
         }
@@ -2272,6 +2871,34 @@ end:
     return ret;
 }
 
+// Copies queued data straight into iov when a reader would get it now:
+// user memory, an iovec or the bvec of an io_uring fixed buffer, with no
+// request context or worker. 0 when nothing is ready.
+static ssize_t ReadIterNow(sQTIDevUSB *pDev, struct iov_iter *iov)
+{
+    size_t dataSize = iov_iter_count(iov);
+    void *data = iov;
+    unsigned long iflags;
+    ssize_t ret = 0;
+    int copyRet;
+
+    spin_lock_irqsave(&pDev->mBulkMemList.mReadMemLock, iflags);
+    if (RxDataReady(pDev, dataSize))
+    {
+        copyRet = CopyFromReadMemListIter(pDev, &data, &dataSize, &iflags, true);
+        if (copyRet == true)
+        {
+            ret = dataSize;
+        }
+        else if (copyRet < 0)
+        {
+            ret = copyRet;
+        }
+    }
+    spin_unlock_irqrestore(&pDev->mBulkMemList.mReadMemLock, iflags);
+    return ret;
+}
+
 static ssize_t processIo(struct kiocb *kiocb)
 {
     ssize_t ret = 0;
@@ -2286,12 +2913,10 @@ static ssize_t processIo(struct kiocb *kiocb)
         return -EINVAL;  
     }
 
-    sema_init(&io_data->readSem, 0);
-
     QC_LOG_DBG(io_data->pDev," --> iov count : %d\n", (int)iov_iter_count(&io_data->data));
 
     spin_lock_irqsave(&io_data->pDev->mBulkMemList.mReadMemLock, iflags);
-    if (io_data->pDev->mBulkMemList.mReadBuffCircular.mBufEmptyStatus==false)
+    if (RxDataReady(io_data->pDev, iov_iter_count(&io_data->data)))
 	{
 	spin_unlock_irqrestore(&io_data->pDev->mBulkMemList.mReadMemLock, iflags);
 	//potential locking issue
@@ -2301,6 +2926,7 @@ static ssize_t processIo(struct kiocb *kiocb)
 		QC_LOG_INFO(io_data->pDev," (<--) successfully read %d\n", (int)ret);
 		return ret;
 	}
+	spin_lock_irqsave(&io_data->pDev->mBulkMemList.mReadMemLock, iflags);
     }
     QC_LOG_INFO(io_data->pDev,"--> To be added to queue, io_data->aio/read:%d/%d\n", io_data->aio, io_data->read);
 
@@ -2309,23 +2935,22 @@ static ssize_t processIo(struct kiocb *kiocb)
     {
         if (!(kiocb->ki_filp->f_flags & O_NONBLOCK))
         {
-            io_data->complete = io_sync_complete;
-            ret = ioData_enqueue(kiocb);
-            if (unlikely(ret < 0))
+            /* Blocks like read(), on the same wait queue */
+            ret = WaitRxData(io_data->pDev, iov_iter_count(&io_data->data), &iflags);
+            if (ret > 0)
             {
-                QC_LOG_ERR(io_data->pDev,"Failed to add to queue (<--)\n");
-                goto end;
+                size_t dataSize = iov_iter_count(&io_data->data);
+                void *data = &io_data->data;
+                int copyRet;
+
+                copyRet = CopyFromReadMemListIter(io_data->pDev, &data, &dataSize, &iflags, true);
+                ret = (copyRet == true) ? (ssize_t)dataSize : ((copyRet < 0) ? copyRet : 0);
             }
-            spin_unlock_irqrestore(&io_data->pDev->mBulkMemList.mReadMemLock, iflags);
-            ret = down_interruptible(&io_data->readSem);
-            spin_lock_irqsave(&io_data->pDev->mBulkMemList.mReadMemLock, iflags);
-            if (ret != 0)
+            else if (ret < 0)
             {
                 QC_LOG_ERR(io_data->pDev,"Interrupted %d (<--)\n", (int)ret);
-                ioData_dequeue(kiocb, NULL);
-                goto end;
             }
-            ret = io_data->len;
+            WakeRxWaiters(io_data->pDev);
         }
         else
         {
@@ -2363,6 +2988,29 @@ static ssize_t UserspaceQTIDevReadIter(struct kiocb *kiocb, struct iov_iter *iov
         QC_LOG_ERR(pDev,"kiocb invalid\n");
         return -EINVAL;  
     }
+
+    pDev = kiocb->ki_filp->private_data;
+    if (pDev != NULL && pDev->mpRing != NULL)
+    {
+        /* Data goes to the mapped ring */
+        return -EBUSY;
+    }
+
+    if (pDev != NULL)
+    {
+        res = ReadIterNow(pDev, iov);
+        if (res != 0)
+        {
+            return res;
+        }
+    }
+#ifdef IOCB_NOWAIT
+    if (kiocb->ki_flags & IOCB_NOWAIT)
+    {
+        /* io_uring retries once poll() reports data */
+        return -EAGAIN;
+    }
+#endif
 	
     aioDataCtx = qti_kmalloc(sizeof(struct qtidev_aio_data), GFP_KERNEL);
     if (unlikely(!aioDataCtx))
@@ -2372,6 +3020,7 @@ static ssize_t UserspaceQTIDevReadIter(struct kiocb *kiocb, struct iov_iter *iov
     }
 
     kref_init(&aioDataCtx->mRefCount);
+    INIT_LIST_HEAD(&aioDataCtx->mReadNode);
 
     if(!is_sync_kiocb(kiocb))
     {
@@ -2387,7 +3036,7 @@ static ssize_t UserspaceQTIDevReadIter(struct kiocb *kiocb, struct iov_iter *iov
     aioDataCtx->pDev  = pDev;
 
     QC_LOG_DBG(pDev, "PID = %u, Pname = %s, tgid= %u\n",task_pid_nr(current),current->comm, task_tgid_nr(current));
-    if(aioDataCtx->aio)
+    if (aioDataCtx->aio && !QTIDEV_ITER_IS_UBUF(iov))
     {
         aioDataCtx->to_free = dup_iter(&aioDataCtx->data, iov, GFP_KERNEL);
         if (aioDataCtx->to_free == NULL)
@@ -2470,6 +3119,7 @@ static void UserspaceQTIDevWrite_bulk_async_callback(struct urb *urb)
     dev = aioDataCtx->pDev;
 
     QC_LOG_DBG(dev,"%px:%px\n", aioDataCtx, aioDataCtx->kiocb);
+    QTIDevBenchUrb(&dev->mBench, false, aioDataCtx->mSubmitNs, urb->actual_length, urb->status);
     /* sync/async unlink faults aren't errors */
     if (urb->status || (urb->status != -EINPROGRESS)) {
         spin_lock(&dev->mSpinErrLock);
@@ -2506,7 +3156,7 @@ static void UserspaceQTIDevWrite_bulk_async_callback(struct urb *urb)
     qti_kfree(urb->transfer_buffer);
     kref_get(&aioDataCtx->pDev->mRefCount);
     INIT_WORK(&aioDataCtx->submit_work, aio_submit_worker);
-    queue_work(aioDataCtx->pDev->mpWorkQ, &aioDataCtx->submit_work);
+    queue_work_on(QTIDevInfWorkCpu(aioDataCtx->pDev->mNumaNode), aioDataCtx->pDev->mpWorkQ, &aioDataCtx->submit_work);
     //qti_kfree(aioDataCtx);
 	usb_free_urb(urb);
     return;
@@ -2520,20 +3170,30 @@ ssize_t UserspaceQTIDevWriteIter(struct kiocb *kiocb, struct iov_iter *iov)
     struct urb *urb;
     char *buf = NULL;
     int writesize = 0;
+    gfp_t memFlags = GFP_KERNEL;
+    ssize_t noMem = -ENOMEM;
 
     if (kiocb == NULL)
     {
         QC_LOG_ERR(pDev,"kiocb invalid\n");
         return -EINVAL;  
     }
+#ifdef IOCB_NOWAIT
+    if (kiocb->ki_flags & IOCB_NOWAIT)
+    {
+        /* No reclaim, io_uring retries from its worker instead */
+        memFlags = GFP_NOWAIT | __GFP_NOWARN;
+        noMem = -EAGAIN;
+    }
+#endif
 
     if(!is_sync_kiocb(kiocb))
     {
-        aioDataCtx = qti_kmalloc(sizeof(struct qtidev_aio_data), GFP_KERNEL);
+        aioDataCtx = qti_kmalloc(sizeof(struct qtidev_aio_data), memFlags);
         if (unlikely(!aioDataCtx))
         {
             QC_LOG_ERR(pDev,"Failed to alloctate memory\n");
-            return -ENOMEM;
+            return noMem;
         }
         aioDataCtx->aio = true;
     } else
@@ -2552,19 +3212,19 @@ ssize_t UserspaceQTIDevWriteIter(struct kiocb *kiocb, struct iov_iter *iov)
     kiocb->private = aioDataCtx;
     QC_LOG_DBG(pDev, "PID = %u, Pname = %s, tgid= %u\n",task_pid_nr(current),current->comm, task_tgid_nr(current));
     /* create a urb, and a buffer for it, and copy the data to the urb */
-    urb = usb_alloc_urb(0, GFP_KERNEL);
+    urb = usb_alloc_urb(0, memFlags);
     if (!urb) {
         qti_kfree(aioDataCtx);
-        return -ENOMEM;
+        return noMem;
     }
 
     aioDataCtx->urb = urb;
-    buf = qti_kmalloc(writesize, GFP_KERNEL);
+    buf = qti_kmalloc(writesize, memFlags);
     if (!buf) {
         QC_LOG_ERR(pDev,"Failed to alloctate memory\n");
         qti_kfree(aioDataCtx);
         usb_free_urb(urb);
-        return -ENOMEM;
+        return noMem;
     }
 
     if (!copy_from_iter(buf, writesize, iov)) {
@@ -2597,7 +3257,8 @@ ssize_t UserspaceQTIDevWriteIter(struct kiocb *kiocb, struct iov_iter *iov)
     }
 
     /* send the data out the bulk port */
-    res = usb_submit_urb(urb, GFP_KERNEL);
+    aioDataCtx->mSubmitNs = QTIDevBenchStamp(&pDev->mBench);
+    res = usb_submit_urb(urb, memFlags);
     if (res) {
 		QC_LOG_ERR(pDev,"failed submitting write urb, error %ld\n", res);
 		usb_unanchor_urb(urb);
@@ -2610,6 +3271,225 @@ ssize_t UserspaceQTIDevWriteIter(struct kiocb *kiocb, struct iov_iter *iov)
     return res;
 }
 
+static int UserspaceQTIDevMmap(struct file *file, struct vm_area_struct *vma)
+{
+    sQTIDevUSB *pDev = file->private_data;
+    sQTIDevRing *pRing;
+    unsigned long flags;
+    int retval;
+
+    if (pDev == NULL)
+    {
+        QC_LOG_ERR(pDev,"Invalid data\n");
+        return -ENODEV;
+    }
+
+    mutex_lock(&pDev->mIoMutex);
+    if (pDev->disconnected)
+    {
+        QC_LOG_EXCEPTION(pDev, "QTI-ALERT-M0: dev interface is gone\n");
+        mutex_unlock(&pDev->mIoMutex);
+        return -ENODEV;
+    }
+    if (!list_empty(&pDev->mBulkMemList.mReaderList))
+    {
+        /* Shared readers follow the chunk queue the ring replaces */
+        mutex_unlock(&pDev->mIoMutex);
+        return -EBUSY;
+    }
+
+    if (pDev->mpRing == NULL)
+    {
+        pRing = QTIDevRingCreate(pDev, RingSlots);
+        if (IS_ERR(pRing))
+        {
+            mutex_unlock(&pDev->mIoMutex);
+            return PTR_ERR(pRing);
+        }
+
+        /* Switch the bulk-in reads from the circular buffer to the ring */
+        StopRead(pDev);
+        spin_lock_irqsave(&pDev->mBulkMemList.mReadMemLock, flags);
+        ClearReadMemList(pDev);
+        spin_unlock_irqrestore(&pDev->mBulkMemList.mReadMemLock, flags);
+        pDev->mpRing = pRing;
+
+        retval = SubmitAllReadUrb(pDev);
+        if (retval != 0)
+        {
+            QC_LOG_ERR(pDev,"Error %d starting ring reads\n", retval);
+            QTIDevRingDetach(pDev);
+            mutex_unlock(&pDev->mIoMutex);
+            return retval;
+        }
+    }
+
+    retval = QTIDevRingMmap(pDev->mpRing, vma);
+    mutex_unlock(&pDev->mIoMutex);
+    return retval;
+}
+
+/* Pipe buffers own a reference on a page of a receive buffer */
+static const struct pipe_buf_operations QTIDevSpliceBufOps = {
+#if (LINUX_VERSION_CODE < KERNEL_VERSION(5,8,0))
+    .confirm = generic_pipe_buf_confirm,
+    .steal   = generic_pipe_buf_steal,
+#endif
+    .release = generic_pipe_buf_release,
+    .get     = generic_pipe_buf_get,
+};
+
+static void QTIDevSpliceSpdRelease(struct splice_pipe_desc *spd, unsigned int i)
+{
+    put_page(spd->pages[i]);
+}
+
+// Give the buffers a pipe or socket still holds a fresh set of pages, the old
+// ones are freed with the last reference
+static void ReplaceSharedChunks(sQTIDevUSB *pDev)
+{
+    LIST_HEAD(busyList);
+    sReadMemChunk *pChunk;
+    sReadMemChunk *pSafe;
+    unsigned long flags;
+    void *pBuffer;
+
+    spin_lock_irqsave(&pDev->mBulkMemList.mReadMemLock, flags);
+    ReclaimSharedChunks(pDev);
+    list_splice_init(&pDev->mBulkMemList.mChunkSharedList, &busyList);
+    spin_unlock_irqrestore(&pDev->mBulkMemList.mReadMemLock, flags);
+
+    if (list_empty(&busyList))
+        return;
+
+    list_for_each_entry(pChunk, &busyList, node)
+    {
+        pBuffer = QtiAllocPagesNode(pDev->mBulkMemList.mChunkNode, pDev->mBulkInSize, GFP_KERNEL | __GFP_NOWARN);
+        if (pBuffer == NULL)
+            continue;
+        free_pages_exact(pChunk->mpBuffer, pDev->mBulkInSize);
+        pChunk->mpBuffer = pBuffer;
+        pChunk->mbShared = false;
+    }
+
+    spin_lock_irqsave(&pDev->mBulkMemList.mReadMemLock, flags);
+    list_for_each_entry_safe(pChunk, pSafe, &busyList, node)
+    {
+        list_del(&pChunk->node);
+        RecycleReadChunk(pDev, pChunk);
+    }
+    ResubmitParkedUrbs(pDev);
+    spin_unlock_irqrestore(&pDev->mBulkMemList.mReadMemLock, flags);
+}
+
+// splice()/sendfile() from the node: the pages the URBs received into are
+// linked into the pipe instead of being copied
+static ssize_t UserspaceQTIDevSpliceRead(struct file *pFile, loff_t *ppos,
+        struct pipe_inode_info *pPipe, size_t len, unsigned int spliceFlags)
+{
+    sQTIDevUSB *pDev = pFile->private_data;
+    struct page *pages[PIPE_DEF_BUFFERS];
+    struct partial_page partial[PIPE_DEF_BUFFERS];
+    struct splice_pipe_desc spd = {
+        .pages = pages,
+        .partial = partial,
+        .nr_pages_max = PIPE_DEF_BUFFERS,
+        .ops = &QTIDevSpliceBufOps,
+        .spd_release = QTIDevSpliceSpdRelease,
+    };
+    sReadMemChunk *pChunk;
+    unsigned long flags;
+    unsigned int offset;
+    unsigned int taken;
+    size_t count;
+    ssize_t retval;
+
+    if (pDev == NULL)
+    {
+        QC_LOG_ERR(pDev,"Invalid data\n");
+        return -ENODEV;
+    }
+    if (pDev->mpRing != NULL)
+    {
+        return -EBUSY;
+    }
+    if (pDev->mbDplRecords || (pDev->mHdlc.mpPacket != NULL))
+    {
+        /* A pipe keeps no record boundaries */
+        return -EINVAL;
+    }
+    if (len == 0)
+    {
+        return 0;
+    }
+
+    ReplaceSharedChunks(pDev);
+
+    spin_lock_irqsave(&pDev->mBulkMemList.mReadMemLock, flags);
+    while (list_empty(&pDev->mBulkMemList.mChunkList) || !RxDataReady(pDev, len))
+    {
+        spin_unlock_irqrestore(&pDev->mBulkMemList.mReadMemLock, flags);
+        if (pDev->disconnected)
+        {
+            return -ENODEV;
+        }
+        if ((spliceFlags & SPLICE_F_NONBLOCK) || (pFile->f_flags & O_NONBLOCK))
+        {
+            return -EAGAIN;
+        }
+        if (wait_event_interruptible(pDev->mBulkMemList.mWaitQueue,
+                RxDataReady(pDev, len) || pDev->disconnected))
+        {
+            return -ERESTARTSYS;
+        }
+        spin_lock_irqsave(&pDev->mBulkMemList.mReadMemLock, flags);
+    }
+
+    /* One chunk per call, off the queue while the pipe lock is taken */
+    pChunk = list_first_entry(&pDev->mBulkMemList.mChunkList, sReadMemChunk, node);
+    list_del(&pChunk->node);
+    offset = pChunk->mOffset;
+    while ((spd.nr_pages < PIPE_DEF_BUFFERS) && (offset < pChunk->mDataLen) && (len > 0))
+    {
+        unsigned char *pData = pChunk->mpBuffer + offset;
+
+        count = min_t(size_t, PAGE_SIZE - offset_in_page(pData), pChunk->mDataLen - offset);
+        count = min(count, len);
+        pages[spd.nr_pages] = virt_to_page(pData);
+        get_page(pages[spd.nr_pages]);
+        partial[spd.nr_pages].offset = offset_in_page(pData);
+        partial[spd.nr_pages].len = count;
+        spd.nr_pages++;
+        offset += count;
+        len -= count;
+    }
+    taken = offset - pChunk->mOffset;
+    pChunk->mbShared = true;
+    pDev->mBulkMemList.mChunkBytes -= taken;
+    spin_unlock_irqrestore(&pDev->mBulkMemList.mReadMemLock, flags);
+
+    retval = splice_to_pipe(pPipe, &spd);
+
+    spin_lock_irqsave(&pDev->mBulkMemList.mReadMemLock, flags);
+    count = (retval > 0) ? retval : 0;
+    pDev->mBulkMemList.mChunkBytes += taken - count;
+    pChunk->mOffset += count;
+    pDev->mStats.ToUsrCnt += count;
+    if (pChunk->mOffset < pChunk->mDataLen)
+    {
+        list_add(&pChunk->node, &pDev->mBulkMemList.mChunkList);
+    }
+    else
+    {
+        RecycleReadChunk(pDev, pChunk);
+    }
+    WakeSharedReaders(pDev);
+    ResubmitParkedUrbs(pDev);
+    spin_unlock_irqrestore(&pDev->mBulkMemList.mReadMemLock, flags);
+
+    QC_LOG_DBG(pDev,"spliced %zd of %u, left %zu\n", retval, taken, pDev->mBulkMemList.mChunkBytes);
+    return retval;
+}
 
 static const struct file_operations UserSpaceQdssFops = {
     .owner  =   THIS_MODULE,
@@ -2625,41 +3505,276 @@ static const struct file_operations UserSpaceQdssFops = {
     .open   =   UserspaceQTIDevOpen,
     .release=   UserspaceQTIDevRelease,
     .flush  =   UserspaceQTIDevFlush,
+    .fsync  =   UserspaceQTIDevFsync,
     .llseek =   UserspaceQTIDevllseek,
     .poll   =   UserspaceQTIDevPoll,
+    .mmap   =   UserspaceQTIDevMmap,
+    .splice_read = UserspaceQTIDevSpliceRead,
 };
 
-static int RegisterQDSSDevice(sQTIDevUSB *pDev)
+// FUNCTION FindReaderChunk runs within mReadMemLock
+//    The chunk holding the next byte of a shared reader, NULL when it has
+//    not arrived yet or the first open is copying it
+static sReadMemChunk *FindReaderChunk(sQTIDevUSB *pDev, sQTIDevReader *pReader)
 {
-    int result = -ENAVAIL;
-    char fqDevName[255];
-    dev_t devno;
-    struct device *dev_ret;
-    QC_LOG_DBG(pDev,"");
+    sReadMemChunk *pChunk;
 
-    // allocate and fill devno with numbers
-    if (pDev->mDevInfo.mClassType == QTIDEV_INF_CLASS_PORTS)
-    {
-        result = alloc_chrdev_region( &devno, 0, 1, QTIDEV_PORT_CLASS_NAME);
-    } else if (pDev->mDevInfo.mClassType == QTIDEV_INF_CLASS_USB)
+    list_for_each_entry(pChunk, &pDev->mBulkMemList.mChunkHeldList, node)
     {
-        result = alloc_chrdev_region( &devno, 0, 1, QTIDEV_USB_CLASS_NAME);
+        if ((pReader->mCursor >= pChunk->mSeq) &&
+                (pReader->mCursor < pChunk->mSeq + pChunk->mDataLen))
+            return pChunk;
     }
-    if (result < 0)
+    list_for_each_entry(pChunk, &pDev->mBulkMemList.mChunkList, node)
     {
-        return result;
+        if ((pReader->mCursor >= pChunk->mSeq) &&
+                (pReader->mCursor < pChunk->mSeq + pChunk->mDataLen))
+            return pChunk;
     }
+    return NULL;
+}
 
-    // Create cdev
-    cdev_init( &pDev->mCdev, &UserSpaceQdssFops );
-    pDev->mCdev.owner = THIS_MODULE;
-    pDev->mCdev.ops = &UserSpaceQdssFops;
+static bool SharedReaderReady(sQTIDevReader *pReader)
+{
+    sQTIDevUSB *pDev = pReader->mpDev;
+    unsigned long flags;
+    bool bReady;
 
-    result = cdev_add( &pDev->mCdev, devno, true );
-    if (result != 0)
-    {
-        QC_LOG_ERR(pDev, "error adding cdev\n" );
-        unregister_chrdev_region(devno, true);
+    spin_lock_irqsave(&pDev->mBulkMemList.mReadMemLock, flags);
+    bReady = SharedReaderDue(pDev, pReader) && (FindReaderChunk(pDev, pReader) != NULL);
+    spin_unlock_irqrestore(&pDev->mBulkMemList.mReadMemLock, flags);
+    return bReady;
+}
+
+static ssize_t UserspaceQTIDevReaderRead(struct file *file, char __user *buffer, size_t size,
+        loff_t *ppos)
+{
+    sQTIDevReader *pReader = file->private_data;
+    sQTIDevUSB *pDev = pReader->mpDev;
+    sReadMemChunk *pChunk;
+    unsigned long flags;
+    size_t copied = 0;
+    size_t offset;
+    size_t len;
+
+    if (!buffer || !size)
+    {
+        QC_LOG_ERR(pDev,"Invalid file data\n");
+        return -EBADF;
+    }
+
+    while (copied < size)
+    {
+        spin_lock_irqsave(&pDev->mBulkMemList.mReadMemLock, flags);
+        pChunk = FindReaderChunk(pDev, pReader);
+        /* The watermark holds back the first byte only, not the rest of a read */
+        if ((pChunk == NULL) || ((copied == 0) && !SharedReaderDue(pDev, pReader)))
+        {
+            spin_unlock_irqrestore(&pDev->mBulkMemList.mReadMemLock, flags);
+            if (copied != 0)
+            {
+                break;
+            }
+            if (pDev->disconnected)
+            {
+                return -ENODEV;
+            }
+            if (file->f_flags & O_NONBLOCK)
+            {
+                return -EAGAIN;
+            }
+            if (wait_event_interruptible(pReader->mWaitQueue,
+                    SharedReaderReady(pReader) || pDev->disconnected))
+            {
+                return -ERESTARTSYS;
+            }
+            continue;
+        }
+
+        /* Neither recycled nor dropped while the reader copies from it */
+        offset = pReader->mCursor - pChunk->mSeq;
+        len = min_t(size_t, pChunk->mDataLen - offset, size - copied);
+        pReader->mpBusyChunk = pChunk;
+        spin_unlock_irqrestore(&pDev->mBulkMemList.mReadMemLock, flags);
+
+        if (copy_to_user(buffer + copied, pChunk->mpBuffer + offset, len))
+        {
+            len = 0;
+        }
+
+        spin_lock_irqsave(&pDev->mBulkMemList.mReadMemLock, flags);
+        pReader->mpBusyChunk = NULL;
+        pReader->mCursor += len;
+        copied += len;
+        ReleaseHeldChunks(pDev);
+        ResubmitParkedUrbs(pDev);
+        spin_unlock_irqrestore(&pDev->mBulkMemList.mReadMemLock, flags);
+
+        if (len == 0)
+        {
+            QC_LOG_ERR(pDev,"Error copying read data to user\n");
+            return (copied != 0) ? copied : -EFAULT;
+        }
+    }
+    return copied;
+}
+
+static unsigned int UserspaceQTIDevReaderPoll(struct file *pFilp,
+        struct poll_table_struct *pPollTable)
+{
+    sQTIDevReader *pReader = pFilp->private_data;
+    unsigned int status = 0;
+
+    poll_wait(pFilp, &pReader->mWaitQueue, pPollTable);
+    if (pReader->mpDev->disconnected)
+    {
+        return POLLERR | POLLHUP;
+    }
+    if (SharedReaderReady(pReader))
+    {
+        status |= POLLIN | POLLRDNORM;
+    }
+    return status;
+}
+
+static long UserspaceQTIDevReaderIOCTL(struct file *pFilp, unsigned int cmd,
+        unsigned long arg)
+{
+    sQTIDevReader *pReader = pFilp->private_data;
+    sQTIDevUSB *pDev = pReader->mpDev;
+    unsigned long flags;
+    unsigned long userValue;
+    __u64 dropped;
+
+    switch (cmd)
+    {
+        case IOCTL_QTIDEV_SET_RX_WATERMARK:
+        case IOCTL_QTIDEV_SET_RX_LATENCY:
+        {
+            if (!arg || copy_from_user(&userValue, (void __user *)arg, sizeof(unsigned long)))
+            {
+                return -EFAULT;
+            }
+            if (((cmd == IOCTL_QTIDEV_SET_RX_WATERMARK) && (userValue > QTIDEV_RX_WATERMARK_MAX)) ||
+                ((cmd == IOCTL_QTIDEV_SET_RX_LATENCY) && (userValue > QTIDEV_RX_LATENCY_MAX)))
+            {
+                QC_LOG_ERR(pDev,"Rx 0x%x: invalid value %lu\n", cmd, userValue);
+                return -EINVAL;
+            }
+            /* Settings of this reader only, the other opens keep theirs */
+            spin_lock_irqsave(&pDev->mBulkMemList.mReadMemLock, flags);
+            if (cmd == IOCTL_QTIDEV_SET_RX_WATERMARK)
+            {
+                pReader->mRxWatermark = userValue;
+            }
+            else
+            {
+                pReader->mRxLatency = userValue;
+            }
+            if (SharedReaderDue(pDev, pReader))
+            {
+                wake_up_interruptible(&pReader->mWaitQueue);
+            }
+            spin_unlock_irqrestore(&pDev->mBulkMemList.mReadMemLock, flags);
+            QC_LOG_DBG(pDev,"reader Rx watermark %zu latency %u\n", pReader->mRxWatermark, pReader->mRxLatency);
+            return 0;
+        }
+        case IOCTL_QTIDEV_GET_RX_DROPPED:
+        {
+            spin_lock_irqsave(&pDev->mBulkMemList.mReadMemLock, flags);
+            dropped = pReader->mDropped;
+            spin_unlock_irqrestore(&pDev->mBulkMemList.mReadMemLock, flags);
+            if (copy_to_user((void __user *)arg, &dropped, sizeof(dropped)))
+            {
+                return -EFAULT;
+            }
+            return 0;
+        }
+        default:
+            return -EBADRQC;
+    }
+}
+
+static int UserspaceQTIDevReaderRelease(struct inode *inode, struct file *file)
+{
+    sQTIDevReader *pReader = file->private_data;
+    sQTIDevUSB *pDev = pReader->mpDev;
+    unsigned long flags;
+    bool bLast;
+
+    QC_LOG_INFO(pDev, "PID = %u, Pname = %s, dropped %llu\n", task_pid_nr(current), current->comm,
+            pReader->mDropped);
+
+    if (pDev->interface)
+        usb_autopm_put_interface(pDev->interface);
+
+    mutex_lock(&pDev->mIoMutex);
+    spin_lock_irqsave(&pDev->mBulkMemList.mReadMemLock, flags);
+    list_del(&pReader->node);
+    ReleaseHeldChunks(pDev);
+    bLast = !pDev->mBulkMemList.mbOwnerOpen && list_empty(&pDev->mBulkMemList.mReaderList);
+    if (!bLast)
+    {
+        ResubmitParkedUrbs(pDev);
+    }
+    spin_unlock_irqrestore(&pDev->mBulkMemList.mReadMemLock, flags);
+
+    if (bLast)
+    {
+        /* The first open closed before, the stream ends with its last reader */
+        StopRead(pDev);
+        spin_lock_irqsave(&pDev->mBulkMemList.mReadMemLock, flags);
+        ClearReadMemList(pDev);
+        spin_unlock_irqrestore(&pDev->mBulkMemList.mReadMemLock, flags);
+    }
+    mutex_unlock(&pDev->mIoMutex);
+
+    qti_kfree(pReader);
+    kref_put(&pDev->mRefCount, QTIDevUSBDelete);
+    return 0;
+}
+
+/* Opens after the first, see OpenSharedReader */
+static const struct file_operations UserSpaceQdssReaderFops = {
+    .owner  =   THIS_MODULE,
+    .read   =   UserspaceQTIDevReaderRead,
+    .unlocked_ioctl = UserspaceQTIDevReaderIOCTL,
+    .release=   UserspaceQTIDevReaderRelease,
+    .llseek =   UserspaceQTIDevllseek,
+    .poll   =   UserspaceQTIDevReaderPoll,
+};
+
+static int RegisterQDSSDevice(sQTIDevUSB *pDev)
+{
+    int result = -ENAVAIL;
+    char fqDevName[255];
+    dev_t devno;
+    struct device *dev_ret;
+    QC_LOG_DBG(pDev,"");
+
+    // allocate and fill devno with numbers
+    if (pDev->mDevInfo.mClassType == QTIDEV_INF_CLASS_PORTS)
+    {
+        result = alloc_chrdev_region( &devno, 0, 1, QTIDEV_PORT_CLASS_NAME);
+    } else if (pDev->mDevInfo.mClassType == QTIDEV_INF_CLASS_USB)
+    {
+        result = alloc_chrdev_region( &devno, 0, 1, QTIDEV_USB_CLASS_NAME);
+    }
+    if (result < 0)
+    {
+        return result;
+    }
+
+    // Create cdev
+    cdev_init( &pDev->mCdev, &UserSpaceQdssFops );
+    pDev->mCdev.owner = THIS_MODULE;
+    pDev->mCdev.ops = &UserSpaceQdssFops;
+
+    result = cdev_add( &pDev->mCdev, devno, true );
+    if (result != 0)
+    {
+        QC_LOG_ERR(pDev, "error adding cdev\n" );
+        unregister_chrdev_region(devno, true);
         return result;
     }
 
@@ -2758,6 +3873,7 @@ static int ReadBulkUSB( sQTIDevUSB *pDev, struct urb * pBlkURB )
                       pBlkURB->complete,
                       pBlkURB->context);
 
+    ((sBulkUrbList *)pBlkURB->context)->mSubmitNs = QTIDevBenchStamp(&pDev->mBench);
     status = usb_submit_urb( pBlkURB, GFP_ATOMIC );
     if (status != 0)
     {
@@ -2801,84 +3917,133 @@ static int ResubmitBulkURB( struct urb * pBlkURB )
    return status;
 }
 
+// FUNCTION AddToReadMemList runs within mReadMemLock
+//    Queue the buffer of a completed URB for the readers and give the URB a
+//    fresh one. Returns false when the pool is empty and the URB has to wait.
 static bool AddToReadMemList(sQTIDevUSB *pDev,
-        void *pDataCopy, unsigned long dataSize)
+        sBulkUrbList *pUrbItem, unsigned long dataSize)
 {
-    void *pBulkStartInBuffer;
-    unsigned int startIdx;
-    unsigned int endIdx;
-    unsigned int buffLen;
+    sReadMemChunk *pChunk = pUrbItem->mpChunk;
 
-    pBulkStartInBuffer = pDev->mBulkMemList.mReadBuffCircular.mBulk_in_buffer;
-    buffLen = pDev->mBulkMemList.mReadBuffCircular.mBufflen;
-    startIdx = pDev->mBulkMemList.mReadBuffCircular.mStartIdx;
-    endIdx = pDev->mBulkMemList.mReadBuffCircular.mEndIdx;
-
-#ifdef QDSS_INT_BULK_BUFFER
-    if (startIdx <= endIdx)
+    pChunk->mDataLen = dataSize;
+    pChunk->mOffset = 0;
+    pChunk->mSeq = pDev->mBulkMemList.mStreamBytes;
+    pChunk->mTimestamp = ktime_get_ns();
+    pDev->mBulkMemList.mStreamBytes += dataSize;
+    pUrbItem->mpChunk = NULL;
+    if (pDev->mBulkMemList.mbOwnerOpen)
     {
-        if ((startIdx == endIdx) && (pDev->mBulkMemList.mReadBuffCircular.mBufEmptyStatus == false))
+        if (pDev->mBulkMemList.mChunkBytes == 0)
         {
-           QC_LOG_ERR(pDev,"buffer full: add to queue (<--)\n");
-           return false;
+            pDev->mRxHeldSince = jiffies;
         }
+        list_add_tail(&pChunk->node, &pDev->mBulkMemList.mChunkList);
+        pDev->mBulkMemList.mChunkBytes += dataSize;
+        WakeSharedReaders(pDev);
+    }
+    else
+    {
+        /* Only shared readers are left, nothing consumes the queue */
+        RecycleReadChunk(pDev, pChunk);
+    }
 
-        if (dataSize <= (buffLen - (endIdx - startIdx)))  // enough space for even wrap-around
-        {
-            int partialLen = 0;
+    QC_LOG_DBG(pDev,"URB[%d] queued %lu, unread %zu\n", pUrbItem->mIndex, dataSize,
+            pDev->mBulkMemList.mChunkBytes);
 
-            partialLen = (dataSize <= (buffLen - endIdx)) ? dataSize : buffLen - endIdx;
-            memmove(pBulkStartInBuffer+ endIdx, pDataCopy, partialLen);
-            if (dataSize != partialLen)  // need to wrap around
-            {
-                memmove(pBulkStartInBuffer,
-                        pDataCopy + partialLen, dataSize - partialLen);  // wrap around filling
-                pDev->mBulkMemList.mReadBuffCircular.mEndIdx
-                    = dataSize - partialLen;
-                QC_LOG_DBG(pDev,"(1) st : %d, end: %d, data : %lu\n",
-                        pDev->mBulkMemList.mReadBuffCircular.mStartIdx,
-                        pDev->mBulkMemList.mReadBuffCircular.mEndIdx,dataSize);
-            }
-            else  // mEndIdx still <= buffer end
-            {
-                pDev->mBulkMemList.mReadBuffCircular.mEndIdx += dataSize;
-                QC_LOG_DBG(pDev,"(2) st : %d, end: %d, data : %lu\n",
-                        pDev->mBulkMemList.mReadBuffCircular.mStartIdx,
-                        pDev->mBulkMemList.mReadBuffCircular.mEndIdx, dataSize);
-            }
-        }
-        else
-        {
-            QC_LOG_ERR(pDev,"Insufficient buf space, add to queue (<--)\n");
-            return false;
-        }
+    if (AttachReadChunk(pDev, pUrbItem) == false)
+    {
+        QC_LOG_DBG(pDev,"URB[%d] no free buffer, parked (<--)\n", pUrbItem->mIndex);
+        pUrbItem->mUrbStatus &= (~BULK_URB_SUBMITTED);
+        pUrbItem->mUrbStatus |= BULK_URB_PARKED;
+        pUrbItem->mBulk_in_urb->transfer_buffer = NULL;
+        return false;
+    }
+    return true;
+}
+
+// FUNCTION NotifyRxReaders runs within mReadMemLock
+//    Hand the queued data to a blocked read(), poll() and the queued aio reads
+static void NotifyRxReaders(sQTIDevUSB *pDev)
+{
+    struct qtidev_aio_data *io_data;
+    struct qtidev_aio_data *psafePtr;
+
+    WakeRxWaiters(pDev);
+    /* Possibly notify poll() that data exists */
+    wake_up_interruptible(&pDev->mBulkMemList.mWaitQueue);
+
+    /*
+     * list_for_each_entry_safe takes care of the deletion in the read_list
+     * being done via ioData_dequeue. The oldest reads are served first,
+     * so the walk ends with the data.
+     */
+    QC_LOG_DBG(pDev," --> Calling ioData_dequeue. Read_list has %lu nodes.\n", pDev->mIoReadBuffListActiveSize);
+    list_for_each_entry_safe(io_data, psafePtr, &pDev->mIoReadBuffListActive, mReadNode ) {
+        if ((pDev->mBulkMemList.mChunkBytes == 0) && !pDev->mHdlc.mbFrame)
+            break;
+        if(ioData_dequeue(io_data->kiocb, pDev) < 0)
+            break;
     }
-    else if (dataSize <= (startIdx - endIdx))  // already wrap-around
+}
+
+// FUNCTION ArmRxLatency runs within mReadMemLock
+//    Data below the watermark is handed out once it has waited mRxLatency ms
+static void ArmRxLatency(sQTIDevUSB *pDev)
+{
+    unsigned long due;
+
+    if (pDev->mRxLatency == 0)
     {
-        memmove(pBulkStartInBuffer + endIdx, pDataCopy, dataSize);
-        pDev->mBulkMemList.mReadBuffCircular.mEndIdx += dataSize;
-        QC_LOG_DBG(pDev,"(3) st : %d, end: %d, data : %lu\n",
-                pDev->mBulkMemList.mReadBuffCircular.mStartIdx,
-                pDev->mBulkMemList.mReadBuffCircular.mEndIdx, dataSize);
+        return;
+    }
+    due = pDev->mRxHeldSince + msecs_to_jiffies(pDev->mRxLatency);
+    QueueRxLatencyWork(pDev, due);
+}
+
+// FUNCTION QueueRxLatencyWork runs within mReadMemLock
+//    The consuming open and the shared readers share the work, it runs at
+//    the earliest time any of them asked for
+static void QueueRxLatencyWork(sQTIDevUSB *pDev, unsigned long due)
+{
+    unsigned long delay = time_after(due, jiffies) ? (due - jiffies) : 0;
+
+    if (delayed_work_pending(&pDev->mRxLatencyWork) &&
+            time_after(pDev->mRxLatencyWork.timer.expires, due))
+    {
+        mod_delayed_work_on(QTIDevInfWorkCpu(pDev->mNumaNode), pDev->mpWorkQ, &pDev->mRxLatencyWork, delay);
     }
     else
     {
-        QC_LOG_ERR(pDev,"wrap-around: Insufficient buf space, add to queue (<--)\n");
-        return false;
+        queue_delayed_work_on(QTIDevInfWorkCpu(pDev->mNumaNode), pDev->mpWorkQ, &pDev->mRxLatencyWork, delay);
     }
-    pDev->mBulkMemList.mReadBuffCircular.mBufEmptyStatus = false;
-#endif
+}
 
-    return true;
+static void RxLatencyWork(struct work_struct *pWork)
+{
+    sQTIDevUSB *pDev = container_of(to_delayed_work(pWork), sQTIDevUSB, mRxLatencyWork);
+    unsigned long flags;
+
+    spin_lock_irqsave(&pDev->mBulkMemList.mReadMemLock, flags);
+    if (RxDataReady(pDev, 0))
+    {
+        QC_LOG_DBG(pDev,"latency expired, unread %zu\n", pDev->mBulkMemList.mChunkBytes);
+        NotifyRxReaders(pDev);
+    }
+    else if (pDev->mBulkMemList.mChunkBytes != 0)
+    {
+        /* The data it was armed for was read, wait for the newer data */
+        ArmRxLatency(pDev);
+    }
+    WakeSharedReaders(pDev);
+    spin_unlock_irqrestore(&pDev->mBulkMemList.mReadMemLock, flags);
 }
 
 static void BlkCallback(struct urb *urb)
 {
     sQTIDevUSB *pDev=NULL;
     unsigned long iflags;
-    sIoReadList *pIoReadTraverse;
-    sIoReadList *psafePtr;
     sBulkUrbList *pUrbItem;
+    bool bParked = false;
 
     if (!urb || !urb->context)
     {
@@ -2889,6 +4054,7 @@ static void BlkCallback(struct urb *urb)
     pDev = pUrbItem->Context;
 
     QC_LOG_DBG(pDev,"-->\n");
+    QTIDevBenchUrb(&pDev->mBench, true, pUrbItem->mSubmitNs, urb->actual_length, urb->status);
 
     if (urb->status && urb->status != -EOVERFLOW)
     {
@@ -2930,7 +4096,7 @@ static void BlkCallback(struct urb *urb)
 
 	    if (pDev->mDevInfo.mDevInfInfo.mDevType == QTIDEV_INF_TYPE_LPC) {
 		    LpcOutputBytes((unsigned char *)urb->transfer_buffer, pDev->mStats.USBRxCnt,
-		    pDev->mBulkMemList.mReadBuffCircular.mEndIdx, "LPC-USB");
+		    pUrbItem->mIndex, "LPC-USB");
 	    }
     
 #endif
@@ -2939,184 +4105,77 @@ static void BlkCallback(struct urb *urb)
             urbLen = urb->actual_length;
 
             if (urbLen) {
-                if (pDev->mBulkUrbBuffListSize > 0 ||
-			AddToReadMemList(pDev, urbData, urbLen) == false) {
-                    QC_LOG_DBG(pDev,"should be added to queue : %d RxCount 0x%lx BufListSize %lu (<--)\n",
-			    urb->actual_length, pDev->mStats.RxCount, pDev->mBulkUrbBuffListSize);
-                    AddToQueue(pDev, urb);
-                    spin_unlock_irqrestore(&pDev->mBulkMemList.mReadMemLock,
-			    iflags);
-                    return;
-                }
-                NotifyUserRequest(pDev, NULL);
-                /* Possibly notify poll() that data exists */
-                wake_up_interruptible(&pDev->mBulkMemList.mWaitQueue);
+                bParked = (AddToReadMemList(pDev, pUrbItem, urbLen) == false);
             }
 
-	    /*
-	     * list_for_each_entry_safe takes care of the deletion in the read_list
-	     * being done via ioData_dequeue.
-	     */
-	    QC_LOG_DBG(pDev," --> Calling ioData_dequeue. Read_list has %lu nodes.\n", pDev->mIoReadBuffListActiveSize);
-	    list_for_each_entry_safe(pIoReadTraverse, psafePtr, &pDev->mIoReadBuffListActive, node ) {
-		if (pIoReadTraverse->kiocb) {
-		    if(ioData_dequeue(pIoReadTraverse->kiocb, pDev) < 0)
-			break;
-		}
-	    }
-            QC_LOG_DBG(pDev,"%d-%s: got %d RxCount %ld endIdx %d <--\n", pDev->udev->bus->busnum, pDev->udev->devpath, urb->actual_length, pDev->mStats.RxCount,
-                 pDev->mBulkMemList.mReadBuffCircular.mEndIdx);
+            if (RxDataReady(pDev, 0))
+            {
+                NotifyRxReaders(pDev);
+            }
+            else
+            {
+                /* A reader asking for less than the watermark may still be due */
+                WakeRxWaiters(pDev);
+                ArmRxLatency(pDev);
+            }
+            QC_LOG_DBG(pDev,"%d-%s: got %d RxCount %ld unread %zu <--\n", pDev->udev->bus->busnum, pDev->udev->devpath, urb->actual_length, pDev->mStats.RxCount,
+                 pDev->mBulkMemList.mChunkBytes);
             spin_unlock_irqrestore(&pDev->mBulkMemList.mReadMemLock, iflags);
         }
     }
 
+    if (bParked)
+    {
+        /* ResubmitParkedUrbs restarts it once a reader frees a buffer */
+        return;
+    }
     ResubmitBulkURB(urb);
     QC_LOG_DBG(pDev,"<--\n");
     return;
 }
 
-static bool PopFromQueueAndSubmit(sQTIDevUSB *pDev)
+// FUNCTION ResubmitParkedUrbs runs within mReadMemLock
+static void ResubmitParkedUrbs(sQTIDevUSB *pDev)
 {
-    sBulkUrbList *pBulkUrbMem = NULL;
-    int idx = 0;
+    int idx;
     int retval;
-    unsigned int availableSpace;
-    int foundUrb = 0;
 
-    if (pDev->mBulkUrbBuffListSize <= 0) {
-        QC_LOG_DBG(pDev,"mBulkUrbBuffList empty. No data found to pop (<--)\n");
-        return false;
-    }
-
-    list_for_each_entry(pBulkUrbMem, &pDev->mBulkUrbBuffList, node) {
-	if (pBulkUrbMem->mBulk_in_buffer != NULL) {
-            foundUrb = 1;  // should be the very first item
-	    break;
-	}
-	idx++;
-    }
-
-    if (foundUrb == 0) {
-        QC_LOG_EXCEPTION(pDev,"No bulk_in_buffer match found for URB list and URB buff list. Bug!\n");
-	idx = 0;
-	list_for_each_entry(pBulkUrbMem, &pDev->mBulkUrbBuffList, node) {
-           QC_LOG_DBG(pDev,"list[%d] vs idx[%d] (<--)\n", pBulkUrbMem->mIndex, idx);
-	   idx++;
-        }
-        return false;
-    }
-    else if (idx > 0)
+    for (idx = 0; idx < pDev->mBulkUrbCount; idx++)
     {
-        QC_LOG_EXCEPTION(pDev,"QTI-ALERT %d-%s: URB queue anomaly!--%d\n",  pDev->udev->bus->busnum, pDev->udev->devpath, idx);
-    }
-    idx = pBulkUrbMem->mIndex;
-
-    availableSpace = ReadBufferFreeSpace(pDev);
-    QC_LOG_DBG(pDev,"RX buf space: %u buffer empty %d\n", availableSpace, pDev->mBulkMemList.mReadBuffCircular.mBufEmptyStatus);
-    if (availableSpace < pDev->mBulkUrbList[idx].mBulk_in_urb->actual_length) {
-        QC_LOG_ERR(pDev,"buf[%d] No pop - Insufficient space: %u/%u (<--)\n",
-	    idx, availableSpace, pDev->mBulkUrbList[idx].mBulk_in_urb->actual_length);
-        return false;
-    }
-
-    pBulkUrbMem->mBulk_in_buffer = NULL;
-    pDev->mBulkUrbBuffListSize--;
-    list_rotate_left(&pDev->mBulkUrbBuffList);	    // To move the idle node to the end of list
-
-    QC_LOG_DBG(pDev,"deQ URB [%d]\n", idx);
-
-    if (AddToReadMemList(pDev,
-                pDev->mBulkUrbList[idx].mBulk_in_urb->transfer_buffer,
-                pDev->mBulkUrbList[idx].mBulk_in_urb->actual_length) == false)
-    {
-        QC_LOG_ERR(pDev,"Error allocating pReadMemListEntry "
-                "read will be discarded (<--)\n");
-        AddToQueue(pDev, pDev->mBulkUrbList[idx].mBulk_in_urb);
-        return false;
-    }
-
-    NotifyUserRequest(pDev, NULL);
-    /* Possibly notify poll() that data exists */
-    wake_up_interruptible(&pDev->mBulkMemList.mWaitQueue);
+        sBulkUrbList *pUrbItem = &pDev->mBulkUrbList[idx];
 
-    if (!IS_URB_INITIALIZED(pDev->mBulkUrbList[idx].mUrbStatus) ||
-            IS_URB_SUBMITTED(pDev->mBulkUrbList[idx].mUrbStatus))
-    {
-        /* Either URB is not initialized or already submitted */
-        QC_LOG_INFO(pDev,"(<--)\n");
-        return true;
-    }
-
-    /* Submit Bulk URB buffers */
-    retval = ResubmitBulkURB(pDev->mBulkUrbList[idx].mBulk_in_urb);
-    if (retval < 0) {
-        QC_LOG_ERR(pDev,"Failed to submitting read urb, error %d\n", retval);
-        pDev->mBulkUrbList[idx].mUrbStatus = BULK_URB_INITIALIZED;;
-    }
-    else
-    {
-        pDev->mBulkUrbList[idx].mUrbStatus |= BULK_URB_SUBMITTED;
-    }
-
-    return true;
-}
-
-static void AddToQueue(sQTIDevUSB *pDev, struct urb *pUrb)
-{
-    sBulkUrbList *pBulkUrbMem;
-    sBulkUrbList *pBulkUrbTraverse;
-    void *pDataCopy;
-    sBulkUrbList *pUrbItem;
-    int idx = 0;
-
-    pUrbItem = pUrb->context;
-    pDataCopy = pUrb->transfer_buffer;
-
-    for (idx = 0; idx < BULK_URB_LIST; idx++) {
-        if (pDataCopy == pDev->mBulkUrbList[idx].mBulk_in_urb->transfer_buffer) {
-            pBulkUrbMem = &pDev->mBulkUrbList[idx];
+        if (!IS_URB_PARKED(pUrbItem->mUrbStatus))
+        {
+            continue;
+        }
+        if (AttachReadChunk(pDev, pUrbItem) == false)
+        {
+            /* Pool still empty */
             break;
         }
-    }
-
-    if (idx == BULK_URB_LIST) {
-	QC_LOG_EXCEPTION(pDev,"No match for pDataCopy(%px) in mBulkUrbList. Bug! (<--)\n", pDataCopy);
-        return;
-    }
 
-    QC_LOG_DBG(pDev,"enQ URB[%d] vs %d <--\n", idx, pUrbItem->mIndex);
-
-    list_for_each_entry(pBulkUrbTraverse, &pDev->mBulkUrbBuffList, node) {
-	if (!pBulkUrbTraverse->mBulk_in_buffer) {
-	    pBulkUrbMem->mUrbStatus &= (~BULK_URB_SUBMITTED);
-	    pBulkUrbTraverse->mUrbStatus = pBulkUrbMem->mUrbStatus;
-	    pBulkUrbTraverse->mBulk_in_urb = pBulkUrbMem->mBulk_in_urb;
-	    pBulkUrbTraverse->mBulk_in_buffer = pBulkUrbMem->mBulk_in_buffer;
-	    pBulkUrbTraverse->mIndex = pBulkUrbMem->mIndex;
-	    pBulkUrbTraverse->Context = pBulkUrbMem->Context;
-	    pDev->mBulkUrbBuffListSize++;
-	    return;
-	}
+        QC_LOG_DBG(pDev,"resubmit parked URB [%d]\n", idx);
+        pUrbItem->mUrbStatus &= (~BULK_URB_PARKED);
+        retval = ResubmitBulkURB(pUrbItem->mBulk_in_urb);
+        if (retval < 0) {
+            QC_LOG_ERR(pDev,"Failed to submitting read urb, error %d\n", retval);
+            pUrbItem->mUrbStatus = BULK_URB_INITIALIZED;
+        }
+        else
+        {
+            pUrbItem->mUrbStatus |= BULK_URB_SUBMITTED;
+        }
     }
-
-    QC_LOG_EXCEPTION(pDev,"No bulk_if_buffer match found for URB list and URB buff list. Bug! (<--)\n");
-    return;
 }
 
 static int InitializeURB(sQTIDevUSB *pDev)
 {
-    int idx = 0;
-    int blkLen;
-    sBulkUrbList *pBulkUrbList;
     unsigned long flags;
 
     spin_lock_irqsave(&pDev->mSpinReadBuffLock, flags);
     INIT_LIST_HEAD(&pDev->mIoReadBuffListActive);
-    INIT_LIST_HEAD(&pDev->mIoReadBuffListIdle);
-    INIT_LIST_HEAD(&pDev->mBulkUrbBuffList);
     pDev->mIoReadBuffListActiveSize = 0;
-    pDev->mIoReadBuffListIdleSize = BULK_URB_LIST;
-    pDev->mBulkUrbBuffListSize = 0;
+    spin_unlock_irqrestore(&pDev->mSpinReadBuffLock, flags);
 
    pDev->mpIntURB = usb_alloc_urb( 0, GFP_KERNEL );
    if (pDev->mpIntURB == NULL)
@@ -3135,65 +4194,169 @@ static int InitializeURB(sQTIDevUSB *pDev)
       return -ENOMEM;
    }   
 
-    while( idx < BULK_URB_LIST) {
-        pDev->mBulkUrbList[idx].Context = (void *)pDev;
-        pDev->mBulkUrbList[idx].mIndex = idx;
-	/* Allocate URB buffers */
-	pDev->mBulkUrbList[idx].mBulk_in_urb = usb_alloc_urb(0, GFP_KERNEL);
-	if (!pDev->mBulkUrbList[idx].mBulk_in_urb) {
-		QC_LOG_ERR(pDev,"Could not allocate.mBulk_in_urb\n");
-		return -ENOMEM;
-	}
+    /* Bulk-in URBs are allocated with their buffers, see ResizeBulkInPipeline */
+    return 0;
+}
 
-        blkLen = pDev->mBulkInSize;
-        /* Create data buffers */
-        pDev->mBulkUrbList[idx].mBulk_in_buffer = qti_kmalloc(blkLen, GFP_KERNEL);
-        if (!pDev->mBulkUrbList[idx].mBulk_in_buffer) {
-            QC_LOG_ERR(pDev,"Could not allocate mBulk_in_buffer\n");
-            usb_free_urb(pDev->mBulkUrbList[idx].mBulk_in_urb);
-            pDev->mBulkUrbList[idx].mBulk_in_urb = NULL;
-            return -ENOMEM;
+// Allocate the bulk-in URBs missing up to mBulkUrbCount and give each one a
+// receive buffer
+static int AllocBulkInUrbs(sQTIDevUSB *pDev)
+{
+    int idx;
+    unsigned long flags;
+    bool bAttached;
+
+    for (idx = 0; idx < pDev->mBulkUrbCount; idx++)
+    {
+        sBulkUrbList *pUrbItem = &pDev->mBulkUrbList[idx];
+
+        pUrbItem->Context = (void *)pDev;
+        pUrbItem->mIndex = idx;
+        if (pUrbItem->mBulk_in_urb == NULL)
+        {
+            pUrbItem->mpChunk = NULL;
+            pUrbItem->mBulk_in_urb = usb_alloc_urb(0, GFP_KERNEL);
+            if (!pUrbItem->mBulk_in_urb) {
+                QC_LOG_ERR(pDev,"Could not allocate.mBulk_in_urb\n");
+                return -ENOMEM;
+            }
         }
 
-        pBulkUrbList = qti_kmalloc(sizeof(sBulkUrbList), GFP_KERNEL);
-        if (!pBulkUrbList) {
-            QC_LOG_ERR(pDev,"Could not allocate mBulkUrbList\n");
-            usb_free_urb(pDev->mBulkUrbList[idx].mBulk_in_urb);
-            pDev->mBulkUrbList[idx].mBulk_in_urb = NULL;
-            qti_kfree(pDev->mBulkUrbList[idx].mBulk_in_buffer);
-            pDev->mBulkUrbList[idx].mBulk_in_buffer = NULL;
+        /* Take a receive buffer from the pool */
+        spin_lock_irqsave(&pDev->mBulkMemList.mReadMemLock, flags);
+        bAttached = AttachReadChunk(pDev, pUrbItem);
+        spin_unlock_irqrestore(&pDev->mBulkMemList.mReadMemLock, flags);
+        if (bAttached == false) {
+            QC_LOG_ERR(pDev,"No receive buffer for URB[%d]\n", idx);
+            usb_free_urb(pUrbItem->mBulk_in_urb);
+            pUrbItem->mBulk_in_urb = NULL;
             return -ENOMEM;
         }
 
-    pDev->mBulkUrbList[idx].mUrbStatus = BULK_URB_INITIALIZED;
+        pUrbItem->mUrbStatus = BULK_URB_INITIALIZED;
+    }
+    return 0;
+}
+
+// Take the receive buffers away from the bulk-in URBs. The caller has
+// stopped reading.
+static void DetachReadChunks(sQTIDevUSB *pDev)
+{
+    unsigned int idx;
+    unsigned long flags;
+
+    spin_lock_irqsave(&pDev->mBulkMemList.mReadMemLock, flags);
+    for (idx = 0; idx < pDev->mBulkUrbCount; idx++)
+    {
+        pDev->mBulkUrbList[idx].mpChunk = NULL;
+        pDev->mBulkUrbList[idx].mUrbStatus &= (~BULK_URB_PARKED);
+        if (pDev->mBulkUrbList[idx].mBulk_in_urb != NULL)
+            pDev->mBulkUrbList[idx].mBulk_in_urb->transfer_buffer = NULL;
+    }
+    spin_unlock_irqrestore(&pDev->mBulkMemList.mReadMemLock, flags);
+}
+
+// FUNCTION StopBulkInUrbs runs within mIoMutex
+//    Kill the bulk-in URBs and take their receive buffers away. Open files
+//    may still be reading what the buffers hold.
+static void StopBulkInUrbs(sQTIDevUSB *pDev)
+{
+    unsigned int idx;
+
+    for (idx = 0; idx < pDev->mBulkUrbCount; idx++)
+    {
+        if (pDev->mBulkUrbList[idx].mBulk_in_urb != NULL)
+        {
+            usb_kill_urb(pDev->mBulkUrbList[idx].mBulk_in_urb);
+            pDev->mBulkUrbList[idx].mUrbStatus &= (~BULK_URB_SUBMITTED);
+        }
+    }
+    DetachReadChunks(pDev);
+}
+
+// Free the receive buffers of a context no file has open. Its bulk-in URBs
+// stay, the next probe gives them buffers on its own node.
+static void FreeBulkInBuffers(sQTIDevUSB *pDev)
+{
+    mutex_lock(&pDev->mIoMutex);
+    StopBulkInUrbs(pDev);
+    FreeReadChunks(pDev);
+    mutex_unlock(&pDev->mIoMutex);
+}
 
-	list_add_tail(&pBulkUrbList->node, &pDev->mBulkUrbBuffList);
+// Change the number and size of the bulk-in URBs, or move their buffers to
+// mNumaNode, or give a context from the idle pool its first buffers. The
+// caller has stopped reading and made sure no reader or mmap ring is using
+// the buffers.
+static int ResizeBulkInPipeline(sQTIDevUSB *pDev, unsigned int urbCount, size_t urbSize)
+{
+    unsigned int oldCount = pDev->mBulkUrbCount;
+    size_t oldSize = pDev->mBulkInSize;
+    unsigned int idx;
+    int retval;
 
-	pDev->mIoReadList[idx].kiocb = NULL;
-	list_add_tail(&pDev->mIoReadList[idx].node, &pDev->mIoReadBuffListIdle);
+    if ((urbCount == oldCount) && (urbSize == oldSize) &&
+            (pDev->mBulkMemList.mpChunkPool != NULL) &&
+            (pDev->mBulkMemList.mChunkNode == pDev->mNumaNode))
+    {
+        return 0;
+    }
 
-        idx++;
+    /* Take the buffers away from the URBs, then drop the URBs not needed */
+    DetachReadChunks(pDev);
+    for (idx = urbCount; idx < oldCount; idx++)
+    {
+        usb_free_urb(pDev->mBulkUrbList[idx].mBulk_in_urb);
+        pDev->mBulkUrbList[idx].mBulk_in_urb = NULL;
+        pDev->mBulkUrbList[idx].mUrbStatus = 0;
     }
-    spin_unlock_irqrestore(&pDev->mSpinReadBuffLock, flags);
-    return 0;
+    FreeReadChunks(pDev);
+
+    pDev->mBulkUrbCount = urbCount;
+    pDev->mBulkInSize = urbSize;
+    retval = InitializeReadChunks(pDev);
+    if (retval != 0)
+    {
+        QC_LOG_ERR(pDev,"No memory for %u URBs of %zu, keeping %u of %zu\n",
+                urbCount, urbSize, oldCount, oldSize);
+        pDev->mBulkUrbCount = oldCount;
+        pDev->mBulkInSize = oldSize;
+        if (InitializeReadChunks(pDev) != 0)
+        {
+            return retval;
+        }
+    }
+
+    if (AllocBulkInUrbs(pDev) != 0)
+    {
+        retval = -ENOMEM;
+    }
+    QC_LOG_INFO(pDev,"%u bulk-in URBs of %zu\n", pDev->mBulkUrbCount, pDev->mBulkInSize);
+    return retval;
 }
 
 static void FinalizeURB(sQTIDevUSB *pDev)
 {
     int i;
+    unsigned long flags;
 
     QC_LOG_INFO(pDev,"-->\n");
-    for (i = 0; i < BULK_URB_LIST; i++)
+    for (i = 0; i < pDev->mBulkUrbCount; i++)
     {
         if (pDev->mBulkUrbList[i].mBulk_in_urb == NULL)
         {
             QC_LOG_INFO(pDev,"URB[%d] NULL for dev 0x%px\n", i, pDev);
             continue;
         }
+        /* A URB parked when the device went away has no buffer */
+        spin_lock_irqsave(&pDev->mBulkMemList.mReadMemLock, flags);
+        AttachReadChunk(pDev, &pDev->mBulkUrbList[i]);
+        spin_unlock_irqrestore(&pDev->mBulkMemList.mReadMemLock, flags);
+
         usb_fill_bulk_urb(pDev->mBulkUrbList[i].mBulk_in_urb,
                 pDev->udev,
                 usb_rcvbulkpipe (pDev->udev, pDev->mBulkInEndAddr),
-                pDev->mBulkUrbList[i].mBulk_in_buffer,
+                pDev->mBulkUrbList[i].mBulk_in_urb->transfer_buffer,
                 pDev->mBulkInSize,
                 BlkCallback,
                 (void *)&(pDev->mBulkUrbList[i])); // pDev);
@@ -3209,13 +4372,19 @@ static int SubmitAllReadUrb(sQTIDevUSB *pDev)
     int idx = 0;
     int submitted = 0;
     struct urb *pUrb;
+    unsigned long flags;
+    bool bAttached;
 
     if (!pDev) {
         QC_LOG_ERR(pDev,"Invalid device \n");
         return -ENXIO;
     }
+    if (pDev->mpRing != NULL)
+    {
+        return QTIDevRingStart(pDev->mpRing);
+    }
     QC_LOG_DBG(pDev,"-->\n");
-    while( idx < BULK_URB_LIST)
+    while( idx < pDev->mBulkUrbCount)
     {
         if (!IS_URB_INITIALIZED(pDev->mBulkUrbList[idx].mUrbStatus) ||
                 IS_URB_SUBMITTED(pDev->mBulkUrbList[idx].mUrbStatus))
@@ -3225,6 +4394,23 @@ static int SubmitAllReadUrb(sQTIDevUSB *pDev)
             continue;
         }
         pUrb = pDev->mBulkUrbList[idx].mBulk_in_urb;
+        spin_lock_irqsave(&pDev->mBulkMemList.mReadMemLock, flags);
+        bAttached = AttachReadChunk(pDev, &pDev->mBulkUrbList[idx]);
+        if (bAttached == false)
+        {
+            /* Starts once a reader frees a buffer */
+            pDev->mBulkUrbList[idx].mUrbStatus |= BULK_URB_PARKED;
+        }
+        else
+        {
+            pDev->mBulkUrbList[idx].mUrbStatus &= (~BULK_URB_PARKED);
+        }
+        spin_unlock_irqrestore(&pDev->mBulkMemList.mReadMemLock, flags);
+        if (bAttached == false)
+        {
+            idx++;
+            continue;
+        }
         /* Submit Bulk URB buffers */
         retval = ReadBulkUSB(pDev, pUrb);
         if (retval < 0) {
@@ -3245,10 +4431,8 @@ static void DeInitializeURB(sQTIDevUSB *pDev)
 {
     int i;
     int idx = 0;
-    sBulkUrbList *pBulkUrbListSafe = NULL;
-    sBulkUrbList *pBulkUrbListTraverse = NULL;
-    sIoReadList *pIoReadTraverse = NULL;
-    sIoReadList *pIoReadsafe = NULL;
+    struct qtidev_aio_data *io_data;
+    struct qtidev_aio_data *pIoReadsafe;
     unsigned long flags;
 
     QC_LOG_DBG(pDev,"");
@@ -3282,7 +4466,7 @@ static void DeInitializeURB(sQTIDevUSB *pDev)
         QC_LOG_WARN(pDev,"WARNING: NULL INT buffer\n");
     }
 
-    while (idx < BULK_URB_LIST) {
+    while (idx < pDev->mBulkUrbCount) {
         if (pDev->mBulkUrbList[idx].mBulk_in_urb != NULL)
         {
             if (pDev->mBulkUrbList[idx].mBulk_in_urb->status &&
@@ -3301,18 +4485,10 @@ static void DeInitializeURB(sQTIDevUSB *pDev)
             QC_LOG_WARN(pDev,"WARNING: NULL URB[%d]\n", idx);
         }
 
-        if (IS_URB_INITIALIZED(pDev->mBulkUrbList[idx].mUrbStatus)) {
-            /* Release buffers */
-            if (pDev->mBulkUrbList[idx].mBulk_in_buffer != NULL)
-            {
-               qti_kfree(pDev->mBulkUrbList[idx].mBulk_in_buffer);
-               pDev->mBulkUrbList[idx].mBulk_in_buffer = NULL;
-            }
-            else
-            {
-                QC_LOG_WARN(pDev,"WARNING: NULL buffer[%d]\n", idx);
-            }
+        /* Buffers belong to the chunk pool, freed below */
+        pDev->mBulkUrbList[idx].mpChunk = NULL;
 
+        if (IS_URB_INITIALIZED(pDev->mBulkUrbList[idx].mUrbStatus)) {
             /* Release URB's */
             if (pDev->mBulkUrbList[idx].mBulk_in_urb != NULL)
             {
@@ -3328,27 +4504,13 @@ static void DeInitializeURB(sQTIDevUSB *pDev)
         idx++;
     }
 
-    QC_LOG_DBG(pDev,"Deleting mBulkUrbBuffList of %lu active requests and %d allocated nodes\n", pDev->mBulkUrbBuffListSize, BULK_URB_LIST);
-    list_for_each_entry_safe(pBulkUrbListTraverse, pBulkUrbListSafe, &pDev->mBulkUrbBuffList, node) {
-	list_del(&pBulkUrbListTraverse->node);
-    qti_kfree(pBulkUrbListTraverse);
-    }
-
     spin_lock_irqsave(&pDev->mSpinReadBuffLock, flags);
-    QC_LOG_DBG(pDev,"Deleting mIoReadBuffList of %lu active requests and %d allocated nodes\n", pDev->mIoReadBuffListActiveSize, BULK_URB_LIST);
-    list_for_each_entry_safe(pIoReadTraverse, pIoReadsafe, &pDev->mIoReadBuffListActive, node) {
-	list_del(&pIoReadTraverse->node);
-	pIoReadTraverse->kiocb = NULL;
+    QC_LOG_DBG(pDev,"Deleting mIoReadBuffList of %lu active requests\n", pDev->mIoReadBuffListActiveSize);
+    /* The requests belong to their kiocbs, only unlink them */
+    list_for_each_entry_safe(io_data, pIoReadsafe, &pDev->mIoReadBuffListActive, mReadNode) {
+	list_del_init(&io_data->mReadNode);
 	pDev->mIoReadBuffListActiveSize--;
-    qti_kfree(pIoReadTraverse);
-    }
-    pIoReadTraverse = NULL;
-    list_for_each_entry_safe(pIoReadTraverse, pIoReadsafe, &pDev->mIoReadBuffListIdle, node) {
-	list_del(&pIoReadTraverse->node);
-	pIoReadTraverse->kiocb = NULL;
-	pDev->mIoReadBuffListIdleSize--;
-    //qti_kfree(pIoReadTraverse); // Not sure at this moment.(double-free or invalid-free issue is coming) DeInitializeURB() called by QtiFreeDevices
-    } 
+    }
     spin_unlock_irqrestore(&pDev->mSpinReadBuffLock, flags);
 
     mutex_lock(&pDev->mIoMutex);
@@ -3368,10 +4530,8 @@ static void DeInitializeURB(sQTIDevUSB *pDev)
     }
     mutex_unlock(&pDev->mIoMutex);
 
-    if (pDev->mBulkMemList.mReadBuffCircular.mBulk_in_buffer) {
-        QC_LOG_INFO(pDev,"freeing up vmalloc memory\n");
-        vfree(pDev->mBulkMemList.mReadBuffCircular.mBulk_in_buffer);
-    }
+    QC_LOG_INFO(pDev,"freeing up %u receive buffers\n", pDev->mBulkMemList.mChunkCount);
+    FreeReadChunks(pDev);
 
     return;
 }
@@ -3379,6 +4539,7 @@ static void DeInitializeURB(sQTIDevUSB *pDev)
 static void StopRead(sQTIDevUSB *pDev)
 {
     int idx = 0;
+    unsigned long flags;
 
     QC_LOG_DBG(pDev,"");
     if (!pDev)
@@ -3396,7 +4557,12 @@ static void StopRead(sQTIDevUSB *pDev)
        QC_LOG_WARN(pDev,"WARNING: NULL INT URB\n");
     }
 
-    while (idx < BULK_URB_LIST)
+    if (pDev->mpRing != NULL)
+    {
+        QTIDevRingStop(pDev->mpRing);
+    }
+
+    while (idx < pDev->mBulkUrbCount)
     {
         if (!IS_URB_INITIALIZED(pDev->mBulkUrbList[idx].mUrbStatus) ||
                 !IS_URB_SUBMITTED(pDev->mBulkUrbList[idx].mUrbStatus ||
@@ -3417,44 +4583,33 @@ static void StopRead(sQTIDevUSB *pDev)
         }
     }
 
+    /* Keep readers from restarting URBs waiting for a buffer */
+    spin_lock_irqsave(&pDev->mBulkMemList.mReadMemLock, flags);
+    for (idx = 0; idx < pDev->mBulkUrbCount; idx++)
+    {
+        pDev->mBulkUrbList[idx].mUrbStatus &= (~BULK_URB_PARKED);
+    }
+    spin_unlock_irqrestore(&pDev->mBulkMemList.mReadMemLock, flags);
+
     return;
 }
 
 static int UpdateDeviceInfo(fileInfo_t **pFileInfo, char *pFilePath)
 {
-    int ret;
-
-    QC_LOG_GLOBAL("");
     if (!pFilePath || !pFileInfo)
     {
         QC_LOG_GLOBAL("Invalid data\n");
         return -EINVAL;
     }
 
-    ret = QTIDevInfEntrySize(pFilePath);
-    if (ret < 0)
-    {
-        QC_LOG_GLOBAL("Failed to get the devices info\n");
-        return ret;
-    }
-
-    *pFileInfo = qti_kmalloc(sizeof(fileInfo_t) + ret * sizeof(devInfo_t), GFP_KERNEL);
-    if (!pFileInfo)
-    {
-        QC_LOG_GLOBAL("error in allocating memory\n");
-        return -ENOMEM;
-    }
-
-    (*pFileInfo)->mLength = ret;
-
-    if (QTIDevInfParse(pFilePath, *pFileInfo) < 0)
+    /* Parsed once per file and shared by every driver using it */
+    *pFileInfo = QTIDevInfGet(pFilePath);
+    if (!*pFileInfo)
     {
         QC_LOG_GLOBAL("Error in parsing INF file\n");
-        qti_kfree(*pFileInfo);
-        *pFileInfo = NULL;
         return -ENXIO;
     }
-    QC_LOG_GLOBAL("Number of devices %d ; %d\n", (*pFileInfo)->mNumResp, ret);
+    QC_LOG_GLOBAL("Number of devices %d\n", (*pFileInfo)->mNumResp);
     return 0;
 }
 
@@ -3498,32 +4653,255 @@ static ssize_t qdss_store(struct kobject *kobj,
         return count;
 }
 struct kobj_attribute dev_attr = __ATTR(Debug, S_IRUGO | S_IWUSR, qdss_show, qdss_store);
+
+static sQTIDevUSB *QtiFindDeviceByKobj(struct kobject *kobj)
+{
+    sQTIDevUSB *pDevOnRecord = NULL;
+    sQTIDevUSB *pDev = NULL;
+    unsigned long flags;
+
+    spin_lock_irqsave(&DevListLock, flags);
+    list_for_each_entry(pDevOnRecord, &DeviceListActive, node)
+    {
+        if (pDevOnRecord->kobj_qdss == kobj)
+        {
+            pDev = pDevOnRecord;
+            break;
+        }
+    }
+    spin_unlock_irqrestore(&DevListLock, flags);
+    return pDev;
+}
+
+static int ApplyBulkInConfig(sQTIDevUSB *pDev, unsigned int urbCount, size_t urbSize, int node)
+{
+    unsigned long flags;
+    int retval;
+
+    mutex_lock(&pDev->mIoMutex);
+    /*
+     * Only while the node is closed. An open node has buffers outside the
+     * pool that mIoMutex does not cover: chunks shared readers and aio reads
+     * copy from, pages splice() gave to pipes and the mmap ring. None of
+     * them can be swapped for buffers of another size under the readers.
+     */
+#if (LINUX_VERSION_CODE <= KERNEL_VERSION(4,10,17))
+    if (pDev->disconnected || (pDev->mpRing != NULL) || (pDev->mRefCount.refcount.counter > 1))
+#else
+    if (pDev->disconnected || (pDev->mpRing != NULL) || (pDev->mRefCount.refcount.refs.counter > 1))
+#endif
+    {
+        mutex_unlock(&pDev->mIoMutex);
+        QC_LOG_INFO(pDev,"bulk-in URBs are only changed while the node is closed\n");
+        return -EBUSY;
+    }
+
+    StopRead(pDev);
+    spin_lock_irqsave(&pDev->mBulkMemList.mReadMemLock, flags);
+    ClearReadMemList(pDev);
+    spin_unlock_irqrestore(&pDev->mBulkMemList.mReadMemLock, flags);
+
+    pDev->mNumaNode = node;
+    retval = ResizeBulkInPipeline(pDev, urbCount, urbSize);
+    FinalizeURB(pDev);
+
+    /* DPL reads from probe on, restart it */
+    if (pDev->mDevInfo.mDevInfInfo.mDevType == QTIDEV_INF_TYPE_DPL)
+    {
+        if (SubmitAllReadUrb(pDev) != 0)
+        {
+            QC_LOG_ERR(pDev,"Error in reading\n");
+        }
+    }
+    mutex_unlock(&pDev->mIoMutex);
+    return retval;
+}
+
+static ssize_t rx_urb_count_show(struct kobject *kobj,
+                struct kobj_attribute *attr, char *buf)
+{
+        sQTIDevUSB *pDev = QtiFindDeviceByKobj(kobj);
+
+        if (!pDev)
+            return -ENODEV;
+        return sprintf(buf, "%u\n", pDev->mBulkUrbCount);
+}
+
+static ssize_t rx_urb_count_store(struct kobject *kobj,
+                struct kobj_attribute *attr, const char *buf, size_t count)
+{
+        sQTIDevUSB *pDev = QtiFindDeviceByKobj(kobj);
+        int urbCount;
+        int retval;
+
+        if (!pDev)
+            return -ENODEV;
+        if (kstrtoint(buf, 0, &urbCount) || urbCount < 1 || urbCount > BULK_URB_LIST_MAX)
+            return -EINVAL;
+        retval = ApplyBulkInConfig(pDev, urbCount, pDev->mBulkInSize, pDev->mNumaNode);
+        return retval ? retval : count;
+}
+
+static ssize_t rx_urb_size_show(struct kobject *kobj,
+                struct kobj_attribute *attr, char *buf)
+{
+        sQTIDevUSB *pDev = QtiFindDeviceByKobj(kobj);
+
+        if (!pDev)
+            return -ENODEV;
+        return sprintf(buf, "%zu\n", pDev->mBulkInSize);
+}
+
+static ssize_t rx_urb_size_store(struct kobject *kobj,
+                struct kobj_attribute *attr, const char *buf, size_t count)
+{
+        sQTIDevUSB *pDev = QtiFindDeviceByKobj(kobj);
+        int urbSize;
+        int retval;
+
+        if (!pDev)
+            return -ENODEV;
+        if (kstrtoint(buf, 0, &urbSize) || urbSize < QTIDEV_RX_SIZE_MIN || urbSize > QTIDEV_RX_SIZE_MAX)
+            return -EINVAL;
+        retval = ApplyBulkInConfig(pDev, pDev->mBulkUrbCount, ALIGN(urbSize, QTIDEV_RX_SIZE_ALIGN), pDev->mNumaNode);
+        return retval ? retval : count;
+}
+
+static ssize_t rx_reader_policy_show(struct kobject *kobj,
+                struct kobj_attribute *attr, char *buf)
+{
+        sQTIDevUSB *pDev = QtiFindDeviceByKobj(kobj);
+
+        if (!pDev)
+            return -ENODEV;
+        return sprintf(buf, "%d\n", pDev->mBulkMemList.mReaderPolicy);
+}
+
+static ssize_t rx_reader_policy_store(struct kobject *kobj,
+                struct kobj_attribute *attr, const char *buf, size_t count)
+{
+        sQTIDevUSB *pDev = QtiFindDeviceByKobj(kobj);
+        unsigned long flags;
+        int policy;
+
+        if (!pDev)
+            return -ENODEV;
+        if (kstrtoint(buf, 0, &policy) ||
+                (policy != QTIDEV_RX_POLICY_DROP && policy != QTIDEV_RX_POLICY_BLOCK))
+            return -EINVAL;
+        spin_lock_irqsave(&pDev->mBulkMemList.mReadMemLock, flags);
+        pDev->mBulkMemList.mReaderPolicy = policy;
+        /* URBs held back for a slow reader may take its data now */
+        ResubmitParkedUrbs(pDev);
+        spin_unlock_irqrestore(&pDev->mBulkMemList.mReadMemLock, flags);
+        return count;
+}
+
+static ssize_t tx_depth_show(struct kobject *kobj,
+                struct kobj_attribute *attr, char *buf)
+{
+        sQTIDevUSB *pDev = QtiFindDeviceByKobj(kobj);
+
+        if (!pDev)
+            return -ENODEV;
+        return sprintf(buf, "%u\n", pDev->mTxDepth);
+}
+
+static ssize_t tx_depth_store(struct kobject *kobj,
+                struct kobj_attribute *attr, const char *buf, size_t count)
+{
+        sQTIDevUSB *pDev = QtiFindDeviceByKobj(kobj);
+        int depth;
+
+        if (!pDev)
+            return -ENODEV;
+        if (kstrtoint(buf, 0, &depth) || depth < 0 || depth > QTIDEV_TX_BUF_POOL_SZ)
+            return -EINVAL;
+        /* Writes already in flight complete as they were sent */
+        pDev->mTxDepth = depth;
+        wake_up(&pDev->mTxWaitQueue);
+        return count;
+}
+
+static ssize_t numa_node_show(struct kobject *kobj,
+                struct kobj_attribute *attr, char *buf)
+{
+        sQTIDevUSB *pDev = QtiFindDeviceByKobj(kobj);
+
+        if (!pDev)
+            return -ENODEV;
+        return sprintf(buf, "%d\n", pDev->mNumaNode);
+}
+
+static ssize_t numa_node_store(struct kobject *kobj,
+                struct kobj_attribute *attr, const char *buf, size_t count)
+{
+        sQTIDevUSB *pDev = QtiFindDeviceByKobj(kobj);
+        int node;
+        int retval;
+
+        if (!pDev)
+            return -ENODEV;
+        /* -1 lets buffers and work go anywhere */
+        if (kstrtoint(buf, 0, &node) ||
+                (node != NUMA_NO_NODE && (node < 0 || node >= MAX_NUMNODES || !node_online(node))))
+            return -EINVAL;
+        retval = ApplyBulkInConfig(pDev, pDev->mBulkUrbCount, pDev->mBulkInSize, node);
+        return retval ? retval : count;
+}
+
+static ssize_t bench_show(struct kobject *kobj,
+                struct kobj_attribute *attr, char *buf)
+{
+        sQTIDevUSB *pDev = QtiFindDeviceByKobj(kobj);
+
+        if (!pDev)
+            return -ENODEV;
+        return QTIDevBenchShow(&pDev->mBench, buf);
+}
+
+static ssize_t bench_store(struct kobject *kobj,
+                struct kobj_attribute *attr, const char *buf, size_t count)
+{
+        sQTIDevUSB *pDev = QtiFindDeviceByKobj(kobj);
+        int run;
+
+        if (!pDev)
+            return -ENODEV;
+        if (kstrtoint(buf, 0, &run) || run < 0 || run > 1)
+            return -EINVAL;
+        /* 1 starts a new window, 0 freezes the report */
+        if (run)
+            QTIDevBenchStart(&pDev->mBench);
+        else
+            QTIDevBenchStop(&pDev->mBench);
+        return count;
+}
+
+static struct kobj_attribute rx_urb_count_attr = __ATTR(RxUrbCount, S_IRUGO | S_IWUSR, rx_urb_count_show, rx_urb_count_store);
+static struct kobj_attribute rx_urb_size_attr = __ATTR(RxUrbSize, S_IRUGO | S_IWUSR, rx_urb_size_show, rx_urb_size_store);
+static struct kobj_attribute rx_reader_policy_attr = __ATTR(RxReaderPolicy, S_IRUGO | S_IWUSR, rx_reader_policy_show, rx_reader_policy_store);
+static struct kobj_attribute tx_depth_attr = __ATTR(TxDepth, S_IRUGO | S_IWUSR, tx_depth_show, tx_depth_store);
+static struct kobj_attribute bench_attr = __ATTR(Bench, S_IRUGO | S_IWUSR, bench_show, bench_store);
+static struct kobj_attribute numa_node_attr = __ATTR(NumaNode, S_IRUGO | S_IWUSR, numa_node_show, numa_node_store);
 /*<===============sysfs ends============>*/
 
-static int QTIDevUSBProbe(struct usb_interface *interface,
-        const struct usb_device_id *id)
-{  
-    
+/*
+ * Find the INF entry of 'interface' and copy it to pDevInfo.  Probes may run
+ * in parallel, so the shared tables are only reloaded and read under
+ * gInfLock, and each probe works on its own copy of the entry.
+ */
+static int QtiLookupDeviceInfo(struct usb_interface *interface,
+        devInfo_t *pDevInfo, deviceClass *pDevClass)
+{
     sQTIDevUSB *dev = NULL;
-    struct usb_host_interface *iface_desc;
-    struct usb_endpoint_descriptor *endpoint;
-    struct usb_device   *udev_tmp = NULL;
-    int i;
-    int retval = -ENOMEM;
     devInfo_t *devInfo;
-    struct usb_device   *device;
-    struct usb_host_interface *alt;
-    char file_name[50];
-#ifdef QCUSB_TEST_ONLY
-    devInfo_t lpcDevInfo;
-#endif
-    deviceClass devClass = QTIDEV_INF_CLASS_UNKNOWN;
     char *path;
+    int retval;
 
+    mutex_lock(&gInfLock);
     path = (gQdssInfFilePath != NULL) ? gQdssInfFilePath : QDSS_INF_PATH;
 
-    QC_LOG_GLOBAL("nEndpoints: %d\n", interface->cur_altsetting->desc.bNumEndpoints);
-
     retval = QTIDevInfCheckFileStatus(gQdssFileInfo, path);
     if (retval == false)
     {
@@ -3533,18 +4911,20 @@ static int QTIDevUSBProbe(struct usb_interface *interface,
         QC_LOG_GLOBAL("Update required\n");
         if (gQdssFileInfo)
         {
-            qti_kfree(gQdssFileInfo);
+            QTIDevInfPut(gQdssFileInfo);
             gQdssFileInfo = NULL;
         }
         if (UpdateDeviceInfo(&gQdssFileInfo, path) < 0)
         {
             QC_LOG_ERR(dev,"Error in parsing INF file\n");
-            return -ENXIO;
+            retval = -ENXIO;
+            goto unlock;
         }
     } else
     {
         QC_LOG_ERR(dev,"Unable to get the status of VID/PID Info\n");
-        return -EIO;
+        retval = -EIO;
+        goto unlock;
     }
 
 #ifdef QDSS_DIAG_MERGE
@@ -3559,18 +4939,20 @@ static int QTIDevUSBProbe(struct usb_interface *interface,
         QC_LOG_GLOBAL("Update required\n");
         if (gDiagFileInfo)
         {
-            qti_kfree(gDiagFileInfo);
+            QTIDevInfPut(gDiagFileInfo);
             gDiagFileInfo = NULL;
         }
         if (UpdateDeviceInfo(&gDiagFileInfo, path) < 0)
         {
             QC_LOG_ERR(dev,"Error in parsing INF file\n");
-            return -ENXIO;
+            retval = -ENXIO;
+            goto unlock;
         }
     } else
     {
         QC_LOG_ERR(dev,"Unable to get the status of VID/PID Info\n");
-        return -EIO;
+        retval = -EIO;
+        goto unlock;
     }
 #endif
 
@@ -3585,20 +4967,72 @@ static int QTIDevUSBProbe(struct usb_interface *interface,
         QC_LOG_GLOBAL("Update required\n");
         if (gModemFileInfo)
         {
-            kfree(gModemFileInfo);
+            QTIDevInfPut(gModemFileInfo);
             gModemFileInfo = NULL;
         }
         if (UpdateDeviceInfo(&gModemFileInfo, path) < 0)
         {
             QC_LOG_ERR(dev,"Error in parsing INF file\n");
-            return -ENXIO;
+            retval = -ENXIO;
+            goto unlock;
         }
     } else
     {
         QC_LOG_ERR(dev,"Unable to get the status of VID/PID Info\n");
-        return -EIO;
+        retval = -EIO;
+        goto unlock;
+    }
+
+    if ((devInfo = QTIDevInfGetDevInfo(interface, gQdssFileInfo)))
+    {
+        *pDevClass = QTIDEV_INF_CLASS_USB;
+        memcpy(pDevInfo, devInfo, sizeof(devInfo_t));
+    } else if((devInfo = QTIDevInfGetDevInfo(interface, gDiagFileInfo)))
+    {
+        *pDevClass = QTIDEV_INF_CLASS_PORTS;
+        memcpy(pDevInfo, devInfo, sizeof(devInfo_t));
+    } else if((devInfo = QTIDevInfGetDevInfo(interface, gModemFileInfo)))
+    {
+        *pDevClass = QTIDEV_INF_CLASS_USB;
+        memcpy(pDevInfo, devInfo, sizeof(devInfo_t));
+        pDevInfo->mDevType = QTIDEV_INF_TYPE_INT_IN;
+    } else
+    {
+        QC_LOG_ERR(dev,"USB corresponds to other Iface, (Supports only: %s)\n", path);
+        retval = -EIO;
+        goto unlock;
     }
+    QC_LOG_INFO(dev,"USB %s Successfully inserted\n", pDevInfo->mpKey);
+    retval = 0;
+
+unlock:
+    mutex_unlock(&gInfLock);
+    return retval;
+}
+
+static int QTIDevUSBProbe(struct usb_interface *interface,
+        const struct usb_device_id *id)
+{  
+    
+    sQTIDevUSB *dev = NULL;
+    struct usb_host_interface *iface_desc;
+    struct usb_endpoint_descriptor *endpoint;
+    struct usb_device   *udev_tmp = NULL;
+    int i;
+    int retval = -ENOMEM;
+    devInfo_t *devInfo;
+    devInfo_t infDevInfo;
+    struct usb_device   *device;
+    struct usb_host_interface *alt;
+    char file_name[50];
+#ifdef QCUSB_TEST_ONLY
+    devInfo_t lpcDevInfo;
+#endif
+    deviceClass devClass = QTIDEV_INF_CLASS_UNKNOWN;
+    unsigned int urbCount;
+    size_t urbSize;
 
+    QC_LOG_GLOBAL("nEndpoints: %d\n", interface->cur_altsetting->desc.bNumEndpoints);
 
 #ifdef QDSS_DIAG_MERGE
 
@@ -3621,23 +5055,13 @@ static int QTIDevUSBProbe(struct usb_interface *interface,
     }
     else
 #endif //QCUSB_TEST_ONLY
-    if ((devInfo = QTIDevInfGetDevInfo(interface, gQdssFileInfo)))
     {
-        devClass = QTIDEV_INF_CLASS_USB;
-        QC_LOG_INFO(dev,"USB %s Successfully inserted\n", devInfo->mpKey);
-    } else if((devInfo = QTIDevInfGetDevInfo(interface, gDiagFileInfo)))
-    {
-        devClass = QTIDEV_INF_CLASS_PORTS;
-        QC_LOG_INFO(dev,"USB %s Successfully inserted\n", devInfo->mpKey);
-    } else if((devInfo = QTIDevInfGetDevInfo(interface, gModemFileInfo)))
-    {
-        devClass = QTIDEV_INF_CLASS_USB;
-        devInfo->mDevType = QTIDEV_INF_TYPE_INT_IN;
-        QC_LOG_INFO(dev,"USB %s Successfully inserted\n", devInfo->mpKey);
-    } else
-    {
-        QC_LOG_ERR(dev,"USB corresponds to other Iface, (Supports only: %s)\n", path);
-        return -EIO;
+        retval = QtiLookupDeviceInfo(interface, &infDevInfo, &devClass);
+        if (retval != 0)
+        {
+            return retval;
+        }
+        devInfo = &infDevInfo;
     }
 #endif //QDSS_DIAG_MERGE
 
@@ -3655,6 +5079,9 @@ static int QTIDevUSBProbe(struct usb_interface *interface,
     dev->udev = udev_tmp;
     dev->interface = usb_get_intf(interface);
     dev->disconnected = 0;
+    dev->mBulkMemList.mReaderPolicy = (RxReaderPolicy == QTIDEV_RX_POLICY_BLOCK) ?
+            QTIDEV_RX_POLICY_BLOCK : QTIDEV_RX_POLICY_DROP;
+    dev->mTxDepth = clamp(TxDepth, 0, QTIDEV_TX_BUF_POOL_SZ);
 
     /* set up the endpoint information */
     /* use only the first bulk-in and no bulk-out endpoints */
@@ -3666,8 +5093,6 @@ static int QTIDevUSBProbe(struct usb_interface *interface,
         if (!dev->mBulkInEndAddr &&
                 usb_endpoint_is_bulk_in(endpoint)) {
             /* we found a bulk in endpoint */
-            dev->mBulkInSize = UrbRxSize; // 131072;
-            QC_LOG_INFO(dev,"URB Rx Size %zu\n", dev->mBulkInSize);
             dev->mBulkInEndAddr = endpoint->bEndpointAddress;
 
             QC_LOG_DBG(dev,"In bulk IN endpoint\n");
@@ -3749,6 +5174,21 @@ static int QTIDevUSBProbe(struct usb_interface *interface,
         goto error;
     }
 
+    /* URB count and size for this device type, buffers on the controller node */
+    dev->mNumaNode = QtiControllerNode(dev->udev);
+    GetBulkInConfig(dev, &urbCount, &urbSize);
+    if (ResizeBulkInPipeline(dev, urbCount, urbSize) != 0)
+    {
+        if (dev->mBulkMemList.mpChunkPool == NULL)
+        {
+            QC_LOG_ERR(dev,"no memory for receive buffers\n");
+            retval = -ENOMEM;
+            goto error;
+        }
+        QC_LOG_WARN(dev,"reading with %u URBs of %zu\n", dev->mBulkUrbCount, dev->mBulkInSize);
+    }
+    QC_LOG_INFO(dev,"URB Rx Size %zu x %u\n", dev->mBulkInSize, dev->mBulkUrbCount);
+
    /* save our data pointer in this interface device */
     usb_set_intfdata(interface, dev);
     FinalizeURB(dev);
@@ -3800,6 +5240,24 @@ static int QTIDevUSBProbe(struct usb_interface *interface,
         dev->kobj_qdss = NULL;
         sysfs_remove_file(dev->kobj_qdss,&dev_attr.attr);
     }
+    if (dev->kobj_qdss && (sysfs_create_file(dev->kobj_qdss, &rx_urb_count_attr.attr) ||
+            sysfs_create_file(dev->kobj_qdss, &rx_urb_size_attr.attr)))
+    {
+        QC_LOG_WARN(dev,"RxUrbCount/RxUrbSize not available in sysfs\n");
+    }
+    if (dev->kobj_qdss && (sysfs_create_file(dev->kobj_qdss, &rx_reader_policy_attr.attr) ||
+            sysfs_create_file(dev->kobj_qdss, &tx_depth_attr.attr)))
+    {
+        QC_LOG_WARN(dev,"RxReaderPolicy/TxDepth not available in sysfs\n");
+    }
+    if (dev->kobj_qdss && sysfs_create_file(dev->kobj_qdss, &bench_attr.attr))
+    {
+        QC_LOG_WARN(dev,"Bench not available in sysfs\n");
+    }
+    if (dev->kobj_qdss && sysfs_create_file(dev->kobj_qdss, &numa_node_attr.attr))
+    {
+        QC_LOG_WARN(dev,"NumaNode not available in sysfs\n");
+    }
     /*<===============sysfs ends============>*/
     
    /* To enable auto suspend */
@@ -3807,7 +5265,6 @@ static int QTIDevUSBProbe(struct usb_interface *interface,
 
     /* Initialize workqueue for poll() */
     init_waitqueue_head( &dev->mBulkMemList.mWaitQueue );
-    InitializeRxNotifyPool(dev);
     QC_LOG_DBG(dev,"size sQTIDevUSB: %zu\n", sizeof(*dev));
     return 0;
     
@@ -3818,6 +5275,7 @@ error:
         {
             DeregisterQDSSDevice(dev);
         }
+        FreeBulkInBuffers(dev);
         QtiReleaseDevice(dev); // qti_kfree(dev);
         dev = NULL;
         /* this frees allocated memory */
@@ -3829,6 +5287,7 @@ error:
 static void QTIDevUSBDisconnect(struct usb_interface *interface)
 {
     sQTIDevUSB *pDev;
+    sQTIDevReader *pReader;
     struct inode * pOpenInode;
     struct list_head * pInodeList;
     struct task_struct * pEachTask = NULL;
@@ -3845,6 +5304,12 @@ static void QTIDevUSBDisconnect(struct usb_interface *interface)
 	mutex_lock(&pDev->mIoMutex);
 	pDev->disconnected = 1;
 	mutex_unlock(&pDev->mIoMutex);
+	spin_lock_irqsave(&pDev->mBulkMemList.mReadMemLock, flags);
+	list_for_each_entry(pReader, &pDev->mBulkMemList.mReaderList, node)
+	{
+	    wake_up_interruptible(&pReader->mWaitQueue);
+	}
+	spin_unlock_irqrestore(&pDev->mBulkMemList.mReadMemLock, flags);
 
     list_for_each( pInodeList, &pDev->mCdev.list ) {
         // Get the inode
@@ -3890,6 +5355,12 @@ static void QTIDevUSBDisconnect(struct usb_interface *interface)
     if (pDev) {
         if(pDev->kobj_qdss)
         {
+            sysfs_remove_file(pDev->kobj_qdss,&numa_node_attr.attr);
+            sysfs_remove_file(pDev->kobj_qdss,&bench_attr.attr);
+            sysfs_remove_file(pDev->kobj_qdss,&tx_depth_attr.attr);
+            sysfs_remove_file(pDev->kobj_qdss,&rx_reader_policy_attr.attr);
+            sysfs_remove_file(pDev->kobj_qdss,&rx_urb_size_attr.attr);
+            sysfs_remove_file(pDev->kobj_qdss,&rx_urb_count_attr.attr);
             sysfs_remove_file(pDev->kobj_qdss,&dev_attr.attr);
             kobject_put(pDev->kobj_qdss);
             pDev->kobj_qdss = NULL;
@@ -3897,9 +5368,16 @@ static void QTIDevUSBDisconnect(struct usb_interface *interface)
     }
     /*<===============sysfs ends============>*/
 
+    /* A mapping keeps the ring pages, not the URBs */
+    QTIDevRingDetach(pDev);
+
+    mutex_lock(&pDev->mIoMutex);
+    StopBulkInUrbs(pDev);
+    mutex_unlock(&pDev->mIoMutex);
+
     spin_lock_irqsave(&pDev->mBulkMemList.mReadMemLock, flags);
-    ClearNotifyList(pDev);
-    QC_LOG_INFO(pDev, "ClearNotifyList done\n" );
+    CancelRxWaiters(pDev);
+    QC_LOG_INFO(pDev, "CancelRxWaiters done\n" );
     ClearReadMemList(pDev);
     QC_LOG_INFO(pDev,"ClearReadMemList done\n" );
     spin_unlock_irqrestore(&pDev->mBulkMemList.mReadMemLock, flags);
@@ -3908,12 +5386,16 @@ static void QTIDevUSBDisconnect(struct usb_interface *interface)
     DeinitializeTxBuffers(pDev);
     usb_kill_anchored_urbs(&pDev->submitted);
 
+    /* Files still open may be copying from the receive buffers, which
+       the last close frees then (QTIDevUSBDelete) */
 #if (LINUX_VERSION_CODE <= KERNEL_VERSION(4,10,17))
     if (pDev->mRefCount.refcount.counter > 1)
 #else
     if (pDev->mRefCount.refcount.refs.counter > 1)
 #endif
         kref_put(&pDev->mRefCount, QTIDevUSBDelete);
+    else
+        FreeBulkInBuffers(pDev);
     QtiReleaseDevice(pDev);
 
     QC_LOG_INFO(pDev,"Exit\n" );
@@ -3986,6 +5468,11 @@ static struct usb_driver qtiDevDriver = {
     .resume     = QTIDevUSBResume,
     .id_table   = QdssVIDPIDTable,
     .supports_autosuspend = true,
+#if (LINUX_VERSION_CODE >= KERNEL_VERSION(6,8,0))
+    .driver.probe_type = PROBE_PREFER_ASYNCHRONOUS,
+#elif (LINUX_VERSION_CODE >= KERNEL_VERSION(4,2,0))
+    .drvwrap.driver.probe_type = PROBE_PREFER_ASYNCHRONOUS,
+#endif
 };
 
 /*===========================================================================
@@ -4028,7 +5515,7 @@ static int QTIDevUSBModInit(void)
     if (UpdateDeviceInfo(&gDiagFileInfo, gDiagInfFilePath) < 0)
     {
         QC_LOG_GLOBAL("Error in parsing DiagInfFilePath INF file\n");
-        qti_kfree(gQdssFileInfo);
+        QTIDevInfPut(gQdssFileInfo);
         return -ENXIO;
     }
 #endif
@@ -4042,9 +5529,9 @@ static int QTIDevUSBModInit(void)
     if (IS_ERR(gpDiagClass) == true)
     {
         QC_LOG_GLOBAL( "error at class_create %ld\n", PTR_ERR(gpDiagClass));
-        qti_kfree(gQdssFileInfo);
+        QTIDevInfPut(gQdssFileInfo);
         gQdssFileInfo = NULL;
-        qti_kfree(gDiagFileInfo);
+        QTIDevInfPut(gDiagFileInfo);
         gDiagFileInfo = NULL;
         return -ENOMEM;
     }
@@ -4058,9 +5545,9 @@ static int QTIDevUSBModInit(void)
     if (IS_ERR(gpQdssClass) == true)
     {
         QC_LOG_GLOBAL( "error at class_create %ld\n", PTR_ERR(gpQdssClass));
-        qti_kfree(gQdssFileInfo);
+        QTIDevInfPut(gQdssFileInfo);
         gQdssFileInfo = NULL;
-        qti_kfree(gDiagFileInfo);
+        QTIDevInfPut(gDiagFileInfo);
         gDiagFileInfo = NULL;
         class_destroy(gpDiagClass);
         return -ENOMEM;
@@ -4108,18 +5595,24 @@ static void __exit QTIDevUSBModExit(void)
 
     if (gQdssFileInfo)
     {
-        qti_kfree(gQdssFileInfo);
+        QTIDevInfPut(gQdssFileInfo);
         gQdssFileInfo = NULL;
     }
 
 #ifdef QDSS_DIAG_MERGE
     if (gDiagFileInfo)
     {
-        qti_kfree(gDiagFileInfo);
+        QTIDevInfPut(gDiagFileInfo);
         gDiagFileInfo = NULL;
     }
 #endif
 
+    if (gModemFileInfo)
+    {
+        QTIDevInfPut(gModemFileInfo);
+        gModemFileInfo = NULL;
+    }
+
     QC_LOG_GLOBAL("<--\n");
     return;
 }
@@ -4136,9 +5629,42 @@ module_param( debug_g, int, S_IRUGO | S_IWUSR );
 module_param( UrbRxSize, int, S_IRUGO | S_IWUSR );
 MODULE_PARM_DESC(UrbRxSize, "URB Rx Size)");
 
+module_param( UrbRxCount, int, S_IRUGO | S_IWUSR );
+MODULE_PARM_DESC(UrbRxCount, "Bulk-in URBs in flight per device, 1 to 32");
+
+module_param( UrbRxCountTrace, int, S_IRUGO | S_IWUSR );
+MODULE_PARM_DESC(UrbRxCountTrace, "UrbRxCount for QDSS trace, 0 to use UrbRxCount");
+
+module_param( UrbRxSizeTrace, int, S_IRUGO | S_IWUSR );
+MODULE_PARM_DESC(UrbRxSizeTrace, "UrbRxSize for QDSS trace, 0 to use UrbRxSize");
+
+module_param( UrbRxCountDpl, int, S_IRUGO | S_IWUSR );
+MODULE_PARM_DESC(UrbRxCountDpl, "UrbRxCount for DPL, 0 to use UrbRxCount");
+
+module_param( UrbRxSizeDpl, int, S_IRUGO | S_IWUSR );
+MODULE_PARM_DESC(UrbRxSizeDpl, "UrbRxSize for DPL, 0 to use UrbRxSize");
+
+module_param( UrbRxCountBulk, int, S_IRUGO | S_IWUSR );
+MODULE_PARM_DESC(UrbRxCountBulk, "UrbRxCount for DIAG and QDSS bulk in/out, 0 to use UrbRxCount");
+
+module_param( UrbRxSizeBulk, int, S_IRUGO | S_IWUSR );
+MODULE_PARM_DESC(UrbRxSizeBulk, "UrbRxSize for DIAG and QDSS bulk in/out, 0 to use UrbRxSize");
+
 module_param( UrbTxSize, int, S_IRUGO | S_IWUSR );
 MODULE_PARM_DESC(UrbTxSize, "URB Tx Size)");
 
+module_param( TxDepth, int, S_IRUGO | S_IWUSR );
+MODULE_PARM_DESC(TxDepth, "write()s in flight per DIAG/QDSS node, 0 to wait for each, up to 32");
+
+module_param( RingSlots, int, S_IRUGO | S_IWUSR );
+MODULE_PARM_DESC(RingSlots, "Slots of the mmap receive ring, 8 to 256");
+
+module_param( RxReaders, int, S_IRUGO | S_IWUSR );
+MODULE_PARM_DESC(RxReaders, "Opens sharing a QDSS/DIAG/DPL stream with the first one, 0 to 8");
+
+module_param( RxReaderPolicy, int, S_IRUGO | S_IWUSR );
+MODULE_PARM_DESC(RxReaderPolicy, "Slow shared readers: 0 drop their oldest data, 1 hold back the reads");
+
 module_param(gQdssInfFilePath, charp, S_IRUGO | S_IWUSR );
 MODULE_PARM_DESC(gQdssInfFilePath, "Inf File location (Need complete path)");
 
@@ -26,6 +26,8 @@
 #include <linux/mmu_context.h>
 #include <linux/usb/cdc.h>
 #include <linux/proc_fs.h>  /* Necessary because we use the proc fs */
+#include <linux/hrtimer.h>
+#include <linux/completion.h>
 
 #if (LINUX_VERSION_CODE < KERNEL_VERSION(4,11,0))
 #include <linux/sched.h>
@@ -222,6 +224,144 @@ typedef struct sURBSetupPacket
 // Common value for sURBSetupPacket.mLength
 #define DEFAULT_READ_URB_LENGTH 0x1000
 
+// Number of preallocated control URBs per device
+#define QMI_TXN_POOL_SIZE        8
+
+// Size of the preallocated request buffer attached to each control URB
+#define QMI_TXN_BUFFER_SIZE      DEFAULT_READ_URB_LENGTH
+
+// Default response timeout in milliseconds
+#define QMI_TXN_TIMEOUT_MS       30000
+
+// Number of preallocated indication slots, must be a power of 2
+#define QMI_IND_RING_SIZE        16
+
+// Largest indication a slot holds
+#define QMI_IND_SLOT_SIZE        DEFAULT_READ_URB_LENGTH
+
+// Transaction flags
+#define QMI_TXN_FLAG_NO_RESP     0x01  /* Done once the request is written */
+
+// readv()/writev() on the QMI device carry several QMI messages per call,
+//    each one preceded by its length as a little endian u16
+#define QMI_BATCH_LEN_SIZE       sizeof( __le16 )
+
+/*=========================================================================*/
+// Struct sQMITxn
+//
+//    Structure that defines one slot of the QMI transaction engine
+//      A slot owns a preallocated control URB and request buffer and
+//      tracks a single request from submission until its response
+//      arrives, it times out or it is cancelled
+/*=========================================================================*/
+typedef struct sQMITxn
+{
+   /* Entry in the engine free list or pending list */
+   struct list_head           node;
+
+   /* Device the transaction belongs to */
+   struct sGobiUSBNet *       mpDev;
+
+   /* QMI "device" the request was issued on */
+   struct sQMIDev *           mpQMIDev;
+
+   /* Preallocated control URB */
+   struct urb *               mpURB;
+
+   /* Preallocated CDC Send Encapsulated setup packet */
+   sURBSetupPacket *          mpSetupPacket;
+
+   /* Preallocated request buffer (QMI_TXN_BUFFER_SIZE bytes) */
+   void *                     mpBuffer;
+
+   /* Request buffer for requests larger than mpBuffer */
+   void *                     mpLargeBuffer;
+
+   /* Client ID and transaction ID the response is matched on */
+   u16                        mClientID;
+   u16                        mTransactionID;
+
+   /* QMI_TXN_FLAG_* */
+   u32                        mFlags;
+
+   /* Response timer */
+   struct hrtimer             mTimer;
+
+   /* Completed once the transaction is done */
+   struct completion          mDone;
+
+   /* Function to be run when the transaction is done, may be NULL */
+   void                  (* mpCallback)(struct sGobiUSBNet *, int, void *, u16, void *);
+
+   /* Data to provide as parameter to mpCallback */
+   void *                     mpContext;
+
+   /* Copy of the response, owned by the slot until it is released */
+   void *                     mpResp;
+   u16                        mRespSize;
+
+   /* Final status of the transaction */
+   int                        mStatus;
+
+   /* Has the transaction been completed? */
+   bool                       mbDone;
+
+   /* References held by the engine, the URB, the timer and a waiter */
+   atomic_t                   mRefCount;
+
+} sQMITxn;
+
+/*=========================================================================*/
+// Struct sQMITxnEngine
+//
+//    Structure that defines the QMI transaction engine of a device
+/*=========================================================================*/
+typedef struct sQMITxnEngine
+{
+   /* Transaction slots */
+   sQMITxn *                  mpPool;
+
+   /* Slots ready for use */
+   struct list_head           mFreeList;
+
+   /* Number of entries in mFreeList */
+   int                        mFreeCount;
+
+   /* Transactions waiting for their response */
+   struct list_head           mPendingList;
+
+   /* Lock for both lists and the slot states */
+   spinlock_t                 mLock;
+
+   /* Woken whenever a slot is returned to mFreeList */
+   wait_queue_head_t          mFreeWait;
+
+   /* Are new transactions accepted? */
+   bool                       mbActive;
+
+} sQMITxnEngine;
+
+/*=========================================================================*/
+// Struct sQMIBatch
+//
+//    Structure that tracks the requests of one batched write
+/*=========================================================================*/
+typedef struct sQMIBatch
+{
+   /* Requests still in flight, plus one held by the submitter */
+   atomic_t                   mPending;
+
+   /* First error reported by a request, 0 if none */
+   int                        mStatus;
+
+   /* Completed once mPending drops to zero */
+   struct completion          mDone;
+
+   /* References held by the submitter and by each request in flight,
+      the batch is freed with the last one */
+   atomic_t                   mRefCount;
+
+} sQMIBatch;
 
 /*=========================================================================*/
 // Struct sAutoPM
@@ -348,13 +488,14 @@ typedef struct sQMIDev
 } sQMIDev;
 
 /*=========================================================================*/
-// Struct sProcessInd
+// Struct sIndDataInfo
 //
-//    Structure that holds the data for Indication
+//    Preallocated slot of the indication ring
 /*=========================================================================*/
 typedef struct sIndDataInfo
 {
-    /* Pointer to the Response data */
+    /* Copy of the message, QMUX header included,
+       QMI_IND_SLOT_SIZE bytes allocated */
     char                *mpData;
 
     /* Length of response data */
@@ -369,26 +510,36 @@ typedef struct sIndDataInfo
     /* QMI "device" memory */
     sQMIDev             *mQMIDev;
 
-    /* Pointer to the next */
-    struct sIndDataInfo *mpNext;
-
 } sIndDataInfo;
 
 /*=========================================================================*/
 // Struct sProcessInd
 //
-//    Structure that holds the data for Indication
+//    Single producer / single consumer ring of WDS indications
+//
+//    The producer is the control read callback, the consumer is mWork
+//    running on the device work queue.  Entries mTail to mHead - 1 are
+//    pending, a full ring drops the new indication.
 /*=========================================================================*/
 typedef struct sProcessInd
 {
-   /* Semaphore */
-   struct semaphore     *mpResponseReadSem;
+   /* QMI_IND_RING_SIZE slots */
+   sIndDataInfo         *mpSlots;
 
-   /* Response list lock (for adding and removing elements) */
-   spinlock_t           *mpResponeListLock;
+   /* Next slot to fill, only written by the producer */
+   unsigned int         mHead;
 
-   /* List of data to be addressed */
-   sIndDataInfo         *mpIndDataInfoList;
+   /* Next slot to process, only written by mWork */
+   unsigned int         mTail;
+
+   /* Is the producer allowed to queue? */
+   bool                 mbActive;
+
+   /* Indications dropped because the ring was full */
+   atomic_t             mDropped;
+
+   /* Finishes a delayed QMI bring up, then drains the ring */
+   struct work_struct   mWork;
 
 } sProcessInd;
 
@@ -505,6 +656,12 @@ typedef struct sGobiUSBNet
    /* AutoPM thread */
    sAutoPM                mAutoPM;
 
+   /* QMI transaction engine */
+   sQMITxnEngine          mTxnEngine;
+
+   /* QMUX capture ring, NULL unless enabled */
+   struct sQMICapture *   mpCapture;
+
    /*QMAP DL Aggregation information */
    unsigned int    DLAggregationMaxDatagram;
    unsigned int    DLAggregationMaxSize;
@@ -520,11 +677,8 @@ typedef struct sGobiUSBNet
 
    struct workqueue_struct *mpWorkQ;   /* Work queue */
 
-   struct task_struct     *pGobiWaitThread;
-
-   spinlock_t             responeListLock;
-   
-   struct semaphore       responseReadSem;
+   /* NUMA node buffers, work and threads go to, NUMA_NO_NODE for any */
+   int                    mNumaNode;
 
 } sGobiUSBNet;
 
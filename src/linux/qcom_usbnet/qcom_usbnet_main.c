@@ -6,6 +6,7 @@
 #include "qmidevice.h"
 #include "qmi.h"
 #include "qmap.h"
+#include "qmicapture.h"
 #include <linux/device.h>
 #include <linux/if_arp.h>
 #include <linux/platform_device.h>
@@ -33,6 +34,9 @@ int mux = 0;
 //Enable DHCP
 int enableDhcp = 0;
 
+// Slots of the per device QMUX capture ring, 0 disables capture
+int qmuxCaptureSlots = 0;
+
 #define CONFIG_USB_CODE
 #ifdef CONFIG_USB_CODE
 #define QTI_RMNET_INF_PATH "/opt/qcom/QUD/qcom_usbnet/qtiwwan.inf"
@@ -40,6 +44,8 @@ int enableDhcp = 0;
 
 fileInfo_t  *gQTIRmnetFileInfo = NULL;
 static char *gQTIRmnetInfFilePath = NULL;
+/* Serializes probes reloading and reading gQTIRmnetFileInfo */
+static DEFINE_MUTEX(gInfLock);
 #endif
 
 static struct list_head DeviceListIdle;
@@ -94,9 +100,19 @@ int GobiInitializeDeviceContext(sGobiUSBNet *pGobiDev)
     pGobiDev->mbQMIValid = false;
     pGobiDev->mQMIDev.debug = 1;
     pGobiDev->mQMIDev.logLevel = QC_LOG_LVL_INFO;/*Initializing logLevel*/
+    /* Pooled contexts are placed by the probe that takes them */
+    pGobiDev->mNumaNode = NUMA_NO_NODE;
     return 0;
 }
 
+/* Node of the host controller the device hangs off, NUMA_NO_NODE on single node systems */
+static int GobiControllerNode(struct usb_device *udev)
+{
+    if (num_online_nodes() <= 1)
+        return NUMA_NO_NODE;
+    return dev_to_node(udev->bus->controller);
+}
+
 int GobiInitializeDeviceList(void)
 {
     sGobiUSBNet * pGobiDev = NULL;
@@ -132,89 +148,69 @@ int GobiInitializeDeviceList(void)
 sGobiUSBNet *GobiAcquireDevice(char *mpKey, struct usbnet * pDev)
 {
    sGobiUSBNet *pGobiDev = NULL;
+   sGobiUSBNet *pEntry;
    char commonDevName[255];
-   int found_devName = 0; 
    unsigned long flags;
    int success = 0;
 
+   snprintf(commonDevName, sizeof(commonDevName), "%s:%d-%s", mpKey, pDev->udev->bus->busnum, pDev->udev->devpath);
+
+   // Probes may run in parallel: the lists are only walked under the lock
    spin_lock_irqsave(&DevListLock, flags);
-   if (list_empty(&DeviceListIdle) == true)
+   list_for_each_entry(pEntry, &DeviceListIdle, node)
    {
-      spin_unlock_irqrestore(&DevListLock, flags);
-      pGobiDev = kzalloc( sizeof( sGobiUSBNet ), GFP_KERNEL );
-      if (pGobiDev != NULL)
-        {
-            if (GobiInitializeDeviceContext(pGobiDev))
-            {
-                QC_LOG_ERR( GET_QMIDEV(pGobiDev),"Failed to initialize dev context\n");
-                kfree(pGobiDev);
-                pGobiDev = NULL;
-            }
-            else
-            {
-                list_add_tail(&pGobiDev->node, &DeviceListActive);
-                ++DevicesActive;
-                success = 1;
-            }
-        }
+      char * res = strstr(pEntry->mQMIDev.mdeviceName, commonDevName); //pEntry->mQMIDev.mdeviceName should contain commonDevName as substring
+      if(res != NULL)
+      {
+         QC_LOG_DBG(GET_QMIDEV(pEntry),"Found matching commonDevName\n");
+         pGobiDev = pEntry;
+         break;
+      }
    }
-   else 
+   if(pGobiDev == NULL)
    {
-      snprintf(commonDevName, sizeof(commonDevName), "%s:%d-%s", mpKey, pDev->udev->bus->busnum, pDev->udev->devpath);
-
-      list_for_each_entry(pGobiDev, &DeviceListIdle, node)
+      list_for_each_entry(pEntry, &DeviceListIdle, node)
       {
-         char * res = strstr(pGobiDev->mQMIDev.mdeviceName, commonDevName); //pGobiDev->mQMIDev.mdeviceName should contain commonDevName as substring
-         if(res != NULL)
+         int res = strncmp(pEntry->mQMIDev.mdeviceName,"",255);
+         if(res == 0)
          {
-            QC_LOG_DBG(GET_QMIDEV(pGobiDev),"Found matching commonDevName\n");
-            found_devName = 1;
-            list_move_tail(&pGobiDev->node, &DeviceListActive);
-            --DevicesIdle;
-            ++DevicesActive;
-            success = 1;
+            QC_LOG_DBG(GET_QMIDEV(pEntry),"Found NULL entry\n");
+            pGobiDev = pEntry;
             break;
          }
       }
-      if(found_devName == 0)
+   }
+   if (pGobiDev != NULL)
+   {
+      list_move_tail(&pGobiDev->node, &DeviceListActive);
+      --DevicesIdle;
+      ++DevicesActive;
+      success = 1;
+   }
+   spin_unlock_irqrestore(&DevListLock, flags);
+
+   if(pGobiDev == NULL)
+   {
+      // Created outside of the lock, the allocations sleep
+      pGobiDev = kzalloc( sizeof( sGobiUSBNet ), GFP_KERNEL );
+      if (pGobiDev != NULL)
       {
-         int findNULL = 0;
-         list_for_each_entry(pGobiDev, &DeviceListIdle, node)
-         {
-            int res = strncmp(pGobiDev->mQMIDev.mdeviceName,"",255);
-            if(res == 0)
+            if (GobiInitializeDeviceContext(pGobiDev))
             {
-               QC_LOG_DBG(GET_QMIDEV(pGobiDev),"Found NULL entry\n");
-               findNULL = 1;
-               list_move_tail(&pGobiDev->node, &DeviceListActive);
-               --DevicesIdle;
-               ++DevicesActive;
-               success = 1;
-               break;
+               QC_LOG_EXCEPTION(GET_QMIDEV(pGobiDev),"Failed to initialize dev context\n");
+               kfree(pGobiDev);
+               pGobiDev = NULL;
             }
-         }
-         if(findNULL == 0)
-         {
-            pGobiDev = kzalloc( sizeof( sGobiUSBNet ), GFP_KERNEL );
-            if (pGobiDev != NULL)
+            else
             {
-                  if (GobiInitializeDeviceContext(pGobiDev))
-                  {
-                     QC_LOG_EXCEPTION(GET_QMIDEV(pGobiDev),"Failed to initialize dev context\n");
-                     kfree(pGobiDev);
-                     pGobiDev = NULL;
-                  }
-                  else
-                  {
-                     QC_LOG_DBG(GET_QMIDEV(pGobiDev),"Created a new entry\n");
-                     list_add_tail(&pGobiDev->node, &DeviceListActive);
-                     ++DevicesActive;
-                     success = 1;
-                  }
+               QC_LOG_DBG(GET_QMIDEV(pGobiDev),"Created a new entry\n");
+               spin_lock_irqsave(&DevListLock, flags);
+               list_add_tail(&pGobiDev->node, &DeviceListActive);
+               ++DevicesActive;
+               spin_unlock_irqrestore(&DevListLock, flags);
+               success = 1;
             }
-         }
       }
-      spin_unlock_irqrestore(&DevListLock, flags);
    }
     if (success == 0)
     {
@@ -785,6 +781,8 @@ static void GobiNetDriverUnbind(
 #endif
 
    DeregisterQMIDevice( pGobiDev );
+   QMITxnEngineRelease( pGobiDev );
+   QMICaptureDestroy( pGobiDev );
 
 #if (LINUX_VERSION_CODE >= KERNEL_VERSION( 2,6,29 ))
    kfree( pDev->net->netdev_ops );
@@ -1278,14 +1276,21 @@ int GobiUSBNetOpen( struct net_device * pNet )
    atomic_set( &pGobiDev->mAutoPM.mURBListLen, 0 );
    init_completion( &pGobiDev->mAutoPM.mThreadDoWork );
 
-   pGobiDev->mAutoPM.mpThread = kthread_run( GobiUSBNetAutoPMThread,
+   // On the CPUs of the host controller node
+   pGobiDev->mAutoPM.mpThread = kthread_create_on_node( GobiUSBNetAutoPMThread,
                                                &pGobiDev->mAutoPM,
+                                               pGobiDev->mNumaNode,
                                                "GobiUSBNetAutoPMThread" );
    if (IS_ERR( pGobiDev->mAutoPM.mpThread ))
    {
      QC_LOG_ERR(GET_QMIDEV(pGobiDev), "AutoPM thread creation error\n" );
       return PTR_ERR( pGobiDev->mAutoPM.mpThread );
    }
+   if (pGobiDev->mNumaNode != NUMA_NO_NODE)
+   {
+      set_cpus_allowed_ptr( pGobiDev->mAutoPM.mpThread, cpumask_of_node( pGobiDev->mNumaNode ) );
+   }
+   wake_up_process( pGobiDev->mAutoPM.mpThread );
 
    // Allow traffic
    GobiClearDownReason( pGobiDev, NET_IFACE_STOPPED );
@@ -1658,7 +1663,7 @@ struct sk_buff *aggr_tx_frame(struct usbnet *dev, struct sk_buff *skb)
     /* allocate a new OUT skb */
     if (!skb_out) {
         ctx->tx_curr_size = ctx->tx_max;
-        skb_out = alloc_skb(ctx->tx_curr_size, GFP_ATOMIC);
+        skb_out = __alloc_skb(ctx->tx_curr_size, GFP_ATOMIC, 0, pGobiDev->mNumaNode);
 
         /* No allocation possible so we will abort */
         if (skb_out == NULL) {
@@ -2374,38 +2379,20 @@ static const struct usb_device_id GobiMUXVIDPIDTable [] =
 #ifdef CONFIG_USB_CODE
 static int UpdateDeviceInfo(fileInfo_t **pFileInfo, char *pFilePath)
 {
-    int ret;
-
     if (!pFilePath || !pFileInfo)
     {
         QC_LOG_GLOBAL("Invalid data\n");
         return -EINVAL;
     }
 
-    ret = QTIDevInfEntrySize(pFilePath);
-    if (ret < 0)
-    {
-        QC_LOG_GLOBAL("Failed to get the devices info\n");
-        return ret;
-    }
-
-    *pFileInfo = kzalloc(sizeof(fileInfo_t) + ret * sizeof(devInfo_t), GFP_KERNEL);
-    if (!pFileInfo)
-    {
-        QC_LOG_GLOBAL("error in allocating memory\n");
-        return -ENOMEM;
-    }
-
-    (*pFileInfo)->mLength = ret;
-
-    if (QTIDevInfParse(pFilePath, *pFileInfo) < 0)
+    /* Parsed once per file and shared by every driver using it */
+    *pFileInfo = QTIDevInfGet(pFilePath);
+    if (!*pFileInfo)
     {
         QC_LOG_GLOBAL("Error in parsing INF file\n");
-        kfree(*pFileInfo);
-        *pFileInfo = NULL;
         return -ENXIO;
     }
-    QC_LOG_GLOBAL("Number of devices %d ; %d\n", (*pFileInfo)->mNumResp, ret);
+    QC_LOG_GLOBAL("Number of devices %d\n", (*pFileInfo)->mNumResp);
     return 0;
 }
 #endif
@@ -2630,12 +2617,58 @@ static ssize_t gobiQMITimer_store(struct kobject *kobj,
    return count;
 }
 
+static ssize_t numaNode_show(struct kobject *kobj,
+                struct kobj_attribute *attr, char *buf)
+{
+   sGobiUSBNet *pDevOnRecord = NULL;
+
+   list_for_each_entry(pDevOnRecord, &DeviceListActive, node)
+   {
+      if (pDevOnRecord->kobj_gobi==kobj)
+      {
+         return scnprintf(buf, PAGE_SIZE, "%d\n", pDevOnRecord->mNumaNode);
+      }
+   }
+
+   return -ENODEV;
+}
+
+static ssize_t numaNode_store(struct kobject *kobj,
+               struct kobj_attribute *attr,const char *buf, size_t count)
+{
+   sGobiUSBNet *pDevOnRecord = NULL;
+   int nodeId;
+
+   // -1 lets buffers, work and threads go anywhere
+   if (kstrtoint(buf, 0, &nodeId) ||
+       (nodeId != NUMA_NO_NODE && (nodeId < 0 || nodeId >= MAX_NUMNODES || !node_online(nodeId))))
+   {
+      return -EINVAL;
+   }
+
+   list_for_each_entry(pDevOnRecord, &DeviceListActive, node)
+   {
+      if (pDevOnRecord->kobj_gobi==kobj)
+      {
+         // Work and aggregates follow right away, the AutoPM thread at
+         //    the next open and the QMI buffers at the next probe
+         pDevOnRecord->mNumaNode = nodeId;
+         QC_LOG_INFO(GET_QMIDEV(pDevOnRecord),"NUMA node %d\n", nodeId);
+         return count;
+      }
+   }
+
+   return -ENODEV;
+}
+
  struct kobj_attribute debug_attr = __ATTR(Debug, S_IRUGO | S_IWUSR, debug_show, debug_store);
  struct kobj_attribute timer_attr = __ATTR(gobiQMITimer, S_IRUGO | S_IWUSR, gobiQMITimer_show, gobiQMITimer_store);
+ struct kobj_attribute numa_node_attr = __ATTR(NumaNode, S_IRUGO | S_IWUSR, numaNode_show, numaNode_store);
 
 struct attribute *gobinet_sysfs_attrs[] = {
    &debug_attr.attr,
    &timer_attr.attr,
+   &numa_node_attr.attr,
    NULL,
 };
 
@@ -2677,49 +2710,34 @@ void sysfs_destroy(sGobiUSBNet * dev)
 }
 /*<===============sysfs ends============>*/
 
+#ifdef CONFIG_USB_CODE
 /*===========================================================================
 METHOD:
-   GobiUSBNetProbe (Public Method)
+   GobiLookupDeviceInfo (Private Method)
 
 DESCRIPTION:
-   Run usbnet_probe
-   Setup QMI device
+   Reload the INF file if needed and copy the entry of the interface.
+   Probes may run in parallel, so gQTIRmnetFileInfo is only replaced and
+   read under gInfLock
 
 PARAMETERS
    pIntf        [ I ] - Pointer to interface
-   pVIDPIDs     [ I ] - Pointer to VID/PID table
+   pDevInfo     [ O ] - Copy of the INF entry
 
 RETURN VALUE:
    int - 0 for success
          Negative errno for error
 ===========================================================================*/
-int GobiUSBNetProbe(
-   struct usb_interface *        pIntf,
-   const struct usb_device_id *  pVIDPIDs )
+static int GobiLookupDeviceInfo(
+   struct usb_interface *  pIntf,
+   devInfo_t *             pDevInfo )
 {
-   int status;
-   int retval;
-   struct usbnet * pDev;
-#ifdef VIRTUAL_USB_CODE
-   struct usbnet * pMUXDev[MAX_MUX_DEVICES];
-#endif
    sGobiUSBNet * pGobiDev = NULL;
-   sEndpoints * pEndpoints;
-   //unsigned int mtu;
-   int pipe;
-   int i;
-
-#if (LINUX_VERSION_CODE >= KERNEL_VERSION( 2,6,29 ))
-   struct net_device_ops * pNetDevOps;
-#ifdef VIRTUAL_USB_CODE
-   struct net_device_ops * pNetMUXDevOps;
-#endif
-#endif
-
-#ifdef CONFIG_USB_CODE
    devInfo_t *devInfo;
    char *path;
+   int retval;
 
+   mutex_lock(&gInfLock);
    path = (gQTIRmnetInfFilePath != NULL) ? gQTIRmnetInfFilePath : QTI_RMNET_INF_PATH;
    retval = QTIDevInfCheckFileStatus(gQTIRmnetFileInfo, path);
 
@@ -2731,27 +2749,86 @@ int GobiUSBNetProbe(
        QC_LOG_GLOBAL("Update required\n");
        if (gQTIRmnetFileInfo)
        {
-           kfree(gQTIRmnetFileInfo);
+           QTIDevInfPut(gQTIRmnetFileInfo);
            gQTIRmnetFileInfo = NULL;
        }
        if (UpdateDeviceInfo(&gQTIRmnetFileInfo, path) < 0)
        {
            QC_LOG_ERR(GET_QMIDEV(pGobiDev),"Error in parsing INF file\n");
-           return -ENXIO;
+           retval = -ENXIO;
+           goto unlock;
        }
    } else
    {
       QC_LOG_ERR(GET_QMIDEV(pGobiDev),"Unable to get the status of VID/PID Info\n");
-      return -EIO;
+      retval = -EIO;
+      goto unlock;
    }
 
    devInfo = QTIDevInfGetDevInfo(pIntf, gQTIRmnetFileInfo);
    if (!devInfo)
    {
        QC_LOG_ERR(GET_QMIDEV(pGobiDev),"USB corresponds to other Iface, (Supports only: %s)\n", path);
-       return -EIO;
+       retval = -EIO;
+       goto unlock;
    }
+   memcpy(pDevInfo, devInfo, sizeof(devInfo_t));
+   retval = 0;
+
+unlock:
+   mutex_unlock(&gInfLock);
+   return retval;
+}
+#endif
+
+/*===========================================================================
+METHOD:
+   GobiUSBNetProbe (Public Method)
+
+DESCRIPTION:
+   Run usbnet_probe
+   Setup QMI device
+
+PARAMETERS
+   pIntf        [ I ] - Pointer to interface
+   pVIDPIDs     [ I ] - Pointer to VID/PID table
+
+RETURN VALUE:
+   int - 0 for success
+         Negative errno for error
+===========================================================================*/
+int GobiUSBNetProbe(
+   struct usb_interface *        pIntf,
+   const struct usb_device_id *  pVIDPIDs )
+{
+   int status;
+   int retval;
+   struct usbnet * pDev;
+#ifdef VIRTUAL_USB_CODE
+   struct usbnet * pMUXDev[MAX_MUX_DEVICES];
+#endif
+   sGobiUSBNet * pGobiDev = NULL;
+   sEndpoints * pEndpoints;
+   //unsigned int mtu;
+   int pipe;
+   int i;
+
+#if (LINUX_VERSION_CODE >= KERNEL_VERSION( 2,6,29 ))
+   struct net_device_ops * pNetDevOps;
+#ifdef VIRTUAL_USB_CODE
+   struct net_device_ops * pNetMUXDevOps;
+#endif
+#endif
+
+#ifdef CONFIG_USB_CODE
+   devInfo_t infDevInfo;
+   devInfo_t *devInfo = &infDevInfo;
 
+   retval = GobiLookupDeviceInfo(pIntf, devInfo);
+   if (retval != 0)
+   {
+      return retval;
+   }
 #endif
 
    pEndpoints = GatherEndpoints( pIntf );
@@ -2804,6 +2881,8 @@ int GobiUSBNetProbe(
       return -ENOMEM;
    }
    memcpy(&(pGobiDev->mDevInfo.mDevInfInfo), devInfo, sizeof(devInfo_t));
+   // QMI buffers, aggregates, work and the AutoPM thread on the controller node
+   pGobiDev->mNumaNode = GobiControllerNode(pDev->udev);
    for (i=0; i<MAX_MUX_DEVICES; i++)
    {
 #ifdef CONFIG_USB_CODE
@@ -3063,6 +3142,13 @@ int GobiUSBNetProbe(
    GobiSetDownReason( pGobiDev, NO_NDIS_CONNECTION );
    GobiSetDownReason( pGobiDev, NET_IFACE_STOPPED );
 
+   // Capture ring first, so the QMI bring up is recorded too
+   status = QMICaptureCreate( pGobiDev );
+   if (status != 0)
+   {
+      QC_LOG_WARN(GET_QMIDEV(pGobiDev),"QMUX capture unavailable %d\n", status );
+   }
+
    // Register QMI
    status = RegisterQMIDevice( pGobiDev );
    if (status != 0)
@@ -3104,6 +3190,11 @@ static struct usb_driver GobiNet =
    .suspend    = GobiSuspend,
    .resume     = GobiResume,
    .supports_autosuspend = true,
+#if (LINUX_VERSION_CODE >= KERNEL_VERSION(6,8,0))
+   .driver.probe_type = PROBE_PREFER_ASYNCHRONOUS,
+#elif (LINUX_VERSION_CODE >= KERNEL_VERSION(4,2,0))
+   .drvwrap.driver.probe_type = PROBE_PREFER_ASYNCHRONOUS,
+#endif
 };
 
 #if 0
@@ -3216,7 +3307,7 @@ static int GobiUSBNetModInit(void)
 #ifdef CONFIG_USB_CODE
      if (gQTIRmnetFileInfo)
      {
-         kfree(gQTIRmnetFileInfo);
+         QTIDevInfPut(gQTIRmnetFileInfo);
          gQTIRmnetFileInfo = NULL;
      }
 #endif
@@ -3231,17 +3322,20 @@ static int GobiUSBNetModInit(void)
 #ifdef CONFIG_USB_CODE
       if (gQTIRmnetFileInfo)
       {
-          kfree(gQTIRmnetFileInfo);
+          QTIDevInfPut(gQTIRmnetFileInfo);
           gQTIRmnetFileInfo = NULL;
       }
 #endif
    }
 #endif
 
+   QMICaptureModInit();
+
    retVal = GobiInitializeDeviceList();
     if (retVal)
     {
         QC_LOG_GLOBAL("QtiInitializeDeviceList failure\n");
+        QMICaptureModExit();
     }
     else
     {
@@ -3249,6 +3343,7 @@ static int GobiUSBNetModInit(void)
         if (retVal)
         {
            QC_LOG_GLOBAL("usb_register failure\n");
+           QMICaptureModExit();
            GobiFreeDevices();
         }
     }
@@ -3274,13 +3369,14 @@ RETURN VALUE:
 static void __exit GobiUSBNetModExit(void)
 {
    usb_deregister( &GobiNet );
+   QMICaptureModExit();
    GobiFreeDevices();
    class_destroy( qcom_usbnet_class );
    proc_remove(gpProcEnt);
 #ifdef CONFIG_USB_CODE
    if (gQTIRmnetFileInfo)
    {
-       kfree(gQTIRmnetFileInfo);
+       QTIDevInfPut(gQTIRmnetFileInfo);
        gQTIRmnetFileInfo = NULL;
    }
 #endif
@@ -3330,6 +3426,10 @@ MODULE_PARM_DESC( txQueueLength,
 module_param( mux, int, S_IRUGO | S_IWUSR );
 MODULE_PARM_DESC( mux, "MUX support enabled or not" );
 
+module_param( qmuxCaptureSlots, int, S_IRUGO );
+MODULE_PARM_DESC( qmuxCaptureSlots,
+   "Slots of the QMUX capture ring in debugfs, per device (0 = disabled)" );
+
 module_param( enableDhcp, int, S_IRUGO | S_IWUSR );
 MODULE_PARM_DESC( enableDhcp,
                   "Enable DHCP over static IP address settings" );
@@ -3,7 +3,9 @@
     SPDX-License-Identifier: BSD-3-Clause
 */
 
+#ifndef QMI_CODEC_USER
 #include "qmidevice.h"
+#endif
 #include "qmi.h"
 /*=========================================================================*/
 // Get sizes of buffers needed by QMI requests
@@ -16,6 +18,186 @@ extern int RmnetIF;
 void PrintIPAddr(char *, unsigned int);
 int QMI_IP_Down(char *);
 
+/*=========================================================================*/
+// QMI message descriptions
+/*=========================================================================*/
+
+// Report channel rate TLV of QMI WDS SET EVENT REPORT REQ
+typedef struct sQMIWDSChannelRate
+{
+   u8          mStatsPeriod;
+   u32         mStatsMask;
+} __attribute__((packed)) sQMIWDSChannelRate;
+
+// Peripheral endpoint ID TLV of QMI WDA / WDS data port requests
+typedef struct sQMIEndpointID
+{
+   u32         mEpType;
+   u32         mIfaceID;
+} sQMIEndpointID;
+
+// QMI WDS SET EVENT REPORT REQ
+typedef struct sQMIWDSSetEventReportReqMsg
+{
+   sQMIWDSChannelRate   mChannelRate;
+} sQMIWDSSetEventReportReqMsg;
+
+static const sQMITLVDesc gQMIWDSSetEventReportReqTLVs[] =
+{
+   QMI_TLV( 0x11, sQMIWDSSetEventReportReqMsg, mChannelRate ),
+};
+
+static const sQMIMsgDesc gQMIWDSSetEventReportReq =
+   QMI_MSG_DESC( 0x0001, gQMIWDSSetEventReportReqTLVs );
+
+// QMI WDS GET PKG SRVC STATUS REQ
+static const sQMIMsgDesc gQMIWDSGetPKGSRVCStatusReq = { 0x0022, 0, NULL };
+
+// QMI DMS GET SERIAL NUMBERS REQ
+static const sQMIMsgDesc gQMIDMSGetMEIDReq = { 0x0025, 0, NULL };
+
+// QMI WDA SET DATA FORMAT REQ
+typedef struct sQMIWDASetDataFormatReqMsg
+{
+   u8                mQOSFormat;
+   u32               mLinkProtocol;
+   u32               mULAggProtocol;
+   u32               mDLAggProtocol;
+   u32               mDLMaxDatagrams;
+   u32               mDLMaxSize;
+   sQMIEndpointID    mEndpoint;
+#ifdef TX_AGGR
+   u32               mULMaxDatagrams;
+   u32               mULMaxSize;
+#endif
+} sQMIWDASetDataFormatReqMsg;
+
+static const sQMITLVDesc gQMIWDASetDataFormatReqTLVs[] =
+{
+   QMI_TLV( 0x10, sQMIWDASetDataFormatReqMsg, mQOSFormat ),
+   QMI_TLV( 0x11, sQMIWDASetDataFormatReqMsg, mLinkProtocol ),
+   QMI_TLV( 0x12, sQMIWDASetDataFormatReqMsg, mULAggProtocol ),
+   QMI_TLV( 0x13, sQMIWDASetDataFormatReqMsg, mDLAggProtocol ),
+   QMI_TLV( 0x15, sQMIWDASetDataFormatReqMsg, mDLMaxDatagrams ),
+   QMI_TLV( 0x16, sQMIWDASetDataFormatReqMsg, mDLMaxSize ),
+   QMI_TLV( 0x17, sQMIWDASetDataFormatReqMsg, mEndpoint ),
+#ifdef TX_AGGR
+   QMI_TLV( 0x1B, sQMIWDASetDataFormatReqMsg, mULMaxDatagrams ),
+   QMI_TLV( 0x1C, sQMIWDASetDataFormatReqMsg, mULMaxSize ),
+#endif
+};
+
+static const sQMIMsgDesc gQMIWDASetDataFormatReq =
+   QMI_MSG_DESC( 0x0020, gQMIWDASetDataFormatReqTLVs );
+
+// QMI WDA SET DATA FORMAT RESP
+typedef struct sQMIWDASetDataFormatRespMsg
+{
+   u32               mDLMaxDatagrams;
+   u32               mDLMaxSize;
+   u32               mULMaxDatagrams;
+   u32               mULMaxSize;
+} sQMIWDASetDataFormatRespMsg;
+
+static const sQMITLVDesc gQMIWDASetDataFormatRespTLVs[] =
+{
+   QMI_TLV( 0x15, sQMIWDASetDataFormatRespMsg, mDLMaxDatagrams ),
+   QMI_TLV( 0x16, sQMIWDASetDataFormatRespMsg, mDLMaxSize ),
+   QMI_TLV( 0x17, sQMIWDASetDataFormatRespMsg, mULMaxDatagrams ),
+   QMI_TLV( 0x18, sQMIWDASetDataFormatRespMsg, mULMaxSize ),
+};
+
+static const sQMIMsgDesc gQMIWDASetDataFormatResp =
+   QMI_MSG_DESC( 0x0020, gQMIWDASetDataFormatRespTLVs );
+
+// QMI WDA 0x002B REQ with QOS format only
+typedef struct sQMIWDAQOSFormatReqMsg
+{
+   u8                mQOSFormat;
+} sQMIWDAQOSFormatReqMsg;
+
+static const sQMITLVDesc gQMIWDAQOSFormatReqTLVs[] =
+{
+   QMI_TLV( 0x10, sQMIWDAQOSFormatReqMsg, mQOSFormat ),
+};
+
+static const sQMIMsgDesc gQMIWDAQOSFormatReq =
+   QMI_MSG_DESC( 0x002B, gQMIWDAQOSFormatReqTLVs );
+
+// QMI WDS START NETWORK INTERFACE REQ
+typedef struct sQMIWDSStartNetworkReqMsg
+{
+   u8                mProfileIndex;
+} sQMIWDSStartNetworkReqMsg;
+
+static const sQMITLVDesc gQMIWDSStartNetworkReqTLVs[] =
+{
+   QMI_TLV( 0x31, sQMIWDSStartNetworkReqMsg, mProfileIndex ),
+};
+
+static const sQMIMsgDesc gQMIWDSStartNetworkReq =
+   QMI_MSG_DESC( 0x0020, gQMIWDSStartNetworkReqTLVs );
+
+// QMI WDS STOP NETWORK INTERFACE REQ
+typedef struct sQMIWDSStopNetworkReqMsg
+{
+   u32               mPktDataHandle;
+} sQMIWDSStopNetworkReqMsg;
+
+static const sQMITLVDesc gQMIWDSStopNetworkReqTLVs[] =
+{
+   QMI_TLV( 0x01, sQMIWDSStopNetworkReqMsg, mPktDataHandle ),
+};
+
+static const sQMIMsgDesc gQMIWDSStopNetworkReq =
+   QMI_MSG_DESC( 0x0021, gQMIWDSStopNetworkReqTLVs );
+
+// QMI WDS GET RUNTIME SETTINGS REQ
+typedef struct sQMIWDSGetRuntimeSettingsReqMsg
+{
+   u32               mRequestedSettings;
+} sQMIWDSGetRuntimeSettingsReqMsg;
+
+static const sQMITLVDesc gQMIWDSGetRuntimeSettingsReqTLVs[] =
+{
+   QMI_TLV( 0x10, sQMIWDSGetRuntimeSettingsReqMsg, mRequestedSettings ),
+};
+
+static const sQMIMsgDesc gQMIWDSGetRuntimeSettingsReq =
+   QMI_MSG_DESC( 0x002D, gQMIWDSGetRuntimeSettingsReqTLVs );
+
+// QMI WDS SET CLIENT IP FAMILY PREF REQ
+typedef struct sQMIWDSSetIPFamilyPrefReqMsg
+{
+   u8                mIPPreference;
+} sQMIWDSSetIPFamilyPrefReqMsg;
+
+static const sQMITLVDesc gQMIWDSSetIPFamilyPrefReqTLVs[] =
+{
+   QMI_TLV( 0x01, sQMIWDSSetIPFamilyPrefReqMsg, mIPPreference ),
+};
+
+static const sQMIMsgDesc gQMIWDSSetIPFamilyPrefReq =
+   QMI_MSG_DESC( 0x004D, gQMIWDSSetIPFamilyPrefReqTLVs );
+
+// QMI WDS BIND MUX DATA PORT REQ
+typedef struct sQMIWDSBindMuxPortReqMsg
+{
+   sQMIEndpointID    mEndpoint;
+   u8                mMuxID;
+   u32               mClientType;
+} sQMIWDSBindMuxPortReqMsg;
+
+static const sQMITLVDesc gQMIWDSBindMuxPortReqTLVs[] =
+{
+   QMI_TLV( 0x10, sQMIWDSBindMuxPortReqMsg, mEndpoint ),
+   QMI_TLV( 0x11, sQMIWDSBindMuxPortReqMsg, mMuxID ),
+   QMI_TLV( 0x13, sQMIWDSBindMuxPortReqMsg, mClientType ),
+};
+
+static const sQMIMsgDesc gQMIWDSBindMuxPortReq =
+   QMI_MSG_DESC( 0x00A2, gQMIWDSBindMuxPortReqTLVs );
+
 /*===========================================================================
 METHOD:
    QMUXHeaderSize (Public Method)
@@ -88,7 +270,7 @@ RETURN VALUE:
 ===========================================================================*/
 u16 QMIWDSSetEventReportReqSize( void )
 {
-   return sizeof( sQMUX ) + 15;
+   return QMIEncodedMsgSize( &gQMIWDSSetEventReportReq );
 }
 
 /*===========================================================================
@@ -103,28 +285,24 @@ RETURN VALUE:
 ===========================================================================*/
 u16 QMIWDSGetPKGSRVCStatusReqSize( void )
 {
-   return sizeof( sQMUX ) + 7;
+   return QMIEncodedMsgSize( &gQMIWDSGetPKGSRVCStatusReq );
 }
 
 u16 QMIWDSStartNetworkReqSize( void )
 {
-   return sizeof( sQMUX ) + 7 + 4;
+   return QMIEncodedMsgSize( &gQMIWDSStartNetworkReq );
 }
 u16 QMIWDASetDataFormatReqSettingsSize( void )
 {
-   return sizeof( sQMUX ) + 11;
+   return QMIEncodedMsgSize( &gQMIWDAQOSFormatReq );
 }
 u16 QMIWDASetDataFormatReqSize( void )
 {
-#ifdef TX_AGGR
-   return sizeof( sQMUX ) + 71;
-#else
-   return sizeof( sQMUX ) + 57;
-#endif
+   return QMIEncodedMsgSize( &gQMIWDASetDataFormatReq );
 }
 u16 QMIWDSGetRuntimeSettingsReqSize( void )
 {
-   return sizeof( sQMUX ) + 14;
+   return QMIEncodedMsgSize( &gQMIWDSGetRuntimeSettingsReq );
 }
 /*===========================================================================
 METHOD:
@@ -138,7 +316,7 @@ RETURN VALUE:
 ===========================================================================*/
 u16 QMIDMSGetMEIDReqSize( void )
 {
-   return sizeof( sQMUX ) + 7;
+   return QMIEncodedMsgSize( &gQMIDMSGetMEIDReq );
 }
 
 /*=========================================================================*/
@@ -374,6 +552,369 @@ int GetQMIMessageID(
    }
 }
 
+/*===========================================================================
+METHOD:
+   QMIEncodedMsgSize (Public Method)
+
+DESCRIPTION:
+   Get size of buffer needed for QMUX + a QMI service request described
+   by pDesc
+
+PARAMETERS
+   pDesc          [ I ] - Message description
+
+RETURN VALUE:
+   u16 - size of buffer
+===========================================================================*/
+u16 QMIEncodedMsgSize( const sQMIMsgDesc * pDesc )
+{
+   u16 size = sizeof( sQMUX ) + 7;
+   u16 i;
+
+   for (i = 0; i < pDesc->mNumTLVs; i++)
+   {
+      size += 3 + pDesc->mpTLVs[i].mSize;
+   }
+
+   return size;
+}
+
+/*===========================================================================
+METHOD:
+   QMIEncodeMsg (Public Method)
+
+DESCRIPTION:
+   Fill buffer with a QMI service request described by pDesc, taking the
+   TLV values from the message struct pMsg, in a single pass
+
+PARAMETERS
+   pBuffer         [ 0 ] - Buffer to be filled
+   buffSize        [ I ] - Size of pBuffer
+   transactionID   [ I ] - Transaction ID
+   pDesc           [ I ] - Message description
+   pMsg            [ I ] - Message struct, may be NULL if there are no TLVs
+
+RETURN VALUE:
+   int - Positive for resulting size of pBuffer
+         Negative errno for error
+===========================================================================*/
+int QMIEncodeMsg(
+   void *                  pBuffer,
+   u16                     buffSize,
+   u16                     transactionID,
+   const sQMIMsgDesc *     pDesc,
+   const void *            pMsg )
+{
+   const sQMITLVDesc * pTLV;
+   u8 * pOut;
+   u32 pos;
+   u16 i;
+
+   if (pBuffer == 0
+   ||  pDesc == 0
+   ||  (pDesc->mNumTLVs != 0 && pMsg == 0)
+   ||  buffSize < sizeof( sQMUX ) + 7)
+   {
+      return -ENOMEM;
+   }
+
+   pOut = (u8 *)pBuffer + sizeof( sQMUX );
+   buffSize -= sizeof( sQMUX );
+
+   // Request
+   *(u8 *)(pOut) = QMI_REQUEST_CONTROL_FLAG;
+   // Transaction ID
+   *(u16 *)(pOut + 1) = transactionID;
+   // Message ID
+   *(u16 *)(pOut + 3) = pDesc->mMessageID;
+
+   pos = 7;
+   for (i = 0; i < pDesc->mNumTLVs; i++)
+   {
+      pTLV = &pDesc->mpTLVs[i];
+      if (pos + 3 + pTLV->mSize > buffSize)
+      {
+         return -ENOMEM;
+      }
+
+      *(u8 *)(pOut + pos) = pTLV->mType;
+      *(u16 *)(pOut + pos + 1) = pTLV->mSize;
+      memcpy( pOut + pos + 3, (const u8 *)pMsg + pTLV->mOffset, pTLV->mSize );
+      pos += 3 + pTLV->mSize;
+   }
+
+   // Size of TLV's
+   *(u16 *)(pOut + 5) = pos - 7;
+
+   // success
+   return sizeof( sQMUX ) + pos;
+}
+
+/*===========================================================================
+METHOD:
+   QMIIndexTLVs (Public Method)
+
+DESCRIPTION:
+   Record type, position and length of every TLV of a QMI message in a
+   single scan; TLVs running past the end of the message are dropped.
+   Only the first QMI_TLV_INDEX_MAX TLVs are recorded, mbOverflow tells
+   lookups to scan the rest of the message for the others
+
+   QMI Message shall NOT include SDU
+
+PARAMETERS
+   pQMIMessage    [ I ] - QMI Message buffer
+   messageLen     [ I ] - Size of QMI Message buffer
+   pIndex         [ O ] - Index to be filled
+
+RETURN VALUE:
+   int - Positive for message ID
+         Negative errno for error
+===========================================================================*/
+int QMIIndexTLVs(
+   void *            pQMIMessage,
+   u16               messageLen,
+   sQMITLVIndex *    pIndex )
+{
+   u8 * pMessage = pQMIMessage;
+   u32 pos;
+   u16 tlvSize;
+   u16 count = 0;
+
+   if (pQMIMessage == 0 || pIndex == 0)
+   {
+      return -ENOMEM;
+   }
+
+   pIndex->mpMessage = pMessage;
+   pIndex->mMessageLen = messageLen;
+   pIndex->mCount = 0;
+   pIndex->mbOverflow = false;
+
+   if (messageLen < 4)
+   {
+      return -ENODATA;
+   }
+
+   for (pos = 4; pos + 3 <= messageLen; pos += 3 + tlvSize)
+   {
+      tlvSize = *(u16 *)(pMessage + pos + 1);
+      if (pos + 3 + tlvSize > messageLen)
+      {
+         break;
+      }
+
+      if (count == QMI_TLV_INDEX_MAX)
+      {
+         pIndex->mbOverflow = true;
+         break;
+      }
+
+      pIndex->mTypes[count] = pMessage[pos];
+      pIndex->mOffsets[count] = pos + 3;
+      pIndex->mLengths[count] = tlvSize;
+      count++;
+   }
+   pIndex->mCount = count;
+
+   return *(u16 *)pMessage;
+}
+
+/*===========================================================================
+METHOD:
+   QMIIndexFindTLV (Private Method)
+
+DESCRIPTION:
+   Find the first TLV of a given type in a message indexed by
+   QMIIndexTLVs(), scanning past the recorded TLVs if the index overflowed
+
+PARAMETERS
+   pIndex         [ I ] - Index of the QMI message
+   type           [ I ] - Desired Type
+   pOffset        [ O ] - Offset of the value in the QMI message
+   pLength        [ O ] - Length of the value
+
+RETURN VALUE:
+   bool - true if the TLV was found
+===========================================================================*/
+static bool QMIIndexFindTLV(
+   const sQMITLVIndex * pIndex,
+   u8                   type,
+   u16 *                pOffset,
+   u16 *                pLength )
+{
+   u32 pos;
+   u16 tlvSize;
+   u16 i;
+
+   for (i = 0; i < pIndex->mCount; i++)
+   {
+      if (pIndex->mTypes[i] == type)
+      {
+         *pOffset = pIndex->mOffsets[i];
+         *pLength = pIndex->mLengths[i];
+         return true;
+      }
+   }
+
+   if (pIndex->mbOverflow == false)
+   {
+      return false;
+   }
+
+   // Linear scan from the first TLV that did not fit in the index
+   pos = pIndex->mOffsets[pIndex->mCount - 1]
+       + pIndex->mLengths[pIndex->mCount - 1];
+   for (; pos + 3 <= pIndex->mMessageLen; pos += 3 + tlvSize)
+   {
+      tlvSize = *(u16 *)(pIndex->mpMessage + pos + 1);
+      if (pos + 3 + tlvSize > pIndex->mMessageLen)
+      {
+         break;
+      }
+
+      if (pIndex->mpMessage[pos] == type)
+      {
+         *pOffset = pos + 3;
+         *pLength = tlvSize;
+         return true;
+      }
+   }
+
+   return false;
+}
+
+/*===========================================================================
+METHOD:
+   QMIIndexGetTLV (Public Method)
+
+DESCRIPTION:
+   Get data buffer of a specified TLV from a message indexed by
+   QMIIndexTLVs(), same results as GetTLV()
+
+PARAMETERS
+   pIndex         [ I ] - Index of the QMI message
+   type           [ I ] - Desired Type
+   pOutDataBuf    [ O ] - Buffer to be filled with TLV
+   bufferLen      [ I ] - Size of pOutDataBuf
+
+RETURN VALUE:
+   int - Size of TLV for success
+         Negative errno for error
+===========================================================================*/
+int QMIIndexGetTLV(
+   const sQMITLVIndex * pIndex,
+   u8                   type,
+   void *               pOutDataBuf,
+   u16                  bufferLen )
+{
+   u16 offset;
+   u16 length;
+
+   if (pIndex == 0 || pOutDataBuf == 0)
+   {
+      return -ENOMEM;
+   }
+
+   if (QMIIndexFindTLV( pIndex, type, &offset, &length ) == false)
+   {
+      return -ENOMSG;
+   }
+
+   if (bufferLen < length)
+   {
+      return -ENOMEM;
+   }
+
+   memcpy( pOutDataBuf, pIndex->mpMessage + offset, length );
+   return length;
+}
+
+/*===========================================================================
+METHOD:
+   QMIIndexResult (Public Method)
+
+DESCRIPTION:
+   Check mandatory TLV in a message indexed by QMIIndexTLVs(), same
+   results as ValidQMIMessage()
+
+PARAMETERS
+   pIndex         [ I ] - Index of the QMI message
+
+RETURN VALUE:
+   int - 0 for success (no error)
+         Negative errno for error
+         Positive for QMI error code
+===========================================================================*/
+int QMIIndexResult( const sQMITLVIndex * pIndex )
+{
+   u16 mandTLV[2];
+
+   if (QMIIndexGetTLV( pIndex, 2, &mandTLV[0], 4 ) != 4)
+   {
+      return -ENOMSG;
+   }
+
+   // Found TLV
+   if (mandTLV[0] != 0)
+   {
+      return mandTLV[1];
+   }
+
+   return 0;
+}
+
+/*===========================================================================
+METHOD:
+   QMIDecodeMsg (Public Method)
+
+DESCRIPTION:
+   Copy the TLVs described by pDesc from an indexed QMI message into the
+   message struct pMsg; members whose TLV is missing or does not have
+   the expected size are left untouched
+
+PARAMETERS
+   pIndex         [ I ] - Index of the QMI message
+   pDesc          [ I ] - Message description
+   pMsg           [ O ] - Message struct
+
+RETURN VALUE:
+   u32 - Bit i set if entry i of pDesc->mpTLVs was filled in
+===========================================================================*/
+u32 QMIDecodeMsg(
+   const sQMITLVIndex * pIndex,
+   const sQMIMsgDesc *  pDesc,
+   void *               pMsg )
+{
+   const sQMITLVDesc * pTLV;
+   u32 found = 0;
+   u16 offset;
+   u16 length;
+   u16 i;
+
+   if (pIndex == 0 || pDesc == 0 || pMsg == 0)
+   {
+      return 0;
+   }
+
+   for (i = 0; i < pDesc->mNumTLVs && i < 32; i++)
+   {
+      pTLV = &pDesc->mpTLVs[i];
+      if (QMIIndexFindTLV( pIndex, pTLV->mType, &offset, &length ) == true
+      &&  length == pTLV->mSize)
+      {
+         memcpy( (u8 *)pMsg + pTLV->mOffset,
+                 pIndex->mpMessage + offset,
+                 pTLV->mSize );
+         found |= 1u << i;
+      }
+   }
+
+   return found;
+}
+
+#ifndef QMI_CODEC_USER
+
 /*=========================================================================*/
 // Fill Buffers with QMI requests
 /*=========================================================================*/
@@ -541,58 +1082,32 @@ int QMIWDSSetEventReportReq(
    u16      buffSize,
    u16      transactionID )
 {
-   if (pBuffer == 0 || buffSize < QMIWDSSetEventReportReqSize() )
-   {
-      return -ENOMEM;
-   }
+   sQMIWDSSetEventReportReqMsg msg;
 
-   // QMI WDS SET EVENT REPORT REQ
-   // Request
-   *(u8 *)(pBuffer + sizeof( sQMUX ))  = 0x00;
-   // Transaction ID
-   *(u16 *)(pBuffer + sizeof( sQMUX ) + 1) = transactionID;
-   // Message ID
-   *(u16 *)(pBuffer + sizeof( sQMUX ) + 3) = 0x0001;
-   // Size of TLV's
-   *(u16 *)(pBuffer + sizeof( sQMUX ) + 5) = 0x0008;
-      // Report channel rate TLV
-      *(u8 *)(pBuffer + sizeof( sQMUX ) + 7)  = 0x11;
-      // Size
-      *(u16 *)(pBuffer + sizeof( sQMUX ) + 8) = 0x0005;
-      // Stats period
-      *(u8 *)(pBuffer + sizeof( sQMUX ) + 10)  = 0x01;
-      // Stats mask
-      *(u32 *)(pBuffer + sizeof( sQMUX ) + 11)  = 0x000000ff;
+   // Report channel rate
+   msg.mChannelRate.mStatsPeriod = 0x01;
+   msg.mChannelRate.mStatsMask = 0x000000ff;
 
-   // success
-   return sizeof( sQMUX ) + 15;
+   return QMIEncodeMsg( pBuffer,
+                        buffSize,
+                        transactionID,
+                        &gQMIWDSSetEventReportReq,
+                        &msg );
 }
 int QMIWDASetDataFormatReqSettings(
       void *   pBuffer,
       u16      buffSize,
       u16      transactionID )
 {
-   if (pBuffer == 0 || buffSize < QMIWDASetDataFormatReqSettingsSize() )
-   {
-      return -ENOMEM;
-   }
+   sQMIWDAQOSFormatReqMsg msg;
 
-   // QMI WDA SET DATA FORMAT REQ
-   // Request
-   *(u8 *)(pBuffer + sizeof( sQMUX ))  = 0x00;
-   // Transaction ID
-   *(u16 *)(pBuffer + sizeof( sQMUX ) + 1) = transactionID;
-   // Message ID
-   *(u16 *)(pBuffer + sizeof( sQMUX ) + 3) = 0x002B;
-   // Size of TLV's
-   //*(u16 *)(pBuffer + sizeof( sQMUX ) + 5) = 0x001C;
-   *(u16 *)(pBuffer + sizeof( sQMUX ) + 5) = 0x0004;
-   *(u8 *)(pBuffer + sizeof( sQMUX ) + 7)  = 0x10;
-   *(u16 *)(pBuffer + sizeof( sQMUX ) + 8) = 0x0001;
-   *(u8 *)(pBuffer + sizeof( sQMUX ) + 10)  = 0x00;
+   msg.mQOSFormat = 0x00;
 
-   // success
-   return sizeof( sQMUX ) + 11;
+   return QMIEncodeMsg( pBuffer,
+                        buffSize,
+                        transactionID,
+                        &gQMIWDAQOSFormatReq,
+                        &msg );
 }
 
 
@@ -618,89 +1133,31 @@ int QMIWDASetDataFormatReq(
       u16      transactionID,
       sGobiUSBNet * pDev)
 {
-   if (pBuffer == 0 || buffSize < QMIWDASetDataFormatReqSize() )
-   {
-      return -ENOMEM;
-   }
-
-   // QMI WDA SET DATA FORMAT REQ
-   // Request
-   *(u8 *)(pBuffer + sizeof( sQMUX ))  = 0x00;
-   // Transaction ID
-   *(u16 *)(pBuffer + sizeof( sQMUX ) + 1) = transactionID;
-   // Message ID
-   *(u16 *)(pBuffer + sizeof( sQMUX ) + 3) = 0x0020;
-   // Size of TLV's
-   //*(u16 *)(pBuffer + sizeof( sQMUX ) + 5) = 0x001C;
+   sQMIWDASetDataFormatReqMsg msg;
+
+   msg.mQOSFormat = 0x00;
+   // Link Layer protocol, IP is enabled
+   msg.mLinkProtocol = 0x00000002;
+   // UL and DL QMAP is enabled
+   msg.mULAggProtocol = 0x00000005;
+   msg.mDLAggProtocol = 0x00000005;
+   // DL Data aggregation Max datagrams and size
+   msg.mDLMaxDatagrams = pDev->DLAggregationMaxDatagram;
+   msg.mDLMaxSize = pDev->DLAggregationMaxSize;
+   // Peripheral endpoint, HSUSB
+   msg.mEndpoint.mEpType = 0x00000002;
+   msg.mEndpoint.mIfaceID = pDev->mpEndpoints->mIntfNum;
 #ifdef TX_AGGR
-   *(u16 *)(pBuffer + sizeof( sQMUX ) + 5) = 0x0040;
-#else
-   *(u16 *)(pBuffer + sizeof( sQMUX ) + 5) = 0x0032;
+   // UL Data aggregation Max datagrams and size
+   msg.mULMaxDatagrams = pDev->ULAggregationMaxDatagram;
+   msg.mULMaxSize = pDev->ULAggregationMaxSize;
 #endif
-   *(u8 *)(pBuffer + sizeof( sQMUX ) + 7)  = 0x10;
-   *(u16 *)(pBuffer + sizeof( sQMUX ) + 8) = 0x0001;
-   *(u8 *)(pBuffer + sizeof( sQMUX ) + 10)  = 0x00;
-   // Link Layer protocol
-   *(u8 *)(pBuffer + sizeof( sQMUX ) + 11)  = 0x11;
-   // Size
-   *(u16 *)(pBuffer + sizeof( sQMUX ) + 12) = 0x0004;
-   // IP is enabled
-   *(u32 *)(pBuffer + sizeof( sQMUX ) + 14) = 0x00000002;
-   // UL Data aggregation protocol
-   *(u8 *)(pBuffer + sizeof( sQMUX ) + 18)  = 0x12;
-   // Size
-   *(u16 *)(pBuffer + sizeof( sQMUX ) + 19) = 0x0004;
-   // UL QMAP is enabled
-   *(u32 *)(pBuffer + sizeof( sQMUX ) + 21) = 0x00000005;
-
-   // DL Data aggregation protocol
-   *(u8 *)(pBuffer + sizeof( sQMUX ) + 25)  = 0x13;
-   // Size
-   *(u16 *)(pBuffer + sizeof( sQMUX ) + 26) = 0x0004;
-   // DL QMAP is enabled
-   *(u32 *)(pBuffer + sizeof( sQMUX ) + 28) = 0x00000005;
-   // DL Data aggregation Max datagrams
-   *(u8 *)(pBuffer + sizeof( sQMUX ) + 32)  = 0x15;
-   // Size
-   *(u16 *)(pBuffer + sizeof( sQMUX ) + 33) = 0x0004;
-   // Datagram is set as 32768
-   *(u32 *)(pBuffer + sizeof( sQMUX ) + 35) = pDev->DLAggregationMaxDatagram;
-   // DL Data aggregation Max datagrams
-   *(u8 *)(pBuffer + sizeof( sQMUX ) + 39)  = 0x16;
-   // Size
-   *(u16 *)(pBuffer + sizeof( sQMUX ) + 40) = 0x0004;
-   // Datagram is set as 32768
-   *(u32 *)(pBuffer + sizeof( sQMUX ) + 42) = pDev->DLAggregationMaxSize;
-
-   // DL Data aggregation Max datagrams
-   *(u8 *)(pBuffer + sizeof( sQMUX ) + 46)  = 0x17;
-   // Size
-   *(u16 *)(pBuffer + sizeof( sQMUX ) + 47) = 0x0008;
-   // Datagram is set as 32768
-   *(u32 *)(pBuffer + sizeof( sQMUX ) + 49) = 0x00000002;
-   *(u32 *)(pBuffer + sizeof( sQMUX ) + 53) = pDev->mpEndpoints->mIntfNum;
-
-#ifdef TX_AGGR
-   // UL Data aggregation Max datagrams
-   *(u8 *)(pBuffer + sizeof( sQMUX ) + 57)  = 0x1B;
-   // Size
-   *(u16 *)(pBuffer + sizeof( sQMUX ) + 58) = 0x0004;
-   // Max Datagram set to 32
-   *(u32 *)(pBuffer + sizeof( sQMUX ) + 60) = pDev->ULAggregationMaxDatagram;
-
-   // UL Data aggregation Max datagrams size
-   *(u8 *)(pBuffer + sizeof( sQMUX ) + 64)  = 0x1C;
-   // Size
-   *(u16 *)(pBuffer + sizeof( sQMUX ) + 65) = 0x0004;
-   // Datagram is set as 32768
-   *(u32 *)(pBuffer + sizeof( sQMUX ) + 67) = pDev->ULAggregationMaxSize;
 
-   // success
-   return sizeof( sQMUX ) + 71;
-#else
-   // success
-   return sizeof( sQMUX ) + 57;
-#endif
+   return QMIEncodeMsg( pBuffer,
+                        buffSize,
+                        transactionID,
+                        &gQMIWDASetDataFormatReq,
+                        &msg );
 }
 
 /*===========================================================================
@@ -724,23 +1181,11 @@ int QMIWDSGetPKGSRVCStatusReq(
    u16      buffSize,
    u16      transactionID )
 {
-   if (pBuffer == 0 || buffSize < QMIWDSGetPKGSRVCStatusReqSize() )
-   {
-      return -ENOMEM;
-   }
-
-   // QMI WDS Get PKG SRVC Status REQ
-   // Request
-   *(u8 *)(pBuffer + sizeof( sQMUX ))  = 0x00;
-   // Transaction ID
-   *(u16 *)(pBuffer + sizeof( sQMUX ) + 1) = transactionID;
-   // Message ID
-   *(u16 *)(pBuffer + sizeof( sQMUX ) + 3) = 0x0022;
-   // Size of TLV's
-   *(u16 *)(pBuffer + sizeof( sQMUX ) + 5) = 0x0000;
-
-   // success
-   return sizeof( sQMUX ) + 7;
+   return QMIEncodeMsg( pBuffer,
+                        buffSize,
+                        transactionID,
+                        &gQMIWDSGetPKGSRVCStatusReq,
+                        NULL );
 }
 
 /*===========================================================================
@@ -764,23 +1209,11 @@ int QMIDMSGetMEIDReq(
    u16      buffSize,
    u16      transactionID )
 {
-   if (pBuffer == 0 || buffSize < QMIDMSGetMEIDReqSize() )
-   {
-      return -ENOMEM;
-   }
-
-   // QMI DMS GET SERIAL NUMBERS REQ
-   // Request
-   *(u8 *)(pBuffer + sizeof( sQMUX ))  = 0x00;
-   // Transaction ID
-   *(u16 *)(pBuffer + sizeof( sQMUX ) + 1) = transactionID;
-   // Message ID
-   *(u16 *)(pBuffer + sizeof( sQMUX ) + 3) = 0x0025;
-   // Size of TLV's
-   *(u16 *)(pBuffer + sizeof( sQMUX ) + 5) = 0x0000;
-
-  // success
-  return sizeof( sQMUX ) + 7;
+   return QMIEncodeMsg( pBuffer,
+                        buffSize,
+                        transactionID,
+                        &gQMIDMSGetMEIDReq,
+                        NULL );
 }
 
 /*=========================================================================*/
@@ -808,6 +1241,7 @@ int QMICTLGetClientIDResp(
    u16    buffSize,
    u16 *  pClientID )
 {
+   sQMITLVIndex index;
    int result;
    u8 offset = 0;
    // Ignore QMUX and SDU
@@ -822,19 +1256,19 @@ int QMICTLGetClientIDResp(
    pBuffer = pBuffer + offset;
    buffSize -= offset;
 
-   result = GetQMIMessageID( pBuffer, buffSize );
+   result = QMIIndexTLVs( pBuffer, buffSize, &index );
    if (result != 0x22)
    {
       return -EFAULT;
    }
 
-   result = ValidQMIMessage( pBuffer, buffSize );
+   result = QMIIndexResult( &index );
    if (result != 0)
    {
       return -EFAULT;
    }
 
-   result = GetTLV( pBuffer, buffSize, 0x01, pClientID, 2 );
+   result = QMIIndexGetTLV( &index, 0x01, pClientID, 2 );
    if (result != 2)
    {
       return -EFAULT;
@@ -862,6 +1296,7 @@ int QMICTLReleaseClientIDResp(
    void *   pBuffer,
    u16      buffSize )
 {
+   sQMITLVIndex index;
    int result;
    u8 offset = 0;
    // Ignore QMUX and SDU
@@ -876,13 +1311,13 @@ int QMICTLReleaseClientIDResp(
    pBuffer = pBuffer + offset;
    buffSize -= offset;
 
-   result = GetQMIMessageID( pBuffer, buffSize );
+   result = QMIIndexTLVs( pBuffer, buffSize, &index );
    if (result != 0x23)
    {
       return -EFAULT;
    }
 
-   result = ValidQMIMessage( pBuffer, buffSize );
+   result = QMIIndexResult( &index );
    if (result != 0)
    {
       return -EFAULT;
@@ -933,6 +1368,7 @@ int QMIWDSEventResp(
    bool *   pbLinkState,
    bool *   pbReconfigure )
 {
+   sQMITLVIndex index;
    int result;
    u8 pktStatusRead[2];
    u8 offset = 0;
@@ -960,24 +1396,24 @@ int QMIWDSEventResp(
 
    // Note: Indications.  No Mandatory TLV required
 
-   result = GetQMIMessageID( pBuffer, buffSize );
+   result = QMIIndexTLVs( pBuffer, buffSize, &index );
    // QMI WDS Set Event Report Resp
    if (result == 0x01)
    {
       // TLV's are not mandatory
-      GetTLV( pBuffer, buffSize, 0x10, (void*)pTXOk, 4 );
-      GetTLV( pBuffer, buffSize, 0x11, (void*)pRXOk, 4 );
-      GetTLV( pBuffer, buffSize, 0x12, (void*)pTXErr, 4 );
-      GetTLV( pBuffer, buffSize, 0x13, (void*)pRXErr, 4 );
-      GetTLV( pBuffer, buffSize, 0x14, (void*)pTXOfl, 4 );
-      GetTLV( pBuffer, buffSize, 0x15, (void*)pRXOfl, 4 );
-      GetTLV( pBuffer, buffSize, 0x19, (void*)pTXBytesOk, 8 );
-      GetTLV( pBuffer, buffSize, 0x1A, (void*)pRXBytesOk, 8 );
+      QMIIndexGetTLV( &index, 0x10, (void*)pTXOk, 4 );
+      QMIIndexGetTLV( &index, 0x11, (void*)pRXOk, 4 );
+      QMIIndexGetTLV( &index, 0x12, (void*)pTXErr, 4 );
+      QMIIndexGetTLV( &index, 0x13, (void*)pRXErr, 4 );
+      QMIIndexGetTLV( &index, 0x14, (void*)pTXOfl, 4 );
+      QMIIndexGetTLV( &index, 0x15, (void*)pRXOfl, 4 );
+      QMIIndexGetTLV( &index, 0x19, (void*)pTXBytesOk, 8 );
+      QMIIndexGetTLV( &index, 0x1A, (void*)pRXBytesOk, 8 );
    }
    // QMI WDS Get PKG SRVC Status Resp
    else if ((result == 0x22)|| (result == 0x20))
    {
-      result = GetTLV( pBuffer, buffSize, 0x01, &pktStatusRead[0], 2 );
+      result = QMIIndexGetTLV( &index, 0x01, &pktStatusRead[0], 2 );
       // 1 or 2 bytes may be received
       if (result >= 1)
       {
@@ -1039,6 +1475,7 @@ int QMIDMSGetMEIDResp(
    char *   pMEID,
    int      meidSize )
 {
+   sQMITLVIndex index;
    int result;
    u8 offset = 0;
    // Ignore QMUX and SDU
@@ -1052,19 +1489,19 @@ int QMIDMSGetMEIDResp(
    pBuffer = pBuffer + offset;
    buffSize -= offset;
 
-   result = GetQMIMessageID( pBuffer, buffSize );
+   result = QMIIndexTLVs( pBuffer, buffSize, &index );
    if (result != 0x25)
    {
       return -EFAULT;
    }
 
-   result = ValidQMIMessage( pBuffer, buffSize );
+   result = QMIIndexResult( &index );
    if (result != 0)
    {
       return -EFAULT;
    }
 
-   result = GetTLV( pBuffer, buffSize, 0x12, (void*)pMEID, 14 );
+   result = QMIIndexGetTLV( &index, 0x12, (void*)pMEID, 14 );
    if (result != 14)
    {
       return -EFAULT;
@@ -1080,6 +1517,9 @@ int QMIWDASetDataFormatResp(
    u32 *    ULDatagram,
    u32 *    ULDatagramSize )
 {
+   sQMITLVIndex index;
+   sQMIWDASetDataFormatRespMsg msg;
+   u32 found;
    int result;
    u8 offset = 0;
    // Ignore QMUX and SDU
@@ -1093,58 +1533,38 @@ int QMIWDASetDataFormatResp(
    pBuffer = pBuffer + offset;
    buffSize -= offset;
 
-   result = GetQMIMessageID( pBuffer, buffSize );
+   result = QMIIndexTLVs( pBuffer, buffSize, &index );
    if (result != 0x20)
    {
       return -EFAULT;
    }
 
-   result = ValidQMIMessage( pBuffer, buffSize );
+   result = QMIIndexResult( &index );
    if (result != 0)
    {
       return -EFAULT;
    }
 
-#ifdef TX_AGGR
-   result = GetTLV( pBuffer, buffSize, 0x15, (void*)DLDatagram, 4 );
-   if (result != 4)
-   {
-      return -EFAULT;
-   }
+   found = QMIDecodeMsg( &index, &gQMIWDASetDataFormatResp, &msg );
 
-   result = GetTLV( pBuffer, buffSize, 0x16, (void*)DLDatagramSize, 4 );
-   if (result != 4)
-   {
-      return -EFAULT;
-   }
-
-   result = GetTLV( pBuffer, buffSize, 0x17, (void*)ULDatagram, 4 );
-   if (result != 4)
+   // DL sizes are mandatory, UL sizes too when UL aggregation is on
+#ifdef TX_AGGR
+   if (found != 0x0F)
+#else
+   if ((found & 0x03) != 0x03)
+#endif
    {
       return -EFAULT;
    }
 
-   result = GetTLV( pBuffer, buffSize, 0x18, (void*)ULDatagramSize, 4 );
-   if (result != 4)
-   {
-      return -EFAULT;
-   }
+   *DLDatagram = msg.mDLMaxDatagrams;
+   *DLDatagramSize = msg.mDLMaxSize;
+#ifdef TX_AGGR
+   *ULDatagram = msg.mULMaxDatagrams;
+   *ULDatagramSize = msg.mULMaxSize;
 
    QC_LOG_GLOBAL("\n\nDLDatagram : 0X%X, DLDatagramSize : 0X%X\n\n", *DLDatagram, *DLDatagramSize);
    QC_LOG_GLOBAL("\n\n ULDatagram : 0X%X, ULDatagramSize : 0X%X\n\n", *ULDatagram, *ULDatagramSize);
-#else
-   result = GetTLV( pBuffer, buffSize, 0x15, (void*)DLDatagram, 4 );
-   if (result != 4)
-   {
-      return -EFAULT;
-   }
-
-   result = GetTLV( pBuffer, buffSize, 0x16, (void*)DLDatagramSize, 4 );
-   if (result != 4)
-   {
-      return -EFAULT;
-   }
-
 #endif
    return 0;
 }
@@ -1154,28 +1574,16 @@ int QMIWDSStartNetworkReq(
    u16      transactionID,
    u8 profileid)
 {
-   if (pBuffer == 0)
-   {
-      return -ENOMEM;
-   }
+   sQMIWDSStartNetworkReqMsg msg;
 
-   // QMI WDS Get PKG SRVC Status REQ
-   // Request
-   *(u8 *)(pBuffer + sizeof( sQMUX ))  = 0x00;
-   // Transaction ID
-   *(u16 *)(pBuffer + sizeof( sQMUX ) + 1) = transactionID;
-   // Message ID
-   *(u16 *)(pBuffer + sizeof( sQMUX ) + 3) = 0x0020;
-   // Size of TLV's
-   *(u16 *)(pBuffer + sizeof( sQMUX ) + 5) = 0x0004;
+   // set Profile Id
+   msg.mProfileIndex = profileid;
 
-   // set Porfile Id
-   *(u8 *)(pBuffer + sizeof( sQMUX ) + 7) = 0x31;
-   *(u16 *)(pBuffer + sizeof( sQMUX ) + 8) = 0x0001;
-   *(u8 *)(pBuffer + sizeof( sQMUX ) + 10) = profileid;
-   
-   // success
-   return sizeof( sQMUX ) + 11;
+   return QMIEncodeMsg( pBuffer,
+                        buffSize,
+                        transactionID,
+                        &gQMIWDSStartNetworkReq,
+                        &msg );
 }
 
 int QMIWDSStartNetworkResp(
@@ -1184,6 +1592,7 @@ int QMIWDSStartNetworkResp(
    char *   pMEID,
    int      meidSize )
 {
+   sQMITLVIndex index;
    int result;
    u8 offset = 0;
    // Ignore QMUX and SDU
@@ -1192,21 +1601,21 @@ int QMIWDSStartNetworkResp(
    pBuffer = pBuffer + offset;
    buffSize -= offset;
 
-   result = GetQMIMessageID( pBuffer, buffSize );
+   result = QMIIndexTLVs( pBuffer, buffSize, &index );
    if (result != 0x20)
    {
       printk("GetQMIMessageID failed\n");
       return -EFAULT;
    }
 
-   result = ValidQMIMessage( pBuffer, buffSize );
+   result = QMIIndexResult( &index );
    if (result != 0)
    {
       printk("ValidQMIMessage failed\n");
       return -EFAULT;
    }
 
-   result = GetTLV( pBuffer, buffSize, 0x1, (void*)pMEID, 4 );
+   result = QMIIndexGetTLV( &index, 0x1, (void*)pMEID, 4 );
    if (result < 0 )
    {
       printk("GetTLV\n");
@@ -1222,28 +1631,15 @@ int QMIWDSStopNetworkReq(
    u16      transactionID,
    int      connectid)
 {
-   if (pBuffer == 0)
-   {
-      return -ENOMEM;
-   }
+   sQMIWDSStopNetworkReqMsg msg;
 
-   // QMI WDS Get PKG SRVC Status REQ
-   // Request
-   *(u8 *)(pBuffer + sizeof( sQMUX ))  = 0x00;
-   // Transaction ID
-   *(u16 *)(pBuffer + sizeof( sQMUX ) + 1) = transactionID;
-   // Message ID
-   *(u16 *)(pBuffer + sizeof( sQMUX ) + 3) = 0x0021;
-   // Size of TLV's
-   *(u16 *)(pBuffer + sizeof( sQMUX ) + 5) = 0x0007;
+   msg.mPktDataHandle = connectid;
 
-   // set Porfile Id
-   *(u8 *)(pBuffer + sizeof( sQMUX ) + 7) = 0x01;
-   *(u16 *)(pBuffer + sizeof( sQMUX ) + 8) = 0x0004;
-   *(u32 *)(pBuffer + sizeof( sQMUX ) + 10) = connectid;
-   
-   // success
-   return sizeof( sQMUX ) + 14;
+   return QMIEncodeMsg( pBuffer,
+                        buffSize,
+                        transactionID,
+                        &gQMIWDSStopNetworkReq,
+                        &msg );
 }
 
 int QMIWDSStopNetworkResp(
@@ -1252,6 +1648,7 @@ int QMIWDSStopNetworkResp(
    char *   pMEID,
    int      meidSize )
 {
+   sQMITLVIndex index;
    int result;
    u8 offset = 0;
    // Ignore QMUX and SDU
@@ -1260,14 +1657,14 @@ int QMIWDSStopNetworkResp(
    pBuffer = pBuffer + offset;
    buffSize -= offset;
 
-   result = GetQMIMessageID( pBuffer, buffSize );
+   result = QMIIndexTLVs( pBuffer, buffSize, &index );
    if (result != 0x20)
    {
       printk("GetQMIMessageID failed\n");
       return -EFAULT;
    }
 
-   result = ValidQMIMessage( pBuffer, buffSize );
+   result = QMIIndexResult( &index );
    if (result != 0)
    {
       printk("ValidQMIMessage failed\n");
@@ -1282,25 +1679,15 @@ int QMIWDSGetRuntimeSettingsReq(
    u16      buffSize,
    u16      transactionID )
 {
-   if (pBuffer == 0)
-   {
-      return -ENOMEM;
-   }
+   sQMIWDSGetRuntimeSettingsReqMsg msg;
 
-   // Request
-   *(u8 *)(pBuffer + sizeof( sQMUX ))  = 0x00;
-   // Transaction ID
-   *(u16 *)(pBuffer + sizeof( sQMUX ) + 1) = transactionID;
-   // Message ID
-   *(u16 *)(pBuffer + sizeof( sQMUX ) + 3) = 0x002D;
-   // Size of TLV's
-   *(u16 *)(pBuffer + sizeof( sQMUX ) + 5) = 0x0007;
+   msg.mRequestedSettings = 0x00002310;
 
-   *(u8 *)(pBuffer + sizeof( sQMUX ) + 7)  = 0x10;
-   *(u16 *)(pBuffer + sizeof( sQMUX ) + 8)  = 0x0004;
-   *(u32 *)(pBuffer + sizeof( sQMUX ) + 10)  = 0x00002310;
-   // success
-   return sizeof( sQMUX ) + 14;
+   return QMIEncodeMsg( pBuffer,
+                        buffSize,
+                        transactionID,
+                        &gQMIWDSGetRuntimeSettingsReq,
+                        &msg );
 }
 
 void PrintIPAddr(char *msg, unsigned int addr)
@@ -1477,6 +1864,7 @@ int QMIWDSGetRuntimeSettingsResp(
    u16      buffSize,
    sQMIDev *QMIDev)
 {
+   sQMITLVIndex index;
    unsigned int addr_tmp = 0;
    int result;
    int mtu;
@@ -1491,21 +1879,21 @@ int QMIWDSGetRuntimeSettingsResp(
    pBuffer = pBuffer + offset;
    buffSize -= offset;
 
-   result = GetQMIMessageID( pBuffer, buffSize );
+   result = QMIIndexTLVs( pBuffer, buffSize, &index );
    if (result != 0x2D)
    {
       printk("GetQMIMessageID failed\n");
       return -EFAULT;
    }
 
-   result = ValidQMIMessage( pBuffer, buffSize );
+   result = QMIIndexResult( &index );
    if (result != 0)
    {
       printk("ValidQMIMessage failed\n");
       return -EFAULT;
    }
 
-   result = GetTLV( pBuffer, buffSize, 0x21, (void*)&addr, 4 );
+   result = QMIIndexGetTLV( &index, 0x21, (void*)&addr, 4 );
    if (result > 0 ) 
    {
       PrintIPAddr("\nMask : ", addr);
@@ -1514,7 +1902,7 @@ int QMIWDSGetRuntimeSettingsResp(
       QMIDev->IPv4SubnetMask = addr;
    }
 
-   result = GetTLV( pBuffer, buffSize, 0x1E, (void*)&addr, 4 );
+   result = QMIIndexGetTLV( &index, 0x1E, (void*)&addr, 4 );
    if (result > 0 ) 
    {
       PrintIPAddr("\nIPv4 Addr : ", addr);
@@ -1531,7 +1919,7 @@ int QMIWDSGetRuntimeSettingsResp(
 
    }
 
-   result = GetTLV( pBuffer, buffSize, 0x20, (void*)&addr, 4 );
+   result = QMIIndexGetTLV( &index, 0x20, (void*)&addr, 4 );
    if (result > 0 ) 
    {
       PrintIPAddr("\nGateway : ", addr);
@@ -1553,21 +1941,21 @@ int QMIWDSGetRuntimeSettingsResp(
      kfree(netAddr);
    }
 
-   result = GetTLV( pBuffer, buffSize, 0x15, (void*)&addr, 4 );
+   result = QMIIndexGetTLV( &index, 0x15, (void*)&addr, 4 );
    if (result > 0 ) 
    {
       PrintIPAddr("\nPrimary DNS : ", addr);
       QMIDev->IPv4PrimaryDNS = addr;
    }
 
-   result = GetTLV( pBuffer, buffSize, 0x16, (void*)&addr, 4 );
+   result = QMIIndexGetTLV( &index, 0x16, (void*)&addr, 4 );
    if (result > 0 ) 
    {
       PrintIPAddr("\nSecondary DNS : ", addr);
       QMIDev->IPv4SecondaryDNS = addr;
    }
 
-   result = GetTLV( pBuffer, buffSize, 0x25, (void*)&ipv6, sizeof(ipv6_addr) );
+   result = QMIIndexGetTLV( &index, 0x25, (void*)&ipv6, sizeof(ipv6_addr) );
    if (result > 0 ) 
    {
       PrintIPV6Addr("\nIPV6 address : ", &ipv6);
@@ -1575,7 +1963,7 @@ int QMIWDSGetRuntimeSettingsResp(
       memcpy(&QMIDev->ipv6_address, &ipv6, sizeof(ipv6_addr));
    }
 
-   result = GetTLV( pBuffer, buffSize, 0x26, (void*)&ipv6, sizeof(ipv6_addr) );
+   result = QMIIndexGetTLV( &index, 0x26, (void*)&ipv6, sizeof(ipv6_addr) );
    if (result > 0 ) 
    {
       PrintIPV6Addr("\nIPV6 Gateway address : ", &ipv6);
@@ -1583,7 +1971,7 @@ int QMIWDSGetRuntimeSettingsResp(
       memcpy(&QMIDev->ipv6_gateway, &ipv6, sizeof(ipv6_addr));
    }
 
-   result = GetTLV( pBuffer, buffSize, 0x27, (void*)&ipv6, sizeof(ipv6_addr) );
+   result = QMIIndexGetTLV( &index, 0x27, (void*)&ipv6, sizeof(ipv6_addr) );
    if (result > 0 ) 
    {
       PrintIPV6Addr("\nIPV6 Primary DNS address : ", &ipv6);
@@ -1591,7 +1979,7 @@ int QMIWDSGetRuntimeSettingsResp(
       memcpy(&QMIDev->ipv6_primaydns, &ipv6, sizeof(ipv6_addr));
    }
 
-   result = GetTLV( pBuffer, buffSize, 0x28, (void*)&ipv6, sizeof(ipv6_addr) );
+   result = QMIIndexGetTLV( &index, 0x28, (void*)&ipv6, sizeof(ipv6_addr) );
    if (result > 0 ) 
    {
       PrintIPV6Addr("\nIPV6 Secondary DNS address : ", &ipv6);
@@ -1599,7 +1987,7 @@ int QMIWDSGetRuntimeSettingsResp(
       memcpy(&QMIDev->ipv6_secondarydns, &ipv6, sizeof(ipv6_addr));
    }
 
-   result = GetTLV( pBuffer, buffSize, 0x29, (void*)&mtu, 4 );
+   result = QMIIndexGetTLV( &index, 0x29, (void*)&mtu, 4 );
    if (result > 0 ) 
    {
       unsigned int MuxId;
@@ -1629,27 +2017,15 @@ int QMIWDSSetIPFamilyPrefReq(
    u16      transactionID,
    u8       ipType)
 {
-   if (pBuffer == 0)
-   {
-      return -ENOMEM;
-   }
+   sQMIWDSSetIPFamilyPrefReqMsg msg;
 
-   // QMI WDS Set Ip family pref REQ
-   // Request
-   *(u8 *)(pBuffer + sizeof( sQMUX ))  = 0x00;
-   // Transaction ID
-   *(u16 *)(pBuffer + sizeof( sQMUX ) + 1) = transactionID;
-   // Message ID
-   *(u16 *)(pBuffer + sizeof( sQMUX ) + 3) = 0x004D;
-   // Size of TLV's
-   *(u16 *)(pBuffer + sizeof( sQMUX ) + 5) = 0x0004;
-   // IP pref msg id, len and value as IPv4
-   *(u8 *)(pBuffer + sizeof( sQMUX ) + 7)  = 0x01;
-   *(u16 *)(pBuffer + sizeof( sQMUX ) + 8)  = 0x0001;
-   *(u8 *)(pBuffer + sizeof( sQMUX ) + 10)  = ipType;
+   msg.mIPPreference = ipType;
 
-   // success
-   return sizeof( sQMUX ) + 11;
+   return QMIEncodeMsg( pBuffer,
+                        buffSize,
+                        transactionID,
+                        &gQMIWDSSetIPFamilyPrefReq,
+                        &msg );
 }
 
 int QMIWDSBindMuxPortReq(
@@ -1659,39 +2035,21 @@ int QMIWDSBindMuxPortReq(
    sGobiUSBNet *pDev,
    sQMIDev *QMIDev)
 {
-   if (pBuffer == 0)
-   {
-      return -ENOMEM;
-   }
-
-   // QMI WDS BIND_MUX_DATA_PORT
-
-   // Request
-   *(u8 *)(pBuffer + sizeof( sQMUX ))  = 0x00;
-   // Transaction ID
-   *(u16 *)(pBuffer + sizeof( sQMUX ) + 1) = transactionID;
-   // Message ID
-   *(u16 *)(pBuffer + sizeof( sQMUX ) + 3) = 0x00a2;
-   // Size of TLV's
-   *(u16 *)(pBuffer + sizeof( sQMUX ) + 5) = 0x0016;
-   // ep type, len as 8 and value as HSUSB, Ifc number as 4
-   *(u8 *)(pBuffer + sizeof( sQMUX ) + 7)  = 0x10;
-   *(u16 *)(pBuffer + sizeof( sQMUX ) + 8)  = 0x0008;
-   *(u32 *)(pBuffer + sizeof( sQMUX ) + 10)  = 0x00000002; //HSUSB
-   *(u32 *)(pBuffer + sizeof( sQMUX ) + 14)  = pDev->mpEndpoints->mIntfNum; //Interface Num
-   // muxid , value is 0x81
-   *(u8 *)(pBuffer + sizeof( sQMUX ) + 18)  = 0x11;
-   *(u16 *)(pBuffer + sizeof( sQMUX ) + 19)  = 0x0001;
-   *(u8 *)(pBuffer + sizeof( sQMUX ) + 21)  = QMIDev->MuxId;
+   sQMIWDSBindMuxPortReqMsg msg;
 
+   // ep type as HSUSB and interface number
+   msg.mEndpoint.mEpType = 0x00000002;
+   msg.mEndpoint.mIfaceID = pDev->mpEndpoints->mIntfNum;
+   // muxid
+   msg.mMuxID = QMIDev->MuxId;
    // client type as tethered
-   *(u8 *)(pBuffer + sizeof( sQMUX ) + 22)  = 0x13;
-   *(u16 *)(pBuffer + sizeof( sQMUX ) + 23)  = 0x0004;
-   *(u8 *)(pBuffer + sizeof( sQMUX ) + 25)  = 0x00000001; //teathered
+   msg.mClientType = 0x00000001;
 
-
-   // success
-   return sizeof( sQMUX ) + 29;
+   return QMIEncodeMsg( pBuffer,
+                        buffSize,
+                        transactionID,
+                        &gQMIWDSBindMuxPortReq,
+                        &msg );
 }
 
 
@@ -1763,6 +2121,7 @@ int QMIWDSGetPktSrvcStatusInd (
    sQMIDev *QMIDev,
    u16 clientID)
 {
+   sQMITLVIndex index;
    struct net_device *net = NULL;
    struct ConnStatusData Status;
    char IFName[IFNAMSIZ];
@@ -1783,14 +2142,14 @@ int QMIWDSGetPktSrvcStatusInd (
    pBuffer = pBuffer + offset;
    buffSize -= offset;
 
-   result = GetQMIMessageID( pBuffer, buffSize );
+   result = QMIIndexTLVs( pBuffer, buffSize, &index );
    if (result != 0x0022)
    {
       QC_LOG_DBG(QMIDev, "GetQMIMessageID failed\n");
       return -EFAULT;
    }
 
-   result = GetTLV( pBuffer, buffSize, 0x01, &Status, sizeof(struct ConnStatusData) );
+   result = QMIIndexGetTLV( &index, 0x01, &Status, sizeof(struct ConnStatusData) );
    if (result > 0 ) 
    {
       MuxId = QMIDev->MuxId - 0x81;
@@ -1928,6 +2287,7 @@ int QMIWDSExtendedIPConfigInd (
    sQMIDev *QMIDev,
    u16 clientID)
 {
+   sQMITLVIndex index;
    int result;
    unsigned int status;
    u8 offset = 0;
@@ -1938,7 +2298,7 @@ int QMIWDSExtendedIPConfigInd (
    pBuffer = pBuffer + offset;
    buffSize -= offset;
 
-   result = GetQMIMessageID( pBuffer, buffSize );
+   result = QMIIndexTLVs( pBuffer, buffSize, &index );
    if (result != 0x008C)
    {
       printk("GetQMIMessageID failed\n");
@@ -1957,7 +2317,7 @@ int QMIWDSExtendedIPConfigInd (
      - Bit 20 -- MSISDN information
     */
 
-   result = GetTLV( pBuffer, buffSize, 0x10, &status, sizeof(uint32_t) );
+   result = QMIIndexGetTLV( &index, 0x10, &status, sizeof(uint32_t) );
    if (result > 0 ) 
    {
       if (status & 0x00002000)
@@ -1976,6 +2336,7 @@ int QMIWDSReverseIPTransportConnInd (
    u16      buffSize,
    sQMIDev *QMIDev)
 {
+   sQMITLVIndex index;
    int result;
    unsigned int mtu;
    u8 offset = 0;
@@ -1986,14 +2347,14 @@ int QMIWDSReverseIPTransportConnInd (
    pBuffer = pBuffer + offset;
    buffSize -= offset;
 
-   result = GetQMIMessageID( pBuffer, buffSize );
+   result = QMIIndexTLVs( pBuffer, buffSize, &index );
    if (result != 0x008E)
    {
       printk("GetQMIMessageID failed\n");
       return -EFAULT;
    }
 
-   result = GetTLV( pBuffer, buffSize, 0x15, (void*)&mtu, sizeof(uint32_t));
+   result = QMIIndexGetTLV( &index, 0x15, (void*)&mtu, sizeof(uint32_t));
    if (result > 0 )
    {
        unsigned int MuxId;
@@ -2017,3 +2378,5 @@ int QMIWDSReverseIPTransportConnInd (
 
    return 0;
 }
+
+#endif // QMI_CODEC_USER
@@ -16,6 +16,9 @@
 #define QMI_RESPONSE_CONTROL_FLAG 0x02
 #define QMI_INDICATION_CONTROL_FLAG 0x04
 
+// QMICTL uses a 1 byte SDU with its own flag values
+#define QMICTL_INDICATION_CONTROL_FLAG 0x02
+
 #define u8        unsigned char
 #define u16       unsigned short
 #define u32       unsigned int
@@ -93,6 +96,126 @@ int GetQMIMessageID(
    void *   pQMIMessage,
    u16      messageLen );
 
+/*=========================================================================*/
+// Table driven TLV codec
+//
+//    A message is described by a C struct with one member per TLV and a
+//    table of sQMITLVDesc mapping each TLV type to its member.  Adding an
+//    option to a message is one member plus one table entry.
+//
+//    QMIEncodeMsg()    - serializes a request in a single pass
+//    QMIIndexTLVs()    - records every TLV of a message in a single scan
+//    QMIIndexGetTLV()  - GetTLV() on the index, no rescan of the message
+//    QMIDecodeMsg()    - copies the indexed TLVs back into a struct
+/*=========================================================================*/
+
+// Maximum number of TLVs recorded by QMIIndexTLVs(), later ones are
+// found by a scan of the rest of the message
+#define QMI_TLV_INDEX_MAX     32
+
+// Describe member "field" of message struct "msg" as TLV "type"
+#define QMI_TLV( type, msg, field ) \
+   { (type), sizeof( ((msg *)0)->field ), offsetof( msg, field ) }
+
+// Describe a message from its ID and its table of sQMITLVDesc
+#define QMI_MSG_DESC( id, tlvs ) \
+   { (id), ARRAY_SIZE( tlvs ), (tlvs) }
+
+/*=========================================================================*/
+// Struct sQMITLVDesc
+//
+//    Structure that maps one TLV to a member of a message struct
+/*=========================================================================*/
+typedef struct sQMITLVDesc
+{
+   /* TLV type */
+   u8       mType;
+
+   /* Size of the value, which is the size of the member */
+   u16      mSize;
+
+   /* Offset of the member in the message struct */
+   u16      mOffset;
+
+} sQMITLVDesc;
+
+/*=========================================================================*/
+// Struct sQMIMsgDesc
+//
+//    Structure that describes a QMI message
+/*=========================================================================*/
+typedef struct sQMIMsgDesc
+{
+   /* QMI message ID */
+   u16                  mMessageID;
+
+   /* Number of entries in mpTLVs, at most 32 */
+   u16                  mNumTLVs;
+
+   /* TLVs in the order they are serialized */
+   const sQMITLVDesc *  mpTLVs;
+
+} sQMIMsgDesc;
+
+/*=========================================================================*/
+// Struct sQMITLVIndex
+//
+//    Structure that records where each TLV of a QMI message is
+/*=========================================================================*/
+typedef struct sQMITLVIndex
+{
+   /* Indexed QMI message (without QMUX and SDU) */
+   u8 *     mpMessage;
+
+   /* Size of the indexed QMI message */
+   u16      mMessageLen;
+
+   /* Number of TLVs found */
+   u16      mCount;
+
+   /* Message has more than QMI_TLV_INDEX_MAX TLVs */
+   bool     mbOverflow;
+
+   /* Type, value offset in mpMessage and value length of each TLV */
+   u8       mTypes[QMI_TLV_INDEX_MAX];
+   u16      mOffsets[QMI_TLV_INDEX_MAX];
+   u16      mLengths[QMI_TLV_INDEX_MAX];
+
+} sQMITLVIndex;
+
+// Get size of buffer needed for QMUX + a request described by pDesc
+u16 QMIEncodedMsgSize( const sQMIMsgDesc * pDesc );
+
+// Fill buffer with a QMI service request described by pDesc
+int QMIEncodeMsg(
+   void *                  pBuffer,
+   u16                     buffSize,
+   u16                     transactionID,
+   const sQMIMsgDesc *     pDesc,
+   const void *            pMsg );
+
+// Record all TLVs of a QMI message, returns the message ID
+int QMIIndexTLVs(
+   void *            pQMIMessage,
+   u16               messageLen,
+   sQMITLVIndex *    pIndex );
+
+// Get data buffer of a specified TLV from an indexed QMI message
+int QMIIndexGetTLV(
+   const sQMITLVIndex * pIndex,
+   u8                   type,
+   void *               pOutDataBuf,
+   u16                  bufferLen );
+
+// Check mandatory TLV in an indexed QMI message
+int QMIIndexResult( const sQMITLVIndex * pIndex );
+
+// Copy the indexed TLVs described by pDesc into a message struct
+u32 QMIDecodeMsg(
+   const sQMITLVIndex * pIndex,
+   const sQMIMsgDesc *  pDesc,
+   void *               pMsg );
+
 /*=========================================================================*/
 // Get sizes of buffers needed by QMI requests
 /*=========================================================================*/
@@ -125,6 +248,10 @@ u16 QMIWDASetDataFormatReqSettingsSize( void );
 u16 QMIWDSStartNetworkReqSize(void);
 u16 QMIWDSGetRuntimeSettingsReqSize(void);
 
+// Service requests and responses need the driver structures, the
+// userspace codec test (QMI_CODEC_USER) only builds what is above
+#ifndef QMI_CODEC_USER
+
 /*=========================================================================*/
 // Fill Buffers with QMI requests
 /*=========================================================================*/
@@ -319,3 +446,4 @@ unsigned short GetTransactionID(sQMIDev *QMIDev);
 
 void PrintIPV6Addr(char *msg, ipv6_addr * addr);
 
+#endif // QMI_CODEC_USER
@@ -0,0 +1,314 @@
+/*===========================================================================
+FILE:
+   qmiCodecTest.c
+DESCRIPTION:
+   Host tool testing and timing the table driven TLV codec of qmi.c
+
+   Copyright (c) Qualcomm Technologies, Inc. and/or its subsidiaries.
+   SPDX-License-Identifier: BSD-3-Clause
+==========================================================================*/
+
+/*
+ * Usage: qmiCodecTest [iterations [seed]]
+ *
+ * qmi.c is built here with QMI_CODEC_USER, which leaves out everything
+ * that needs the driver, so the codec under test is the one of the driver.
+ *
+ *  - every message table of qmi.c is encoded, indexed and decoded back
+ *  - random, truncated and oversized (more than QMI_TLV_INDEX_MAX TLVs)
+ *    messages are indexed and every TLV type is looked up, the results
+ *    must match a plain linear scan
+ *  - GetTLV() per TLV is timed against QMIIndexTLVs() + QMIIndexGetTLV()
+ *
+ * Returns 0 if all checks pass, the seed is printed to replay a failure.
+ */
+#define QMI_CODEC_USER
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include <time.h>
+
+/* Userspace stand-ins for what the codec uses from the kernel */
+#define ARRAY_SIZE(arr)             (sizeof(arr) / sizeof((arr)[0]))
+
+#include "qmi.c"
+
+#define TEST_MSG_MAX    1024
+
+static unsigned int gSeed;
+static unsigned int gFailures;
+
+#define CHECK(cond, format, args...)                                \
+    do {                                                            \
+        if (!(cond))                                                \
+        {                                                           \
+            fprintf(stderr, "FAIL %s:%d: " format "\n",             \
+                    __func__, __LINE__, ##args);                    \
+            gFailures++;                                            \
+        }                                                           \
+    } while (0)
+
+static unsigned int testRand(void)
+{
+    /* xorshift32, the same seed gives the same messages on every host */
+    gSeed ^= gSeed << 13;
+    gSeed ^= gSeed >> 17;
+    gSeed ^= gSeed << 5;
+    return gSeed;
+}
+
+static double testNow(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/* Append one TLV, returns the new message length */
+static u16 addTLV(u8 *pMsg, u16 len, u8 type, u16 size)
+{
+    u16 i;
+
+    pMsg[len] = type;
+    *(u16 *)(pMsg + len + 1) = size;
+    for (i = 0; i < size; i++)
+        pMsg[len + 3 + i] = (u8)testRand();
+    return len + 3 + size;
+}
+
+/* Reference lookup, the first complete TLV of the type wins */
+static int refGetTLV(const u8 *pMsg, u16 len, u8 type, u16 *pOffset)
+{
+    unsigned int pos;
+    u16 size;
+
+    for (pos = 4; pos + 3 <= len; pos += 3 + size)
+    {
+        size = *(const u16 *)(pMsg + pos + 1);
+        if (pos + 3 + size > len)
+            break;
+        if (pMsg[pos] == type)
+        {
+            *pOffset = pos + 3;
+            return size;
+        }
+    }
+    return -ENOMSG;
+}
+
+typedef struct _testMsgDesc {
+    const char *        mpName;
+    const sQMIMsgDesc * mpDesc;
+    size_t              mMsgSize;
+} testMsgDesc_t;
+
+#define TEST_MSG(desc, msg)     { #desc, &desc, sizeof(msg) }
+
+static const testMsgDesc_t gTestMsgs[] =
+{
+    TEST_MSG(gQMIWDSSetEventReportReq, sQMIWDSSetEventReportReqMsg),
+    TEST_MSG(gQMIWDASetDataFormatReq, sQMIWDASetDataFormatReqMsg),
+    TEST_MSG(gQMIWDASetDataFormatResp, sQMIWDASetDataFormatRespMsg),
+    TEST_MSG(gQMIWDAQOSFormatReq, sQMIWDAQOSFormatReqMsg),
+    TEST_MSG(gQMIWDSStartNetworkReq, sQMIWDSStartNetworkReqMsg),
+    TEST_MSG(gQMIWDSStopNetworkReq, sQMIWDSStopNetworkReqMsg),
+    TEST_MSG(gQMIWDSGetRuntimeSettingsReq, sQMIWDSGetRuntimeSettingsReqMsg),
+    TEST_MSG(gQMIWDSSetIPFamilyPrefReq, sQMIWDSSetIPFamilyPrefReqMsg),
+    TEST_MSG(gQMIWDSBindMuxPortReq, sQMIWDSBindMuxPortReqMsg),
+};
+
+/* Encode a message from random members, decode it and compare members */
+static void testRoundTrip(const testMsgDesc_t *pTest)
+{
+    const sQMIMsgDesc *pDesc = pTest->mpDesc;
+    u8 in[256], out[256], buf[TEST_MSG_MAX];
+    const sQMITLVDesc *pTLV;
+    sQMITLVIndex index;
+    u16 msgLen;
+    u32 found;
+    int size;
+    u16 i;
+
+    for (i = 0; i < pTest->mMsgSize; i++)
+        in[i] = (u8)testRand();
+    memset(out, 0, sizeof(out));
+
+    size = QMIEncodeMsg(buf, sizeof(buf), 0x1234, pDesc, in);
+    CHECK(size == QMIEncodedMsgSize(pDesc), "%s: encoded %d, expected %u",
+          pTest->mpName, size, QMIEncodedMsgSize(pDesc));
+    if (size < (int)sizeof(sQMUX) + 3)
+        return;
+
+    /* Too small a buffer must fail, not overrun */
+    CHECK(QMIEncodeMsg(buf, size - 1, 0x1234, pDesc, in) < 0,
+          "%s: short buffer accepted", pTest->mpName);
+
+    /* Index without QMUX and SDU, as the driver does for responses */
+    msgLen = size - sizeof(sQMUX) - 3;
+    CHECK(QMIIndexTLVs(buf + sizeof(sQMUX) + 3, msgLen, &index)
+          == pDesc->mMessageID, "%s: wrong message ID", pTest->mpName);
+    CHECK(index.mCount == pDesc->mNumTLVs, "%s: indexed %u of %u TLVs",
+          pTest->mpName, index.mCount, pDesc->mNumTLVs);
+
+    found = QMIDecodeMsg(&index, pDesc, out);
+    CHECK(found == (pDesc->mNumTLVs ? (u32)((1ull << pDesc->mNumTLVs) - 1)
+                                    : 0),
+          "%s: decoded TLVs 0x%x", pTest->mpName, found);
+
+    for (i = 0; i < pDesc->mNumTLVs; i++)
+    {
+        pTLV = &pDesc->mpTLVs[i];
+        CHECK(!memcmp(in + pTLV->mOffset, out + pTLV->mOffset, pTLV->mSize),
+              "%s: TLV 0x%02x differs", pTest->mpName, pTLV->mType);
+    }
+}
+
+/* Index a random message and look up every TLV type */
+static void testFuzz(void)
+{
+    u8 msg[TEST_MSG_MAX], value[TEST_MSG_MAX];
+    sQMITLVIndex index;
+    u16 len = 4, offset;
+    unsigned int numTLVs, i;
+    int ref, got;
+
+    *(u16 *)msg = (u16)testRand();
+    *(u16 *)(msg + 2) = 0;
+
+    /* Up to twice the index size, few types so that some repeat */
+    numTLVs = testRand() % (2 * QMI_TLV_INDEX_MAX + 1);
+    for (i = 0; i < numTLVs; i++)
+    {
+        u16 size = testRand() % 12;
+
+        if ((size_t)len + 3 + size > sizeof(msg))
+            break;
+        len = addTLV(msg, len, (u8)(testRand() % 48), size);
+    }
+
+    /* Corrupt a length, truncate or leave the message alone */
+    switch (testRand() % 4)
+    {
+    case 0:
+        if (len > 6)
+            *(u16 *)(msg + 4 + testRand() % (len - 6)) = (u16)testRand();
+        break;
+    case 1:
+        len = testRand() % (len + 1);
+        break;
+    default:
+        break;
+    }
+    *(u16 *)(msg + 2) = len > 4 ? len - 4 : 0;
+
+    got = QMIIndexTLVs(msg, len, &index);
+    if (len < 4)
+    {
+        CHECK(got == -ENODATA, "len %u: returned %d", len, got);
+        return;
+    }
+    CHECK(got == *(u16 *)msg, "len %u: wrong message ID", len);
+
+    for (i = 0; i < 256; i++)
+    {
+        ref = refGetTLV(msg, len, (u8)i, &offset);
+        got = QMIIndexGetTLV(&index, (u8)i, value, sizeof(value));
+        CHECK(got == ref, "len %u type 0x%02x: %d, expected %d",
+              len, i, got, ref);
+        if (got > 0 && got == ref)
+            CHECK(!memcmp(value, msg + offset, got),
+                  "len %u type 0x%02x: wrong value", len, i);
+    }
+
+    ref = refGetTLV(msg, len, 2, &offset);
+    got = QMIIndexResult(&index);
+    if (ref != 4)
+        CHECK(got == -ENOMSG, "len %u: result %d without TLV 2", len, got);
+    else
+        CHECK(got == (*(u16 *)(msg + offset) ? *(u16 *)(msg + offset + 2)
+                                             : 0),
+              "len %u: result %d", len, got);
+}
+
+/* Time the lookups of a WDS runtime settings like response */
+static void testBench(unsigned int iterations)
+{
+    static const u8 types[] = { 0x02, 0x14, 0x15, 0x1E, 0x20, 0x21, 0x29 };
+    u8 msg[TEST_MSG_MAX], value[64];
+    sQMIWDASetDataFormatReqMsg req;
+    sQMITLVIndex index;
+    volatile int sink = 0;
+    double start, scanNs, indexNs, encodeNs;
+    unsigned int n, i;
+    u16 len = 4;
+
+    *(u16 *)msg = 0x002D;
+    len = addTLV(msg, len, 0x02, 4);
+    *(u32 *)(msg + 7) = 0;
+    for (i = 0x10; i < 0x2C; i++)
+        len = addTLV(msg, len, (u8)i, 4 + testRand() % 16);
+    *(u16 *)(msg + 2) = len - 4;
+
+    start = testNow();
+    for (n = 0; n < iterations; n++)
+        for (i = 0; i < ARRAY_SIZE(types); i++)
+            sink += GetTLV(msg, len, types[i], value, sizeof(value));
+    scanNs = (testNow() - start) / iterations;
+
+    start = testNow();
+    for (n = 0; n < iterations; n++)
+    {
+        QMIIndexTLVs(msg, len, &index);
+        for (i = 0; i < ARRAY_SIZE(types); i++)
+            sink += QMIIndexGetTLV(&index, types[i], value, sizeof(value));
+    }
+    indexNs = (testNow() - start) / iterations;
+
+    memset(&req, 0, sizeof(req));
+    start = testNow();
+    for (n = 0; n < iterations; n++)
+        sink += QMIEncodeMsg(msg, sizeof(msg), (u16)n,
+                             &gQMIWDASetDataFormatReq, &req);
+    encodeNs = (testNow() - start) / iterations;
+
+    printf("%zu of %u TLVs by GetTLV:        %8.1f ns\n",
+           ARRAY_SIZE(types), 29, scanNs);
+    printf("%zu of %u TLVs by QMIIndexTLVs:  %8.1f ns\n",
+           ARRAY_SIZE(types), 29, indexNs);
+    printf("QMIEncodeMsg WDA SET DATA FORMAT: %8.1f ns\n", encodeNs);
+    (void)sink;
+}
+
+int main(int argc, char **argv)
+{
+    unsigned int iterations = 100000;
+    unsigned int i, n;
+
+    if (argc > 1)
+        iterations = strtoul(argv[1], NULL, 0);
+    gSeed = argc > 2 ? strtoul(argv[2], NULL, 0) : (unsigned int)time(NULL);
+    if (!gSeed)
+        gSeed = 1;
+    printf("seed %u\n", gSeed);
+
+    for (n = 0; n < 16; n++)
+        for (i = 0; i < ARRAY_SIZE(gTestMsgs); i++)
+            testRoundTrip(&gTestMsgs[i]);
+
+    for (n = 0; n < iterations; n++)
+        testFuzz();
+
+    if (iterations)
+        testBench(iterations);
+
+    if (gFailures)
+    {
+        printf("%u checks failed\n", gFailures);
+        return 1;
+    }
+    printf("all checks passed\n");
+    return 0;
+}
@@ -0,0 +1,551 @@
+/*
+    Copyright (c) Qualcomm Technologies, Inc. and/or its subsidiaries.
+    SPDX-License-Identifier: BSD-3-Clause
+*/
+
+#include <linux/debugfs.h>
+#include <linux/vmalloc.h>
+#include <linux/mm.h>
+#include <linux/log2.h>
+#include "qmicapture.h"
+#include "qmi.h"
+
+// Number of slots of the capture ring of each device, 0 to disable
+extern int qmuxCaptureSlots;
+
+// debugfs root of the driver
+static struct dentry * gpCaptureRoot = NULL;
+
+/*===========================================================================
+METHOD:
+   QMICaptureFree (Private Method)
+
+DESCRIPTION:
+   Free a capture ring once its last reference is dropped
+
+PARAMETERS:
+   pRef           [ I ] - mRefCount of the ring
+
+RETURN VALUE:
+   None
+===========================================================================*/
+static void QMICaptureFree( struct kref * pRef )
+{
+   sQMICapture * pCapture = container_of( pRef, sQMICapture, mRefCount );
+
+   vfree( pCapture->mpRing );
+   kfree( pCapture );
+}
+
+/*===========================================================================
+METHOD:
+   QMICaptureSlotAt (Private Method)
+
+DESCRIPTION:
+   Slot of a record
+
+PARAMETERS:
+   pCapture       [ I ] - Capture ring
+   seq            [ I ] - Record number
+
+RETURN VALUE:
+   sQMICaptureSlot *
+===========================================================================*/
+static sQMICaptureSlot * QMICaptureSlotAt(
+   sQMICapture *     pCapture,
+   u64               seq )
+{
+   return (sQMICaptureSlot *)((u8 *)pCapture->mpRing
+                              + pCapture->mpRing->mDataOffset
+                              + (size_t)(seq & pCapture->mSlotMask) * QMI_CAPTURE_SLOT_SIZE);
+}
+
+/*===========================================================================
+METHOD:
+   QMICaptureRecord (Public Method)
+
+DESCRIPTION:
+   Copy one QMUX message into the capture ring of the device, overwriting
+   the oldest record when the ring is full
+
+   May be called from interrupt context
+
+PARAMETERS:
+   pDev           [ I ] - Device specific memory
+   direction      [ I ] - QMI_CAPTURE_DIR_*
+   pData          [ I ] - QMUX message
+   dataSize       [ I ] - Size of pData
+
+RETURN VALUE:
+   None
+===========================================================================*/
+void QMICaptureRecord(
+   sGobiUSBNet *      pDev,
+   u8                 direction,
+   const void *       pData,
+   u16                dataSize )
+{
+   sQMICapture * pCapture = pDev->mpCapture;
+   const sQMUX * pQMUX = pData;
+   const u8 * pSDU;
+   sQMICaptureSlot * pSlot;
+   u16 clientID = 0;
+   u16 transactionID = 0;
+   u16 copySize;
+   u32 usec;
+   u64 now;
+   u64 seq;
+   unsigned long flags;
+
+   if (pCapture == NULL || pData == NULL)
+   {
+      return;
+   }
+
+   // Client ID from the QMUX header, TID from the service SDU header
+   if (dataSize >= sizeof( sQMUX ))
+   {
+      clientID = (pQMUX->mQMIClientID << 8) + pQMUX->mQMIService;
+      pSDU = (const u8 *)pData + sizeof( sQMUX );
+      if (pQMUX->mQMIService == QMICTL && dataSize >= sizeof( sQMUX ) + 2)
+      {
+         transactionID = pSDU[1];
+      }
+      else if (pQMUX->mQMIService != QMICTL && dataSize >= sizeof( sQMUX ) + 3)
+      {
+         transactionID = pSDU[1] | (pSDU[2] << 8);
+      }
+   }
+
+   copySize = min_t( u16,
+                     dataSize,
+                     QMI_CAPTURE_SLOT_SIZE - sizeof( sQMICaptureSlot ) );
+   now = ktime_to_us( ktime_get_real() );
+
+   spin_lock_irqsave( &pCapture->mLock, flags );
+
+   seq = pCapture->mpRing->mHead;
+   pSlot = QMICaptureSlotAt( pCapture, seq );
+
+   // Invalidate the slot before overwriting it
+   WRITE_ONCE( pSlot->mSeq, 0 );
+   smp_wmb();
+
+   pSlot->mRecord.mTsSec = (u32)div_u64_rem( now, USEC_PER_SEC, &usec );
+   pSlot->mRecord.mTsUsec = usec;
+   pSlot->mRecord.mInclLen = sizeof( sQMICapturePseudoHeader ) + copySize;
+   pSlot->mRecord.mOrigLen = sizeof( sQMICapturePseudoHeader ) + dataSize;
+   pSlot->mPseudo.mDirection = direction;
+   pSlot->mPseudo.mReserved = 0;
+   pSlot->mPseudo.mClientID = cpu_to_le16( clientID );
+   pSlot->mPseudo.mTransactionID = cpu_to_le16( transactionID );
+   pSlot->mPseudo.mReserved2 = 0;
+   memcpy( pSlot->mData, pData, copySize );
+
+   // Publish the slot, then the new head
+   smp_wmb();
+   WRITE_ONCE( pSlot->mSeq, seq + 1 );
+   smp_wmb();
+   WRITE_ONCE( pCapture->mpRing->mHead, seq + 1 );
+
+   spin_unlock_irqrestore( &pCapture->mLock, flags );
+}
+
+/*===========================================================================
+METHOD:
+   QMICaptureOpen (Private Method)
+
+DESCRIPTION:
+   Open the capture file of a device
+
+PARAMETERS
+   pInode         [ I ] - kernel file descriptor
+   pFilp          [ I ] - userspace file descriptor
+
+RETURN VALUE:
+   int - 0 for success
+         Negative errno for failure
+===========================================================================*/
+static int QMICaptureOpen(
+   struct inode *       pInode,
+   struct file *        pFilp )
+{
+   sQMICapture * pCapture = pInode->i_private;
+   sQMICaptureReader * pReader;
+
+   pReader = kzalloc( sizeof( sQMICaptureReader ), GFP_KERNEL );
+   if (pReader == NULL)
+   {
+      return -ENOMEM;
+   }
+
+   pReader->mpSlot = kmalloc( QMI_CAPTURE_SLOT_SIZE, GFP_KERNEL );
+   if (pReader->mpSlot == NULL)
+   {
+      kfree( pReader );
+      return -ENOMEM;
+   }
+
+   // The file (and any mapping of it) keeps the ring alive after
+   //    the device is gone
+   kref_get( &pCapture->mRefCount );
+   pReader->mpCapture = pCapture;
+   pReader->mNext = 0;
+   pReader->mbHeaderDone = false;
+
+   pFilp->private_data = pReader;
+   return nonseekable_open( pInode, pFilp );
+}
+
+/*===========================================================================
+METHOD:
+   QMICaptureRelease (Private Method)
+
+DESCRIPTION:
+   Close the capture file of a device
+
+PARAMETERS
+   pInode         [ I ] - kernel file descriptor
+   pFilp          [ I ] - userspace file descriptor
+
+RETURN VALUE:
+   int - 0 for success
+===========================================================================*/
+static int QMICaptureRelease(
+   struct inode *       pInode,
+   struct file *        pFilp )
+{
+   sQMICaptureReader * pReader = pFilp->private_data;
+
+   kref_put( &pReader->mpCapture->mRefCount, QMICaptureFree );
+   kfree( pReader->mpSlot );
+   kfree( pReader );
+   return 0;
+}
+
+/*===========================================================================
+METHOD:
+   QMICaptureRead (Private Method)
+
+DESCRIPTION:
+   Return the pcap file header, then the records still in the ring that
+   were not returned yet; whole records only
+
+PARAMETERS
+   pFilp          [ I ] - userspace file descriptor
+   pBuf           [ I ] - read buffer
+   size           [ I ] - size of read buffer
+   pUnusedFpos    [ I ] - (unused) file position
+
+RETURN VALUE:
+   ssize_t - Number of bytes read, 0 once the ring is drained
+             Negative errno for failure
+===========================================================================*/
+static ssize_t QMICaptureRead(
+   struct file *        pFilp,
+   char __user *        pBuf,
+   size_t               size,
+   loff_t *             pUnusedFpos )
+{
+   sQMICaptureReader * pReader = pFilp->private_data;
+   sQMICapture * pCapture = pReader->mpCapture;
+   sQMICaptureSlot * pSlot;
+   size_t recordSize;
+   size_t total = 0;
+   u64 slotCount = pCapture->mSlotMask + 1;
+   unsigned long flags;
+   u64 head;
+
+   if (pReader->mbHeaderDone == false)
+   {
+      if (size < sizeof( sPcapFileHeader ))
+      {
+         return -EINVAL;
+      }
+      if (copy_to_user( pBuf,
+                        &pCapture->mpRing->mPcapHeader,
+                        sizeof( sPcapFileHeader ) ) != 0)
+      {
+         return -EFAULT;
+      }
+      pReader->mbHeaderDone = true;
+      total += sizeof( sPcapFileHeader );
+   }
+
+   // mHead is 64 bit and may tear on 32 bit systems, read it under the
+   //    writers' lock, which also orders it after the published slots
+   spin_lock_irqsave( &pCapture->mLock, flags );
+   head = pCapture->mpRing->mHead;
+   spin_unlock_irqrestore( &pCapture->mLock, flags );
+   while (pReader->mNext < head)
+   {
+      // Skip what has been overwritten already
+      if (head - pReader->mNext > slotCount)
+      {
+         pReader->mNext = head - slotCount;
+      }
+
+      pSlot = QMICaptureSlotAt( pCapture, pReader->mNext );
+      if (READ_ONCE( pSlot->mSeq ) != pReader->mNext + 1)
+      {
+         pReader->mNext++;
+         continue;
+      }
+      smp_rmb();
+      memcpy( pReader->mpSlot, pSlot, QMI_CAPTURE_SLOT_SIZE );
+      smp_rmb();
+      if (READ_ONCE( pSlot->mSeq ) != pReader->mNext + 1)
+      {
+         // Overwritten while copying
+         pReader->mNext++;
+         continue;
+      }
+
+      recordSize = sizeof( sPcapRecordHeader ) + pReader->mpSlot->mRecord.mInclLen;
+      if (total + recordSize > size)
+      {
+         break;
+      }
+      if (copy_to_user( pBuf + total, &pReader->mpSlot->mRecord, recordSize ) != 0)
+      {
+         return (total > 0) ? total : -EFAULT;
+      }
+
+      total += recordSize;
+      pReader->mNext++;
+   }
+
+   if (total == 0 && pReader->mNext < head)
+   {
+      // Buffer can't hold a single record
+      return -EINVAL;
+   }
+
+   return total;
+}
+
+/*===========================================================================
+METHOD:
+   QMICaptureMmap (Private Method)
+
+DESCRIPTION:
+   Map the capture ring read only
+
+PARAMETERS
+   pFilp          [ I ] - userspace file descriptor
+   pVma           [ I ] - mapping
+
+RETURN VALUE:
+   int - 0 for success
+         Negative errno for failure
+===========================================================================*/
+static int QMICaptureMmap(
+   struct file *              pFilp,
+   struct vm_area_struct *    pVma )
+{
+   sQMICaptureReader * pReader = pFilp->private_data;
+
+   if ((pVma->vm_flags & VM_WRITE) != 0)
+   {
+      return -EPERM;
+   }
+   // Nor may mprotect() make it writable later
+#if (LINUX_VERSION_CODE >= KERNEL_VERSION( 6,3,0 ))
+   vm_flags_clear( pVma, VM_MAYWRITE );
+#else
+   pVma->vm_flags &= ~VM_MAYWRITE;
+#endif
+
+   return remap_vmalloc_range( pVma, pReader->mpCapture->mpRing, pVma->vm_pgoff );
+}
+
+static const struct file_operations QMICaptureFops =
+{
+   .owner   = THIS_MODULE,
+   .open    = QMICaptureOpen,
+   .release = QMICaptureRelease,
+   .read    = QMICaptureRead,
+   .mmap    = QMICaptureMmap,
+};
+
+/*===========================================================================
+METHOD:
+   QMICaptureModInit (Public Method)
+
+DESCRIPTION:
+   Create the debugfs root of the driver
+   Capture stays unavailable if debugfs is not there
+
+RETURN VALUE:
+   None
+===========================================================================*/
+void QMICaptureModInit( void )
+{
+   struct dentry * pRoot;
+
+   if (qmuxCaptureSlots <= 0)
+   {
+      return;
+   }
+
+   pRoot = debugfs_create_dir( "qcom_usbnet", NULL );
+   if (IS_ERR_OR_NULL( pRoot ))
+   {
+      QC_LOG_GLOBAL("unable to create debugfs root, QMUX capture disabled\n");
+      return;
+   }
+   gpCaptureRoot = pRoot;
+}
+
+/*===========================================================================
+METHOD:
+   QMICaptureModExit (Public Method)
+
+DESCRIPTION:
+   Remove the debugfs root of the driver
+
+RETURN VALUE:
+   None
+===========================================================================*/
+void QMICaptureModExit( void )
+{
+   debugfs_remove_recursive( gpCaptureRoot );
+   gpCaptureRoot = NULL;
+}
+
+/*===========================================================================
+METHOD:
+   QMICaptureCreate (Public Method)
+
+DESCRIPTION:
+   Allocate the capture ring of a device and expose it in debugfs
+   Does nothing unless qmuxCaptureSlots is set
+
+PARAMETERS:
+   pDev           [ I ] - Device specific memory
+
+RETURN VALUE:
+   int - 0 for success
+         Negative errno for failure
+===========================================================================*/
+int QMICaptureCreate( sGobiUSBNet * pDev )
+{
+   sQMICapture * pCapture;
+   sQMICaptureHeader * pHeader;
+   struct dentry * pFile;
+   u32 slotCount;
+   size_t dataOffset;
+
+   pDev->mpCapture = NULL;
+   if (qmuxCaptureSlots <= 0 || gpCaptureRoot == NULL)
+   {
+      return 0;
+   }
+
+   slotCount = roundup_pow_of_two( clamp_t( u32,
+                                            qmuxCaptureSlots,
+                                            QMI_CAPTURE_MIN_SLOTS,
+                                            QMI_CAPTURE_MAX_SLOTS ) );
+   dataOffset = PAGE_ALIGN( sizeof( sQMICaptureHeader ) );
+
+   pCapture = kzalloc( sizeof( sQMICapture ), GFP_KERNEL );
+   if (pCapture == NULL)
+   {
+      return -ENOMEM;
+   }
+
+   pCapture->mRingSize = dataOffset + (size_t)slotCount * QMI_CAPTURE_SLOT_SIZE;
+   pCapture->mpRing = vmalloc_user( pCapture->mRingSize );
+   if (pCapture->mpRing == NULL)
+   {
+      QC_LOG_ERR(GET_QMIDEV(pDev),"unable to allocate %zu byte capture ring\n",
+                 pCapture->mRingSize );
+      kfree( pCapture );
+      return -ENOMEM;
+   }
+
+   kref_init( &pCapture->mRefCount );
+   spin_lock_init( &pCapture->mLock );
+   pCapture->mSlotMask = slotCount - 1;
+
+   pHeader = pCapture->mpRing;
+   pHeader->mMagic = QMI_CAPTURE_MAGIC;
+   pHeader->mVersion = QMI_CAPTURE_VERSION;
+   pHeader->mSlotSize = QMI_CAPTURE_SLOT_SIZE;
+   pHeader->mSlotCount = slotCount;
+   pHeader->mDataOffset = dataOffset;
+   pHeader->mHead = 0;
+   pHeader->mPcapHeader.mMagic = 0xa1b2c3d4;
+   pHeader->mPcapHeader.mVersionMajor = 2;
+   pHeader->mPcapHeader.mVersionMinor = 4;
+   pHeader->mPcapHeader.mThisZone = 0;
+   pHeader->mPcapHeader.mSigFigs = 0;
+   pHeader->mPcapHeader.mSnapLen = QMI_CAPTURE_SLOT_SIZE
+                                 - offsetof( sQMICaptureSlot, mPseudo );
+   pHeader->mPcapHeader.mLinkType = QMI_CAPTURE_LINKTYPE;
+
+   pCapture->mpDir = debugfs_create_dir( dev_name( &pDev->mpIntf->dev ), gpCaptureRoot );
+   if (IS_ERR_OR_NULL( pCapture->mpDir ))
+   {
+      QC_LOG_ERR(GET_QMIDEV(pDev),"unable to create debugfs directory\n" );
+      kref_put( &pCapture->mRefCount, QMICaptureFree );
+      return -ENOMEM;
+   }
+
+   // debugfs' full proxy does not forward mmap, open only goes through
+   //    the proxy so removal still waits for it
+#if (LINUX_VERSION_CODE >= KERNEL_VERSION( 4,7,0 ))
+   pFile = debugfs_create_file_unsafe( "qmux_capture",
+                                       0400,
+                                       pCapture->mpDir,
+                                       pCapture,
+                                       &QMICaptureFops );
+#else
+   pFile = debugfs_create_file( "qmux_capture",
+                                0400,
+                                pCapture->mpDir,
+                                pCapture,
+                                &QMICaptureFops );
+#endif
+   if (IS_ERR_OR_NULL( pFile ))
+   {
+      QC_LOG_ERR(GET_QMIDEV(pDev),"unable to create debugfs capture file\n" );
+      debugfs_remove_recursive( pCapture->mpDir );
+      kref_put( &pCapture->mRefCount, QMICaptureFree );
+      return -ENOMEM;
+   }
+
+   QC_LOG_INFO(GET_QMIDEV(pDev),"QMUX capture ring of %u slots\n", slotCount );
+   pDev->mpCapture = pCapture;
+   return 0;
+}
+
+/*===========================================================================
+METHOD:
+   QMICaptureDestroy (Public Method)
+
+DESCRIPTION:
+   Remove the capture ring of a device from debugfs and drop the device
+   reference; open files keep the memory until they are closed
+
+   Must be called once no more messages can be recorded
+
+PARAMETERS:
+   pDev           [ I ] - Device specific memory
+
+RETURN VALUE:
+   None
+===========================================================================*/
+void QMICaptureDestroy( sGobiUSBNet * pDev )
+{
+   sQMICapture * pCapture = pDev->mpCapture;
+
+   if (pCapture == NULL)
+   {
+      return;
+   }
+
+   pDev->mpCapture = NULL;
+   debugfs_remove_recursive( pCapture->mpDir );
+   kref_put( &pCapture->mRefCount, QMICaptureFree );
+}
@@ -0,0 +1,209 @@
+/*
+    Copyright (c) Qualcomm Technologies, Inc. and/or its subsidiaries.
+    SPDX-License-Identifier: BSD-3-Clause
+*/
+
+#ifndef __QMICAPTURE_H
+#define __QMICAPTURE_H
+
+#include "common.h"
+
+/*=========================================================================*/
+// QMUX capture ring
+//
+//    When the qmuxCaptureSlots module parameter is set, every QMUX message
+//    sent or received by a device is copied into a ring exposed as
+//    <debugfs>/qcom_usbnet/<usb interface>/qmux_capture
+//
+//    read()  - returns a pcap file: the file header followed by the records
+//              currently in the ring, then end of file
+//    mmap()  - maps sQMICaptureHeader (one page) followed by mSlotCount
+//              slots of mSlotSize bytes, read only
+//
+//    Mapped ring protocol:
+//       mHead is the number of records ever written, record n lives in
+//       slot n % mSlotCount.  A slot is valid for record n while its mSeq
+//       equals n + 1; read mSeq, copy the slot, read mSeq again and drop
+//       the copy if it changed.  Concatenating mPcapHeader and, for every
+//       record, mRecord, mPseudo and mData (mRecord.mInclLen bytes from
+//       mPseudo on) gives a regular pcap file.
+/*=========================================================================*/
+
+// Direction of a captured message
+#define QMI_CAPTURE_DIR_TX       0  /* host to device */
+#define QMI_CAPTURE_DIR_RX       1  /* device to host */
+
+#define QMI_CAPTURE_MAGIC        0x51434150  /* "QCAP" */
+#define QMI_CAPTURE_VERSION      1
+
+// Bytes per slot, messages larger than a slot are truncated
+#define QMI_CAPTURE_SLOT_SIZE    1024
+
+// Bounds of the qmuxCaptureSlots module parameter
+#define QMI_CAPTURE_MIN_SLOTS    4
+#define QMI_CAPTURE_MAX_SLOTS    65536
+
+// pcap link type of the records (LINKTYPE_USER0), every record starts
+//    with sQMICapturePseudoHeader followed by the QMUX message
+#define QMI_CAPTURE_LINKTYPE     147
+
+/*=========================================================================*/
+// Struct sPcapFileHeader
+//
+//    pcap global header, microsecond timestamps, host byte order
+/*=========================================================================*/
+typedef struct sPcapFileHeader
+{
+   __u32    mMagic;
+   __u16    mVersionMajor;
+   __u16    mVersionMinor;
+   __s32    mThisZone;
+   __u32    mSigFigs;
+   __u32    mSnapLen;
+   __u32    mLinkType;
+
+} __attribute__((packed)) sPcapFileHeader;
+
+/*=========================================================================*/
+// Struct sPcapRecordHeader
+//
+//    pcap per record header
+/*=========================================================================*/
+typedef struct sPcapRecordHeader
+{
+   __u32    mTsSec;
+   __u32    mTsUsec;
+   __u32    mInclLen;
+   __u32    mOrigLen;
+
+} __attribute__((packed)) sPcapRecordHeader;
+
+/*=========================================================================*/
+// Struct sQMICapturePseudoHeader
+//
+//    Link layer header of every record
+/*=========================================================================*/
+typedef struct sQMICapturePseudoHeader
+{
+   /* QMI_CAPTURE_DIR_* */
+   __u8     mDirection;
+   __u8     mReserved;
+
+   /* (client << 8) | service, as used throughout the driver */
+   __le16   mClientID;
+
+   /* Transaction ID, 0 for indications and unparsable messages */
+   __le16   mTransactionID;
+   __le16   mReserved2;
+
+} __attribute__((packed)) sQMICapturePseudoHeader;
+
+/*=========================================================================*/
+// Struct sQMICaptureSlot
+//
+//    One record of the ring
+/*=========================================================================*/
+typedef struct sQMICaptureSlot
+{
+   /* Record number + 1 while the slot is valid, 0 while it is written */
+   __u64                      mSeq;
+
+   sPcapRecordHeader          mRecord;
+
+   sQMICapturePseudoHeader    mPseudo;
+
+   /* QMUX message, mRecord.mInclLen - sizeof( mPseudo ) bytes */
+   __u8                       mData[0];
+
+} __attribute__((packed)) sQMICaptureSlot;
+
+/*=========================================================================*/
+// Struct sQMICaptureHeader
+//
+//    First page of the mapped ring
+/*=========================================================================*/
+typedef struct sQMICaptureHeader
+{
+   /* QMI_CAPTURE_MAGIC and QMI_CAPTURE_VERSION */
+   __u32                      mMagic;
+   __u32                      mVersion;
+
+   /* Geometry of the slot array */
+   __u32                      mSlotSize;
+   __u32                      mSlotCount;
+
+   /* Offset of slot 0 from the start of the mapping */
+   __u32                      mDataOffset;
+   __u32                      mReserved;
+
+   /* Number of records written so far */
+   __u64                      mHead;
+
+   /* Header to start a pcap file with */
+   sPcapFileHeader            mPcapHeader;
+
+} sQMICaptureHeader;
+
+/*=========================================================================*/
+// Struct sQMICapture
+//
+//    Capture ring of a device
+/*=========================================================================*/
+typedef struct sQMICapture
+{
+   /* Held by the device and by every open file */
+   struct kref                mRefCount;
+
+   /* Serializes writers */
+   spinlock_t                 mLock;
+
+   /* vmalloc_user() memory, sQMICaptureHeader then the slots */
+   sQMICaptureHeader *        mpRing;
+   size_t                     mRingSize;
+
+   /* mSlotCount - 1 */
+   u32                        mSlotMask;
+
+   /* debugfs directory of the device */
+   struct dentry *            mpDir;
+
+} sQMICapture;
+
+/*=========================================================================*/
+// Struct sQMICaptureReader
+//
+//    State of one open capture file
+/*=========================================================================*/
+typedef struct sQMICaptureReader
+{
+   sQMICapture *              mpCapture;
+
+   /* Next record to return from read() */
+   u64                        mNext;
+
+   /* Has the pcap file header been returned? */
+   bool                       mbHeaderDone;
+
+   /* Copy of the slot being returned */
+   sQMICaptureSlot *          mpSlot;
+
+} sQMICaptureReader;
+
+// Create / remove the debugfs root of the driver
+void QMICaptureModInit( void );
+void QMICaptureModExit( void );
+
+// Create the capture ring of a device, if enabled
+int QMICaptureCreate( sGobiUSBNet * pDev );
+
+// Remove the capture ring of a device
+void QMICaptureDestroy( sGobiUSBNet * pDev );
+
+// Record one QMUX message
+void QMICaptureRecord(
+   sGobiUSBNet *      pDev,
+   u8                 direction,
+   const void *       pData,
+   u16                dataSize );
+
+#endif /* __QMICAPTURE_H */
@@ -4,18 +4,22 @@
 */
 
 #include "qmidevice.h"
+#include "qmicapture.h"
 
 extern int debug_g;
 extern int interruptible;
 extern int use_down_timeout;
 extern sGobiUSBNet * gpGobiDev;
-static struct mutex IoMutex;
+static DEFINE_MUTEX(IoMutex);
 
 long UnlockedUserspaceIOCTL(struct file *, unsigned int, unsigned long);
 int WriteAsync(sGobiUSBNet *,char *, int, u16, sQMIDev *, sIoData *);
 void QMIAIOReadcallback(sGobiUSBNet *, u16, void *, sQMIDev *);
 int GobiSuspend(struct usb_interface *, pm_message_t); /*Prototype to GobiSuspend function*/
-static int GobiWaitForResponses(void *);
+static void ProcessIndWork(struct work_struct *);
+static int QMIBringUp(sGobiUSBNet *);
+static int QMIIndRingInit(sGobiUSBNet *);
+static void QMIIndRingRelease(sGobiUSBNet *);
 void WriteAsyncCallback(struct urb *);
 
 // UnlockedUserspacecIOCTL is a simple passthrough to UserspacecIOCTL
@@ -288,62 +292,74 @@ int ResubmitIntURB( struct urb * pIntURB )
    return status;
 }
 
+/*===========================================================================
+METHOD:
+   AddToProcessIndList (Private Method)
+
+DESCRIPTION:
+   Copy a WDS indication into the next free slot of the indication ring
+   and schedule mProcessIndData.mWork
+
+   Only the control read callback calls this, so the ring has a single
+   producer and needs neither a lock nor an allocation.  The indication
+   is dropped when every slot is still waiting to be processed.
+
+PARAMETERS:
+   pDev         [ I ] - Device specific memory
+   QMIDev       [ I ] - QMI "device" the message belongs to
+   MsgId        [ I ] - QMI message ID
+   pData        [ I ] - Message, QMUX header included
+   dataSize     [ I ] - Size of pData
+   clientId     [ I ] - Client ID the message was received for
+
+RETURN VALUE:
+   None
+===========================================================================*/
 static void AddToProcessIndList(sGobiUSBNet *pDev, sQMIDev *QMIDev, int MsgId, char *pData, int dataSize, u16 clientId)
 {
+    sProcessInd *pRing;
     sIndDataInfo *pIndDataInfo;
-    sIndDataInfo *pIndDataInfoList;
-    char *pDataCopy;
-    unsigned long flags;
-    spinlock_t  *pResponeListLock;
+    unsigned int head;
 
     if (!pDev || !QMIDev || !pData || !dataSize)
     {
         QC_LOG_ERR(QMIDev,"Invalid Response data to process\n");
         return;
     }
-    pResponeListLock = pDev->mProcessIndData.mpResponeListLock;
+    pRing = &pDev->mProcessIndData;
+
+    if (pRing->mbActive == false)
+    {
+        return;
+    }
 
-    pIndDataInfo = kzalloc(sizeof(sIndDataInfo), GFP_ATOMIC);
-    if (pIndDataInfo == NULL)
+    if (dataSize > QMI_IND_SLOT_SIZE)
     {
-        QC_LOG_ERR(QMIDev, "Unable to allocate memory\n");
+        QC_LOG_ERR(QMIDev, "Indication 0x%x too large %d\n", MsgId, dataSize);
+        atomic_inc(&pRing->mDropped);
         return;
     }
-    pDataCopy = kzalloc(dataSize, GFP_ATOMIC);
-    if (pDataCopy == NULL)
+
+    head = pRing->mHead;
+    if (head - smp_load_acquire(&pRing->mTail) >= QMI_IND_RING_SIZE)
     {
-        QC_LOG_ERR(QMIDev, "Unable to allocate memory\n");
-        kfree(pIndDataInfo);
+        QC_LOG_ERR(QMIDev, "Indication ring full, 0x%x dropped (%d)\n",
+                   MsgId, atomic_inc_return(&pRing->mDropped));
         return;
     }
-    memcpy(pDataCopy, pData, dataSize);
+
+    pIndDataInfo = &pRing->mpSlots[head & (QMI_IND_RING_SIZE - 1)];
+    memcpy(pIndDataInfo->mpData, pData, dataSize);
 
     pIndDataInfo->mMsgId    = MsgId;
-    pIndDataInfo->mpData    = pDataCopy;
-    pIndDataInfo->mpNext    = NULL;
     pIndDataInfo->mDataLen  = dataSize;
     pIndDataInfo->mClientId = clientId; 
     pIndDataInfo->mQMIDev   = QMIDev; 
 
-    /* Lock here */
-    spin_lock_irqsave(pResponeListLock, flags);
-    pIndDataInfoList = pDev->mProcessIndData.mpIndDataInfoList;
-
-    if (pIndDataInfoList == NULL)
-    {
-        pDev->mProcessIndData.mpIndDataInfoList = pIndDataInfo;
-    } else
-    {
-        /* Add at the end of list */
-        while (pIndDataInfoList->mpNext != NULL)
-        {
-            pIndDataInfoList = pIndDataInfoList->mpNext;
-        }
-        pIndDataInfoList->mpNext = pIndDataInfo;
-    }
+    // Publish the slot before the consumer can see the new head
+    smp_store_release(&pRing->mHead, head + 1);
 
-    /* Unlock here */
-    spin_unlock_irqrestore(pResponeListLock, flags);
+    queue_work_on(QTIDevInfWorkCpu(pDev->mNumaNode), pDev->mpWorkQ, &pRing->mWork);
 
     return;
 }
@@ -351,7 +367,6 @@ static void AddToProcessIndList(sGobiUSBNet *pDev, sQMIDev *QMIDev, int MsgId, c
 static void processIndResponses(char *pDataCopy, sGobiUSBNet *pDev, sQMIDev *QMIDev, u16 dataSize, u16 clientId)
 {
     u8 cntlFlg;
-    struct semaphore *pReadSem;
     memcpy(&cntlFlg, pDataCopy+QMUXHeaderSize(), sizeof(uint8_t));
 	
     if (IsDeviceValid(pDev) == false)
@@ -359,8 +374,6 @@ static void processIndResponses(char *pDataCopy, sGobiUSBNet *pDev, sQMIDev *QMI
        QC_LOG_ERR(QMIDev,"Invalid device!\n" );
        return;
     }
-    pReadSem = pDev->mProcessIndData.mpResponseReadSem;
-
     //To check Indication msg and 
     if ( ((sQMUX *)(pDataCopy))->mQMIService == QMIWDS )
     {
@@ -380,20 +393,14 @@ static void processIndResponses(char *pDataCopy, sGobiUSBNet *pDev, sQMIDev *QMI
                 case QMI_WDS_PKT_SRVC_STATUS_IND:
                     QC_LOG_INFO(QMIDev, "QMI_WDS_PKT_SRVC_STATUS_IND\n");
                     AddToProcessIndList(pDev, QMIDev, MsgId, pDataCopy, dataSize, clientId);
-                    up(pReadSem);
-                    QC_LOG_INFO(QMIDev,"Triggered semaphore\n");
                     break;
                 case QMI_WDS_EXTENDED_IP_CONFIG_IND:
                     QC_LOG_INFO(QMIDev,"QMI_WDS_EXTENDED_IP_CONFIG_IND\n");
                     AddToProcessIndList(pDev, QMIDev, MsgId, pDataCopy, dataSize, clientId);
-                    up(pReadSem);
-                    QC_LOG_INFO(QMIDev,"Triggered semaphore\n");
                     break;
                 case QMI_WDS_REVERSE_IP_TRANSPORT_CONNECTION_IND:
                     QC_LOG_INFO(QMIDev,"QMI_WDS_REVERSE_IP_TRANSPORT_CONNECTION_IND\n");
                     AddToProcessIndList(pDev, QMIDev, MsgId, pDataCopy, dataSize, clientId);
-                    up(pReadSem);
-                    QC_LOG_INFO(QMIDev,"Triggered semaphore\n");
                     break;
                 default:
                     QC_LOG_INFO(QMIDev,"Some Ind triggerd : %X\n", MsgId);
@@ -406,8 +413,6 @@ static void processIndResponses(char *pDataCopy, sGobiUSBNet *pDev, sQMIDev *QMI
                 case QMI_WDS_GET_RUNTIME_SETTINGS_RESP:
                     QC_LOG_INFO(QMIDev,"QMI_WDS_GET_RUNTIME_SETTINGS_RESP\n");
                     AddToProcessIndList(pDev, QMIDev, MsgId, pDataCopy, dataSize, clientId);
-                    up(pReadSem);
-                    QC_LOG_INFO(QMIDev,"Triggered semaphore\n");
                     break;
                 default:
                     break;
@@ -469,6 +474,7 @@ void ReadCallback( struct urb * pReadURB )
    dataSize = pReadURB->actual_length;
 
    PrintHex( pData, dataSize );
+   QMICaptureRecord( pDev, QMI_CAPTURE_DIR_RX, pData, dataSize );
 
    result = ParseQMUX( &clientID,
                        pData,
@@ -506,6 +512,15 @@ void ReadCallback( struct urb * pReadURB )
       transactionID = *(u16*)(pData + result + 1);
    }
 
+   // Responses to in-flight transactions go straight to their owner
+   if (QMITxnDispatch( pDev, clientID, transactionID, pData, dataSize ) == true)
+   {
+      // Resubmit the interrupt URB
+      ResubmitIntURB( pDev->mQMIDev.mpIntURB );
+
+      return;
+   }
+
    // Find memory storage for this service and Client ID
    // Not using FindClientMem because it can't handle broadcasts
    list_for_each_entry( pClientMemIter, &pDev->mQMIDev.mClientMemList, node){
@@ -831,7 +846,7 @@ int StartRead( sGobiUSBNet * pDev )
    }
 
    // Create data buffers
-   pDev->mQMIDev.mpReadBuffer = kzalloc( DEFAULT_READ_URB_LENGTH, GFP_KERNEL );
+   pDev->mQMIDev.mpReadBuffer = kzalloc_node( DEFAULT_READ_URB_LENGTH, GFP_KERNEL, pDev->mNumaNode );
    if (pDev->mQMIDev.mpReadBuffer == NULL)
    {
       QC_LOG_ERR(GET_QMIDEV(pDev),"Error allocating read buffer\n" );
@@ -842,7 +857,7 @@ int StartRead( sGobiUSBNet * pDev )
       return -ENOMEM;
    }
    
-   pDev->mQMIDev.mpIntBuffer = kzalloc( DEFAULT_READ_URB_LENGTH, GFP_KERNEL );
+   pDev->mQMIDev.mpIntBuffer = kzalloc_node( DEFAULT_READ_URB_LENGTH, GFP_KERNEL, pDev->mNumaNode );
    if (pDev->mQMIDev.mpIntBuffer == NULL)
    {
       QC_LOG_ERR(GET_QMIDEV(pDev),"Error allocating int buffer\n" );
@@ -1316,126 +1331,422 @@ int ReadSyncTimeout(
    return dataSize;
 }
 
+/*=========================================================================*/
+// QMI transaction engine
+/*=========================================================================*/
+
 /*===========================================================================
 METHOD:
-   WriteSyncCallback (Public Method)
+   QMITxnPut (Private Method)
 
 DESCRIPTION:
-   Write callback
+   Drop a reference on a transaction slot
+   The slot goes back to the free list once the last reference is gone
 
-PARAMETERS
-   pWriteURB       [ I ] - URB this callback is run for
+PARAMETERS:
+   pTxn           [ I ] - Transaction slot
 
 RETURN VALUE:
    None
 ===========================================================================*/
-void WriteSyncCallback( struct urb * pWriteURB )
+static void QMITxnPut( sQMITxn * pTxn )
 {
-   if (pWriteURB == NULL)
+   sQMITxnEngine * pEngine = &pTxn->mpDev->mTxnEngine;
+   unsigned long flags;
+
+   if (atomic_dec_and_test( &pTxn->mRefCount ) == 0)
    {
-     QC_LOG_GLOBAL( "null urb\n" );
       return;
    }
 
-  QC_LOG_GLOBAL( "Write status/size %d/%d\n", pWriteURB->status, pWriteURB->actual_length );
+   kfree( pTxn->mpResp );
+   pTxn->mpResp = NULL;
+   kfree( pTxn->mpLargeBuffer );
+   pTxn->mpLargeBuffer = NULL;
+   pTxn->mpCallback = NULL;
+   pTxn->mpContext = NULL;
 
-   // Notify that write has completed by up()-ing semeaphore
-   up( (struct semaphore * )pWriteURB->context );
-   
-   return;
+   spin_lock_irqsave( &pEngine->mLock, flags );
+   list_add_tail( &pTxn->node, &pEngine->mFreeList );
+   pEngine->mFreeCount++;
+   spin_unlock_irqrestore( &pEngine->mLock, flags );
+
+   wake_up( &pEngine->mFreeWait );
 }
 
 /*===========================================================================
 METHOD:
-   WriteSync (Public Method)
+   QMITxnClaimLocked (Private Method)
 
 DESCRIPTION:
-   Start synchronous write
+   Take ownership of completing a transaction
+
+   Caller MUST have lock on mTxnEngine.mLock
 
 PARAMETERS:
-   pDev                 [ I ] - Device specific memory
-   pWriteBuffer         [ I ] - Data to be written
-   writeBufferSize      [ I ] - Size of data to be written
-   clientID             [ I ] - Client ID of requester
+   pTxn           [ I ] - Transaction slot
 
 RETURN VALUE:
-   int - write size (includes QMUX)
-         negative errno for failure
+   bool - true if the caller must now complete the transaction
+          false if it has already been completed by someone else
 ===========================================================================*/
-int WriteSync(
-   sGobiUSBNet *          pDev,
-   char *                 pWriteBuffer,
-   int                    writeBufferSize,
-   u16                    clientID,
-   sQMIDev *              QMIDev)
+static bool QMITxnClaimLocked( sQMITxn * pTxn )
+{
+   if (pTxn->mbDone == true)
+   {
+      return false;
+   }
+
+   pTxn->mbDone = true;
+   list_del_init( &pTxn->node );
+   return true;
+}
+
+/*===========================================================================
+METHOD:
+   QMITxnFinish (Private Method)
+
+DESCRIPTION:
+   Complete a claimed transaction: stop its timer, run its callback,
+   wake any waiter and drop the engine reference
+
+   May be called from interrupt context
+
+PARAMETERS:
+   pTxn           [ I ] - Transaction slot
+   status         [ I ] - 0 or negative errno
+   pResp          [ I ] - Response copy, freed with the slot
+   respSize       [ I ] - Size of pResp
+
+RETURN VALUE:
+   None
+===========================================================================*/
+static void QMITxnFinish(
+   sQMITxn *      pTxn,
+   int            status,
+   void *         pResp,
+   u16            respSize )
+{
+   pTxn->mStatus = status;
+   pTxn->mpResp = pResp;
+   pTxn->mRespSize = respSize;
+
+   // Drop the timer reference, unless the timer callback is running
+   //    in which case it drops it itself
+   if (hrtimer_try_to_cancel( &pTxn->mTimer ) == 1)
+   {
+      QMITxnPut( pTxn );
+   }
+
+   if (pTxn->mpCallback != NULL)
+   {
+      pTxn->mpCallback( pTxn->mpDev,
+                        status,
+                        pResp,
+                        respSize,
+                        pTxn->mpContext );
+   }
+
+   complete_all( &pTxn->mDone );
+
+   // Drop the engine reference
+   QMITxnPut( pTxn );
+}
+
+/*===========================================================================
+METHOD:
+   QMITxnFail (Private Method)
+
+DESCRIPTION:
+   Complete a claimed transaction with an error and unlink its URB
+
+   May be called from interrupt context
+
+PARAMETERS:
+   pTxn           [ I ] - Transaction slot
+   status         [ I ] - Negative errno
+
+RETURN VALUE:
+   None
+===========================================================================*/
+static void QMITxnFail(
+   sQMITxn *      pTxn,
+   int            status )
+{
+   // Still holding the engine reference, so the URB can't be reused yet
+   usb_unlink_urb( pTxn->mpURB );
+
+   QMITxnFinish( pTxn, status, NULL, 0 );
+}
+
+/*===========================================================================
+METHOD:
+   QMITxnTimerCallback (Private Method)
+
+DESCRIPTION:
+   Response timer expired, fail the transaction with -ETIME
+
+PARAMETERS:
+   pTimer         [ I ] - Timer of the transaction slot
+
+RETURN VALUE:
+   enum hrtimer_restart - HRTIMER_NORESTART
+===========================================================================*/
+static enum hrtimer_restart QMITxnTimerCallback( struct hrtimer * pTimer )
+{
+   sQMITxn * pTxn = container_of( pTimer, sQMITxn, mTimer );
+   sQMITxnEngine * pEngine = &pTxn->mpDev->mTxnEngine;
+   unsigned long flags;
+   bool bClaimed;
+
+   spin_lock_irqsave( &pEngine->mLock, flags );
+   bClaimed = QMITxnClaimLocked( pTxn );
+   spin_unlock_irqrestore( &pEngine->mLock, flags );
+
+   if (bClaimed == true)
+   {
+      QC_LOG_ERR( pTxn->mpQMIDev,
+                  "client 0x%x TID 0x%x timed out\n",
+                  pTxn->mClientID,
+                  pTxn->mTransactionID );
+      QMITxnFail( pTxn, -ETIME );
+   }
+
+   // Drop the timer reference
+   QMITxnPut( pTxn );
+
+   return HRTIMER_NORESTART;
+}
+
+/*===========================================================================
+METHOD:
+   QMITxnWriteCallback (Private Method)
+
+DESCRIPTION:
+   Control URB of a transaction completed
+   Completes write-only transactions and transactions whose write failed
+
+PARAMETERS:
+   pWriteURB      [ I ] - URB this callback is run for
+
+RETURN VALUE:
+   None
+===========================================================================*/
+static void QMITxnWriteCallback( struct urb * pWriteURB )
+{
+   sQMITxn * pTxn = pWriteURB->context;
+   sGobiUSBNet * pDev = pTxn->mpDev;
+   unsigned long flags;
+   bool bClaimed = false;
+
+   QC_LOG_DBG( pTxn->mpQMIDev,
+               "Write status/size %d/%d\n",
+               pWriteURB->status,
+               pWriteURB->actual_length );
+
+   if (pWriteURB->status != 0
+   ||  (pTxn->mFlags & QMI_TXN_FLAG_NO_RESP) != 0)
+   {
+      spin_lock_irqsave( &pDev->mTxnEngine.mLock, flags );
+      bClaimed = QMITxnClaimLocked( pTxn );
+      spin_unlock_irqrestore( &pDev->mTxnEngine.mLock, flags );
+   }
+
+   if (bClaimed == true)
+   {
+      QMITxnFinish( pTxn, pWriteURB->status, NULL, 0 );
+   }
+
+   // Write is done, release device
+   usb_autopm_put_interface_async( pDev->mpIntf );
+
+   // Drop the URB reference
+   QMITxnPut( pTxn );
+}
+
+/*===========================================================================
+METHOD:
+   QMITxnTryAlloc (Private Method)
+
+DESCRIPTION:
+   Take a slot from the free list
+
+PARAMETERS:
+   pEngine        [ I ] - Transaction engine
+   ppTxn          [ O ] - Slot, or NULL if the engine is stopped
+
+RETURN VALUE:
+   bool - true if *ppTxn is valid
+          false if no slot is free yet
+===========================================================================*/
+static bool QMITxnTryAlloc(
+   sQMITxnEngine *   pEngine,
+   sQMITxn **        ppTxn )
+{
+   unsigned long flags;
+   bool bResult = true;
+
+   spin_lock_irqsave( &pEngine->mLock, flags );
+   if (pEngine->mbActive == false)
+   {
+      *ppTxn = NULL;
+   }
+   else if (list_empty( &pEngine->mFreeList ))
+   {
+      bResult = false;
+   }
+   else
+   {
+      *ppTxn = list_first_entry( &pEngine->mFreeList, sQMITxn, node );
+      list_del_init( &(*ppTxn)->node );
+      pEngine->mFreeCount--;
+   }
+   spin_unlock_irqrestore( &pEngine->mLock, flags );
+
+   return bResult;
+}
+
+/*===========================================================================
+METHOD:
+   QMITxnStart (Private Method)
+
+DESCRIPTION:
+   Fill QMUX, copy the request into a free slot and submit its control URB
+
+   Must be called from process context
+
+PARAMETERS:
+   pDev              [ I ] - Device specific memory
+   QMIDev            [ I ] - QMI "device" of the requester
+   clientID          [ I ] - Client ID of requester
+   transactionID     [ I ] - Transaction ID the response carries
+   pWriteBuffer      [ I ] - Request, starting with room for QMUX
+   writeBufferSize   [ I ] - Size of request (includes QMUX)
+   timeoutMs         [ I ] - Timeout in milliseconds, 0 for none
+   txnFlags          [ I ] - QMI_TXN_FLAG_*
+   pCallback         [ I ] - Run once the transaction is done, may be NULL
+   pContext          [ I ] - Passed (unmodified) to pCallback
+   ppTxn             [ O ] - If not NULL, holds a reference on the slot
+                             that must be released with QMITxnWait()
+
+RETURN VALUE:
+   int - 0 for success
+         negative errno for failure, pCallback is not run
+===========================================================================*/
+static int QMITxnStart(
+   sGobiUSBNet *      pDev,
+   sQMIDev *          QMIDev,
+   u16                clientID,
+   u16                transactionID,
+   void *             pWriteBuffer,
+   u16                writeBufferSize,
+   u32                timeoutMs,
+   u32                txnFlags,
+   void               (* pCallback)(sGobiUSBNet *, int, void *, u16, void *),
+   void *             pContext,
+   sQMITxn **         ppTxn )
 {
+   sQMITxnEngine * pEngine;
+   sQMITxn * pTxn = NULL;
+   void * pBuffer;
+   unsigned long flags;
    int result;
-   struct semaphore writeSem;
-   struct urb * pWriteURB;
-   //sURBSetupPacket writeSetup;
-   sURBSetupPacket *writeSetup;
 
    if (IsDeviceValid( pDev ) == false)
    {
       QC_LOG_ERR(QMIDev,"Invalid device!\n" );
       return -ENXIO;
    }
-   
-   
-   pWriteURB = usb_alloc_urb( 0, GFP_KERNEL );
-   if (pWriteURB == NULL)
-   {
-      QC_LOG_ERR(QMIDev,"URB mem error\n" );
-      return -ENOMEM;
-   }
+   pEngine = &pDev->mTxnEngine;
 
    // Fill writeBuffer with QMUX
    result = FillQMUX( clientID, pWriteBuffer, writeBufferSize );
    if (result < 0)
    {
-      usb_free_urb( pWriteURB );
       return result;
    }
 
-   writeSetup = kzalloc(sizeof(sURBSetupPacket), GFP_KERNEL);
-   if (writeSetup == NULL)
+   // Wait for a free slot
+   if (interruptible != 0)
    {
-      QC_LOG_ERR(QMIDev,"writeSetup mem error\n" );
-      return -ENOMEM;
+      result = wait_event_interruptible( pEngine->mFreeWait,
+                                         QMITxnTryAlloc( pEngine, &pTxn ) );
+      if (result != 0)
+      {
+         return -EINTR;
+      }
+   }
+   else
+   {
+      wait_event( pEngine->mFreeWait, QMITxnTryAlloc( pEngine, &pTxn ) );
+   }
+
+   if (pTxn == NULL)
+   {
+      QC_LOG_ERR(QMIDev,"transaction engine stopped\n" );
+      return -ENXIO;
+   }
+
+   // Engine reference, plus one held by us until the URB is submitted
+   atomic_set( &pTxn->mRefCount, 2 );
+
+   if (writeBufferSize > QMI_TXN_BUFFER_SIZE)
+   {
+      pTxn->mpLargeBuffer = kmalloc( writeBufferSize, GFP_KERNEL );
+      if (pTxn->mpLargeBuffer == NULL)
+      {
+         QC_LOG_ERR(QMIDev,"request mem error\n" );
+         QMITxnPut( pTxn );
+         QMITxnPut( pTxn );
+         return -ENOMEM;
+      }
+      pBuffer = pTxn->mpLargeBuffer;
+   }
+   else
+   {
+      pBuffer = pTxn->mpBuffer;
    }
+   memcpy( pBuffer, pWriteBuffer, writeBufferSize );
+
+   pTxn->mpQMIDev = QMIDev;
+   pTxn->mClientID = clientID;
+   pTxn->mTransactionID = transactionID;
+   pTxn->mFlags = txnFlags;
+   pTxn->mpCallback = pCallback;
+   pTxn->mpContext = pContext;
+   pTxn->mpResp = NULL;
+   pTxn->mRespSize = 0;
+   pTxn->mStatus = 0;
+   pTxn->mbDone = false;
+   reinit_completion( &pTxn->mDone );
 
    // CDC Send Encapsulated Request packet
-   writeSetup->mRequestType = 0x21;
-   writeSetup->mRequestCode = 0;
-   writeSetup->mValue = 0;
-   writeSetup->mIndex = pDev->mpEndpoints->mIntfNum;
-   writeSetup->mLength = writeBufferSize;
-
-   // Create URB   
-   usb_fill_control_urb( pWriteURB,
+   pTxn->mpSetupPacket->mRequestType = 0x21;
+   pTxn->mpSetupPacket->mRequestCode = 0;
+   pTxn->mpSetupPacket->mValue = 0;
+   pTxn->mpSetupPacket->mIndex = pDev->mpEndpoints->mIntfNum;
+   pTxn->mpSetupPacket->mLength = writeBufferSize;
+
+   usb_fill_control_urb( pTxn->mpURB,
                          pDev->mpNetDev->udev,
                          usb_sndctrlpipe( pDev->mpNetDev->udev, 0 ),
-                         (unsigned char *)writeSetup,
-                         (void*)pWriteBuffer,
+                         (unsigned char *)pTxn->mpSetupPacket,
+                         pBuffer,
                          writeBufferSize,
-                         NULL,
-                         pDev );
+                         QMITxnWriteCallback,
+                         pTxn );
 
-   QC_LOG_INFO(QMIDev,"Write size %d\n", writeSetup->mLength );
-   PrintHex( pWriteBuffer, writeBufferSize );
+   QC_LOG_INFO(QMIDev,"Write size %d, client 0x%x TID 0x%x\n",
+               writeBufferSize, clientID, transactionID );
+   PrintHex( pBuffer, writeBufferSize );
+   QMICaptureRecord( pDev, QMI_CAPTURE_DIR_TX, pBuffer, writeBufferSize );
 
-   sema_init( &writeSem, 0 );
-   
-   pWriteURB->complete = WriteSyncCallback;
-   pWriteURB->context = &writeSem;
-   
    // Wake device
-   //QC_LOG_GLOBAL( "<QMIDevice> Device Wakeup\n" );
    result = usb_autopm_get_interface( pDev->mpIntf );
    if (result < 0)
    {
       QC_LOG_ERR(QMIDev,"unable to resume interface: %d\n", result );
-      
+
       // Likely caused by device going from autosuspend -> full suspend
       if (result == -EPERM)
       {
@@ -1445,121 +1756,680 @@ int WriteSync(
          GobiSuspend( pDev->mpIntf, PMSG_SUSPEND );
       }
 
-      usb_free_urb( pWriteURB );
-      kfree(writeSetup);
-      
+      QMITxnPut( pTxn );
+      QMITxnPut( pTxn );
       return result;
    }
 
-   if (AddToURBList( pDev, clientID, pWriteURB, QMIDev ) == false)
+   // Register for the response before it can possibly arrive
+   if ((txnFlags & QMI_TXN_FLAG_NO_RESP) == 0)
    {
-
-      usb_autopm_put_interface( pDev->mpIntf );
-      usb_free_urb( pWriteURB );   
-      kfree(writeSetup);
-
-      return -EINVAL;
+      spin_lock_irqsave( &pEngine->mLock, flags );
+      list_add_tail( &pTxn->node, &pEngine->mPendingList );
+      spin_unlock_irqrestore( &pEngine->mLock, flags );
    }
 
-   result = usb_submit_urb( pWriteURB, GFP_KERNEL );
+   // URB reference
+   atomic_inc( &pTxn->mRefCount );
+
+   result = usb_submit_urb( pTxn->mpURB, GFP_KERNEL );
    if (result < 0)
    {
-      QC_LOG_DBG(QMIDev,"submit URB error %d\n", result );
-      
-      // Get URB back so we can destroy it
-      if (PopFromURBList( pDev, clientID, QMIDev ) != pWriteURB)
-      {
-         // This shouldn't happen
-         QC_LOG_EXCEPTION(QMIDev,"Didn't get write URB back\n" );
-         
-      }
-      else
-      {
-         usb_free_urb( pWriteURB );
-      }
-      
+      QC_LOG_ERR(QMIDev,"submit URB error %d\n", result );
+
+      // Nothing else can complete a transaction that was never sent
+      spin_lock_irqsave( &pEngine->mLock, flags );
+      QMITxnClaimLocked( pTxn );
+      spin_unlock_irqrestore( &pEngine->mLock, flags );
+
       usb_autopm_put_interface( pDev->mpIntf );
-      kfree(writeSetup);
 
+      // Drop the URB, engine and our own reference
+      QMITxnPut( pTxn );
+      QMITxnPut( pTxn );
+      QMITxnPut( pTxn );
       return result;
    }
 
-   if (use_down_timeout != 0)
-   {
-       // Allow user interrupts
-       result = down_timeout( &writeSem, WRITE_TIMEOUT);
-   }
-   else
+   // Arm the timer unless the transaction is already done
+   if (timeoutMs != 0)
    {
-      // Wait for write to finish
-      if (interruptible != 0)
-      {
-         // Allow user interrupts
-         result = down_interruptible( &writeSem );
-      }
-      else
+      spin_lock_irqsave( &pEngine->mLock, flags );
+      if (pTxn->mbDone == false)
       {
-         // Ignore user interrupts
-         result = 0;
-         down( &writeSem );
+         // Timer reference
+         atomic_inc( &pTxn->mRefCount );
+         hrtimer_start( &pTxn->mTimer,
+                        ktime_set( timeoutMs / MSEC_PER_SEC,
+                                   (timeoutMs % MSEC_PER_SEC) * NSEC_PER_MSEC ),
+                        HRTIMER_MODE_REL );
       }
+      spin_unlock_irqrestore( &pEngine->mLock, flags );
    }
 
-   // Write is done, release device
-   usb_autopm_put_interface( pDev->mpIntf );
-   // Verify device is still valid
-   if (IsDeviceValid( pDev ) == false)
+   if (ppTxn != NULL)
    {
-      QC_LOG_ERR(QMIDev,"Invalid device!\n" );
-
-      kfree(writeSetup);
-      return -ENXIO;
+      // Hand our reference over to the waiter
+      *ppTxn = pTxn;
    }
-
-   // Get URB back so we can destroy it
-   if (PopFromURBList( pDev, clientID, QMIDev ) != pWriteURB)
+   else
    {
-      // This shouldn't happen
-      QC_LOG_EXCEPTION(QMIDev, "Didn't get write URB back\n" );
-      // Add URB back in URBlist
-      if (pWriteURB != NULL)
-         AddToURBList( pDev, clientID, pWriteURB, QMIDev );
-      kfree(writeSetup);
-      return -EINVAL;
+      QMITxnPut( pTxn );
    }
 
-   if (result == 0)
-   {
-      // Write is finished
-      if (pWriteURB->status == 0)
-      {
-         // Return number of bytes that were supposed to have been written,
-         //   not size of QMI request
-         result = writeBufferSize;
-      }
-      else
-      {
-         QC_LOG_ERR(QMIDev,"bad status = %d\n", pWriteURB->status );
-         
-         // Return error value
-         result = pWriteURB->status;
-      }
+   return 0;
+}
+
+/*===========================================================================
+METHOD:
+   QMITxnWait (Private Method)
+
+DESCRIPTION:
+   Wait for a transaction started by QMITxnStart() and release it
+
+PARAMETERS:
+   pTxn           [ I ] - Transaction slot
+   ppOutBuffer    [ O ] - On success, will be filled with a pointer to
+                          the response, which the caller must kfree()
+                          Unused for QMI_TXN_FLAG_NO_RESP transactions
+
+RETURN VALUE:
+   int - size of response (0 for write-only transactions) for success
+         negative errno for failure
+===========================================================================*/
+static int QMITxnWait(
+   sQMITxn *      pTxn,
+   void **        ppOutBuffer )
+{
+   sQMITxnEngine * pEngine = &pTxn->mpDev->mTxnEngine;
+   unsigned long flags;
+   bool bClaimed;
+   int result = 0;
+
+   if (interruptible != 0)
+   {
+      // Allow user interrupts
+      result = wait_for_completion_interruptible( &pTxn->mDone );
    }
    else
    {
-      // We have been forcibly interrupted
-      QC_LOG_ERR(QMIDev, "Interrupted %d !!!\n", result );
-      QC_LOG_ERR(QMIDev, "Device may be in bad state and need reset !!!\n" );
+      // Ignore user interrupts
+      wait_for_completion( &pTxn->mDone );
+   }
+
+   if (result != 0)
+   {
+      QC_LOG_INFO(pTxn->mpQMIDev, "Interrupted %d\n", result );
 
-      // URB has not finished
-      usb_kill_urb( pWriteURB );
+      spin_lock_irqsave( &pEngine->mLock, flags );
+      bClaimed = QMITxnClaimLocked( pTxn );
+      spin_unlock_irqrestore( &pEngine->mLock, flags );
+
+      if (bClaimed == true)
+      {
+         QMITxnFail( pTxn, -EINTR );
+      }
+
+      // Whoever claimed it signals completion right after
+      wait_for_completion( &pTxn->mDone );
    }
 
-   usb_free_urb( pWriteURB );
-   kfree(writeSetup);
+   result = pTxn->mStatus;
+   if (result == 0 && (pTxn->mFlags & QMI_TXN_FLAG_NO_RESP) == 0)
+   {
+      *ppOutBuffer = pTxn->mpResp;
+      pTxn->mpResp = NULL;
+      result = pTxn->mRespSize;
+   }
+
+   // Drop the waiter reference
+   QMITxnPut( pTxn );
+
    return result;
 }
 
+/*===========================================================================
+METHOD:
+   QMITxnSubmit (Public Method)
+
+DESCRIPTION:
+   Start an asynchronous QMI transaction
+   pCallback is run exactly once, from interrupt context, with the status
+   and the response; the response is only valid during the callback
+
+   Must be called from process context
+
+PARAMETERS:
+   pDev              [ I ] - Device specific memory
+   QMIDev            [ I ] - QMI "device" of the requester
+   clientID          [ I ] - Client ID of requester
+   transactionID     [ I ] - Transaction ID the response carries
+   pWriteBuffer      [ I ] - Request, starting with room for QMUX
+                             Copied, may be freed on return
+   writeBufferSize   [ I ] - Size of request (includes QMUX)
+   timeoutMs         [ I ] - Timeout in milliseconds, 0 for none
+   txnFlags          [ I ] - QMI_TXN_FLAG_*
+   pCallback         [ I ] - Function to be run when the transaction is done
+   pContext          [ I ] - Passed (unmodified) to pCallback
+
+RETURN VALUE:
+   int - 0 for success
+         negative errno for failure, pCallback is not run
+===========================================================================*/
+int QMITxnSubmit(
+   sGobiUSBNet *      pDev,
+   sQMIDev *          QMIDev,
+   u16                clientID,
+   u16                transactionID,
+   void *             pWriteBuffer,
+   u16                writeBufferSize,
+   u32                timeoutMs,
+   u32                txnFlags,
+   void               (* pCallback)(sGobiUSBNet *, int, void *, u16, void *),
+   void *             pContext )
+{
+   return QMITxnStart( pDev,
+                       QMIDev,
+                       clientID,
+                       transactionID,
+                       pWriteBuffer,
+                       writeBufferSize,
+                       timeoutMs,
+                       txnFlags,
+                       pCallback,
+                       pContext,
+                       NULL );
+}
+
+/*===========================================================================
+METHOD:
+   QMITxnExchange (Public Method)
+
+DESCRIPTION:
+   Send a QMI request and wait for the response with the same client ID
+   and transaction ID
+
+PARAMETERS:
+   pDev              [ I ] - Device specific memory
+   QMIDev            [ I ] - QMI "device" of the requester
+   clientID          [ I ] - Client ID of requester
+   transactionID     [ I ] - Transaction ID of the request
+   pWriteBuffer      [ I ] - Request, starting with room for QMUX
+                             Copied, may be freed on return
+   writeBufferSize   [ I ] - Size of request (includes QMUX)
+   ppOutBuffer       [ O ] - On success, will be filled with a pointer
+                             to the response, which the caller must kfree()
+   timeoutMs         [ I ] - Timeout in milliseconds, 0 for none
+
+RETURN VALUE:
+   int - size of response for success
+         negative errno for failure
+===========================================================================*/
+int QMITxnExchange(
+   sGobiUSBNet *      pDev,
+   sQMIDev *          QMIDev,
+   u16                clientID,
+   u16                transactionID,
+   void *             pWriteBuffer,
+   u16                writeBufferSize,
+   void **            ppOutBuffer,
+   u32                timeoutMs )
+{
+   sQMITxn * pTxn;
+   int result;
+
+   result = QMITxnStart( pDev,
+                         QMIDev,
+                         clientID,
+                         transactionID,
+                         pWriteBuffer,
+                         writeBufferSize,
+                         timeoutMs,
+                         0,
+                         NULL,
+                         NULL,
+                         &pTxn );
+   if (result < 0)
+   {
+      return result;
+   }
+
+   return QMITxnWait( pTxn, ppOutBuffer );
+}
+
+/*===========================================================================
+METHOD:
+   QMITxnDispatch (Public Method)
+
+DESCRIPTION:
+   Complete the pending transaction a message read from the device
+   responds to, if any
+
+   Called from ReadCallback
+
+PARAMETERS:
+   pDev              [ I ] - Device specific memory
+   clientID          [ I ] - Client ID from QMUX
+   transactionID     [ I ] - Transaction ID from the SDU
+   pData             [ I ] - Message, including QMUX
+   dataSize          [ I ] - Size of message
+
+RETURN VALUE:
+   bool - true if the message was consumed by a transaction
+===========================================================================*/
+bool QMITxnDispatch(
+   sGobiUSBNet *      pDev,
+   u16                clientID,
+   u16                transactionID,
+   void *             pData,
+   u16                dataSize )
+{
+   sQMITxnEngine * pEngine = &pDev->mTxnEngine;
+   sQMITxn * pTxnIter;
+   sQMITxn * pTxn = NULL;
+   void * pResp;
+   unsigned long flags;
+   u8 ctrlFlag;
+
+   // Broadcasts and indications never answer a transaction
+   if (pEngine->mpPool == NULL
+   ||  transactionID == 0
+   ||  clientID >> 8 == 0xff
+   ||  dataSize <= QMUXHeaderSize())
+   {
+      return false;
+   }
+
+   ctrlFlag = *(u8 *)(pData + QMUXHeaderSize());
+   if (clientID == QMICTL)
+   {
+      if ((ctrlFlag & QMICTL_INDICATION_CONTROL_FLAG) != 0)
+      {
+         return false;
+      }
+   }
+   else if ((ctrlFlag & QMI_INDICATION_CONTROL_FLAG) != 0)
+   {
+      return false;
+   }
+
+   spin_lock_irqsave( &pEngine->mLock, flags );
+   list_for_each_entry( pTxnIter, &pEngine->mPendingList, node )
+   {
+      if (pTxnIter->mClientID == clientID
+      &&  pTxnIter->mTransactionID == transactionID)
+      {
+         pTxn = pTxnIter;
+         QMITxnClaimLocked( pTxn );
+         break;
+      }
+   }
+   spin_unlock_irqrestore( &pEngine->mLock, flags );
+
+   if (pTxn == NULL)
+   {
+      return false;
+   }
+
+   QC_LOG_DBG(pTxn->mpQMIDev, "response for client 0x%x TID 0x%x\n",
+              clientID, transactionID );
+
+   // Responses such as runtime settings also feed the indication ring
+   processIndResponses( pData, pDev, pTxn->mpQMIDev, dataSize, clientID );
+
+   pResp = kmalloc( dataSize, GFP_ATOMIC );
+   if (pResp == NULL)
+   {
+      QMITxnFinish( pTxn, -ENOMEM, NULL, 0 );
+      return true;
+   }
+   memcpy( pResp, pData, dataSize );
+
+   QMITxnFinish( pTxn, 0, pResp, dataSize );
+   return true;
+}
+
+/*===========================================================================
+METHOD:
+   QMITxnCancelClient (Public Method)
+
+DESCRIPTION:
+   Fail all pending transactions of a client with -ENXIO
+
+PARAMETERS:
+   pDev              [ I ] - Device specific memory
+   clientID          [ I ] - Client ID being released
+
+RETURN VALUE:
+   None
+===========================================================================*/
+void QMITxnCancelClient(
+   sGobiUSBNet *      pDev,
+   u16                clientID )
+{
+   sQMITxnEngine * pEngine = &pDev->mTxnEngine;
+   sQMITxn * pTxnIter;
+   sQMITxn * pTxn;
+   unsigned long flags;
+
+   if (pEngine->mpPool == NULL)
+   {
+      return;
+   }
+
+   do
+   {
+      pTxn = NULL;
+      spin_lock_irqsave( &pEngine->mLock, flags );
+      list_for_each_entry( pTxnIter, &pEngine->mPendingList, node )
+      {
+         if (pTxnIter->mClientID == clientID)
+         {
+            pTxn = pTxnIter;
+            QMITxnClaimLocked( pTxn );
+            break;
+         }
+      }
+      spin_unlock_irqrestore( &pEngine->mLock, flags );
+
+      if (pTxn != NULL)
+      {
+         QMITxnFail( pTxn, -ENXIO );
+      }
+   } while (pTxn != NULL);
+}
+
+/*===========================================================================
+METHOD:
+   QMITxnCancelContext (Private Method)
+
+DESCRIPTION:
+   Fail all transactions in flight that were submitted with pContext,
+   whether or not they wait for a response
+
+PARAMETERS:
+   pDev              [ I ] - Device specific memory
+   pContext          [ I ] - Context the transactions were submitted with
+   status            [ I ] - Negative errno to fail them with
+
+RETURN VALUE:
+   None
+===========================================================================*/
+static void QMITxnCancelContext(
+   sGobiUSBNet *      pDev,
+   void *             pContext,
+   int                status )
+{
+   sQMITxnEngine * pEngine = &pDev->mTxnEngine;
+   sQMITxn * pTxn;
+   unsigned long flags;
+   int i;
+
+   if (pEngine->mpPool == NULL)
+   {
+      return;
+   }
+
+   // Write-only transactions are on no list, so look at every slot
+   for (i = 0; i < QMI_TXN_POOL_SIZE; i++)
+   {
+      pTxn = &pEngine->mpPool[i];
+
+      spin_lock_irqsave( &pEngine->mLock, flags );
+      if (pTxn->mpContext != pContext
+      ||  QMITxnClaimLocked( pTxn ) == false)
+      {
+         pTxn = NULL;
+      }
+      spin_unlock_irqrestore( &pEngine->mLock, flags );
+
+      if (pTxn != NULL)
+      {
+         QMITxnFail( pTxn, status );
+      }
+   }
+}
+
+/*===========================================================================
+METHOD:
+   QMITxnEngineInit (Public Method)
+
+DESCRIPTION:
+   Allocate the transaction slots, each with its own control URB, setup
+   packet and request buffer, and start accepting transactions
+
+PARAMETERS:
+   pDev     [ I ] - Device specific memory
+
+RETURN VALUE:
+   int - 0 for success
+         Negative errno for failure
+===========================================================================*/
+int QMITxnEngineInit( sGobiUSBNet * pDev )
+{
+   sQMITxnEngine * pEngine = &pDev->mTxnEngine;
+   sQMITxn * pTxn;
+   int i;
+
+   spin_lock_init( &pEngine->mLock );
+   init_waitqueue_head( &pEngine->mFreeWait );
+   INIT_LIST_HEAD( &pEngine->mFreeList );
+   INIT_LIST_HEAD( &pEngine->mPendingList );
+   pEngine->mFreeCount = 0;
+   pEngine->mbActive = false;
+
+   pEngine->mpPool = kzalloc_node( QMI_TXN_POOL_SIZE * sizeof( sQMITxn ), GFP_KERNEL, pDev->mNumaNode );
+   if (pEngine->mpPool == NULL)
+   {
+      QC_LOG_ERR(GET_QMIDEV(pDev),"transaction pool mem error\n" );
+      return -ENOMEM;
+   }
+
+   for (i = 0; i < QMI_TXN_POOL_SIZE; i++)
+   {
+      pTxn = &pEngine->mpPool[i];
+      pTxn->mpDev = pDev;
+      pTxn->mpQMIDev = GET_QMIDEV(pDev);
+      pTxn->mbDone = true;
+      init_completion( &pTxn->mDone );
+#if (LINUX_VERSION_CODE >= KERNEL_VERSION(6, 15, 0))
+      hrtimer_setup( &pTxn->mTimer, QMITxnTimerCallback,
+                     CLOCK_MONOTONIC, HRTIMER_MODE_REL );
+#else
+      hrtimer_init( &pTxn->mTimer, CLOCK_MONOTONIC, HRTIMER_MODE_REL );
+      pTxn->mTimer.function = QMITxnTimerCallback;
+#endif
+
+      pTxn->mpURB = usb_alloc_urb( 0, GFP_KERNEL );
+      pTxn->mpSetupPacket = kzalloc_node( sizeof( sURBSetupPacket ), GFP_KERNEL, pDev->mNumaNode );
+      pTxn->mpBuffer = kmalloc_node( QMI_TXN_BUFFER_SIZE, GFP_KERNEL, pDev->mNumaNode );
+      if (pTxn->mpURB == NULL
+      ||  pTxn->mpSetupPacket == NULL
+      ||  pTxn->mpBuffer == NULL)
+      {
+         QC_LOG_ERR(GET_QMIDEV(pDev),"transaction slot mem error\n" );
+         QMITxnEngineRelease( pDev );
+         return -ENOMEM;
+      }
+
+      list_add_tail( &pTxn->node, &pEngine->mFreeList );
+      pEngine->mFreeCount++;
+   }
+
+   pEngine->mbActive = true;
+   return 0;
+}
+
+/*===========================================================================
+METHOD:
+   QMITxnEngineStop (Public Method)
+
+DESCRIPTION:
+   Refuse new transactions, fail the pending ones with -ENODEV and wait
+   until every slot is back on the free list
+
+PARAMETERS:
+   pDev     [ I ] - Device specific memory
+
+RETURN VALUE:
+   None
+===========================================================================*/
+void QMITxnEngineStop( sGobiUSBNet * pDev )
+{
+   sQMITxnEngine * pEngine = &pDev->mTxnEngine;
+   sQMITxn * pTxn;
+   unsigned long flags;
+   int i;
+
+   if (pEngine->mpPool == NULL)
+   {
+      return;
+   }
+
+   spin_lock_irqsave( &pEngine->mLock, flags );
+   pEngine->mbActive = false;
+   spin_unlock_irqrestore( &pEngine->mLock, flags );
+
+   // Let anyone waiting for a slot see the engine is stopped
+   wake_up( &pEngine->mFreeWait );
+
+   do
+   {
+      pTxn = NULL;
+      spin_lock_irqsave( &pEngine->mLock, flags );
+      if (list_empty( &pEngine->mPendingList ) == 0)
+      {
+         pTxn = list_first_entry( &pEngine->mPendingList, sQMITxn, node );
+         QMITxnClaimLocked( pTxn );
+      }
+      spin_unlock_irqrestore( &pEngine->mLock, flags );
+
+      if (pTxn != NULL)
+      {
+         QMITxnFail( pTxn, -ENODEV );
+      }
+   } while (pTxn != NULL);
+
+   // Flush write-only transactions and running timers
+   for (i = 0; i < QMI_TXN_POOL_SIZE; i++)
+   {
+      pTxn = &pEngine->mpPool[i];
+      if (pTxn->mpURB != NULL)
+      {
+         usb_kill_urb( pTxn->mpURB );
+      }
+      hrtimer_cancel( &pTxn->mTimer );
+   }
+
+   // Synchronous waiters drop their reference as soon as they wake up
+   wait_event( pEngine->mFreeWait,
+               pEngine->mFreeCount == QMI_TXN_POOL_SIZE );
+}
+
+/*===========================================================================
+METHOD:
+   QMITxnEngineRelease (Public Method)
+
+DESCRIPTION:
+   Stop the transaction engine and free the transaction slots
+
+PARAMETERS:
+   pDev     [ I ] - Device specific memory
+
+RETURN VALUE:
+   None
+===========================================================================*/
+void QMITxnEngineRelease( sGobiUSBNet * pDev )
+{
+   sQMITxnEngine * pEngine;
+   sQMITxn * pTxn;
+   int i;
+
+   if (pDev == NULL || pDev->mTxnEngine.mpPool == NULL)
+   {
+      return;
+   }
+   pEngine = &pDev->mTxnEngine;
+
+   // Slots still being set up by QMITxnEngineInit are not on the free list
+   if (pEngine->mbActive == true)
+   {
+      QMITxnEngineStop( pDev );
+   }
+
+   for (i = 0; i < QMI_TXN_POOL_SIZE; i++)
+   {
+      pTxn = &pEngine->mpPool[i];
+      usb_free_urb( pTxn->mpURB );
+      kfree( pTxn->mpSetupPacket );
+      kfree( pTxn->mpBuffer );
+   }
+
+   kfree( pEngine->mpPool );
+   pEngine->mpPool = NULL;
+}
+
+/*===========================================================================
+METHOD:
+   WriteSync (Public Method)
+
+DESCRIPTION:
+   Start synchronous write on a preallocated transaction slot
+
+PARAMETERS:
+   pDev                 [ I ] - Device specific memory
+   pWriteBuffer         [ I ] - Data to be written
+   writeBufferSize      [ I ] - Size of data to be written
+   clientID             [ I ] - Client ID of requester
+
+RETURN VALUE:
+   int - write size (includes QMUX)
+         negative errno for failure
+===========================================================================*/
+int WriteSync(
+   sGobiUSBNet *          pDev,
+   char *                 pWriteBuffer,
+   int                    writeBufferSize,
+   u16                    clientID,
+   sQMIDev *              QMIDev)
+{
+   sQMITxn * pTxn;
+   int result;
+
+   if (writeBufferSize <= 0 || writeBufferSize > 0xFFFF)
+   {
+      QC_LOG_ERR(QMIDev,"bad write size %d\n", writeBufferSize );
+      return -EINVAL;
+   }
+
+   result = QMITxnStart( pDev,
+                         QMIDev,
+                         clientID,
+                         0,
+                         pWriteBuffer,
+                         writeBufferSize,
+                         (use_down_timeout != 0) ? jiffies_to_msecs( WRITE_TIMEOUT ) : 0,
+                         QMI_TXN_FLAG_NO_RESP,
+                         NULL,
+                         NULL,
+                         &pTxn );
+   if (result < 0)
+   {
+      return result;
+   }
+
+   result = QMITxnWait( pTxn, NULL );
+   if (result < 0)
+   {
+      QC_LOG_ERR(QMIDev,"bad status = %d\n", result );
+      return result;
+   }
+
+   // Return number of bytes that were supposed to have been written,
+   //   not size of QMI request
+   return writeBufferSize;
+}
+
 /*=========================================================================*/
 // Internal memory management functions
 /*=========================================================================*/
@@ -1631,23 +2501,15 @@ int GetClientID(
          return result;
       }
 
-      result = WriteSync( pDev,
-                          pWriteBuffer,
-                          writeBufferSize,
-                          QMICTL,
-                          &pDev->mQMIDev);
+      result = QMITxnExchange( pDev,
+                               &pDev->mQMIDev,
+                               QMICTL,
+                               transactionID,
+                               pWriteBuffer,
+                               writeBufferSize,
+                               &pReadBuffer,
+                               QMI_TXN_TIMEOUT_MS );
       kfree( pWriteBuffer );
-
-      if (result < 0)
-      {
-         return result;
-      }
-
-      result = ReadSyncTimeout( pDev,
-                         &pReadBuffer,
-                         QMICTL,
-                         transactionID,
-                         &pDev->mQMIDev);
       if (result < 0)
       {
          QC_LOG_ERR(QMIDev, "bad read data %d\n", result );
@@ -1774,45 +2636,39 @@ void ReleaseClientID(
          }
          else
          {
-            result = WriteSync( pDev,
-                                pWriteBuffer,
-                                writeBufferSize,
-                                QMICTL,
-                                &pDev->mQMIDev);
+            result = QMITxnExchange( pDev,
+                                     &pDev->mQMIDev,
+                                     QMICTL,
+                                     transactionID,
+                                     pWriteBuffer,
+                                     writeBufferSize,
+                                     &pReadBuffer,
+                                     QMI_TXN_TIMEOUT_MS );
             kfree( pWriteBuffer );
 
             if (result < 0)
             {
-               QC_LOG_ERR(QMIDev,"bad write status %d\n", result );
+               QC_LOG_ERR(QMIDev,"bad read status %d\n", result );
             }
             else
             {
-               result = ReadSyncTimeout( pDev,
-                                  &pReadBuffer,
-                                  QMICTL,
-                                  transactionID,
-                                  &pDev->mQMIDev);
+               readBufferSize = result;
+               result = QMICTLReleaseClientIDResp( pReadBuffer,
+                                                   readBufferSize );
+               kfree( pReadBuffer );
+
                if (result < 0)
                {
-                  QC_LOG_ERR(QMIDev,"bad read status %d\n", result );
-               }
-               else
-               {
-                  readBufferSize = result;
-                  result = QMICTLReleaseClientIDResp( pReadBuffer,
-                                                      readBufferSize );
-                  kfree( pReadBuffer );
-
-                  if (result < 0)
-                  {
-                     QC_LOG_ERR(QMIDev, "error %d parsing response\n", result );
-                  }
+                  QC_LOG_ERR(QMIDev, "error %d parsing response\n", result );
                }
             }
          }
       }
    }
 
+   // Fail anything still waiting for a response on this client
+   QMITxnCancelClient( pDev, clientID );
+
    // Cleaning up client memory
    //Always use list_for_each_entry_safe for performing list_del operations
    spin_lock_irqsave( &QMIDev->mClientMemLock, flags );
@@ -2055,6 +2911,72 @@ bool PopFromReadMemList(
    QC_LOG_DBG(QMIDev," OUT!!\n");
 }
 
+/*===========================================================================
+METHOD:
+   PopFromReadMemListIfFits (Public Method)
+
+DESCRIPTION:
+   Remove the oldest data from this client's ReadMem list if it is no
+   larger than maxSize, otherwise leave it queued
+
+   Never blocks, used to drain the list in a batched read
+
+PARAMETERS:
+   pDev              [ I ] - Device specific memory
+   clientID          [ I ] - Requester's client ID
+   maxSize           [ I ] - Largest data size accepted (includes QMUX)
+   ppData            [I/O] - On success, will be filled with a 
+                             pointer to read buffer
+   pDataSize         [I/O] - On succces, will be filled with the 
+                             read buffer's size
+
+RETURN VALUE:
+   bool
+===========================================================================*/
+bool PopFromReadMemListIfFits( 
+   sGobiUSBNet *      pDev,
+   u16                  clientID,
+   u16                  maxSize,
+   void **              ppData,
+   u16 *                pDataSize,
+   sQMIDev *          QMIDev)
+{
+   sReadMemList *pReadMemList = NULL;
+   sClientMemList *pClientMem = NULL;
+   unsigned long flags;
+
+   if (IsDeviceValid( pDev ) == false)
+   {
+      QC_LOG_ERR(QMIDev,"Invalid device\n" );
+      return false;
+   }
+
+   spin_lock_irqsave( &QMIDev->mClientMemLock, flags );
+   pClientMem = FindClientMem( pDev, clientID, QMIDev );
+   if (pClientMem == NULL || list_empty( &pClientMem->mList ))
+   {
+      spin_unlock_irqrestore( &QMIDev->mClientMemLock, flags );
+      return false;
+   }
+
+   pReadMemList = list_first_entry( &pClientMem->mList, sReadMemList, node );
+   if (pReadMemList->mDataSize > maxSize)
+   {
+      spin_unlock_irqrestore( &QMIDev->mClientMemLock, flags );
+      QC_LOG_DBG(QMIDev,"0x%x data TID = 0x%x does not fit, left queued\n",
+                 clientID, pReadMemList->mTransactionID);
+      return false;
+   }
+
+   *ppData = pReadMemList->mpData;
+   *pDataSize = pReadMemList->mDataSize;
+   list_del( &pReadMemList->node );
+   spin_unlock_irqrestore( &QMIDev->mClientMemLock, flags );
+
+   kfree( pReadMemList );
+   return true;
+}
+
 /*===========================================================================
 METHOD:
    AddToNotifyList (Public Method)
@@ -3166,7 +4088,7 @@ static int aio_write_cancel(struct kiocb *iocb)
    QC_LOG_GLOBAL("Inside cancel \n");
 
     INIT_WORK(&io_data->cancellation_work, aio_cancel_worker);
-    queue_work(io_data->pDev->mpWorkQ, &io_data->cancellation_work);
+    queue_work_on(QTIDevInfWorkCpu(io_data->pDev->mNumaNode), io_data->pDev->mpWorkQ, &io_data->cancellation_work);
     value = -EINPROGRESS;
 
     return value;
@@ -3203,118 +4125,441 @@ int WriteAsync(
     //sURBSetupPacket writeSetup;
     sURBSetupPacket *writeSetup;
 
-    if (IsDeviceValid( pDev ) == false)
-    {
-        QC_LOG_ERR(QMIDev,"Invalid device!\n" );
-        return -ENXIO;
-    }
+    if (IsDeviceValid( pDev ) == false)
+    {
+        QC_LOG_ERR(QMIDev,"Invalid device!\n" );
+        return -ENXIO;
+    }
+
+    pWriteURB = usb_alloc_urb( 0, GFP_KERNEL );
+    if (pWriteURB == NULL)
+    {
+        QC_LOG_ERR(QMIDev,"URB mem error\n" );
+        return -ENOMEM;
+    }
+
+    // Fill writeBuffer with QMUX
+    result = FillQMUX( clientID, pWriteBuffer, writeBufferSize );
+    if (result < 0)
+    {
+        usb_free_urb( pWriteURB );
+        return result;
+    }
+
+    writeSetup = kzalloc(sizeof(sURBSetupPacket), GFP_KERNEL);
+    if (writeSetup == NULL)
+    {
+        QC_LOG_ERR(QMIDev,"writeSetup mem error\n" );
+        return -ENOMEM;
+    }
+
+    // CDC Send Encapsulated Request packet
+    writeSetup->mRequestType = 0x21;
+    writeSetup->mRequestCode = 0;
+    writeSetup->mValue = 0;
+    writeSetup->mIndex = pDev->mpEndpoints->mIntfNum;
+    writeSetup->mLength = writeBufferSize;
+
+    // Create URB   
+    usb_fill_control_urb( pWriteURB,
+            pDev->mpNetDev->udev,
+            usb_sndctrlpipe( pDev->mpNetDev->udev, 0 ),
+            (unsigned char *)writeSetup,
+            (void*)pWriteBuffer,
+            writeBufferSize,
+            WriteAsyncCallback,
+            pAioDataCtx );
+
+    QC_LOG_INFO(QMIDev,"Actual Write:\n");
+    PrintHex( pWriteBuffer, writeBufferSize );
+    QMICaptureRecord( pDev, QMI_CAPTURE_DIR_TX, pWriteBuffer, writeBufferSize );
+
+    sema_init( &writeSem, 0 );
+
+    pWriteURB->complete = WriteAsyncCallback;
+    pWriteURB->context = pAioDataCtx;
+
+    // Wake device
+    result = usb_autopm_get_interface( pDev->mpIntf );
+    if (result < 0)
+    {
+        QC_LOG_ERR(QMIDev, "unable to resume interface: %d\n", result );
+
+        // Likely caused by device going from autosuspend -> full suspend
+        if (result == -EPERM)
+        {
+#if (LINUX_VERSION_CODE < KERNEL_VERSION( 2,6,33 ))
+            pDev->mpNetDev->udev->auto_pm = 0;
+#endif
+            GobiSuspend( pDev->mpIntf, PMSG_SUSPEND );
+        }
+
+        usb_free_urb( pWriteURB );
+        kfree(writeSetup);
+
+        return result;
+    }
+
+    if (AddToURBList( pDev, clientID, pWriteURB, QMIDev ) == false)
+    {
+        usb_autopm_put_interface( pDev->mpIntf );
+        usb_free_urb( pWriteURB );
+        kfree(writeSetup);
+        return -EINVAL;
+    }
+
+    if (pAioDataCtx->aio)
+    {
+        kiocb_set_cancel_fn(pAioDataCtx->kiocb, aio_write_cancel);
+    }
+
+    result = usb_submit_urb( pWriteURB, GFP_KERNEL );
+    if (result < 0)
+    {
+        QC_LOG_DBG(QMIDev, "submit URB error %d\n", result );
+
+        // Get URB back so we can destroy it
+        if (PopFromURBList( pDev, clientID, QMIDev ) != pWriteURB)
+        {
+            // This shouldn't happen
+            QC_LOG_ERR(QMIDev, "Didn't get write URB back\n" );
+        }
+        else
+        {
+            usb_free_urb( pWriteURB );
+        }
+
+        usb_autopm_put_interface( pDev->mpIntf );
+        kfree(writeSetup);
+        return result;
+    }
+
+    kfree(writeSetup);
+    QC_LOG_DBG(QMIDev,"<QMIDevice> Ends with result = %d\n",result);
+    result = -EIOCBQUEUED;
+    return result;
+}
+
+/*===========================================================================
+METHOD:
+   UserspaceReadBatch (Private Method)
+
+DESCRIPTION:
+   Userspace readv (synchronous)
+   Blocks for the first message, then returns as many of the already
+   queued messages as fit, each preceded by its length (QMI_BATCH_LEN_SIZE)
+
+PARAMETERS
+   pFilp           [ I ] - userspace file descriptor
+   pIter           [ I ] - read buffers
+
+RETURN VALUE:
+   ssize_t - Number of bytes read for success
+             Negative errno for failure
+===========================================================================*/
+static ssize_t UserspaceReadBatch(
+   struct file *          pFilp,
+   struct iov_iter *      pIter )
+{
+   sQMIFilpStorage *pFilpData = NULL;
+   size_t room = iov_iter_count( pIter );
+   ssize_t total = 0;
+   void * pReadData = NULL;
+   u16 readSize;
+   u16 msgSize;
+   __le16 msgLen;
+   int result;
+
+   if (pFilp == NULL || pFilp->private_data == NULL)
+   {
+      QC_LOG_GLOBAL("Bad file data\n" );
+      return -EBADF;
+   }
+   pFilpData = (sQMIFilpStorage *)pFilp->private_data;
+   if (IsDeviceValid( pFilpData->mpDev ) == false)
+   {
+     QC_LOG_ERR(GET_QMIDEV_QMIFILP(pFilpData),"Invalid device! Updating f_ops\n" );
+      pFilp->f_op = file_inode(pFilp)->i_fop;
+      return -ENXIO;
+   }
+
+   if (pFilpData->mpDev->mbQMIReadyStatus == false)
+   {
+     QC_LOG_ERR(GET_QMIDEV_QMIFILP(pFilpData), "Device QMI is not ready\n" );
+      return -ENXIO;
+   }
+
+   if (pFilpData->mClientID == (u16)-1)
+   {
+     QC_LOG_ERR(GET_QMIDEV_QMIFILP(pFilpData),"Client ID must be set before reading 0x%x\n", pFilpData->mClientID );
+      return -EBADR;
+   }
+
+   // Wait for the first message, as read() does
+   result = ReadSync( pFilpData->mpDev,
+                      &pReadData,
+                      pFilpData->mClientID,
+                      0,
+                      pFilpData->QMIDev);
+   if (result <= 0)
+   {
+      return result;
+   }
+   readSize = result;
+
+   for (;;)
+   {
+      // Discard QMUX header
+      msgSize = readSize - QMUXHeaderSize();
+      if (QMI_BATCH_LEN_SIZE + msgSize > room)
+      {
+         // Only the first message can get here, later ones are left queued
+        QC_LOG_ERR(GET_QMIDEV_QMIFILP(pFilpData),"Read data is too large for amount user has requested\n" );
+         kfree( pReadData );
+         return -EOVERFLOW;
+      }
+
+      msgLen = cpu_to_le16( msgSize );
+      if (copy_to_iter( &msgLen, QMI_BATCH_LEN_SIZE, pIter ) != QMI_BATCH_LEN_SIZE
+      ||  copy_to_iter( pReadData + QMUXHeaderSize(), msgSize, pIter ) != msgSize)
+      {
+        QC_LOG_ERR(GET_QMIDEV_QMIFILP(pFilpData), "Error copying read data to user\n" );
+         kfree( pReadData );
+         return (total > 0) ? total : -EFAULT;
+      }
+
+      // Reader is responsible for freeing read buffer
+      kfree( pReadData );
+      pReadData = NULL;
+
+      total += QMI_BATCH_LEN_SIZE + msgSize;
+      room -= QMI_BATCH_LEN_SIZE + msgSize;
+      if (room <= QMI_BATCH_LEN_SIZE)
+      {
+         break;
+      }
+
+      // Take the next message only if it fits in what is left
+      if (PopFromReadMemListIfFits( pFilpData->mpDev,
+                                    pFilpData->mClientID,
+                                    min_t( size_t,
+                                           room - QMI_BATCH_LEN_SIZE + QMUXHeaderSize(),
+                                           0xFFFF ),
+                                    &pReadData,
+                                    &readSize,
+                                    pFilpData->QMIDev ) == false)
+      {
+         break;
+      }
+   }
+
+  QC_LOG_DBG(GET_QMIDEV_QMIFILP(pFilpData), "batched read, total = %zd\n", total);
+   return total;
+}
+
+/*===========================================================================
+METHOD:
+   UserspaceWriteBatchPut (Private Method)
+
+DESCRIPTION:
+   Drop a reference on a batched write, free it with the last one
+   The submitter may have returned while requests were still in flight
+
+   May be called from interrupt context
+
+PARAMETERS:
+   pBatch         [ I ] - sQMIBatch of the write
+
+RETURN VALUE:
+   None
+===========================================================================*/
+static void UserspaceWriteBatchPut( sQMIBatch * pBatch )
+{
+   if (atomic_dec_and_test( &pBatch->mRefCount ))
+   {
+      kfree( pBatch );
+   }
+}
+
+/*===========================================================================
+METHOD:
+   UserspaceWriteBatchCallback (Private Method)
+
+DESCRIPTION:
+   One request of a batched write has been written
+
+PARAMETERS:
+   pDev           [ I ] - Device specific memory
+   status         [ I ] - 0 or negative errno
+   pResp          [ I ] - (unused) response
+   respSize       [ I ] - (unused) size of response
+   pContext       [ I ] - sQMIBatch of the write
 
-    pWriteURB = usb_alloc_urb( 0, GFP_KERNEL );
-    if (pWriteURB == NULL)
-    {
-        QC_LOG_ERR(QMIDev,"URB mem error\n" );
-        return -ENOMEM;
-    }
+RETURN VALUE:
+   None
+===========================================================================*/
+static void UserspaceWriteBatchCallback(
+   sGobiUSBNet *    pDev,
+   int              status,
+   void *           pResp,
+   u16              respSize,
+   void *           pContext )
+{
+   sQMIBatch * pBatch = (sQMIBatch *)pContext;
 
-    // Fill writeBuffer with QMUX
-    result = FillQMUX( clientID, pWriteBuffer, writeBufferSize );
-    if (result < 0)
-    {
-        usb_free_urb( pWriteURB );
-        return result;
-    }
+   if (status < 0)
+   {
+      cmpxchg( &pBatch->mStatus, 0, status );
+   }
 
-    writeSetup = kzalloc(sizeof(sURBSetupPacket), GFP_KERNEL);
-    if (writeSetup == NULL)
-    {
-        QC_LOG_ERR(QMIDev,"writeSetup mem error\n" );
-        return -ENOMEM;
-    }
+   if (atomic_dec_and_test( &pBatch->mPending ))
+   {
+      complete( &pBatch->mDone );
+   }
 
-    // CDC Send Encapsulated Request packet
-    writeSetup->mRequestType = 0x21;
-    writeSetup->mRequestCode = 0;
-    writeSetup->mValue = 0;
-    writeSetup->mIndex = pDev->mpEndpoints->mIntfNum;
-    writeSetup->mLength = writeBufferSize;
+   // Drop the reference of the request
+   UserspaceWriteBatchPut( pBatch );
+}
 
-    // Create URB   
-    usb_fill_control_urb( pWriteURB,
-            pDev->mpNetDev->udev,
-            usb_sndctrlpipe( pDev->mpNetDev->udev, 0 ),
-            (unsigned char *)writeSetup,
-            (void*)pWriteBuffer,
-            writeBufferSize,
-            WriteAsyncCallback,
-            pAioDataCtx );
+/*===========================================================================
+METHOD:
+   UserspaceWriteBatch (Private Method)
 
-    QC_LOG_INFO(QMIDev,"Actual Write:\n");
-    PrintHex( pWriteBuffer, writeBufferSize );
+DESCRIPTION:
+   Userspace writev (synchronous)
+   The buffers hold one or more QMI requests, each preceded by its length
+   (QMI_BATCH_LEN_SIZE); all of them are put in flight on the transaction
+   engine before waiting for any of them. A signal, or WRITE_TIMEOUT when
+   use_down_timeout is set, cancels the requests still in flight
 
-    sema_init( &writeSem, 0 );
+PARAMETERS
+   pFilpData       [ I ] - file data of the client
+   pIter           [ I ] - write buffers
 
-    pWriteURB->complete = WriteAsyncCallback;
-    pWriteURB->context = pAioDataCtx;
+RETURN VALUE:
+   ssize_t - Number of bytes written for success
+             Negative errno for failure
+===========================================================================*/
+static ssize_t UserspaceWriteBatch(
+   sQMIFilpStorage *      pFilpData,
+   struct iov_iter *      pIter )
+{
+   sQMIBatch * pBatch;
+   ssize_t total = 0;
+   void * pWriteBuffer;
+   u16 msgSize;
+   __le16 msgLen;
+   int status = 0;
+   long timeout;
+   long result = 1;
 
-    // Wake device
-    result = usb_autopm_get_interface( pDev->mpIntf );
-    if (result < 0)
-    {
-        QC_LOG_ERR(QMIDev, "unable to resume interface: %d\n", result );
+   // Requests may outlive an interrupted writev, so the batch is not on
+   //    this stack
+   pBatch = kmalloc( sizeof( sQMIBatch ), GFP_KERNEL );
+   if (pBatch == NULL)
+   {
+      return -ENOMEM;
+   }
+   atomic_set( &pBatch->mPending, 1 );
+   atomic_set( &pBatch->mRefCount, 1 );
+   pBatch->mStatus = 0;
+   init_completion( &pBatch->mDone );
 
-        // Likely caused by device going from autosuspend -> full suspend
-        if (result == -EPERM)
-        {
-#if (LINUX_VERSION_CODE < KERNEL_VERSION( 2,6,33 ))
-            pDev->mpNetDev->udev->auto_pm = 0;
-#endif
-            GobiSuspend( pDev->mpIntf, PMSG_SUSPEND );
-        }
+   while (iov_iter_count( pIter ) > 0)
+   {
+      if (copy_from_iter( &msgLen, QMI_BATCH_LEN_SIZE, pIter ) != QMI_BATCH_LEN_SIZE)
+      {
+        QC_LOG_ERR(GET_QMIDEV_QMIFILP(pFilpData), "Truncated length prefix\n");
+         status = -EINVAL;
+         break;
+      }
 
-        usb_free_urb( pWriteURB );
-        kfree(writeSetup);
+      msgSize = le16_to_cpu( msgLen );
+      if (msgSize == 0
+      ||  msgSize > iov_iter_count( pIter )
+      ||  msgSize > 0xFFFF - QMUXHeaderSize())
+      {
+        QC_LOG_ERR(GET_QMIDEV_QMIFILP(pFilpData), "Bad request size %u\n", msgSize);
+         status = -EINVAL;
+         break;
+      }
 
-        return result;
-    }
+      pWriteBuffer = kmalloc( msgSize + QMUXHeaderSize(), GFP_KERNEL );
+      if (pWriteBuffer == NULL)
+      {
+         status = -ENOMEM;
+         break;
+      }
 
-    if (AddToURBList( pDev, clientID, pWriteURB, QMIDev ) == false)
-    {
-        usb_autopm_put_interface( pDev->mpIntf );
-        usb_free_urb( pWriteURB );
-        kfree(writeSetup);
-        return -EINVAL;
-    }
+      if (copy_from_iter( pWriteBuffer + QMUXHeaderSize(), msgSize, pIter ) != msgSize)
+      {
+        QC_LOG_ERR(GET_QMIDEV_QMIFILP(pFilpData), "Unable to copy data from userspace\n");
+         kfree( pWriteBuffer );
+         status = -EFAULT;
+         break;
+      }
 
-    if (pAioDataCtx->aio)
-    {
-        kiocb_set_cancel_fn(pAioDataCtx->kiocb, aio_write_cancel);
-    }
+      // The engine copies the request, so the buffer can go right away
+      atomic_inc( &pBatch->mPending );
+      atomic_inc( &pBatch->mRefCount );
+      status = QMITxnSubmit( pFilpData->mpDev,
+                             pFilpData->QMIDev,
+                             pFilpData->mClientID,
+                             0,
+                             pWriteBuffer,
+                             msgSize + QMUXHeaderSize(),
+                             (use_down_timeout != 0) ? jiffies_to_msecs( WRITE_TIMEOUT ) : 0,
+                             QMI_TXN_FLAG_NO_RESP,
+                             UserspaceWriteBatchCallback,
+                             pBatch );
+      kfree( pWriteBuffer );
+      if (status < 0)
+      {
+         // The callback is not run for a request that was not submitted
+         atomic_dec( &pBatch->mPending );
+         atomic_dec( &pBatch->mRefCount );
+         break;
+      }
 
-    result = usb_submit_urb( pWriteURB, GFP_KERNEL );
-    if (result < 0)
-    {
-        QC_LOG_DBG(QMIDev, "submit URB error %d\n", result );
+      total += QMI_BATCH_LEN_SIZE + msgSize;
+   }
 
-        // Get URB back so we can destroy it
-        if (PopFromURBList( pDev, clientID, QMIDev ) != pWriteURB)
-        {
-            // This shouldn't happen
-            QC_LOG_ERR(QMIDev, "Didn't get write URB back\n" );
-        }
-        else
-        {
-            usb_free_urb( pWriteURB );
-        }
+   // Drop the submitter count and wait for everything in flight
+   if (atomic_dec_and_test( &pBatch->mPending ) == false)
+   {
+      timeout = (use_down_timeout != 0) ? WRITE_TIMEOUT : MAX_SCHEDULE_TIMEOUT;
+      if (interruptible != 0)
+      {
+         // Allow user interrupts
+         result = wait_for_completion_interruptible_timeout( &pBatch->mDone, timeout );
+      }
+      else
+      {
+         // Ignore user interrupts
+         result = wait_for_completion_timeout( &pBatch->mDone, timeout );
+      }
+   }
 
-        usb_autopm_put_interface( pDev->mpIntf );
-        kfree(writeSetup);
-        return result;
-    }
+   if (result <= 0)
+   {
+      // Fail what is still in flight, its callbacks drop the last references
+      status = (result == 0) ? -ETIME : -EINTR;
+     QC_LOG_INFO(GET_QMIDEV_QMIFILP(pFilpData), "batched write interrupted %d\n", status);
+      QMITxnCancelContext( pFilpData->mpDev, pBatch, status );
+      UserspaceWriteBatchPut( pBatch );
+      return status;
+   }
 
-    kfree(writeSetup);
-    QC_LOG_DBG(QMIDev,"<QMIDevice> Ends with result = %d\n",result);
-    result = -EIOCBQUEUED;
-    return result;
+   result = pBatch->mStatus;
+   UserspaceWriteBatchPut( pBatch );
+   if (result < 0)
+   {
+     QC_LOG_ERR(GET_QMIDEV_QMIFILP(pFilpData), "batched write failed %ld\n", result);
+      return result;
+   }
+
+  QC_LOG_DBG(GET_QMIDEV_QMIFILP(pFilpData), "batched write, total = %zd\n", total);
+   return (total > 0) ? total : status;
 }
 
 /*===========================================================================
@@ -3322,7 +4567,7 @@ METHOD:
    UserspaceWriteIter (Public Method)
 
 DESCRIPTION:
-   Userspace write (Asynchronous)
+   Userspace write (Asynchronous), or batched writev (synchronous)
 
 PARAMETERS
    pFilp           [ I ] - userspace file descriptor
@@ -3384,8 +4629,8 @@ static ssize_t UserspaceWriteIter(struct kiocb *kiocb, struct iov_iter *iov)
        aioDataCtx->aio = true;
    } else
    {
-      QC_LOG_ERR(GET_QMIDEV_QMIFILP(pFilpData),"No need to handle\n");
-       return -EINVAL;
+      // writev(), several length prefixed requests in one call
+      return UserspaceWriteBatch( pFilpData, iov );
    }
 
    size = iov_iter_count(iov);
@@ -3530,7 +4775,7 @@ void QMIAIOReadcallback(
    }
 
    INIT_WORK(&aioDataCtx->submit_work, aio_read_copy_worker);
-   queue_work(aioDataCtx->pDev->mpWorkQ, &aioDataCtx->submit_work);
+   queue_work_on(QTIDevInfWorkCpu(aioDataCtx->pDev->mNumaNode), aioDataCtx->pDev->mpWorkQ, &aioDataCtx->submit_work);
 
     return;
 }
@@ -3633,7 +4878,7 @@ static int aio_read_cancel(struct kiocb *iocb)
     io_data = iocb->private;
 
     INIT_WORK(&io_data->cancellation_work, aio_read_cancel_worker);
-    queue_work(io_data->pDev->mpWorkQ, &io_data->cancellation_work);
+    queue_work_on(QTIDevInfWorkCpu(io_data->pDev->mNumaNode), io_data->pDev->mpWorkQ, &io_data->cancellation_work);
     value = -EINPROGRESS;
 
     return value;
@@ -3645,6 +4890,12 @@ static ssize_t UserspaceReadIter(struct kiocb *kiocb, struct iov_iter *iov)
     struct qtidev_aio_data *aioDataCtx;
     sQMIFilpStorage * pFilpData = NULL;
 
+    if ((kiocb != NULL) && is_sync_kiocb(kiocb))
+    {
+        // readv(), as many length prefixed messages as fit
+        return UserspaceReadBatch(kiocb->ki_filp, iov);
+    }
+
     aioDataCtx = kzalloc(sizeof(struct qtidev_aio_data), GFP_KERNEL);
     if (unlikely(!aioDataCtx))
     {
@@ -3751,8 +5002,8 @@ int RegisterQMIDevice( sGobiUSBNet * pDev )
    dev_t devMUXno[MAX_MUX_DEVICES];
    char * pDevName = NULL;
    int i;
-   static int Major;
-   static int Minor;
+   int Major;
+   int Minor;
    struct device *dev_ret;
    if (pDev == NULL)
    {
@@ -3760,8 +5011,6 @@ int RegisterQMIDevice( sGobiUSBNet * pDev )
       return -ENXIO;
    }
 
-   mutex_init(&IoMutex);
-   
    QC_LOG_INFO(GET_QMIDEV(pDev)," Inside.\n");
    if (pDev->mQMIDev.mbCdevIsInitialized == true)
    {
@@ -3773,6 +5022,20 @@ int RegisterQMIDevice( sGobiUSBNet * pDev )
    pDev->mbQMIReadyStatus = false;
    pDev->mbQMIValid = true;
 
+   result = QMITxnEngineInit( pDev );
+   if (result != 0)
+   {
+      pDev->mbQMIValid = false;
+      return result;
+   }
+
+   result = QMIIndRingInit( pDev );
+   if (result != 0)
+   {
+      pDev->mbQMIValid = false;
+      return result;
+   }
+
    // Send SetControlLineState request (USB_CDC)
    //   Required for Autoconnect
    result = usb_control_msg( pDev->mpNetDev->udev,
@@ -3813,60 +5076,12 @@ int RegisterQMIDevice( sGobiUSBNet * pDev )
       pDev->mQMIMUXDev[i].MuxId = pDev->mQMIDev.MuxId + i + 1;
    }
 
-   // Device is not ready for QMI connections right away
-   //   Wait up to 3 seconds before moving the polling to thread
-   if (QMIReady( pDev, 3500 ) == true)
-   {
-      //QC_LOG_DBG(GET_QMIDEV(pDev), "Device unresponsive to QMI\n" );
-      //return -ETIMEDOUT;
-      pDev->mbQMIReadyStatus = true;
-      result = ConfigureQMAP(pDev);
-      if (result != 0)
-      {
-          QC_LOG_ERR(GET_QMIDEV(pDev),"ConfigureQMAP failed\n");
-          return result;
-      }
-
-      // Setup WDS callback
-      result = SetupQMIWDSCallback( pDev, &pDev->mQMIDev );
-      if (result != 0)
-      {
-          QC_LOG_ERR(GET_QMIDEV(pDev),"SetupQMIWDSCallback failed\n");
-          return result;
-      }
-
-      // Fill MEID for device
-      result = QMIDMSGetMEID( pDev, &pDev->mQMIDev );
-      if (result != 0)
-      {
-          QC_LOG_ERR(GET_QMIDEV(pDev),"QMIDMSGetMEID failed\n");
-          return result;
-      }
-
-       /* need to sub rx URBs for the aggregation size negotiated */
-       pDev->mpNetDev->rx_urb_size = RX_URB_SIZE;
-
-#ifdef VIRTUAL_USB_CODE
-       for (i=0; i<MAX_MUX_DEVICES; i++)
-       {
-           /* need to sub rx URBs for the aggregation size negotiated */
-           pDev->mpNetMUXDev[i]->rx_urb_size = RX_URB_SIZE;
-       }
-#endif
-#ifdef TX_AGGR
-       pDev->tx_aggr_ctx.tx_max = pDev->ULAggregationMaxSize;
-       pDev->tx_aggr_ctx.tx_max_datagrams = pDev->ULAggregationMaxDatagram;
-#endif
-   }
-
-   pDev->pGobiWaitThread = kthread_run(GobiWaitForResponses, pDev, "qcom_usbnet/%d-%s", pDev->mpNetDev->udev->bus->busnum, pDev->mpNetDev->udev->devpath);
-   if (IS_ERR(pDev->pGobiWaitThread))
-   {
-       QC_LOG_ERR(GET_QMIDEV(pDev),"Thread creation error : %ld\n", PTR_ERR(pDev->pGobiWaitThread));
-       pDev->pGobiWaitThread = NULL;
-   }
+   // Device is not ready for QMI connections right away, so polling it
+   //   is left to the work queue instead of holding up the probe:
+   //   mProcessIndData.mWork finishes the bring up before it processes
+   //   any indication
+   queue_work_on( QTIDevInfWorkCpu( pDev->mNumaNode ), pDev->mpWorkQ, &pDev->mProcessIndData.mWork );
 
-   //get_task_struct(pGobiWaitThread); // no need to increment counter at this moment
    // allocate and fill devno with numbers
    result = alloc_chrdev_region( &devno, 0, 1+MAX_MUX_DEVICES, "qcom_usbnet" );
    if (result < 0)
@@ -4071,12 +5286,10 @@ void DeregisterQMIDevice( sGobiUSBNet * pDev )
    struct task_struct * pEachTask = NULL;
    struct fdtable * pFDT;
    struct file * pFilp;
-   unsigned long flags;
    int count = 0;
    int tries = 0;
    int result = 0;
    int i;
-   int retThread = 0;
 
    sClientMemList *pClientMemIter, *pClientMemSafe = NULL;
 
@@ -4112,6 +5325,9 @@ void DeregisterQMIDevice( sGobiUSBNet * pDev )
    // Stop all reads
    KillRead( pDev );
 
+   // No response can arrive anymore, fail whatever is still pending
+   QMITxnEngineStop( pDev );
+
    /*<===============sysfs starts============>*/
 
    sysfs_destroy(pDev);
@@ -4232,46 +5448,8 @@ void DeregisterQMIDevice( sGobiUSBNet * pDev )
       QC_LOG_ERR(GET_QMIDEV(pDev),"Bad SetControlLineState status %d\n", result );
    }
 
-   /* Release the data present in response threads */
-/* Minimized the long hold of spin lock, for better concurrency and responsiveness of the system */
-   spin_lock_irqsave(pDev->mProcessIndData.mpResponeListLock, flags);
-   /* Extract the data from begining */
-   while(pDev->mProcessIndData.mpIndDataInfoList)
-   {
-       sIndDataInfo *pIndDataInfo = pDev->mProcessIndData.mpIndDataInfoList;
-       pDev->mProcessIndData.mpIndDataInfoList = pIndDataInfo->mpNext;
-       kfree(pIndDataInfo);
-   }
-   
-   spin_unlock_irqrestore(pDev->mProcessIndData.mpResponeListLock, flags);
-   
-    /* Release lock */
-
-   raw_spin_lock_irqsave(&pDev->mProcessIndData.mpResponseReadSem->lock, flags);
-	   if ( !list_empty(&pDev->mProcessIndData.mpResponseReadSem->wait_list) ) {
-         raw_spin_unlock_irqrestore(&pDev->mProcessIndData.mpResponseReadSem->lock, flags);
-
-         up(pDev->mProcessIndData.mpResponseReadSem);
-
-      } 
-      else {
-         raw_spin_unlock_irqrestore(&pDev->mProcessIndData.mpResponseReadSem->lock, flags);
-         QC_LOG_INFO(GET_QMIDEV(pDev),"ResponseReadSem wait_list empty. UP no required\n");
-      }
-
-   // kthread_stop signals to gobiwaitforresponse thread and waits for the thread to exit
-   if (pDev->pGobiWaitThread) {
-      retThread = kthread_stop(pDev->pGobiWaitThread);
-      if (retThread != -EINTR) {
-         QC_LOG_INFO(GET_QMIDEV(pDev),"GobiWaitForResponses thread stopped, retThread= %d\n",retThread);
-      }
-      else {
-         QC_LOG_INFO(GET_QMIDEV(pDev),"GobiWaitForResponses thread stopped, Interrupted ret= %d\n",retThread);
-      }
-   }
-   else {
-      QC_LOG_INFO(GET_QMIDEV(pDev),"GobiWaitForResponses thread already exited. No need for kthread_stop\n");
-   }
+   // Nothing queues indications anymore, process or drop the pending ones
+   QMIIndRingRelease( pDev );
    
    // Remove device (so no more calls can be made by users)
    if (IS_ERR( pDev->mQMIDev.mpDevClass ) == false)
@@ -4639,195 +5817,276 @@ void QMIWDSCallback(
       }
    }
 
-   kfree( pReadBuffer );
+   kfree( pReadBuffer );
+
+   // Setup next read
+   QC_LOG_DBG(QMIDev, "pQMIDevDBG:0x%px, Setup next read", QMIDev);
+   result = ReadAsync( pDev,
+                       clientID,
+                       0,
+                       QMIWDSCallback,
+                       pData,
+                       QMIDev);
+   if (result != 0)
+   {
+      QC_LOG_ERR(QMIDev, "pQMIDevDBG:0x%px, unable to setup next async read\n",QMIDev);
+   }
+
+   return;
+}
+
+/*===========================================================================
+METHOD:
+   QMIBringUp (Private Method)
+
+DESCRIPTION:
+   Configure a device which answered QMIReady(): QMAP data format, WDS
+   callback, MEID and the URB sizes that depend on the negotiated
+   aggregation
+
+PARAMETERS:
+   pDev     [ I ] - Device specific memory
+
+RETURN VALUE:
+   int - 0 for success
+         Negative errno for failure
+===========================================================================*/
+static int QMIBringUp( sGobiUSBNet * pDev )
+{
+   int result;
+#ifdef VIRTUAL_USB_CODE
+   int i;
+#endif
+
+   pDev->mbQMIReadyStatus = true;
+   result = ConfigureQMAP(pDev);
+   if (result != 0)
+   {
+      QC_LOG_ERR(GET_QMIDEV(pDev),"ConfigureQMAP failed\n");
+      return result;
+   }
+
+   // Setup WDS callback
+   result = SetupQMIWDSCallback( pDev, &pDev->mQMIDev );
+   if (result != 0)
+   {
+      QC_LOG_ERR(GET_QMIDEV(pDev),"SetupQMIWDSCallback failed\n");
+      return result;
+   }
 
-   // Setup next read
-   QC_LOG_DBG(QMIDev, "pQMIDevDBG:0x%px, Setup next read", QMIDev);
-   result = ReadAsync( pDev,
-                       clientID,
-                       0,
-                       QMIWDSCallback,
-                       pData,
-                       QMIDev);
+   // Fill MEID for device
+   result = QMIDMSGetMEID( pDev, &pDev->mQMIDev );
    if (result != 0)
    {
-      QC_LOG_ERR(QMIDev, "pQMIDevDBG:0x%px, unable to setup next async read\n",QMIDev);
+      QC_LOG_ERR(GET_QMIDEV(pDev),"QMIDMSGetMEID failed\n");
+      return result;
    }
 
-   return;
+   /* need to sub rx URBs for the aggregation size negotiated */
+   pDev->mpNetDev->rx_urb_size = RX_URB_SIZE;
+
+#ifdef VIRTUAL_USB_CODE
+   for (i=0; i<MAX_MUX_DEVICES; i++)
+   {
+      /* need to sub rx URBs for the aggregation size negotiated */
+      pDev->mpNetMUXDev[i]->rx_urb_size = RX_URB_SIZE;
+   }
+#endif
+
+#ifdef TX_AGGR
+   pDev->tx_aggr_ctx.tx_max = pDev->ULAggregationMaxSize;
+   pDev->tx_aggr_ctx.tx_max_datagrams = pDev->ULAggregationMaxDatagram;
+#endif
+
+   return 0;
 }
 
-static int GobiWaitForResponses(void *pData)
-{
-    sGobiUSBNet     *pDev;
-    sIndDataInfo    *pIndDataInfo;
-    sQMIDev         *QMIDev;
-    unsigned long   flags;
-    int             retval;
-    int             i;
-    /* Static -> to make sure the variables are not cleared in case of unusual thread closure */
-
-    pDev = pData;
-    if (pDev == NULL)
-    {
-       QC_LOG_ERR(GET_QMIDEV(pDev),"Invalid device\n" );
-        return -EINVAL;
-    }
-    QC_LOG_INFO(GET_QMIDEV(pDev), "Thread open\n");
+/*===========================================================================
+METHOD:
+   QMIIndRingInit (Private Method)
 
-    spin_lock_init(&pDev->responeListLock);
+DESCRIPTION:
+   Allocate the indication slots and start accepting indications
 
-    pDev->mProcessIndData.mpResponeListLock = &pDev->responeListLock;
+PARAMETERS:
+   pDev     [ I ] - Device specific memory
 
-    sema_init(&pDev->responseReadSem, 0);
+RETURN VALUE:
+   int - 0 for success
+         Negative errno for failure
+===========================================================================*/
+static int QMIIndRingInit( sGobiUSBNet * pDev )
+{
+   sProcessInd * pRing = &pDev->mProcessIndData;
+   int i;
 
-    pDev->mProcessIndData.mpResponseReadSem = &pDev->responseReadSem;
+   pRing->mHead = 0;
+   pRing->mTail = 0;
+   pRing->mbActive = false;
+   atomic_set( &pRing->mDropped, 0 );
+   INIT_WORK( &pRing->mWork, ProcessIndWork );
 
-    allow_signal(SIGKILL);
+   pRing->mpSlots = kzalloc_node( QMI_IND_RING_SIZE * sizeof( sIndDataInfo ), GFP_KERNEL, pDev->mNumaNode );
+   if (pRing->mpSlots == NULL)
+   {
+      QC_LOG_ERR(GET_QMIDEV(pDev),"indication ring mem error\n" );
+      return -ENOMEM;
+   }
 
-   if (pDev->mbQMIReadyStatus == false)
+   for (i = 0; i < QMI_IND_RING_SIZE; i++)
    {
-       // Device is not ready for QMI connections right away
-       //   Wait up to 120 seconds before failing
-       if (QMIReady( pDev, 120000 ) == false)
-       {
-         QC_LOG_ERR(GET_QMIDEV(pDev), "Device unresponsive to QMI\n");
-         pDev->pGobiWaitThread = NULL;
-         retval = -ETIMEDOUT;
-         goto end; 
-       }
+      pRing->mpSlots[i].mpData = kmalloc_node( QMI_IND_SLOT_SIZE, GFP_KERNEL, pDev->mNumaNode );
+      if (pRing->mpSlots[i].mpData == NULL)
+      {
+         QC_LOG_ERR(GET_QMIDEV(pDev),"indication slot mem error\n" );
+         QMIIndRingRelease( pDev );
+         return -ENOMEM;
+      }
+   }
 
-       pDev->mbQMIReadyStatus = true;
-       retval = ConfigureQMAP(pDev);
-       if (retval != 0)
-       {
-         QC_LOG_ERR(GET_QMIDEV(pDev),"ConfigureQMAP failed\n");
-         pDev->pGobiWaitThread = NULL;
-         goto end;
-       }
+   pRing->mbActive = true;
+   return 0;
+}
 
-       // Setup WDS callback
-       retval = SetupQMIWDSCallback( pDev, &pDev->mQMIDev );
-       if (retval != 0)
-       {
-        QC_LOG_ERR(GET_QMIDEV(pDev),"SetupQMIWDSCallback failed\n");
-         pDev->pGobiWaitThread = NULL;
-         goto end;
-       }
+/*===========================================================================
+METHOD:
+   QMIIndRingRelease (Private Method)
 
-       // Fill MEID for device
-       retval = QMIDMSGetMEID( pDev, &pDev->mQMIDev );
-       if (retval != 0)
-       {
-         QC_LOG_ERR(GET_QMIDEV(pDev),"QMIDMSGetMEID failed\n");
-         pDev->pGobiWaitThread = NULL;
-         goto end;
-       }
+DESCRIPTION:
+   Refuse new indications, wait for mWork and free the indication slots
 
-       /* need to sub rx URBs for the aggregation size negotiated */
-       pDev->mpNetDev->rx_urb_size = RX_URB_SIZE;
+   The read URB must already be killed
 
-#ifdef VIRTUAL_USB_CODE
-       for (i=0; i<MAX_MUX_DEVICES; i++)
-       {
-           /* need to sub rx URBs for the aggregation size negotiated */
-           pDev->mpNetMUXDev[i]->rx_urb_size = RX_URB_SIZE;
-       }
-#endif
+PARAMETERS:
+   pDev     [ I ] - Device specific memory
 
-#ifdef TX_AGGR
-       pDev->tx_aggr_ctx.tx_max = pDev->ULAggregationMaxSize;
-       pDev->tx_aggr_ctx.tx_max_datagrams = pDev->ULAggregationMaxDatagram;
-#endif
+RETURN VALUE:
+   None
+===========================================================================*/
+static void QMIIndRingRelease( sGobiUSBNet * pDev )
+{
+   sProcessInd * pRing = &pDev->mProcessIndData;
+   int i;
+
+   if (pRing->mpSlots == NULL)
+   {
+      return;
    }
-   
 
-    set_current_state(TASK_INTERRUPTIBLE);
-    while ( !kthread_should_stop() )
-    {
+   pRing->mbActive = false;
+   cancel_work_sync( &pRing->mWork );
 
-        retval = down_interruptible(&pDev->responseReadSem);
-        if (retval != 0)
-        {
-            retval = -EINTR;
-            break;
-        }
-        if (retval == 0) {
-         QC_LOG_INFO(GET_QMIDEV(pDev),"Successfully acquired responseReadSem\n");
-        }
+   if (atomic_read( &pRing->mDropped ) != 0)
+   {
+      QC_LOG_INFO(GET_QMIDEV(pDev),"%d indications dropped\n",
+                  atomic_read( &pRing->mDropped ) );
+   }
 
-       if (signal_pending(pDev->pGobiWaitThread)) {
-            QC_LOG_ERR(GET_QMIDEV(pDev),"signal to kill thread\n");
-            break;
-        }
+   for (i = 0; i < QMI_IND_RING_SIZE; i++)
+   {
+      kfree( pRing->mpSlots[i].mpData );
+   }
+   kfree( pRing->mpSlots );
+   pRing->mpSlots = NULL;
+   pRing->mHead = 0;
+   pRing->mTail = 0;
+}
 
-        if (IsDeviceValid( pDev ) == false)
-        {
-            QC_LOG_ERR(GET_QMIDEV(pDev),"Invalid device\n" );
-            retval = -ENXIO;
-            break;
-        }
+/*===========================================================================
+METHOD:
+   ProcessIndWork (Private Method)
 
-        /* Acquire Lock */
-        spin_lock_irqsave(&pDev->responeListLock, flags);
+DESCRIPTION:
+   Work item of the indication ring
 
-        pIndDataInfo = pDev->mProcessIndData.mpIndDataInfoList;
-        /* Extract the data from begining */
-        if (pIndDataInfo)
-        {
-            pDev->mProcessIndData.mpIndDataInfoList = pIndDataInfo->mpNext;
-        }
-        /* Release lock */
-        spin_unlock_irqrestore(&pDev->responeListLock, flags);
+   Finishes the QMI bring up of a device that was not ready during
+   RegisterQMIDevice(), then processes every queued indication in one
+   run.  Work items never run concurrently with themselves, so this is
+   the only consumer of the ring.
 
-        if (!pIndDataInfo)
-        {
-            /* This should never happen */
-            QC_LOG_ERR(GET_QMIDEV(pDev),"%d-%s: No data available\n",pDev->mpNetDev->udev->bus->busnum, pDev->mpNetDev->udev->devpath);
-            continue;
-        }
+PARAMETERS:
+   pWork    [ I ] - mProcessIndData.mWork of the device
+
+RETURN VALUE:
+   None
+===========================================================================*/
+static void ProcessIndWork( struct work_struct * pWork )
+{
+   sProcessInd * pRing = container_of( pWork, sProcessInd, mWork );
+   sGobiUSBNet * pDev = container_of( pRing, sGobiUSBNet, mProcessIndData );
+   sIndDataInfo * pIndDataInfo;
+   sQMIDev * QMIDev;
+   unsigned int head;
+   unsigned int tail;
+   int count = 0;
 
-        QMIDev = pIndDataInfo->mQMIDev;
+   if (IsDeviceValid( pDev ) == false)
+   {
+      QC_LOG_ERR(GET_QMIDEV(pDev),"Invalid device\n" );
+      return;
+   }
 
-        QC_LOG_DBG(QMIDev,"Got request : %d , %d\n", pIndDataInfo->mMsgId, pIndDataInfo->mDataLen);
+   if (pDev->mbQMIReadyStatus == false)
+   {
+      // Device is not ready for QMI connections right away
+      //   Wait up to 120 seconds before failing
+      if (QMIReady( pDev, 120000 ) == false)
+      {
+         QC_LOG_ERR(GET_QMIDEV(pDev), "Device unresponsive to QMI\n");
+         pRing->mbActive = false;
+         return;
+      }
 
-        switch(pIndDataInfo->mMsgId)
-        {
+      if (QMIBringUp( pDev ) != 0)
+      {
+         pRing->mbActive = false;
+         return;
+      }
+   }
+
+   tail = pRing->mTail;
+   head = smp_load_acquire( &pRing->mHead );
+   while (tail != head)
+   {
+      for (; tail != head; tail++)
+      {
+         pIndDataInfo = &pRing->mpSlots[tail & (QMI_IND_RING_SIZE - 1)];
+         QMIDev = pIndDataInfo->mQMIDev;
+
+         QC_LOG_DBG(QMIDev,"Got request : %d , %d\n", pIndDataInfo->mMsgId, pIndDataInfo->mDataLen);
+
+         switch (pIndDataInfo->mMsgId)
+         {
             case QMI_WDS_PKT_SRVC_STATUS_IND:
-                QC_LOG_DBG(QMIDev,"QMI_WDS_PKT_SRVC_STATUS_IND\n");
-                QMIWDSGetPktSrvcStatusInd(pDev, pIndDataInfo->mpData, pIndDataInfo->mDataLen, QMIDev, pIndDataInfo->mClientId);
-                QC_LOG_DBG(QMIDev,"Need to set IP, Power Up/Down\n");
-                break;
+               QC_LOG_DBG(QMIDev,"QMI_WDS_PKT_SRVC_STATUS_IND\n");
+               QMIWDSGetPktSrvcStatusInd(pDev, pIndDataInfo->mpData, pIndDataInfo->mDataLen, QMIDev, pIndDataInfo->mClientId);
+               break;
             case QMI_WDS_EXTENDED_IP_CONFIG_IND:
-                QC_LOG_DBG(QMIDev,"QMI_WDS_EXTENDED_IP_CONFIG_IND\n");
-                QMIWDSExtendedIPConfigInd(pDev, pIndDataInfo->mpData, pIndDataInfo->mDataLen, QMIDev, pIndDataInfo->mClientId);
-                QC_LOG_DBG(QMIDev,"Need to set MTU\n");
-                break;
+               QC_LOG_DBG(QMIDev,"QMI_WDS_EXTENDED_IP_CONFIG_IND\n");
+               QMIWDSExtendedIPConfigInd(pDev, pIndDataInfo->mpData, pIndDataInfo->mDataLen, QMIDev, pIndDataInfo->mClientId);
+               break;
             case QMI_WDS_REVERSE_IP_TRANSPORT_CONNECTION_IND:
-                QC_LOG_DBG(QMIDev,"QMI_WDS_REVERSE_IP_TRANSPORT_CONNECTION_IND\n");
-                QMIWDSReverseIPTransportConnInd(pDev, pIndDataInfo->mpData, pIndDataInfo->mDataLen, QMIDev);
-                QC_LOG_DBG(QMIDev,"Need to set MTU\n");
-                break;
+               QC_LOG_DBG(QMIDev,"QMI_WDS_REVERSE_IP_TRANSPORT_CONNECTION_IND\n");
+               QMIWDSReverseIPTransportConnInd(pDev, pIndDataInfo->mpData, pIndDataInfo->mDataLen, QMIDev);
+               break;
             case QMI_WDS_GET_RUNTIME_SETTINGS_RESP:
-                QC_LOG_DBG(QMIDev,"QMI_WDS_GET_RUNTIME_SETTINGS_RESP\n");
-                QMIWDSGetRuntimeSettingsResp(pDev, pIndDataInfo->mpData, pIndDataInfo->mDataLen, QMIDev);
-                QC_LOG_DBG(QMIDev,"Need to set IP, MTU, Runtime params\n");
-                break;
+               QC_LOG_DBG(QMIDev,"QMI_WDS_GET_RUNTIME_SETTINGS_RESP\n");
+               QMIWDSGetRuntimeSettingsResp(pDev, pIndDataInfo->mpData, pIndDataInfo->mDataLen, QMIDev);
+               break;
             default:
-                break;
-        }
-
-        kfree(pIndDataInfo->mpData);
-        kfree(pIndDataInfo);
+               break;
+         }
+         count++;
 
-        set_current_state(TASK_INTERRUPTIBLE);
-    }
+         // Hand the slot back to the producer
+         smp_store_release( &pRing->mTail, tail + 1 );
+      }
 
-end:
-    set_current_state(TASK_RUNNING);
-    QC_LOG_INFO(GET_QMIDEV(pDev)," Thread close: %d\n", retval);
+      // Pick up whatever arrived meanwhile
+      head = smp_load_acquire( &pRing->mHead );
+   }
 
-    return retval;
+   QC_LOG_DBG(GET_QMIDEV(pDev),"%d indications processed\n", count );
 }
 
 /*===========================================================================
@@ -5022,24 +6281,15 @@ int QMIWDASetQMAPSettings( sGobiUSBNet * pDev , u16 WDAClientID, sQMIDev *QMIDev
       return result;
    }
 
-   result = WriteSync( pDev,
-                       pWriteBuffer,
-                       writeBufferSize,
-                       WDAClientID,
-                       QMIDev);
+   result = QMITxnExchange( pDev,
+                            QMIDev,
+                            WDAClientID,
+                            QMIDev->mQMITransactionID,
+                            pWriteBuffer,
+                            writeBufferSize,
+                            &pReadBuffer,
+                            QMI_TXN_TIMEOUT_MS );
    kfree( pWriteBuffer );
-
-   if (result < 0)
-   {
-      return result;
-   }
-
-   // QMI WDA QMAP Resp
-   result = ReadSyncTimeout( pDev,
-                      &pReadBuffer,
-                      WDAClientID,
-                      QMIDev->mQMITransactionID,
-                      QMIDev);
    if (result < 0)
    {
       return result;
@@ -5099,24 +6349,15 @@ int QMIWDASetQMAP( sGobiUSBNet * pDev , u16 WDAClientID, sQMIDev *QMIDev)
       return result;
    }
 
-   result = WriteSync( pDev,
-                       pWriteBuffer,
-                       writeBufferSize,
-                       WDAClientID,
-                       QMIDev);
+   result = QMITxnExchange( pDev,
+                            QMIDev,
+                            WDAClientID,
+                            QMIDev->mQMITransactionID,
+                            pWriteBuffer,
+                            writeBufferSize,
+                            &pReadBuffer,
+                            QMI_TXN_TIMEOUT_MS );
    kfree( pWriteBuffer );
-
-   if (result < 0)
-   {
-      return result;
-   }
-
-   // QMI WDA QMAP Resp
-   result = ReadSyncTimeout( pDev,
-                      &pReadBuffer,
-                      WDAClientID,
-                      QMIDev->mQMITransactionID,
-                      QMIDev);
    if (result < 0)
    {
       return result;
@@ -5217,24 +6458,15 @@ int QMIDMSGetMEID( sGobiUSBNet * pDev, sQMIDev *QMIDev )
       return result;
    }
 
-   result = WriteSync( pDev,
-                       pWriteBuffer,
-                       writeBufferSize,
-                       DMSClientID,
-                       &pDev->mQMIDev);
+   result = QMITxnExchange( pDev,
+                            &pDev->mQMIDev,
+                            DMSClientID,
+                            QMIDev->mQMITransactionID,
+                            pWriteBuffer,
+                            writeBufferSize,
+                            &pReadBuffer,
+                            QMI_TXN_TIMEOUT_MS );
    kfree( pWriteBuffer );
-
-   if (result < 0)
-   {
-      return result;
-   }
-
-   // QMI DMS Get Serial numbers Resp
-   result = ReadSyncTimeout( pDev,
-                      &pReadBuffer,
-                      DMSClientID,
-                      QMIDev->mQMITransactionID,
-                      &pDev->mQMIDev);
    if (result < 0)
    {
       return result;
@@ -5304,26 +6536,18 @@ int WDSConnect(sGobiUSBNet *pDev, sQMIDev *QMIDev, u8 profileid, int *ipv6id, u3
        return result;
    }
 
-   result = WriteSync( pDev,
-         pWriteBuffer,
-         writeBufferSize,
-         id,
-         QMIDev);
+   result = QMITxnExchange( pDev,
+                            QMIDev,
+                            id,
+                            QMIDev->mQMITransactionID,
+                            pWriteBuffer,
+                            writeBufferSize,
+                            &pReadBuffer,
+                            QMI_TXN_TIMEOUT_MS );
    kfree( pWriteBuffer );
    if (result < 0)
    {
-       QC_LOG_ERR(QMIDev,"Bind mux port Failed\n");
-       return result;
-   }
-
-   result = ReadSync( pDev,
-                      &pReadBuffer,
-                      id,
-                      QMIDev->mQMITransactionID,
-                      QMIDev);
-   if (result < 0)
-   {
-      QC_LOG_ERR(QMIDev,"ReadSync failed for bind mux port\n");
+      QC_LOG_ERR(QMIDev,"Bind mux port Failed\n");
       return result;
    }
    kfree(pReadBuffer);
@@ -5348,26 +6572,18 @@ int WDSConnect(sGobiUSBNet *pDev, sQMIDev *QMIDev, u8 profileid, int *ipv6id, u3
        return result;
    }
 
-   result = WriteSync( pDev,
-         pWriteBuffer,
-         writeBufferSize,
-         id,
-         QMIDev);
+   result = QMITxnExchange( pDev,
+                            QMIDev,
+                            id,
+                            QMIDev->mQMITransactionID,
+                            pWriteBuffer,
+                            writeBufferSize,
+                            &pReadBuffer,
+                            QMI_TXN_TIMEOUT_MS );
    kfree( pWriteBuffer );
    if (result < 0)
    {
-       QC_LOG_ERR(QMIDev,"set ip family pref Failed\n");
-       return result;
-   }
-
-   result = ReadSync( pDev,
-                      &pReadBuffer,
-                      id,
-                      QMIDev->mQMITransactionID,
-                      QMIDev);
-   if (result < 0)
-   {
-      QC_LOG_ERR(QMIDev,"ReadSync failed for set ip family pref\n");
+      QC_LOG_ERR(QMIDev,"set ip family pref Failed\n");
       return result;
    }
    kfree(pReadBuffer);
@@ -5390,28 +6606,18 @@ int WDSConnect(sGobiUSBNet *pDev, sQMIDev *QMIDev, u8 profileid, int *ipv6id, u3
        return result;
    }
 
-   result = WriteSync( pDev,
-         pWriteBuffer,
-         writeBufferSize,
-         id,
-         QMIDev);
-
+   result = QMITxnExchange( pDev,
+                            QMIDev,
+                            id,
+                            QMIDev->mQMITransactionID,
+                            pWriteBuffer,
+                            writeBufferSize,
+                            &pReadBuffer,
+                            QMI_TXN_TIMEOUT_MS );
    kfree( pWriteBuffer );
-
-   if (result < 0)
-   {
-       QC_LOG_ERR(QMIDev,"Connect Failed\n");
-       return result;
-   }
-
-   result = ReadSync( pDev,
-                      &pReadBuffer,
-                      id,
-                      QMIDev->mQMITransactionID,
-                      QMIDev);
    if (result < 0)
    {
-      QC_LOG_ERR(QMIDev,"ReadSync failed\n");
+      QC_LOG_ERR(QMIDev,"Connect Failed\n");
       return result;
    }
    readBufferSize = result;
@@ -5446,26 +6652,18 @@ int WDSConnect(sGobiUSBNet *pDev, sQMIDev *QMIDev, u8 profileid, int *ipv6id, u3
        return result;
    }
 
-   result = WriteSync( pDev,
-                        pWriteBuffer,
-                        writeBufferSize,
-                        id,
-                        QMIDev);
+   result = QMITxnExchange( pDev,
+                            QMIDev,
+                            id,
+                            QMIDev->mQMITransactionID,
+                            pWriteBuffer,
+                            writeBufferSize,
+                            &pReadBuffer,
+                            QMI_TXN_TIMEOUT_MS );
    kfree( pWriteBuffer );
    if (result < 0)
    {
-       QC_LOG_ERR(QMIDev,"Request runtime settings Failed\n");
-       return result;
-   }
-
-   result = ReadSync( pDev,
-                      &pReadBuffer,
-                      id,
-                      QMIDev->mQMITransactionID,
-                      QMIDev);
-   if (result < 0)
-   {
-      QC_LOG_ERR(QMIDev,"ReadSync failed\n");
+      QC_LOG_ERR(QMIDev,"Request runtime settings Failed\n");
       return result;
    }
    readBufferSize = result;
@@ -5504,26 +6702,18 @@ int WDSConnect(sGobiUSBNet *pDev, sQMIDev *QMIDev, u8 profileid, int *ipv6id, u3
        return result;
    }
 
-   result = WriteSync( pDev,
-         pWriteBuffer,
-         writeBufferSize,
-         ipv6ID,
-         QMIDev);
+   result = QMITxnExchange( pDev,
+                            QMIDev,
+                            ipv6ID,
+                            QMIDev->mQMITransactionID,
+                            pWriteBuffer,
+                            writeBufferSize,
+                            &pReadBuffer,
+                            QMI_TXN_TIMEOUT_MS );
    kfree( pWriteBuffer );
    if (result < 0)
    {
-       QC_LOG_ERR(QMIDev,"Bind mux port Failed\n");
-       return result;
-   }
-
-   result = ReadSync( pDev,
-                      &pReadBuffer,
-                      ipv6ID,
-                      QMIDev->mQMITransactionID,
-                      QMIDev);
-   if (result < 0)
-   {
-      QC_LOG_ERR(QMIDev,"ReadSync failed for bind mux port\n");
+      QC_LOG_ERR(QMIDev,"Bind mux port Failed\n");
       return result;
    }
    kfree(pReadBuffer);
@@ -5546,27 +6736,18 @@ int WDSConnect(sGobiUSBNet *pDev, sQMIDev *QMIDev, u8 profileid, int *ipv6id, u3
        return result;
    }
 
-   result = WriteSync( pDev,
-         pWriteBuffer,
-         writeBufferSize,
-         ipv6ID,
-         QMIDev);
-
+   result = QMITxnExchange( pDev,
+                            QMIDev,
+                            ipv6ID,
+                            QMIDev->mQMITransactionID,
+                            pWriteBuffer,
+                            writeBufferSize,
+                            &pReadBuffer,
+                            QMI_TXN_TIMEOUT_MS );
    kfree( pWriteBuffer );
    if (result < 0)
    {
-       QC_LOG_ERR(QMIDev,"set ip family pref Failed\n");
-       return result;
-   }
-
-   result = ReadSync( pDev,
-                      &pReadBuffer,
-                      ipv6ID,
-                      QMIDev->mQMITransactionID,
-                      QMIDev);
-   if (result < 0)
-   {
-      QC_LOG_ERR(QMIDev,"ReadSync failed for set ip family pref\n");
+      QC_LOG_ERR(QMIDev,"set ip family pref Failed\n");
       return result;
    }
    kfree(pReadBuffer);
@@ -5589,26 +6770,18 @@ int WDSConnect(sGobiUSBNet *pDev, sQMIDev *QMIDev, u8 profileid, int *ipv6id, u3
        return result;
    }
 
-   result = WriteSync( pDev,
-         pWriteBuffer,
-         writeBufferSize,
-         ipv6ID,
-         QMIDev);
+   result = QMITxnExchange( pDev,
+                            QMIDev,
+                            ipv6ID,
+                            QMIDev->mQMITransactionID,
+                            pWriteBuffer,
+                            writeBufferSize,
+                            &pReadBuffer,
+                            QMI_TXN_TIMEOUT_MS );
    kfree( pWriteBuffer );
    if (result < 0)
    {
-       QC_LOG_ERR(QMIDev,"Connect Failed\n");
-       return result;
-   }
-
-   result = ReadSync( pDev,
-                      &pReadBuffer,
-                      ipv6ID,
-                      QMIDev->mQMITransactionID,
-                      QMIDev);
-   if (result < 0)
-   {
-      QC_LOG_ERR(QMIDev,"ReadSync failed\n");
+      QC_LOG_ERR(QMIDev,"Connect Failed\n");
       return result;
    }
    readBufferSize = result;
@@ -5644,26 +6817,18 @@ int WDSConnect(sGobiUSBNet *pDev, sQMIDev *QMIDev, u8 profileid, int *ipv6id, u3
        return result;
    }
 
-   result = WriteSync( pDev,
-                        pWriteBuffer,
-                        writeBufferSize,
-                        ipv6ID,
-                        QMIDev);
+   result = QMITxnExchange( pDev,
+                            QMIDev,
+                            ipv6ID,
+                            QMIDev->mQMITransactionID,
+                            pWriteBuffer,
+                            writeBufferSize,
+                            &pReadBuffer,
+                            QMI_TXN_TIMEOUT_MS );
    kfree( pWriteBuffer );
    if (result < 0)
    {
-       QC_LOG_ERR(QMIDev,"Request runtime settings Failed\n");
-       return result;
-   }
-
-   result = ReadSync( pDev,
-                      &pReadBuffer,
-                      ipv6ID,
-                      QMIDev->mQMITransactionID,
-                      QMIDev);
-   if (result < 0)
-   {
-      QC_LOG_ERR(QMIDev,"ReadSync failed\n");
+      QC_LOG_ERR(QMIDev,"Request runtime settings Failed\n");
       return result;
    }
    readBufferSize = result;
@@ -5713,28 +6878,20 @@ void WDSDisConnect(int id, sGobiUSBNet *pDev, sQMIDev *QMIDev, int ipv6id, int c
         return;
     }
     
-    result = WriteSync( pDev,
-          pWriteBuffer,
-          writeBufferSize,
-          id,
-          QMIDev);
+    result = QMITxnExchange( pDev,
+                             QMIDev,
+                             id,
+                             QMIDev->mQMITransactionID,
+                             pWriteBuffer,
+                             writeBufferSize,
+                             &pReadBuffer,
+                             QMI_TXN_TIMEOUT_MS );
     kfree( pWriteBuffer );
     if (result < 0)
     {
-        QC_LOG_ERR(QMIDev,"set ip family pref Failed\n");
+        QC_LOG_ERR(QMIDev,"stop network failed %d\n", result);
         return;
     }
-    
-    result = ReadSync( pDev,
-                       &pReadBuffer,
-                       id,
-                       QMIDev->mQMITransactionID,
-                       QMIDev);
-    if (result < 0)
-    {
-       QC_LOG_ERR(QMIDev,"ReadSync failed for set ip family pref\n");
-       return;
-    }
     kfree( pReadBuffer );   
 
    writeBufferSize = sizeof( sQMUX ) + 14;
@@ -5755,28 +6912,20 @@ void WDSDisConnect(int id, sGobiUSBNet *pDev, sQMIDev *QMIDev, int ipv6id, int c
         return;
     }
     
-    result = WriteSync( pDev,
-          pWriteBuffer,
-          writeBufferSize,
-          ipv6id,
-          QMIDev);
+    result = QMITxnExchange( pDev,
+                             QMIDev,
+                             ipv6id,
+                             QMIDev->mQMITransactionID,
+                             pWriteBuffer,
+                             writeBufferSize,
+                             &pReadBuffer,
+                             QMI_TXN_TIMEOUT_MS );
     kfree( pWriteBuffer );
     if (result < 0)
     {
-        QC_LOG_ERR(QMIDev,"set ip family pref Failed\n");
+        QC_LOG_ERR(QMIDev,"stop network failed %d\n", result);
         return;
     }
-    
-    result = ReadSync( pDev,
-                       &pReadBuffer,
-                       ipv6id,
-                       QMIDev->mQMITransactionID,
-                       QMIDev);
-    if (result < 0)
-    {
-       QC_LOG_ERR(QMIDev,"ReadSync failed for set ip family pref\n");
-       return;
-    }
     kfree( pReadBuffer );   
 
    ReleaseClientID( pDev, id, QMIDev );
@@ -103,9 +103,6 @@ int ReadSyncTimeout(
    sQMIDev *QMIDev );
 
 
-// Write callback
-void WriteSyncCallback( struct urb * pWriteURB );
-
 // Start synchronous write
 int WriteSync(
    sGobiUSBNet *    pDev,
@@ -114,6 +111,56 @@ int WriteSync(
    u16                clientID,
    sQMIDev *QMIDev );
 
+/*=========================================================================*/
+// QMI transaction engine
+/*=========================================================================*/
+
+// Allocate the transaction slots and their control URBs
+int QMITxnEngineInit( sGobiUSBNet * pDev );
+
+// Fail all outstanding transactions and refuse new ones
+void QMITxnEngineStop( sGobiUSBNet * pDev );
+
+// Stop the engine and free the transaction slots
+void QMITxnEngineRelease( sGobiUSBNet * pDev );
+
+// Start a transaction, pCallback is run once it is done
+int QMITxnSubmit(
+   sGobiUSBNet *      pDev,
+   sQMIDev *          QMIDev,
+   u16                clientID,
+   u16                transactionID,
+   void *             pWriteBuffer,
+   u16                writeBufferSize,
+   u32                timeoutMs,
+   u32                txnFlags,
+   void               (* pCallback)(sGobiUSBNet *, int, void *, u16, void *),
+   void *             pContext );
+
+// Send a request and wait for the matching response
+int QMITxnExchange(
+   sGobiUSBNet *      pDev,
+   sQMIDev *          QMIDev,
+   u16                clientID,
+   u16                transactionID,
+   void *             pWriteBuffer,
+   u16                writeBufferSize,
+   void **            ppOutBuffer,
+   u32                timeoutMs );
+
+// Complete the transaction matching a response read from the device
+bool QMITxnDispatch(
+   sGobiUSBNet *      pDev,
+   u16                clientID,
+   u16                transactionID,
+   void *             pData,
+   u16                dataSize );
+
+// Fail all outstanding transactions of a client
+void QMITxnCancelClient(
+   sGobiUSBNet *      pDev,
+   u16                clientID );
+
 /*=========================================================================*/
 // Internal memory management functions
 /*=========================================================================*/
@@ -155,6 +202,16 @@ bool PopFromReadMemList(
    u16 *                pDataSize,
    sQMIDev *QMIDev );
 
+// Remove the oldest data from this client's ReadMem list
+//    if it is no larger than maxSize
+bool PopFromReadMemListIfFits( 
+   sGobiUSBNet *      pDev,
+   u16                  clientID,
+   u16                  maxSize,
+   void **              ppData,
+   u16 *                pDataSize,
+   sQMIDev *QMIDev );
+
 // Add Notify entry to this client's notify List
 bool AddToNotifyList( 
    sGobiUSBNet *      pDev,